@@ -0,0 +1,174 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    Main.cpp
+
+    Builds an asset pack from files and directories:
+
+        PackTool [-c] <output.pack> <file or directory>...
+
+    Directories are walked recursively, and the files are stored under the
+    paths they were given with, so run the tool in the directory the game
+    runs in, e.g. "PackTool -c data.pack data". With -c, the entries are
+    compressed when it pays off. Text scenes are converted to binary ones,
+    so that loading them from the pack does not need parsing. The asset
+    cache is specific to the machine, so cache directories are skipped.
+*/
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "../ShadowPeople/asset/PackFile.hpp"
+#include "../ShadowPeople/asset/SceneFile.hpp"
+#include "../ShadowPeople/MappedFile.hpp"
+
+namespace
+{
+    bool endsWith(const std::string& str, const std::string& suffix)
+    {
+        return (str.size() >= suffix.size()) && (str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0);
+    }
+
+    // Appends the files in the directory and its subdirectories
+    void listFiles(const std::string& directory, std::vector<std::string>& files)
+    {
+#ifdef _WIN32
+        WIN32_FIND_DATA findData;
+        HANDLE find = FindFirstFile((directory + "/*").c_str(), &findData);
+        if (find == INVALID_HANDLE_VALUE) return;
+        do
+        {
+            std::string name(findData.cFileName);
+            if ((name == ".") || (name == "..")) continue;
+
+            std::string path = directory + "/" + name;
+            if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+            {
+                if (name != "cache") listFiles(path, files);
+            }
+            else
+            {
+                files.emplace_back(path);
+            }
+        } while (FindNextFile(find, &findData));
+        FindClose(find);
+#else
+        DIR* dir = opendir(directory.c_str());
+        if (!dir) return;
+        while (dirent* entry = readdir(dir))
+        {
+            std::string name(entry->d_name);
+            if ((name == ".") || (name == "..")) continue;
+
+            std::string path = directory + "/" + name;
+            struct stat fileStat;
+            if (stat(path.c_str(), &fileStat) != 0) continue;
+            if (S_ISDIR(fileStat.st_mode))
+            {
+                if (name != "cache") listFiles(path, files);
+            }
+            else
+            {
+                files.emplace_back(path);
+            }
+        }
+        closedir(dir);
+#endif
+    }
+
+    bool isDirectory(const std::string& path)
+    {
+#ifdef _WIN32
+        DWORD attributes = GetFileAttributes(path.c_str());
+        return (attributes != INVALID_FILE_ATTRIBUTES) && (attributes & FILE_ATTRIBUTE_DIRECTORY);
+#else
+        struct stat fileStat;
+        return (stat(path.c_str(), &fileStat) == 0) && S_ISDIR(fileStat.st_mode);
+#endif
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int arg = 1;
+    bool compress = false;
+    if ((arg < argc) && (std::string(argv[arg]) == "-c"))
+    {
+        compress = true;
+        arg++;
+    }
+
+    if (argc - arg < 2)
+    {
+        printf("Usage: PackTool [-c] <output.pack> <file or directory>...\n");
+        return 1;
+    }
+
+    std::string output(argv[arg++]);
+
+    std::vector<std::string> files;
+    for (; arg < argc; arg++)
+    {
+        std::string input = asset::normalizePackPath(argv[arg]);
+        while (!input.empty() && (input.back() == '/')) input.pop_back();
+
+        if (isDirectory(input)) listFiles(input, files);
+        else                    files.emplace_back(input);
+    }
+
+    // Sorted, so that the same inputs always give the same pack
+    std::sort(files.begin(), files.end());
+
+    asset::PackWriter writer;
+    uint64_t totalSize = 0;
+    for (const auto& filename : files)
+    {
+        if (filename == asset::normalizePackPath(output)) continue;
+
+        MappedFile file(filename, MappedFile::AccessPattern::Sequential);
+        if (!file.valid())
+        {
+            printf("Unable to read %s\n", filename.c_str());
+            return 1;
+        }
+
+        Range<const uint8_t> data = file.bytes();
+        std::vector<uint8_t> converted;
+        if (endsWith(filename, ".scn") && !asset::isBinaryScene(data))
+        {
+            if (!asset::convertTextScene(file.asRange<char>(), converted))
+            {
+                printf("Unable to convert scene %s\n", filename.c_str());
+                return 1;
+            }
+            data = converted;
+        }
+
+        if (!writer.add(filename, data, compress))
+        {
+            printf("Duplicate file %s\n", filename.c_str());
+            return 1;
+        }
+        totalSize += data.byteSize();
+    }
+
+    if (!writer.write(output))
+    {
+        printf("Unable to write %s\n", output.c_str());
+        return 1;
+    }
+
+    MappedFile pack(output);
+    printf("Packed %u files, %llu bytes into %llu bytes\n", static_cast<uint32_t>(writer.numEntries()),
+           static_cast<unsigned long long>(totalSize), static_cast<unsigned long long>(pack.size()));
+    return 0;
+}
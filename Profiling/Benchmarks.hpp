@@ -0,0 +1,17 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    Benchmarks.hpp
+*/
+
+#pragma once
+
+void benchmarkVertexWelding();
+void benchmarkBlockCompression();
+void benchmarkMeshOptimization();
+void benchmarkTangentFrames();
+void benchmarkTransforms();
+void benchmarkVectorExpressions();
+void benchmarkStreams();
+void benchmarkFastMath();
+void benchmarkCulling();
+void benchmarkPageResidency();
@@ -0,0 +1,110 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    BlockCompressionBenchmark.cpp
+*/
+
+#include "Benchmarks.hpp"
+
+#include <cstdio>
+#include <cmath>
+#include <random>
+
+#include "../ShadowPeople/Types.hpp"
+#include "../ShadowPeople/Timer.hpp"
+#include "../ShadowPeople/graphics/Image.hpp"
+#include "../ShadowPeople/graphics/BlockCompression.hpp"
+
+using namespace graphics;
+
+namespace
+{
+    constexpr uint16_t ImageSize = 2048;
+
+    // Smooth gradients with noise and hard edges, roughly like a photographic albedo map
+    Image testImage()
+    {
+        Image image(32, ImageSize, ImageSize);
+        uint8_t* data = image.asRange<uint8_t>().begin();
+        std::mt19937 random(1234);
+        std::uniform_int_distribution<int> noise(-6, 6);
+        for (int y = 0; y < ImageSize; y++)
+        {
+            for (int x = 0; x < ImageSize; x++)
+            {
+                uint8_t* texel = data + image.byteOffset(x, y);
+                bool edge = ((x / 53 + y / 41) % 3) == 0;
+                float r = 128.f + 100.f * std::sin(x * 0.011f) + noise(random);
+                float g = 96.f + 80.f * std::cos(y * 0.017f) + noise(random);
+                float b = edge ? 220.f - 0.05f * x : 40.f + 0.03f * y;
+                float a = 128.f + 120.f * std::sin((x + y) * 0.004f);
+                texel[0] = static_cast<uint8_t>(std::min(std::max(r, 0.f), 255.f));
+                texel[1] = static_cast<uint8_t>(std::min(std::max(g, 0.f), 255.f));
+                texel[2] = static_cast<uint8_t>(std::min(std::max(b, 0.f), 255.f));
+                texel[3] = static_cast<uint8_t>(std::min(std::max(a, 0.f), 255.f));
+            }
+        }
+        return image;
+    }
+
+    int storedChannels(BlockFormat format)
+    {
+        return (format == BlockFormat::BC4) ? 1 :
+               (format == BlockFormat::BC5) ? 2 :
+               (format == BlockFormat::BC1) ? 3 :
+               4;
+    }
+
+    double psnr(const Image& original, const Image& blocks, BlockFormat format)
+    {
+        int channels = storedChannels(format);
+        double squaredError = 0.0;
+        uint8_t rgba[4 * BlockDim * BlockDim];
+        for (int by = 0; by < blocks.height(); by++)
+        {
+            for (int bx = 0; bx < blocks.width(); bx++)
+            {
+                decodeBlock(format, blocks.data() + blocks.byteOffset(bx, by), rgba);
+                for (int i = 0; i < BlockDim * BlockDim; i++)
+                {
+                    const uint8_t* texel = original.data() + original.byteOffset(bx * BlockDim + i % BlockDim,
+                                                                                 by * BlockDim + i / BlockDim);
+                    for (int c = 0; c < channels; c++)
+                    {
+                        double d = static_cast<double>(rgba[i * 4 + c]) - texel[c];
+                        squaredError += d * d;
+                    }
+                }
+            }
+        }
+        double mse = squaredError / (static_cast<double>(original.width()) * original.height() * channels);
+        return (mse > 0.0) ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+    }
+}
+
+void benchmarkBlockCompression()
+{
+    printf("Block compression, %u x %u\n", ImageSize, ImageSize);
+
+    Image image = testImage();
+    Rect<int, 2> wholeImage(int2{ ImageSize, ImageSize });
+
+    const char* formatNames[]   = { "BC1", "BC3", "BC4", "BC5", "BC7" };
+    const char* qualityNames[]  = { "fast", "normal", "high" };
+
+    Timer timer;
+    for (BlockFormat format : { BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC4, BlockFormat::BC5, BlockFormat::BC7 })
+    {
+        for (CompressionQuality quality : { CompressionQuality::Fast, CompressionQuality::Normal, CompressionQuality::High })
+        {
+            Image blocks = createBlockImage(format, ImageSize, ImageSize);
+
+            timer.start();
+            compressRect(image, PixelLayout::RGBA8, wholeImage, blocks, format, quality);
+            float seconds = timer.stop();
+
+            printf("  %s %-6s: %8.2f ms, %7.1f M texels/s, PSNR %5.2f dB\n",
+                   formatNames[static_cast<int>(format)], qualityNames[static_cast<int>(quality)],
+                   seconds * 1000.0f, ImageSize * ImageSize / seconds * 1e-6f, psnr(image, blocks, format));
+        }
+    }
+}
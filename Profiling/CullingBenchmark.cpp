@@ -0,0 +1,91 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    CullingBenchmark.cpp
+*/
+
+#include "Benchmarks.hpp"
+
+#include <array>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../ShadowPeople/Types.hpp"
+#include "../ShadowPeople/Bounds.hpp"
+#include "../ShadowPeople/Culling.hpp"
+#include "../ShadowPeople/Streams.hpp"
+#include "../ShadowPeople/Timer.hpp"
+
+namespace
+{
+    constexpr size_t NumObjects = 100000;
+    constexpr int    Rounds     = 10;
+
+    void report(const char* name, size_t visible, float seconds)
+    {
+        printf("  %-28s %8.3f ms, %6zu visible\n", name, seconds * 1000.0f / Rounds, visible);
+    }
+}
+
+void benchmarkCulling()
+{
+    printf("Frustum culling of %zu objects, one core\n", NumObjects);
+
+    // A camera at the origin, looking along z with a 90 degree field of view
+    const float s = 1.f / sqrtf(2.f);
+    std::array<float4, 6> planes = {
+        float4{ s, 0.f, s, 0.f }, float4{ -s, 0.f, s, 0.f },
+        float4{ 0.f, s, s, 0.f }, float4{ 0.f, -s, s, 0.f },
+        float4{ 0.f, 0.f, 1.f, -0.1f }, float4{ 0.f, 0.f, -1.f, 100.f } };
+
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> coordinate(-100.f, 100.f);
+    std::uniform_real_distribution<float> size(0.1f, 5.f);
+    std::vector<Sphere> spheres(NumObjects);
+    std::vector<AABB> boxes(NumObjects);
+    Float3Stream centers(NumObjects);
+    Float3Stream extents(NumObjects);
+    std::vector<float> radii(NumObjects);
+    for (size_t i = 0; i < NumObjects; i++)
+    {
+        float3 center{ coordinate(random), coordinate(random), coordinate(random) };
+        float3 extent{ size(random), size(random), size(random) };
+        spheres[i]  = Sphere(center, extent.length());
+        boxes[i]    = AABB(center - extent, center + extent);
+        centers.set(i, center);
+        extents.set(i, extent);
+        radii[i]    = spheres[i].radius();
+    }
+    std::vector<uint32_t> visible(NumObjects);
+
+    Timer timer;
+    size_t count = 0;
+    timer.start();
+    for (int r = 0; r < Rounds; r++)
+    {
+        count = 0;
+        for (size_t i = 0; i < NumObjects; i++)
+            if (!math::outsideFrustum(planes, spheres[i])) visible[count++] = static_cast<uint32_t>(i);
+    }
+    report("Spheres, one by one", count, timer.stop());
+
+    size_t streamCount = 0;
+    timer.start();
+    for (int r = 0; r < Rounds; r++) streamCount = math::cullSpheres(planes, centers, radii, visible);
+    report("Spheres, stream", streamCount, timer.stop());
+    if (streamCount != count) printf("  Visible spheres differ\n");
+
+    timer.start();
+    for (int r = 0; r < Rounds; r++)
+    {
+        count = 0;
+        for (size_t i = 0; i < NumObjects; i++)
+            if (!math::outsideFrustum(planes, boxes[i])) visible[count++] = static_cast<uint32_t>(i);
+    }
+    report("Boxes, one by one", count, timer.stop());
+
+    timer.start();
+    for (int r = 0; r < Rounds; r++) streamCount = math::cullAABBs(planes, centers, extents, visible);
+    report("Boxes, stream", streamCount, timer.stop());
+    if (streamCount != count) printf("  Visible boxes differ\n");
+}
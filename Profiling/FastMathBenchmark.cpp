@@ -0,0 +1,155 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    FastMathBenchmark.cpp
+*/
+
+#include "Benchmarks.hpp"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../ShadowPeople/Types.hpp"
+#include "../ShadowPeople/FastMath.hpp"
+#include "../ShadowPeople/Timer.hpp"
+
+namespace
+{
+    constexpr size_t NumValues = 1 << 20;
+
+    using math::Accuracy;
+
+    template<typename Function>
+    void measure(const char* name, Function function)
+    {
+        Timer timer;
+        timer.start();
+        function();
+        float seconds = timer.stop();
+        printf("  %-28s %8.2f ms, %7.1f M/s\n", name, seconds * 1000.0f, NumValues / seconds * 1e-6f);
+    }
+
+    // The maximum errors documented in FastMath.hpp
+    struct ErrorBound
+    {
+        double  high;
+        double  low;
+        bool    relative;
+    };
+
+    constexpr ErrorBound SinCosBound    = { 1e-7,   1.5e-5, false };
+    constexpr ErrorBound Atan2Bound     = { 3e-7,   1e-4,   false };
+    constexpr ErrorBound ExpBound       = { 1.5e-7, 1.5e-4, true };
+#if defined(SP_SIMD_SSE)
+    constexpr ErrorBound RsqrtBound     = { 3e-7,   4e-4,   true };
+#else
+    constexpr ErrorBound RsqrtBound     = { 3e-7,   2e-3,   true };
+#endif
+
+    // Against double precision, over the whole range where the bounds hold
+    template<typename Exact>
+    void checkError(const char* name, Accuracy accuracy, ErrorBound bound, const std::vector<float>& result,
+                    Exact exact)
+    {
+        double maxError = 0.0;
+        for (size_t i = 0; i < result.size(); i++)
+        {
+            double expected = exact(i);
+            double error    = std::fabs(result[i] - expected);
+            if (bound.relative) error /= std::fabs(expected);
+            maxError = std::max(maxError, error);
+        }
+
+        double limit = (accuracy == Accuracy::High) ? bound.high : bound.low;
+        printf("  %-28s %s, max %s error %.2e of %.2e\n", name, (maxError <= limit) ? "ok" : "FAILED",
+               bound.relative ? "relative" : "absolute", maxError, limit);
+    }
+}
+
+void benchmarkFastMath()
+{
+    printf("Fast math, batches of each accuracy\n");
+
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> coordinate(-100.f, 100.f);
+    std::uniform_real_distribution<float> exponent(-80.f, 80.f);
+    std::uniform_real_distribution<float> positive(1e-6f, 1e6f);
+    std::vector<float> x(NumValues);
+    std::vector<float> y(NumValues);
+    std::vector<float> exponents(NumValues);
+    std::vector<float> positives(NumValues);
+    for (size_t i = 0; i < NumValues; i++)
+    {
+        x[i]            = coordinate(random);
+        y[i]            = coordinate(random);
+        exponents[i]    = exponent(random);
+        positives[i]    = positive(random);
+    }
+    std::vector<float> result(NumValues);
+
+    measure("sin, full", [&] { math::sin<Accuracy::Full>(x, result); });
+    measure("sin, high", [&] { math::sin<Accuracy::High>(x, result); });
+    measure("sin, low", [&] { math::sin<Accuracy::Low>(x, result); });
+    measure("atan2, full", [&] { math::atan2<Accuracy::Full>(y, x, result); });
+    measure("atan2, high", [&] { math::atan2<Accuracy::High>(y, x, result); });
+    measure("atan2, low", [&] { math::atan2<Accuracy::Low>(y, x, result); });
+    measure("exp, full", [&] { math::exp<Accuracy::Full>(exponents, result); });
+    measure("exp, high", [&] { math::exp<Accuracy::High>(exponents, result); });
+    measure("exp, low", [&] { math::exp<Accuracy::Low>(exponents, result); });
+    measure("rsqrt, full", [&] { math::rsqrt<Accuracy::Full>(positives, result); });
+    measure("rsqrt, high", [&] { math::rsqrt<Accuracy::High>(positives, result); });
+    measure("rsqrt, low", [&] { math::rsqrt<Accuracy::Low>(positives, result); });
+
+    printf("Fast math, errors against double precision\n");
+
+    // sin and cos are checked for |x| < 8192, atan2 also on the axes and at the origin, exp over
+    // the whole clamped range and rsqrt over all the positive normal floats
+    std::uniform_real_distribution<float> angle(-8191.f, 8191.f);
+    std::uniform_real_distribution<float> anyExponent(-87.f, 88.f);
+    std::uniform_real_distribution<float> logPositive(std::log2(FLT_MIN), 127.f);
+    for (size_t i = 0; i < NumValues; i++)
+    {
+        x[i]            = angle(random);
+        exponents[i]    = anyExponent(random);
+        positives[i]    = std::exp2(logPositive(random));
+    }
+    std::vector<float> atanX(NumValues);
+    std::vector<float> atanY(NumValues);
+    for (size_t i = 0; i < NumValues; i++)
+    {
+        atanX[i] = ((i % 16) == 0) ? 0.f : coordinate(random);
+        atanY[i] = ((i % 16) == 1) ? 0.f : coordinate(random);
+    }
+
+    for (Accuracy accuracy : { Accuracy::High, Accuracy::Low })
+    {
+        bool high = (accuracy == Accuracy::High);
+
+        if (high) math::sin<Accuracy::High>(x, result);
+        else      math::sin<Accuracy::Low>(x, result);
+        checkError(high ? "sin, high" : "sin, low", accuracy, SinCosBound, result,
+                   [&](size_t i) { return std::sin(static_cast<double>(x[i])); });
+
+        if (high) math::cos<Accuracy::High>(x, result);
+        else      math::cos<Accuracy::Low>(x, result);
+        checkError(high ? "cos, high" : "cos, low", accuracy, SinCosBound, result,
+                   [&](size_t i) { return std::cos(static_cast<double>(x[i])); });
+
+        if (high) math::atan2<Accuracy::High>(atanY, atanX, result);
+        else      math::atan2<Accuracy::Low>(atanY, atanX, result);
+        checkError(high ? "atan2, high" : "atan2, low", accuracy, Atan2Bound, result,
+                   [&](size_t i) { return std::atan2(static_cast<double>(atanY[i]), static_cast<double>(atanX[i])); });
+
+        if (high) math::exp<Accuracy::High>(exponents, result);
+        else      math::exp<Accuracy::Low>(exponents, result);
+        checkError(high ? "exp, high" : "exp, low", accuracy, ExpBound, result,
+                   [&](size_t i) { return std::exp(static_cast<double>(exponents[i])); });
+
+        if (high) math::rsqrt<Accuracy::High>(positives, result);
+        else      math::rsqrt<Accuracy::Low>(positives, result);
+        checkError(high ? "rsqrt, high" : "rsqrt, low", accuracy, RsqrtBound, result,
+                   [&](size_t i) { return 1.0 / std::sqrt(static_cast<double>(positives[i])); });
+    }
+}
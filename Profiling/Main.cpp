@@ -2,8 +2,21 @@
 
 #include "../ShadowPeople/rendering/PatchGenerator.hpp"
 
+#include "Benchmarks.hpp"
+
 int main(int argc, char** argv)
 {
     rendering::PatchCache cache;
     rendering::PatchGenerator generator(cache);
+
+    benchmarkVertexWelding();
+    benchmarkBlockCompression();
+    benchmarkMeshOptimization();
+    benchmarkTangentFrames();
+    benchmarkTransforms();
+    benchmarkVectorExpressions();
+    benchmarkStreams();
+    benchmarkFastMath();
+    benchmarkCulling();
+    benchmarkPageResidency();
 }
@@ -0,0 +1,109 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    MeshOptimizationBenchmark.cpp
+*/
+
+#include "Benchmarks.hpp"
+
+#include <cstdio>
+#include <cmath>
+#include <random>
+#include <algorithm>
+
+#include "../ShadowPeople/Types.hpp"
+#include "../ShadowPeople/Timer.hpp"
+#include "../ShadowPeople/asset/MeshOptimizer.hpp"
+#include "../ShadowPeople/asset/MeshSimplifier.hpp"
+
+using namespace asset;
+
+namespace
+{
+    // UV sphere with its triangles in random order, like an exported mesh that has been
+    // through a few tools
+    void sphereMesh(uint32_t gridSize, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+    {
+        vertices.clear();
+        for (uint32_t y = 0; y <= gridSize; y++)
+        {
+            for (uint32_t x = 0; x <= gridSize; x++)
+            {
+                float theta = 2.f * 3.14159265f * x / gridSize;
+                float phi   = 3.14159265f * y / gridSize;
+
+                Vertex vertex = {};
+                vertex.position = float3{ std::cos(theta) * std::sin(phi), std::cos(phi), std::sin(theta) * std::sin(phi) };
+                vertex.normal   = vertex.position;
+                vertex.uv       = float2{ static_cast<float>(x) / gridSize, static_cast<float>(y) / gridSize };
+                vertices.emplace_back(vertex);
+            }
+        }
+
+        std::vector<uint32_t> triangles;
+        for (uint32_t y = 0; y < gridSize; y++)
+        {
+            for (uint32_t x = 0; x < gridSize; x++)
+            {
+                uint32_t v00 = y * (gridSize + 1) + x;
+                uint32_t v10 = v00 + 1;
+                uint32_t v01 = v00 + gridSize + 1;
+                uint32_t v11 = v01 + 1;
+                for (uint32_t v : { v00, v01, v10, v10, v01, v11 }) triangles.emplace_back(v);
+            }
+        }
+
+        std::vector<uint32_t> order(triangles.size() / 3);
+        for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+        std::shuffle(order.begin(), order.end(), std::mt19937(1234));
+
+        indices.clear();
+        for (auto triangle : order)
+        {
+            for (int c = 0; c < 3; c++) indices.emplace_back(triangles[triangle * 3 + c]);
+        }
+    }
+}
+
+void benchmarkMeshOptimization()
+{
+    printf("Mesh optimization\n");
+
+    Timer timer;
+    for (uint32_t gridSize : { 64u, 256u, 1024u })
+    {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        sphereMesh(gridSize, vertices, indices);
+
+        // The triangle order without meshlets, which they must not make worse
+        uint32_t numVertices = static_cast<uint32_t>(vertices.size());
+        std::vector<uint32_t> cacheOptimized(indices.size());
+        std::vector<uint32_t> overdrawOptimized(indices.size());
+        optimizeVertexCache(indices, numVertices, cacheOptimized);
+        optimizeOverdraw(cacheOptimized, vertices, overdrawOptimized);
+        VertexCacheStatistics reference = analyzeVertexCache(overdrawOptimized, numVertices);
+
+        VertexCacheStatistics before, after;
+        std::vector<rendering::Meshlet> meshlets;
+        timer.start();
+        optimizeMesh(vertices, indices, meshlets, &before, &after);
+        float seconds = timer.stop();
+
+        printf("  %9zu triangles: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %7zu meshlets, %8.2f ms, %6.1f M triangles/s\n",
+               indices.size() / 3, before.acmr, after.acmr, before.atvr, after.atvr, meshlets.size(),
+               seconds * 1000.0f, indices.size() / 3 / seconds * 1e-6f);
+        if (after.acmr > reference.acmr)
+        {
+            printf("  WARNING: Meshlets raise the ACMR from %.3f to %.3f\n", reference.acmr, after.acmr);
+        }
+
+        std::vector<rendering::MeshLod> lods;
+        timer.start();
+        buildLodChain(vertices, indices, lods);
+        seconds = timer.stop();
+
+        printf("  %9s LOD chain of %zu levels in %8.2f ms:", "", lods.size(), seconds * 1000.0f);
+        for (const auto& lod : lods) printf(" %u (%.4f)", lod.numIndices / 3, lod.error);
+        printf("\n");
+    }
+}
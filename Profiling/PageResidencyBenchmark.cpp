@@ -0,0 +1,262 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    PageResidencyBenchmark.cpp
+*/
+
+#include "Benchmarks.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../ShadowPeople/Types.hpp"
+#include "../ShadowPeople/Timer.hpp"
+#include "../ShadowPeople/rendering/PageResidency.hpp"
+
+using namespace rendering;
+
+namespace
+{
+    constexpr int       VirtualPages        = 16;
+    constexpr int       PhysicalPages       = 4;
+    constexpr int       Frames              = 200;
+    constexpr int       FeedbackWidth       = 240;
+    constexpr int       FeedbackHeight      = 135;
+    constexpr uint32_t  MaxLoadsPerFrame    = 4;
+    constexpr uint32_t  FailEveryNthLoad    = 13;
+
+    // A camera flying low over the texture. The upper rows of the feedback see it further away,
+    // i.e. at coarser mips, and the footprint grows and shrinks over time.
+    void syntheticFeedback(int frame, uint32_t mipLevels, std::vector<uint32_t>& feedback)
+    {
+        float t         = static_cast<float>(frame);
+        float centerU   = 0.5f + 0.45f * std::sin(t * 0.05f);
+        float centerV   = 0.5f + 0.45f * std::cos(t * 0.037f);
+        float width     = 0.1f + 0.15f * (1.f + std::sin(t * 0.021f));
+
+        feedback.clear();
+        for (int y = 0; y < FeedbackHeight; y++)
+        {
+            float distance = 1.f + 2.f * (FeedbackHeight - 1 - y) / FeedbackHeight;
+            float texels   = width * distance * VirtualPages * VirtualPageSize / FeedbackWidth;
+            uint32_t mip   = std::min<uint32_t>(static_cast<uint32_t>(std::max<float>(std::log2(texels), 0.f)),
+                                                mipLevels - 1);
+            int pages      = std::max<int>(VirtualPages >> mip, 1);
+            for (int x = 0; x < FeedbackWidth; x++)
+            {
+                float u = centerU + (static_cast<float>(x) / FeedbackWidth - 0.5f) * width * distance;
+                float v = centerV + (static_cast<float>(y) / FeedbackHeight - 0.5f) * width * distance * 0.5625f;
+                if ((u < 0.f) || (u >= 1.f) || (v < 0.f) || (v >= 1.f))
+                {
+                    feedback.emplace_back(VirtualFeedbackNone);
+                    continue;
+                }
+                feedback.emplace_back(VirtualPageId(static_cast<uint32_t>(u * pages), static_cast<uint32_t>(v * pages),
+                                                    mip).id);
+            }
+        }
+    }
+
+    // What the residency should look like, built from the results of the calls only
+    struct ResidencyModel
+    {
+        std::unordered_map<uint32_t, int>   slotOf;
+        std::vector<uint32_t>               pageIn;
+        std::unordered_set<uint32_t>        used;       // Since the last beginFrame()
+        uint64_t                            evictions = 0;
+    };
+
+    uint32_t expectedEntry(const ResidencyModel& model, VirtualPageId page, uint32_t mipLevels)
+    {
+        for (; ; page = page.parent())
+        {
+            auto slot = model.slotOf.find(page.id);
+            if (slot != model.slotOf.end())
+            {
+                uint8_t entry[4] = { static_cast<uint8_t>(slot->second % PhysicalPages),
+                                     static_cast<uint8_t>(slot->second / PhysicalPages),
+                                     static_cast<uint8_t>(page.mip()), 1 };
+                uint32_t packed;
+                memcpy(&packed, entry, 4);
+                return packed;
+            }
+            if (page.mip() + 1 >= mipLevels) return 0;
+        }
+    }
+
+    uint32_t entryAt(const graphics::Image& image, int x, int y)
+    {
+        uint32_t packed;
+        memcpy(&packed, image.data() + image.byteOffset(x, y), 4);
+        return packed;
+    }
+
+    // Copies the changed rectangles to the images, which stand for the GPU copy of the table
+    void uploadChanges(const PageResidency& residency, std::vector<graphics::Image>& uploaded)
+    {
+        for (uint32_t mip = 0; mip < residency.mipLevels(); mip++)
+        {
+            const graphics::Image& src = residency.indirection(mip);
+            graphics::Image& dst = uploaded[mip];
+            for (const auto& rect : residency.indirectionChanges(mip))
+            {
+                for (int y = rect.minCorner()[1]; y < rect.minCorner()[1] + rect.size()[1]; y++)
+                {
+                    memcpy(dst.asRange<uint8_t>().begin() + dst.byteOffset(rect.minCorner()[0], y),
+                           src.data() + src.byteOffset(rect.minCorner()[0], y), rect.size()[0] * 4);
+                }
+            }
+        }
+    }
+}
+
+void benchmarkPageResidency()
+{
+    printf("Page residency, %d x %d pages, %d x %d cache, %d frames\n",
+           VirtualPages, VirtualPages, PhysicalPages, PhysicalPages, Frames);
+
+    PageResidency residency(int2{ VirtualPages, VirtualPages }, int2{ PhysicalPages, PhysicalPages });
+    uint32_t mipLevels = residency.mipLevels();
+
+    ResidencyModel model;
+    model.pageIn.assign(PhysicalPages * PhysicalPages, VirtualFeedbackNone);
+
+    std::vector<graphics::Image> uploaded;
+    for (uint32_t mip = 0; mip < mipLevels; mip++)
+    {
+        int2 size = residency.sizeInPages(mip);
+        uploaded.emplace_back(graphics::Image(32, static_cast<uint16_t>(size[0]), static_cast<uint16_t>(size[1])));
+    }
+
+    // Pages finish loading one or two frames after they were requested
+    struct Load
+    {
+        VirtualPageId   page;
+        int             frame;
+    };
+    std::vector<Load> inFlight;
+
+    std::vector<uint32_t> feedback;
+    std::vector<VirtualPageId> pages;
+    uint32_t loads = 0, failures = 0, rejected = 0, peakRequested = 0;
+    uint32_t residencyErrors = 0, evictionErrors = 0, indirectionErrors = 0, uploadErrors = 0;
+
+    Timer timer;
+    float seconds = 0.f;
+    for (int frame = 0; frame < Frames; frame++)
+    {
+        syntheticFeedback(frame, mipLevels, feedback);
+
+        // The completions of the streamer run before the update of the frame
+        std::vector<Load> finished;
+        auto due = std::partition(inFlight.begin(), inFlight.end(), [frame](const Load& load) { return load.frame > frame; });
+        finished.assign(due, inFlight.end());
+        inFlight.erase(due, inFlight.end());
+
+        for (const auto& load : finished)
+        {
+            loads++;
+            if (loads % FailEveryNthLoad == 0)
+            {
+                timer.start();
+                residency.pageFailed(load.page);
+                seconds += timer.stop();
+                failures++;
+                continue;
+            }
+
+            int2 physicalPage;
+            timer.start();
+            bool loaded = residency.pageLoaded(load.page, physicalPage);
+            seconds += timer.stop();
+            if (!loaded)
+            {
+                rejected++;
+                continue;
+            }
+
+            if (model.slotOf.count(load.page.id) > 0) residencyErrors++;
+            int slot = physicalPage[1] * PhysicalPages + physicalPage[0];
+            uint32_t previous = model.pageIn[slot];
+            if (previous != VirtualFeedbackNone)
+            {
+                // Neither the pages used since the frame began nor the coarsest mip may be evicted
+                if ((model.used.count(previous) > 0) || (VirtualPageId(previous).mip() + 1 >= mipLevels)) evictionErrors++;
+                model.slotOf.erase(previous);
+                model.evictions++;
+            }
+            model.pageIn[slot]          = load.page.id;
+            model.slotOf[load.page.id]  = slot;
+            model.used.insert(load.page.id);
+        }
+
+        timer.start();
+        residency.beginFrame();
+        residency.processFeedback(feedback);
+        pages.clear();
+        residency.pagesToLoad(pages, MaxLoadsPerFrame);
+        seconds += timer.stop();
+
+        peakRequested = std::max(peakRequested, residency.statistics().requestedPages + static_cast<uint32_t>(pages.size()));
+        for (size_t i = 0; i < pages.size(); i++) inFlight.push_back(Load{ pages[i], frame + 1 + static_cast<int>(i % 2) });
+
+        // The feedback pages and their resident ancestors are used in this frame
+        model.used.clear();
+        for (auto entry : feedback)
+        {
+            if (entry == VirtualFeedbackNone) continue;
+            for (VirtualPageId page(entry); ; page = page.parent())
+            {
+                if (model.slotOf.count(page.id) > 0) model.used.insert(page.id);
+                if (page.mip() + 1 >= mipLevels) break;
+            }
+        }
+
+        // Residency, and both the CPU and the uploaded indirection tables, against the model
+        for (uint32_t mip = 0; mip < mipLevels; mip++)
+        {
+            int2 size = residency.sizeInPages(mip);
+            for (int y = 0; y < size[1]; y++)
+            {
+                for (int x = 0; x < size[0]; x++)
+                {
+                    VirtualPageId page(x, y, mip);
+                    if (residency.resident(page) != (model.slotOf.count(page.id) > 0)) residencyErrors++;
+
+                    uint32_t expected = expectedEntry(model, page, mipLevels);
+                    if (entryAt(residency.indirection(mip), x, y) != expected) indirectionErrors++;
+                }
+            }
+        }
+
+        uploadChanges(residency, uploaded);
+        residency.clearIndirectionChanges();
+        for (uint32_t mip = 0; mip < mipLevels; mip++)
+        {
+            const graphics::Image& table = residency.indirection(mip);
+            if (memcmp(table.data(), uploaded[mip].data(), table.dataSize()) != 0)
+            {
+                uploadErrors++;
+                break;
+            }
+        }
+
+        PageResidencyStatistics statistics = residency.statistics();
+        if (statistics.residentPages != model.slotOf.size()) residencyErrors++;
+        if (statistics.evictions != model.evictions) evictionErrors++;
+    }
+
+    PageResidencyStatistics statistics = residency.statistics();
+    printf("  %8.3f ms, %6.2f us per frame\n", seconds * 1000.0f, seconds * 1e6f / Frames);
+    printf("  %u loads, %u failed, %u rejected, %llu evictions, %u resident, at most %u requested\n",
+           loads, failures, rejected, static_cast<unsigned long long>(statistics.evictions),
+           statistics.residentPages, peakRequested);
+    if (residencyErrors > 0)    printf("  Residency differs from the loads %u times\n", residencyErrors);
+    if (evictionErrors > 0)     printf("  Evictions differ from the loads %u times\n", evictionErrors);
+    if (indirectionErrors > 0)  printf("  Indirection differs in %u entries\n", indirectionErrors);
+    if (uploadErrors > 0)       printf("  Uploaded indirection differs in %u frames\n", uploadErrors);
+}
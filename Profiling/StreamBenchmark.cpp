@@ -0,0 +1,76 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    StreamBenchmark.cpp
+*/
+
+#include "Benchmarks.hpp"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../ShadowPeople/Types.hpp"
+#include "../ShadowPeople/Math.hpp"
+#include "../ShadowPeople/Streams.hpp"
+#include "../ShadowPeople/Timer.hpp"
+#include "../ShadowPeople/Transform.hpp"
+
+namespace
+{
+    constexpr size_t NumVectors = 1 << 20;
+
+    void report(const char* name, size_t count, float seconds)
+    {
+        printf("  %-28s %8.2f ms, %7.1f M/s\n", name, seconds * 1000.0f, count / seconds * 1e-6f);
+    }
+}
+
+void benchmarkStreams()
+{
+    printf("Streams, the same operations on float3 arrays and on streams\n");
+
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> coordinate(-10.f, 10.f);
+    std::vector<float3> points(NumVectors);
+    Float3Stream stream(NumVectors);
+    for (size_t i = 0; i < NumVectors; i++)
+    {
+        points[i] = float3{ coordinate(random), coordinate(random), coordinate(random) };
+        stream.set(i, points[i]);
+    }
+    std::vector<float3> pointResult(NumVectors);
+    Float3Stream streamResult(NumVectors);
+
+    Timer timer;
+    timer.start();
+    AABB box;
+    for (const auto& p : points) box.extend(p);
+    report("Bounds, float3", NumVectors, timer.stop());
+
+    timer.start();
+    AABB streamBox = math::bounds(stream);
+    report("Bounds, stream", NumVectors, timer.stop());
+
+    timer.start();
+    for (size_t i = 0; i < NumVectors; i++) pointResult[i] = normalize(points[i]);
+    report("Normalize, float3", NumVectors, timer.stop());
+
+    timer.start();
+    math::normalize(stream, streamResult);
+    report("Normalize, stream", NumVectors, timer.stop());
+
+    Matrix4x4 m = math::rotationMatrix(0.1f, 0.2f, 0.3f);
+    m(0, 3) = 1.f;
+    m(1, 3) = 2.f;
+    m(2, 3) = 3.f;
+
+    timer.start();
+    math::transformPoints(m, points, pointResult);
+    report("Transform points, float3", NumVectors, timer.stop());
+
+    timer.start();
+    math::transformPoints(m, stream, streamResult);
+    report("Transform points, stream", NumVectors, timer.stop());
+
+    if (!(box == streamBox)) printf("  Bounds differ\n");
+}
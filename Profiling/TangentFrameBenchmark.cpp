@@ -0,0 +1,212 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    TangentFrameBenchmark.cpp
+*/
+
+#include "Benchmarks.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+
+#include "../ShadowPeople/Types.hpp"
+#include "../ShadowPeople/Timer.hpp"
+#include "../ShadowPeople/rendering/Mesh.hpp"
+
+namespace
+{
+    // UV sphere with smooth normals
+    void sphereMesh(uint32_t gridSize, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+    {
+        vertices.clear();
+        for (uint32_t y = 0; y <= gridSize; y++)
+        {
+            for (uint32_t x = 0; x <= gridSize; x++)
+            {
+                float theta = 2.f * 3.14159265f * x / gridSize;
+                float phi   = 3.14159265f * (y + 0.5f) / (gridSize + 1);
+
+                Vertex vertex = {};
+                vertex.position = float3{ std::cos(theta) * std::sin(phi), std::cos(phi), std::sin(theta) * std::sin(phi) };
+                vertex.normal   = vertex.position;
+                vertex.uv       = float2{ static_cast<float>(x) / gridSize, static_cast<float>(y) / gridSize };
+                vertices.emplace_back(vertex);
+            }
+        }
+
+        indices.clear();
+        for (uint32_t y = 0; y < gridSize; y++)
+        {
+            for (uint32_t x = 0; x < gridSize; x++)
+            {
+                uint32_t v00 = y * (gridSize + 1) + x;
+                uint32_t v10 = v00 + 1;
+                uint32_t v01 = v00 + gridSize + 1;
+                uint32_t v11 = v01 + 1;
+                for (uint32_t v : { v00, v01, v10, v10, v01, v11 }) indices.emplace_back(v);
+            }
+        }
+    }
+
+    // Unit square in the xy plane, split into two triangles
+    void quadMesh(float3 normal, float2 uvScale, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+    {
+        vertices.clear();
+        for (float y : { 0.f, 1.f })
+        {
+            for (float x : { 0.f, 1.f })
+            {
+                Vertex vertex = {};
+                vertex.position = float3{ x, y, 0.f };
+                vertex.normal   = normal;
+                vertex.uv       = float2{ x * uvScale[0], y * uvScale[1] };
+                vertices.emplace_back(vertex);
+            }
+        }
+        indices = { 0, 2, 1, 1, 2, 3 };
+    }
+
+    // The frames one vertex at a time, in the same stages as Mesh, but with float3 and Quaternion
+    void referenceFrames(std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+    {
+        std::vector<float3> bitangents(vertices.size(), float3{ 0.f, 0.f, 0.f });
+        std::vector<float> handedness(vertices.size(), 0.f);
+        for (size_t i = 0; i + 3 <= indices.size(); i += 3)
+        {
+            const Vertex& v0 = vertices[indices[i + 0]];
+            const Vertex& v1 = vertices[indices[i + 1]];
+            const Vertex& v2 = vertices[indices[i + 2]];
+
+            float3 e1   = v1.position - v0.position;
+            float3 e2   = v2.position - v0.position;
+            float2 f1   = v1.uv - v0.uv;
+            float2 f2   = v2.uv - v0.uv;
+            float det   = f1[0] * f2[1] - f1[1] * f2[0];
+
+            float3 b    = f2[1] * e1 - f1[1] * e2;
+            float3 t    = f1[0] * e2 - f2[0] * e1;
+            float3 n    = cross(e2, e1);
+            float area  = 0.5f * n.length();
+            if (b.length() == 0.f || det == 0.f) continue;
+
+            float3 faceBitangent    = ((det < 0.f) ? -area : area) / b.length() * b;
+            float faceHandedness    = (n.dot(cross(b, t)) < 0.f) ? -area : area;
+            for (size_t c = 0; c < 3; c++)
+            {
+                bitangents[indices[i + c]] += faceBitangent;
+                handedness[indices[i + c]] += faceHandedness;
+            }
+        }
+
+        for (size_t v = 0; v < vertices.size(); v++)
+        {
+            float3 n = (vertices[v].normal.length() > 0.f) ? normalize(vertices[v].normal) : float3{ 0.f, 0.f, 1.f };
+            float3 b = bitangents[v] - bitangents[v].dot(n) * n;
+            if (bitangents[v].dot(bitangents[v]) > 0.f && b.dot(b) > 1e-8f * bitangents[v].dot(bitangents[v]))
+            {
+                b = normalize(b);
+            }
+            else
+            {
+                float s = (n[2] < 0.f) ? -1.f : 1.f;
+                float a = -1.f / (s + n[2]);
+                b = float3{ 1.f + s * a * n[0] * n[0], s * a * n[0] * n[1], -s * n[0] };
+            }
+            float3 t = cross(n, b);
+
+            vertices[v].orientation     = Quaternion(Matrix3x3(b, t, n)).toFloat4();
+            vertices[v].bitangentSign   = (handedness[v] < 0.f) ? -1.f : 1.f;
+        }
+    }
+
+    // Quaternions q and -q are the same rotation
+    size_t countMismatches(const std::vector<Vertex>& expected, const std::vector<Vertex>& actual)
+    {
+        const float Epsilon = 1e-4f;
+
+        size_t mismatches = 0;
+        for (size_t v = 0; v < expected.size(); v++)
+        {
+            float4 q = expected[v].orientation;
+            float4 r = actual[v].orientation;
+            float same = 0.f;
+            float opposite = 0.f;
+            for (int i = 0; i < 4; i++)
+            {
+                same        = std::max<float>(same, std::fabs(q[i] - r[i]));
+                opposite    = std::max<float>(opposite, std::fabs(q[i] + r[i]));
+            }
+            bool rotationDiffers = std::min<float>(same, opposite) > Epsilon;
+            bool signDiffers     = expected[v].bitangentSign != actual[v].bitangentSign;
+            if (rotationDiffers || signDiffers) mismatches++;
+        }
+        return mismatches;
+    }
+
+    void check(const char* name, std::vector<Vertex> vertices, std::vector<uint32_t>& indices)
+    {
+        rendering::Mesh mesh;
+        mesh.fill(vertices, indices);
+        referenceFrames(vertices, indices);
+
+        size_t mismatches = countMismatches(vertices, mesh.vertices());
+        printf("  %-34s %s, %zu of %zu vertices differ\n", name,
+               mismatches ? "FAILED" : "ok", mismatches, vertices.size());
+    }
+}
+
+void benchmarkTangentFrames()
+{
+    printf("Tangent frames\n");
+
+    // Against the scalar reference, also for the frames, which are rotated by 180 degrees, and
+    // for triangles without a usable UV mapping or without area
+    {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+
+        sphereMesh(64, vertices, indices);
+        check("Sphere", vertices, indices);
+
+        quadMesh(float3{ 0.f, 0.f, 1.f }, float2{ 1.f, 1.f }, vertices, indices);
+        check("Quad, identity frame", vertices, indices);
+
+        quadMesh(float3{ 0.f, 0.f, -1.f }, float2{ 1.f, 1.f }, vertices, indices);
+        check("Quad, rotated by 180 degrees", vertices, indices);
+
+        quadMesh(float3{ 0.f, 0.f, -1.f }, float2{ -1.f, 1.f }, vertices, indices);
+        check("Quad, mirrored UV", vertices, indices);
+
+        quadMesh(float3{ 0.f, 0.f, 1.f }, float2{ 0.f, 0.f }, vertices, indices);
+        check("Quad, no UV mapping", vertices, indices);
+
+        quadMesh(float3{ 0.f, 1.f, 0.f }, float2{ 1.f, 1.f }, vertices, indices);
+        for (auto& vertex : vertices) vertex.position = float3{ 0.f, 0.f, 0.f };
+        check("Quad, no area", vertices, indices);
+    }
+
+    Timer timer;
+    for (uint32_t gridSize : { 256u, 1024u, 2048u })
+    {
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        sphereMesh(gridSize, vertices, indices);
+
+        // Includes copying the vertices and indices into the mesh
+        rendering::Mesh mesh;
+        timer.start();
+        mesh.fill(vertices, indices);
+        float seconds = timer.stop();
+
+        // Copies the vertices too, like Mesh::fill
+        timer.start();
+        std::vector<Vertex> reference(vertices);
+        referenceFrames(reference, indices);
+        float referenceSeconds = timer.stop();
+
+        printf("  %9zu vertices: %8.2f ms, %6.1f M vertices/s, scalar reference %8.2f ms, %zu differ\n",
+               vertices.size(), seconds * 1000.0f, vertices.size() / seconds * 1e-6f, referenceSeconds * 1000.0f,
+               countMismatches(reference, mesh.vertices()));
+    }
+}
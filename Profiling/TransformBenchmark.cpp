@@ -0,0 +1,90 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    TransformBenchmark.cpp
+*/
+
+#include "Benchmarks.hpp"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../ShadowPeople/Types.hpp"
+#include "../ShadowPeople/Math.hpp"
+#include "../ShadowPeople/Timer.hpp"
+#include "../ShadowPeople/Transform.hpp"
+
+namespace
+{
+    constexpr size_t NumPoints      = 1 << 20;
+    constexpr size_t NumMatrices    = 1 << 16;
+
+    Matrix4x4 modelMatrix(std::mt19937& random)
+    {
+        std::uniform_real_distribution<float> angle(-math::Pi, math::Pi);
+        std::uniform_real_distribution<float> offset(-100.f, 100.f);
+        Matrix4x4 m = math::rotationMatrix(angle(random), angle(random), angle(random));
+        m(0, 3) = offset(random);
+        m(1, 3) = offset(random);
+        m(2, 3) = offset(random);
+        return m;
+    }
+
+    void report(const char* name, size_t count, float seconds)
+    {
+        printf("  %-28s %8.2f ms, %7.1f M/s\n", name, seconds * 1000.0f, count / seconds * 1e-6f);
+    }
+}
+
+void benchmarkTransforms()
+{
+    printf("Transforms\n");
+
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> coordinate(-10.f, 10.f);
+    Matrix4x4 m = modelMatrix(random);
+
+    std::vector<float3> points(NumPoints);
+    for (auto& p : points) p = float3{ coordinate(random), coordinate(random), coordinate(random) };
+    std::vector<float3> transformed(NumPoints);
+
+    // The baseline is one matrix-vector product per point, as the call sites did before
+    Timer timer;
+    timer.start();
+    for (size_t i = 0; i < NumPoints; i++)
+    {
+        float4 p = m * float4{ points[i][0], points[i][1], points[i][2], 1.f };
+        transformed[i] = float3{ p[0], p[1], p[2] };
+    }
+    report("Points, one at a time", NumPoints, timer.stop());
+
+    timer.start();
+    math::transformPoints(m, points, transformed);
+    report("Points, batched", NumPoints, timer.stop());
+
+    timer.start();
+    math::transformDirections(m, points, transformed);
+    report("Directions, batched", NumPoints, timer.stop());
+
+    std::vector<AABB> boxes(NumPoints);
+    for (size_t i = 0; i < NumPoints; i++)
+    {
+        boxes[i] = AABB(points[i], points[i] + float3{ 1.f, 2.f, 0.5f });
+    }
+    std::vector<AABB> transformedBoxes(NumPoints);
+    timer.start();
+    math::transformAABBs(m, boxes, transformedBoxes);
+    report("AABBs, batched", NumPoints, timer.stop());
+
+    std::vector<Matrix4x4> matrices(NumMatrices);
+    for (auto& matrix : matrices) matrix = modelMatrix(random);
+    std::vector<Matrix4x4> inverses(NumMatrices);
+
+    timer.start();
+    for (size_t i = 0; i < NumMatrices; i++) math::inverse(matrices[i], inverses[i]);
+    report("General inverse", NumMatrices, timer.stop());
+
+    timer.start();
+    for (size_t i = 0; i < NumMatrices; i++) math::affineInverse(matrices[i], inverses[i]);
+    report("Affine inverse", NumMatrices, timer.stop());
+}
@@ -0,0 +1,85 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    VectorExpressionBenchmark.cpp
+*/
+
+#include "Benchmarks.hpp"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../ShadowPeople/Types.hpp"
+#include "../ShadowPeople/Timer.hpp"
+
+namespace
+{
+    constexpr size_t NumVectors = 1 << 20;
+    constexpr int Repeats       = 8;
+
+    // The same computation as the expression, written out element by element
+    void handWritten(const std::vector<float3>& e1, const std::vector<float3>& e2, std::vector<float3>& result)
+    {
+        for (size_t i = 0; i < e1.size(); i++)
+        {
+            float c1 = static_cast<float>(i & 7);
+            float c2 = 0.25f;
+            float x = c1 * e1[i][0] + c2 * e2[i][0] - 0.5f * result[i][0];
+            float y = c1 * e1[i][1] + c2 * e2[i][1] - 0.5f * result[i][1];
+            float z = c1 * e1[i][2] + c2 * e2[i][2] - 0.5f * result[i][2];
+            result[i][0] = x;
+            result[i][1] = y;
+            result[i][2] = z;
+        }
+    }
+
+    void expression(const std::vector<float3>& e1, const std::vector<float3>& e2, std::vector<float3>& result)
+    {
+        for (size_t i = 0; i < e1.size(); i++)
+        {
+            float c1 = static_cast<float>(i & 7);
+            float c2 = 0.25f;
+            result[i] = c1 * e1[i] + c2 * e2[i] - 0.5f * result[i];
+        }
+    }
+
+    float checksum(const std::vector<float3>& vectors)
+    {
+        float sum = 0.f;
+        for (const auto& v : vectors) sum += v[0] + v[1] + v[2];
+        return sum;
+    }
+}
+
+void benchmarkVectorExpressions()
+{
+    printf("Vector expressions, c1 * e1 + c2 * e2 - 0.5 * r\n");
+
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> coordinate(-1.f, 1.f);
+    std::vector<float3> e1(NumVectors);
+    std::vector<float3> e2(NumVectors);
+    for (size_t i = 0; i < NumVectors; i++)
+    {
+        e1[i] = float3{ coordinate(random), coordinate(random), coordinate(random) };
+        e2[i] = float3{ coordinate(random), coordinate(random), coordinate(random) };
+    }
+
+    // One round of each first, so that both are timed with warm caches and clocks
+    std::vector<float3> handWrittenResult(NumVectors);
+    std::vector<float3> expressionResult(NumVectors);
+    handWritten(e1, e2, handWrittenResult);
+    expression(e1, e2, expressionResult);
+
+    Timer timer;
+    timer.start();
+    for (int r = 0; r < Repeats; r++) handWritten(e1, e2, handWrittenResult);
+    float handWrittenSeconds = timer.stop();
+
+    timer.start();
+    for (int r = 0; r < Repeats; r++) expression(e1, e2, expressionResult);
+    float expressionSeconds = timer.stop();
+
+    printf("  Hand-written: %8.2f ms, checksum %f\n", handWrittenSeconds * 1000.0f, checksum(handWrittenResult));
+    printf("  Expression:   %8.2f ms, checksum %f\n", expressionSeconds * 1000.0f, checksum(expressionResult));
+}
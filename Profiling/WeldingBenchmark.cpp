@@ -0,0 +1,77 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    WeldingBenchmark.cpp
+*/
+
+#include "Benchmarks.hpp"
+
+#include <cstdio>
+#include <vector>
+#include <unordered_map>
+
+#include "../ShadowPeople/Types.hpp"
+#include "../ShadowPeople/Timer.hpp"
+#include "../ShadowPeople/asset/VertexWelder.hpp"
+
+namespace
+{
+    // Face corners of a grid of quads, with shared positions and normals and uv seams
+    // every few quads, like in a typical scanned or sculpted mesh
+    std::vector<uint3> gridCorners(uint32_t gridSize)
+    {
+        std::vector<uint3> corners;
+        corners.reserve(static_cast<size_t>(gridSize) * gridSize * 6);
+        for (uint32_t y = 0; y < gridSize; y++)
+        {
+            for (uint32_t x = 0; x < gridSize; x++)
+            {
+                uint32_t v00 = y * (gridSize + 1) + x;
+                uint32_t v10 = v00 + 1;
+                uint32_t v01 = v00 + gridSize + 1;
+                uint32_t v11 = v01 + 1;
+                uint32_t uvChart = (x / 16) * 7;
+                for (uint32_t v : { v00, v10, v11, v00, v11, v01 })
+                {
+                    corners.emplace_back(uint3{ v, v + uvChart, v });
+                }
+            }
+        }
+        return corners;
+    }
+}
+
+void benchmarkVertexWelding()
+{
+    printf("Vertex welding\n");
+
+    Timer timer;
+    for (uint32_t gridSize : { 256u, 1024u, 2048u })
+    {
+        std::vector<uint3> corners = gridCorners(gridSize);
+        std::vector<uint32_t> remap(corners.size());
+
+        asset::VertexWelder welder(corners.size());
+        timer.start();
+        uint32_t numVertices = welder.weld(corners, remap);
+        float weldSeconds = timer.stop();
+
+        printf("  %10zu corners -> %9u vertices: %8.2f ms, %7.1f M corners/s\n",
+               corners.size(), numVertices, weldSeconds * 1000.0f,
+               corners.size() / weldSeconds * 1e-6f);
+    }
+
+    // The node based map for comparison, only at the smallest size, because it is slow
+    {
+        std::vector<uint3> corners = gridCorners(256);
+        std::unordered_map<uint3, uint32_t> uniqueIndices;
+        timer.start();
+        for (const auto& corner : corners)
+        {
+            uniqueIndices.emplace(corner, static_cast<uint32_t>(uniqueIndices.size()));
+        }
+        float mapSeconds = timer.stop();
+
+        printf("  %10zu corners with std::unordered_map: %8.2f ms, %7.1f M corners/s\n",
+               corners.size(), mapSeconds * 1000.0f, corners.size() / mapSeconds * 1e-6f);
+    }
+}
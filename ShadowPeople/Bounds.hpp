@@ -0,0 +1,79 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    Bounds.hpp
+
+    Bounding volumes
+*/
+
+#pragma once
+
+#include <cfloat>
+
+#include "Types.hpp"
+
+// Axis aligned bounding box. The default one is empty, so that extending it with the first
+// point makes it the point.
+class AABB
+{
+public:
+    AABB() : m_minCorner(FLT_MAX), m_maxCorner(-FLT_MAX) {}
+    AABB(float3 minCorner, float3 maxCorner) : m_minCorner(minCorner), m_maxCorner(maxCorner) {}
+
+    float3 minCorner() const    { return m_minCorner; }
+    float3 maxCorner() const    { return m_maxCorner; }
+
+    float3 center() const       { return (m_minCorner + m_maxCorner) * 0.5f; }
+    float3 extents() const      { return (m_maxCorner - m_minCorner) * 0.5f; }   // Half of the size
+
+    bool empty() const
+    {
+        return (m_minCorner[0] > m_maxCorner[0]) || (m_minCorner[1] > m_maxCorner[1]) ||
+               (m_minCorner[2] > m_maxCorner[2]);
+    }
+
+    void extend(float3 point)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            m_minCorner[i] = (point[i] < m_minCorner[i]) ? point[i] : m_minCorner[i];
+            m_maxCorner[i] = (point[i] > m_maxCorner[i]) ? point[i] : m_maxCorner[i];
+        }
+    }
+
+    void extend(const AABB& box)
+    {
+        if (box.empty()) return;
+        extend(box.m_minCorner);
+        extend(box.m_maxCorner);
+    }
+
+    bool operator==(const AABB& rhs) const
+    {
+        return (m_minCorner == rhs.m_minCorner) && (m_maxCorner == rhs.m_maxCorner);
+    }
+private:
+    float3 m_minCorner;
+    float3 m_maxCorner;
+};
+
+// Bounding sphere. The default one is a point at the origin.
+class Sphere
+{
+public:
+    Sphere() : m_center(0.f), m_radius(0.f) {}
+    Sphere(float3 center, float radius) : m_center(center), m_radius(radius) {}
+
+    // Center in xyz and radius in w, as the spheres of the meshes and meshlets are stored
+    explicit Sphere(const float4& sphere) : m_center{ sphere[0], sphere[1], sphere[2] }, m_radius(sphere[3]) {}
+
+    float3 center() const       { return m_center; }
+    float radius() const        { return m_radius; }
+
+    bool operator==(const Sphere& rhs) const
+    {
+        return (m_center == rhs.m_center) && (m_radius == rhs.m_radius);
+    }
+private:
+    float3 m_center;
+    float  m_radius;
+};
@@ -0,0 +1,183 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    Culling.cpp
+*/
+
+#include "Culling.hpp"
+#include "Errors.hpp"
+#include "Simd.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// The SIMD and the scalar tests do the same operations in the same order, so that the batch and
+// the single volume tests agree. The signed distance of the volume from a plane is the distance of
+// its center plus its radius, and it is outside, if the smallest of them is negative.
+namespace
+{
+    float sphereDistance(const float4& plane, const float3& center, float radius)
+    {
+        float distance = plane[0] * center[0] + plane[3];
+        distance = plane[1] * center[1] + distance;
+        distance = plane[2] * center[2] + distance;
+        return distance + radius;
+    }
+
+    // The radius of a box is the extent of its farthest corner along the normal
+    float boxDistance(const float4& plane, const float3& center, const float3& extents)
+    {
+        float radius = extents[0] * std::fabs(plane[0]);
+        radius = extents[1] * std::fabs(plane[1]) + radius;
+        radius = extents[2] * std::fabs(plane[2]) + radius;
+        return sphereDistance(plane, center, radius);
+    }
+
+    bool outsideSphere(const std::array<float4, 6>& planes, const float3& center, float radius)
+    {
+        float nearest = FLT_MAX;
+        for (const auto& plane : planes) nearest = std::min<float>(nearest, sphereDistance(plane, center, radius));
+        return nearest < 0.f;
+    }
+
+    bool outsideBox(const std::array<float4, 6>& planes, const float3& center, const float3& extents)
+    {
+        float nearest = FLT_MAX;
+        for (const auto& plane : planes) nearest = std::min<float>(nearest, boxDistance(plane, center, extents));
+        return nearest < 0.f;
+    }
+
+    float3 get(const ConstFloat3StreamRange& src, size_t i)
+    {
+        return float3{ src.component(0)[i], src.component(1)[i], src.component(2)[i] };
+    }
+
+#ifdef SP_SIMD_FLOAT4
+    using simd::Float4;
+
+    struct Plane4
+    {
+        Float4 x, y, z, w;
+        Float4 absX, absY, absZ;
+    };
+
+    std::array<Plane4, 6> splatPlanes(const std::array<float4, 6>& planes)
+    {
+        std::array<Plane4, 6> result;
+        for (size_t p = 0; p < planes.size(); p++)
+        {
+            const float4& plane = planes[p];
+            result[p] = { simd::splat(plane[0]), simd::splat(plane[1]), simd::splat(plane[2]), simd::splat(plane[3]),
+                          simd::splat(std::fabs(plane[0])), simd::splat(std::fabs(plane[1])),
+                          simd::splat(std::fabs(plane[2])) };
+        }
+        return result;
+    }
+
+    Float4 sphereDistance(const Plane4& plane, Float4 x, Float4 y, Float4 z, Float4 radius)
+    {
+        Float4 distance = simd::madd(plane.x, x, plane.w);
+        distance = simd::madd(plane.y, y, distance);
+        distance = simd::madd(plane.z, z, distance);
+        return simd::add(distance, radius);
+    }
+
+    // Appends the indices of the lanes, whose bit is not set in the mask. Writing every index
+    // and advancing only past the visible ones avoids a branch, which would be hard to predict.
+    size_t compact(int outsideMask, uint32_t first, Range<uint32_t>& visible, size_t count)
+    {
+        for (uint32_t lane = 0; lane < 4; lane++)
+        {
+            visible[count] = first + lane;
+            count += ((outsideMask >> lane) & 1) ^ 1;
+        }
+        return count;
+    }
+#endif
+}
+
+namespace math
+{
+    bool outsideFrustum(const std::array<float4, 6>& planes, const Sphere& sphere)
+    {
+        return outsideSphere(planes, sphere.center(), sphere.radius());
+    }
+
+    bool outsideFrustum(const std::array<float4, 6>& planes, const AABB& box)
+    {
+        return outsideBox(planes, box.center(), box.extents());
+    }
+
+    size_t cullSpheres(const std::array<float4, 6>& planes, ConstFloat3StreamRange centers,
+                       Range<const float> radii, Range<uint32_t> visible)
+    {
+        SP_ASSERT((radii.size() == centers.size()) && (visible.size() == centers.size()),
+                  "Radii and visible must have as many elements as the centers");
+
+        size_t n = centers.size();
+        size_t i = 0;
+        size_t count = 0;
+#ifdef SP_SIMD_FLOAT4
+        std::array<Plane4, 6> planes4 = splatPlanes(planes);
+        for (; i + 4 <= n; i += 4)
+        {
+            Float4 x        = simd::load(centers.component(0) + i);
+            Float4 y        = simd::load(centers.component(1) + i);
+            Float4 z        = simd::load(centers.component(2) + i);
+            Float4 radius   = simd::load(&radii[i]);
+
+            Float4 nearest  = simd::splat(FLT_MAX);
+            for (const auto& plane : planes4)
+                nearest = simd::minimum(nearest, sphereDistance(plane, x, y, z, radius));
+
+            count = compact(simd::lessMask(nearest, simd::zero()), static_cast<uint32_t>(i), visible, count);
+        }
+#endif
+        for (; i < n; i++)
+        {
+            visible[count] = static_cast<uint32_t>(i);
+            if (!outsideSphere(planes, get(centers, i), radii[i])) count++;
+        }
+        return count;
+    }
+
+    size_t cullAABBs(const std::array<float4, 6>& planes, ConstFloat3StreamRange centers,
+                     ConstFloat3StreamRange extents, Range<uint32_t> visible)
+    {
+        SP_ASSERT((extents.size() == centers.size()) && (visible.size() == centers.size()),
+                  "Extents and visible must have as many elements as the centers");
+
+        size_t n = centers.size();
+        size_t i = 0;
+        size_t count = 0;
+#ifdef SP_SIMD_FLOAT4
+        std::array<Plane4, 6> planes4 = splatPlanes(planes);
+        for (; i + 4 <= n; i += 4)
+        {
+            Float4 x        = simd::load(centers.component(0) + i);
+            Float4 y        = simd::load(centers.component(1) + i);
+            Float4 z        = simd::load(centers.component(2) + i);
+            Float4 ex       = simd::load(extents.component(0) + i);
+            Float4 ey       = simd::load(extents.component(1) + i);
+            Float4 ez       = simd::load(extents.component(2) + i);
+
+            Float4 nearest  = simd::splat(FLT_MAX);
+            for (const auto& plane : planes4)
+            {
+                Float4 radius = simd::mul(ex, plane.absX);
+                radius = simd::madd(ey, plane.absY, radius);
+                radius = simd::madd(ez, plane.absZ, radius);
+                nearest = simd::minimum(nearest, sphereDistance(plane, x, y, z, radius));
+            }
+
+            count = compact(simd::lessMask(nearest, simd::zero()), static_cast<uint32_t>(i), visible, count);
+        }
+#endif
+        for (; i < n; i++)
+        {
+            visible[count] = static_cast<uint32_t>(i);
+            if (!outsideBox(planes, get(centers, i), get(extents, i))) count++;
+        }
+        return count;
+    }
+}
@@ -0,0 +1,37 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    Culling.hpp
+
+    Frustum culling of bounding spheres and boxes. The planes are the ones
+    from Camera::frustumPlanes(), normalized and with the normals pointing
+    inside. A volume is culled, if it is completely behind one of the
+    planes. The test is conservative, so a volume near a corner of the
+    frustum may pass, although it is outside.
+
+    The batch versions take the bounds as streams, test four of them at a
+    time against all the planes, and compact the indices of the visible
+    ones into a list.
+*/
+
+#pragma once
+
+#include <array>
+#include <stdint.h>
+
+#include "Types.hpp"
+#include "Bounds.hpp"
+#include "Streams.hpp"
+
+namespace math
+{
+    bool outsideFrustum(const std::array<float4, 6>& planes, const Sphere& sphere);
+    bool outsideFrustum(const std::array<float4, 6>& planes, const AABB& box);
+
+    // Writes the indices of the volumes, which are not outside, in increasing order, and returns
+    // their count. Visible must have as many elements as there are volumes. The boxes are given
+    // by their centers and extents, which is cheaper to test than the corners.
+    size_t cullSpheres(const std::array<float4, 6>& planes, ConstFloat3StreamRange centers,
+                       Range<const float> radii, Range<uint32_t> visible);
+    size_t cullAABBs(const std::array<float4, 6>& planes, ConstFloat3StreamRange centers,
+                     ConstFloat3StreamRange extents, Range<uint32_t> visible);
+}
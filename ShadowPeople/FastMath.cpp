@@ -0,0 +1,107 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    FastMath.cpp
+*/
+
+#include "FastMath.hpp"
+#include "Errors.hpp"
+
+#include <type_traits>
+
+namespace
+{
+    template<math::Accuracy A>
+    using Vectorized = std::integral_constant<bool, A != math::Accuracy::Full>;
+
+    // The function is a generic lambda, which takes both floats and SIMD registers
+    template<typename Function>
+    void batch(std::true_type, Range<const float> x, Range<float> result, Function function)
+    {
+        SP_ASSERT(result.size() == x.size(), "Result must have as many elements as the input");
+
+        size_t n = x.size();
+        size_t i = 0;
+#ifdef SP_SIMD_FLOAT4
+        for (; i + 4 <= n; i += 4) simd::store(&result[i], function(simd::load(&x[i])));
+#endif
+        for (; i < n; i++) result[i] = function(x[i]);
+    }
+
+    template<typename Function>
+    void batch(std::false_type, Range<const float> x, Range<float> result, Function function)
+    {
+        SP_ASSERT(result.size() == x.size(), "Result must have as many elements as the input");
+
+        for (size_t i = 0; i < x.size(); i++) result[i] = function(x[i]);
+    }
+
+    template<typename Function>
+    void batch(std::true_type, Range<const float> y, Range<const float> x, Range<float> result, Function function)
+    {
+        SP_ASSERT((x.size() == y.size()) && (result.size() == y.size()), "Result must have as many elements as the input");
+
+        size_t n = y.size();
+        size_t i = 0;
+#ifdef SP_SIMD_FLOAT4
+        for (; i + 4 <= n; i += 4) simd::store(&result[i], function(simd::load(&y[i]), simd::load(&x[i])));
+#endif
+        for (; i < n; i++) result[i] = function(y[i], x[i]);
+    }
+
+    template<typename Function>
+    void batch(std::false_type, Range<const float> y, Range<const float> x, Range<float> result, Function function)
+    {
+        SP_ASSERT((x.size() == y.size()) && (result.size() == y.size()), "Result must have as many elements as the input");
+
+        for (size_t i = 0; i < y.size(); i++) result[i] = function(y[i], x[i]);
+    }
+}
+
+namespace math
+{
+    template<Accuracy A>
+    void sin(Range<const float> x, Range<float> result)
+    {
+        batch(Vectorized<A>(), x, result, [](auto v) { return sin<A>(v); });
+    }
+
+    template<Accuracy A>
+    void cos(Range<const float> x, Range<float> result)
+    {
+        batch(Vectorized<A>(), x, result, [](auto v) { return cos<A>(v); });
+    }
+
+    template<Accuracy A>
+    void atan2(Range<const float> y, Range<const float> x, Range<float> result)
+    {
+        batch(Vectorized<A>(), y, x, result, [](auto v, auto u) { return atan2<A>(v, u); });
+    }
+
+    template<Accuracy A>
+    void exp(Range<const float> x, Range<float> result)
+    {
+        batch(Vectorized<A>(), x, result, [](auto v) { return exp<A>(v); });
+    }
+
+    template<Accuracy A>
+    void rsqrt(Range<const float> x, Range<float> result)
+    {
+        batch(Vectorized<A>(), x, result, [](auto v) { return rsqrt<A>(v); });
+    }
+
+    template void sin<Accuracy::Full>(Range<const float> x, Range<float> result);
+    template void sin<Accuracy::High>(Range<const float> x, Range<float> result);
+    template void sin<Accuracy::Low>(Range<const float> x, Range<float> result);
+    template void cos<Accuracy::Full>(Range<const float> x, Range<float> result);
+    template void cos<Accuracy::High>(Range<const float> x, Range<float> result);
+    template void cos<Accuracy::Low>(Range<const float> x, Range<float> result);
+    template void atan2<Accuracy::Full>(Range<const float> y, Range<const float> x, Range<float> result);
+    template void atan2<Accuracy::High>(Range<const float> y, Range<const float> x, Range<float> result);
+    template void atan2<Accuracy::Low>(Range<const float> y, Range<const float> x, Range<float> result);
+    template void exp<Accuracy::Full>(Range<const float> x, Range<float> result);
+    template void exp<Accuracy::High>(Range<const float> x, Range<float> result);
+    template void exp<Accuracy::Low>(Range<const float> x, Range<float> result);
+    template void rsqrt<Accuracy::Full>(Range<const float> x, Range<float> result);
+    template void rsqrt<Accuracy::High>(Range<const float> x, Range<float> result);
+    template void rsqrt<Accuracy::Low>(Range<const float> x, Range<float> result);
+}
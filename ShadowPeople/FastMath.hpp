@@ -0,0 +1,434 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    FastMath.hpp
+
+    Polynomial approximations of the elementary functions, in accuracy
+    tiers. Full calls the standard library, so that a subsystem can choose
+    its tier with one constant, and go back to Full, if the error shows.
+
+    Maximum errors      High                Low
+    sin, cos            1e-7 absolute       1.5e-5 absolute
+    atan2               3e-7 absolute       1e-4 absolute
+    exp                 1.5e-7 relative     1.5e-4 relative
+    rsqrt               3e-7 relative       2e-3 relative, 4e-4 with SSE
+
+    The bounds hold for |x| < 8192 for sin and cos, for finite inputs of
+    atan2, for [-87, 88] for exp, and for positive inputs of rsqrt. Exp
+    clamps its input to that range, so that the result neither overflows
+    nor becomes denormal.
+    Atan2(0, 0) is 0. Rsqrt refines the reciprocal square root estimate of
+    the instruction set, so its results vary between the instruction sets.
+
+    The SIMD versions take four values at a time, and give the same results
+    as the scalar ones. The batch versions use them for whole ranges.
+*/
+
+#pragma once
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+
+#include "Types.hpp"
+#include "Simd.hpp"
+
+namespace math
+{
+    enum class Accuracy
+    {
+        Full,
+        High,
+        Low
+    };
+
+    template<Accuracy A> float sin(float x);
+    template<Accuracy A> float cos(float x);
+    template<Accuracy A> void sincos(float x, float& s, float& c);
+    template<Accuracy A> float atan2(float y, float x);
+    template<Accuracy A> float exp(float x);
+    template<Accuracy A> float rsqrt(float x);
+
+#ifdef SP_SIMD_FLOAT4
+    // High and Low only, since the standard library has no SIMD versions
+    template<Accuracy A> simd::Float4 sin(simd::Float4 x);
+    template<Accuracy A> simd::Float4 cos(simd::Float4 x);
+    template<Accuracy A> void sincos(simd::Float4 x, simd::Float4& s, simd::Float4& c);
+    template<Accuracy A> simd::Float4 atan2(simd::Float4 y, simd::Float4 x);
+    template<Accuracy A> simd::Float4 exp(simd::Float4 x);
+    template<Accuracy A> simd::Float4 rsqrt(simd::Float4 x);
+#endif
+
+    // Result must have as many elements as the input, and may be the same range
+    template<Accuracy A> void sin(Range<const float> x, Range<float> result);
+    template<Accuracy A> void cos(Range<const float> x, Range<float> result);
+    template<Accuracy A> void atan2(Range<const float> y, Range<const float> x, Range<float> result);
+    template<Accuracy A> void exp(Range<const float> x, Range<float> result);
+    template<Accuracy A> void rsqrt(Range<const float> x, Range<float> result);
+}
+
+// The kernels are templates on the lane type, so that the scalar and the SIMD versions are the
+// same code. The scalar operations work on the bits like the SIMD instructions.
+namespace math
+{
+    namespace poly
+    {
+        inline uint32_t asInt(float a)
+        {
+            uint32_t bits;
+            memcpy(&bits, &a, sizeof(float));
+            return bits;
+        }
+
+        inline float asFloat(uint32_t a)
+        {
+            float f;
+            memcpy(&f, &a, sizeof(float));
+            return f;
+        }
+
+        inline float add(float a, float b)              { return a + b; }
+        inline float sub(float a, float b)              { return a - b; }
+        inline float mul(float a, float b)              { return a * b; }
+        inline float div(float a, float b)              { return a / b; }
+        inline float madd(float a, float b, float c)    { return a * b + c; }
+        inline float abs(float a)                       { return fabsf(a); }
+        inline float minimum(float a, float b)          { return (a < b) ? a : b; }
+        inline float maximum(float a, float b)          { return (a > b) ? a : b; }
+        inline float greater(float a, float b)          { return asFloat((a > b) ? ~0u : 0u); }
+        inline float bitAnd(float a, float b)           { return asFloat(asInt(a) & asInt(b)); }
+        inline float bitXor(float a, float b)           { return asFloat(asInt(a) ^ asInt(b)); }
+
+        inline float select(float mask, float a, float b)
+        {
+            return asFloat((asInt(mask) & asInt(a)) | (~asInt(mask) & asInt(b)));
+        }
+
+        inline uint32_t add(uint32_t a, uint32_t b)     { return a + b; }
+        inline uint32_t bitAnd(uint32_t a, uint32_t b)  { return a & b; }
+
+        template<int N>
+        inline uint32_t shiftLeft(uint32_t a)           { return a << N; }
+        template<int N>
+        inline uint32_t shiftRight(uint32_t a)          { return static_cast<uint32_t>(static_cast<int32_t>(a) >> N); }
+
+        // The same estimate as the SIMD version, followed by as many Newton-Raphson steps as
+        // the bounds of the tiers need
+#ifdef SP_SIMD_FLOAT4
+        inline float rsqrtEstimate(float a)
+        {
+            float lanes[4];
+            simd::store(lanes, simd::rsqrtEstimate(simd::splat(a)));
+            return lanes[0];
+        }
+#endif
+#if defined(SP_SIMD_SSE)
+        constexpr int RsqrtHighSteps    = 1;
+        constexpr int RsqrtLowSteps     = 0;
+#elif defined(SP_SIMD_NEON)
+        constexpr int RsqrtHighSteps    = 2;
+        constexpr int RsqrtLowSteps     = 1;
+#else
+        // Lomont, "Fast Inverse Square Root"
+        inline float rsqrtEstimate(float a)             { return asFloat(0x5f375a86u - (asInt(a) >> 1)); }
+
+        constexpr int RsqrtHighSteps    = 3;
+        constexpr int RsqrtLowSteps     = 1;
+#endif
+
+#ifdef SP_SIMD_FLOAT4
+        using simd::asInt;
+        using simd::asFloat;
+        using simd::add;
+        using simd::sub;
+        using simd::mul;
+        using simd::div;
+        using simd::madd;
+        using simd::abs;
+        using simd::minimum;
+        using simd::maximum;
+        using simd::greater;
+        using simd::bitAnd;
+        using simd::bitXor;
+        using simd::select;
+        using simd::shiftLeft;
+        using simd::shiftRight;
+        using simd::rsqrtEstimate;
+#endif
+
+        // The integer lanes of the bits of V. The type is found through the overloads of asInt,
+        // since a class template keyed on simd::Float4 would drop its alignment attributes.
+        template<typename V>
+        using IntLanes = decltype(asInt(V()));
+
+        template<typename V>
+        V splat(float a);
+
+        template<>
+        inline float splat<float>(float a)              { return a; }
+
+        template<typename V>
+        IntLanes<V> splatInt(uint32_t a);
+
+        template<>
+        inline uint32_t splatInt<float>(uint32_t a)     { return a; }
+
+#ifdef SP_SIMD_FLOAT4
+        template<>
+        inline simd::Float4 splat<simd::Float4>(float a) { return simd::splat(a); }
+
+        template<>
+        inline simd::Int4 splatInt<simd::Float4>(uint32_t a) { return simd::splatInt(a); }
+#endif
+
+        constexpr float Pi              = 3.14159265f;
+        constexpr float PiOver2         = 1.57079633f;
+        constexpr float PiOver4         = 0.785398163f;
+        constexpr float TanPiOver8      = 0.414213562f;
+        constexpr float TwoOverPi       = 0.636619772f;
+        constexpr float Log2e           = 1.44269504f;
+
+        // The first parts have so few bits, that their products with small integers are exact
+        constexpr float PiOver2Part1    = 1.5703125f;
+        constexpr float PiOver2Part2    = 4.837512969970703125e-4f;
+        constexpr float PiOver2Part3    = 7.54978995489188216e-8f;
+        constexpr float Ln2Part1        = 0.693359375f;
+        constexpr float Ln2Part2        = -2.12194440e-4f;
+
+        // 1.5 * 2^23. Adding it rounds to the nearest integer, which is then in the low bits of the
+        // sum. This needs the precise floating point model, which keeps the addition.
+        constexpr float RoundingMagic   = 12582912.f;
+        constexpr uint32_t RoundingMagicBits = 0x4b400000u;
+
+        // The lanes, where the sign bit of a is set
+        template<typename V>
+        V signMask(V a)
+        {
+            return asFloat(shiftRight<31>(asInt(a)));
+        }
+
+        // Reduces x to [-pi / 4, pi / 4]. The quadrant is in the low bits of q.
+        template<typename V>
+        V reduceQuadrant(V x, IntLanes<V>& q)
+        {
+            V sum   = madd(x, splat<V>(TwoOverPi), splat<V>(RoundingMagic));
+            V k     = sub(sum, splat<V>(RoundingMagic));
+            q       = asInt(sum);
+
+            V r     = madd(k, splat<V>(-PiOver2Part1), x);
+            r       = madd(k, splat<V>(-PiOver2Part2), r);
+            return madd(k, splat<V>(-PiOver2Part3), r);
+        }
+
+        // Minimax polynomials on [-pi / 4, pi / 4], z = r^2. High is from Cephes.
+        template<Accuracy A, typename V>
+        V sinPolynomial(V r, V z)
+        {
+            V p = (A == Accuracy::High) ?
+                madd(madd(splat<V>(-1.9515295891e-4f), z, splat<V>(8.3321608736e-3f)), z, splat<V>(-1.6666654611e-1f)) :
+                madd(splat<V>(8.152992326e-3f), z, splat<V>(-1.666283381e-1f));
+            return madd(mul(r, z), p, r);
+        }
+
+        template<Accuracy A, typename V>
+        V cosPolynomial(V z)
+        {
+            if (A == Accuracy::High)
+            {
+                V p = madd(madd(splat<V>(2.443315711809948e-5f), z, splat<V>(-1.388731625493765e-3f)), z,
+                           splat<V>(4.166664568298827e-2f));
+                return madd(mul(z, z), p, madd(z, splat<V>(-0.5f), splat<V>(1.f)));
+            }
+            return madd(madd(splat<V>(4.048893588e-2f), z, splat<V>(-4.997763071e-1f)), z, splat<V>(1.f));
+        }
+
+        // sin(r + q * pi / 2), from the sine and cosine of r
+        template<typename V>
+        V fromQuadrant(V s, V c, IntLanes<V> q)
+        {
+            V odd   = asFloat(shiftRight<31>(shiftLeft<31>(q)));
+            V sign  = asFloat(bitAnd(shiftLeft<30>(q), splatInt<V>(0x80000000u)));
+            return bitXor(select(odd, c, s), sign);
+        }
+
+        template<Accuracy A, typename V>
+        void sincos(V x, V& s, V& c)
+        {
+            IntLanes<V> q;
+            V r     = reduceQuadrant(x, q);
+            V z     = mul(r, r);
+            V sr    = sinPolynomial<A>(r, z);
+            V cr    = cosPolynomial<A>(z);
+
+            // The cosine is the sine one quadrant ahead
+            s       = fromQuadrant(sr, cr, q);
+            c       = fromQuadrant(sr, cr, add(q, splatInt<V>(1)));
+        }
+
+        template<Accuracy A, typename V>
+        V sin(V x)
+        {
+            IntLanes<V> q;
+            V r     = reduceQuadrant(x, q);
+            V z     = mul(r, r);
+            return fromQuadrant(sinPolynomial<A>(r, z), cosPolynomial<A>(z), q);
+        }
+
+        template<Accuracy A, typename V>
+        V cos(V x)
+        {
+            IntLanes<V> q;
+            V r     = reduceQuadrant(x, q);
+            V z     = mul(r, r);
+            return fromQuadrant(sinPolynomial<A>(r, z), cosPolynomial<A>(z), add(q, splatInt<V>(1)));
+        }
+
+        // The arctangent of the smaller over the larger of |x| and |y| is in [0, pi / 4], and is
+        // then mirrored to the right octant. High reduces it further with
+        // atan(t) = pi / 4 + atan((t - 1) / (t + 1)), to the range of the Cephes polynomial.
+        template<Accuracy A, typename V>
+        V atan2(V y, V x)
+        {
+            V ax    = abs(x);
+            V ay    = abs(y);
+            V t     = div(minimum(ax, ay), maximum(maximum(ax, ay), splat<V>(FLT_MIN)));
+
+            V a;
+            if (A == Accuracy::High)
+            {
+                V one       = splat<V>(1.f);
+                V reduced   = greater(t, splat<V>(TanPiOver8));
+                t           = select(reduced, div(sub(t, one), add(t, one)), t);
+                V z         = mul(t, t);
+                V p         = madd(madd(madd(splat<V>(8.05374449538e-2f), z, splat<V>(-1.38776856032e-1f)), z,
+                                        splat<V>(1.99777106478e-1f)), z, splat<V>(-3.33329491539e-1f));
+                a           = add(madd(mul(t, z), p, t), bitAnd(reduced, splat<V>(PiOver4)));
+            }
+            else
+            {
+                V z         = mul(t, t);
+                V p         = madd(madd(madd(splat<V>(-3.898651241e-2f), z, splat<V>(1.462644618e-1f)), z,
+                                        splat<V>(-3.211749695e-1f)), z, splat<V>(9.992138129e-1f));
+                a           = mul(t, p);
+            }
+
+            a = select(greater(ay, ax), sub(splat<V>(PiOver2), a), a);
+            a = select(signMask(x), sub(splat<V>(Pi), a), a);
+            return bitXor(a, bitAnd(y, splat<V>(-0.f)));
+        }
+
+        // exp(x) = 2^n * exp(r), where r is in [-ln(2) / 2, ln(2) / 2]. High is from Cephes.
+        template<Accuracy A, typename V>
+        V exp(V x)
+        {
+            x       = minimum(maximum(x, splat<V>(-87.f)), splat<V>(88.f));
+            V sum   = madd(x, splat<V>(Log2e), splat<V>(RoundingMagic));
+            V n     = sub(sum, splat<V>(RoundingMagic));
+            V r     = madd(n, splat<V>(-Ln2Part1), x);
+            r       = madd(n, splat<V>(-Ln2Part2), r);
+
+            V p;
+            if (A == Accuracy::High)
+            {
+                p = madd(madd(madd(madd(madd(splat<V>(1.9875691500e-4f), r, splat<V>(1.3981999507e-3f)), r,
+                                        splat<V>(8.3334519073e-3f)), r, splat<V>(4.1665795894e-2f)), r,
+                              splat<V>(1.6666665459e-1f)), r, splat<V>(5.0000001201e-1f));
+            }
+            else
+            {
+                p = madd(splat<V>(1.666281108e-1f), r, splat<V>(5.039410292e-1f));
+            }
+            p = madd(mul(r, r), p, add(r, splat<V>(1.f)));
+
+            // 2^n from the exponent bits
+            V scale = asFloat(shiftLeft<23>(add(asInt(sum), splatInt<V>(127u - RoundingMagicBits))));
+            return mul(p, scale);
+        }
+
+        template<Accuracy A, typename V>
+        V rsqrt(V x)
+        {
+            constexpr int Steps = (A == Accuracy::High) ? RsqrtHighSteps : RsqrtLowSteps;
+
+            V y     = rsqrtEstimate(x);
+            V halfX = mul(x, splat<V>(0.5f));
+            for (int i = 0; i < Steps; i++) y = mul(y, sub(splat<V>(1.5f), mul(mul(halfX, y), y)));
+            return y;
+        }
+    }
+
+    template<Accuracy A>
+    inline float sin(float x)                           { return poly::sin<A>(x); }
+    template<Accuracy A>
+    inline float cos(float x)                           { return poly::cos<A>(x); }
+    template<Accuracy A>
+    inline void sincos(float x, float& s, float& c)     { poly::sincos<A>(x, s, c); }
+    template<Accuracy A>
+    inline float atan2(float y, float x)                { return poly::atan2<A>(y, x); }
+    template<Accuracy A>
+    inline float exp(float x)                           { return poly::exp<A>(x); }
+    template<Accuracy A>
+    inline float rsqrt(float x)                         { return poly::rsqrt<A>(x); }
+
+    template<>
+    inline float sin<Accuracy::Full>(float x)           { return sinf(x); }
+    template<>
+    inline float cos<Accuracy::Full>(float x)           { return cosf(x); }
+    template<>
+    inline float atan2<Accuracy::Full>(float y, float x) { return atan2f(y, x); }
+    template<>
+    inline float exp<Accuracy::Full>(float x)           { return expf(x); }
+    template<>
+    inline float rsqrt<Accuracy::Full>(float x)         { return 1.f / sqrtf(x); }
+
+    template<>
+    inline void sincos<Accuracy::Full>(float x, float& s, float& c)
+    {
+        s = sinf(x);
+        c = cosf(x);
+    }
+
+#ifdef SP_SIMD_FLOAT4
+    template<Accuracy A>
+    inline simd::Float4 sin(simd::Float4 x)
+    {
+        static_assert(A != Accuracy::Full, "The standard library has no SIMD versions");
+        return poly::sin<A>(x);
+    }
+
+    template<Accuracy A>
+    inline simd::Float4 cos(simd::Float4 x)
+    {
+        static_assert(A != Accuracy::Full, "The standard library has no SIMD versions");
+        return poly::cos<A>(x);
+    }
+
+    template<Accuracy A>
+    inline void sincos(simd::Float4 x, simd::Float4& s, simd::Float4& c)
+    {
+        static_assert(A != Accuracy::Full, "The standard library has no SIMD versions");
+        poly::sincos<A>(x, s, c);
+    }
+
+    template<Accuracy A>
+    inline simd::Float4 atan2(simd::Float4 y, simd::Float4 x)
+    {
+        static_assert(A != Accuracy::Full, "The standard library has no SIMD versions");
+        return poly::atan2<A>(y, x);
+    }
+
+    template<Accuracy A>
+    inline simd::Float4 exp(simd::Float4 x)
+    {
+        static_assert(A != Accuracy::Full, "The standard library has no SIMD versions");
+        return poly::exp<A>(x);
+    }
+
+    template<Accuracy A>
+    inline simd::Float4 rsqrt(simd::Float4 x)
+    {
+        static_assert(A != Accuracy::Full, "The standard library has no SIMD versions");
+        return poly::rsqrt<A>(x);
+    }
+#endif
+}
@@ -1,5 +1,7 @@
 #include "Hash.hpp"
 
+#include <string.h>
+
 constexpr uint64_t FNVPrime64   = 0x00000100000001b3ULL;
 constexpr uint64_t FNVOffset64  = 0xcbf29ce484222325ULL;
 
@@ -14,3 +16,49 @@ uint32_t FNV1a::operator()()
     }
     return static_cast<uint32_t>((hash >> 32) ^ (hash & 0x00000000ffffffff));
 }
+
+constexpr uint64_t LanePrime1   = 0x9e3779b185ebca87ULL;
+constexpr uint64_t LanePrime2   = 0xc2b2ae3d27d4eb4fULL;
+
+static uint64_t rotateLeft(uint64_t x, int bits)
+{
+    return (x << bits) | (x >> (64 - bits));
+}
+
+static uint64_t hashLane(uint64_t lane, uint64_t input)
+{
+    lane += input * LanePrime2;
+    lane = rotateLeft(lane, 31);
+    return lane * LanePrime1;
+}
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed)
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    uint64_t lanes[4] = { seed + LanePrime1 + LanePrime2, seed + LanePrime2, seed, seed - LanePrime1 };
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        uint64_t input[4];
+        memcpy(input, bytes + i, 32);
+        for (int l = 0; l < 4; l++) lanes[l] = hashLane(lanes[l], input[l]);
+    }
+
+    uint64_t hash = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) +
+                    rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+    hash ^= static_cast<uint64_t>(size);
+
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t input;
+        memcpy(&input, bytes + i, 8);
+        hash = mix64(hash ^ hashLane(0, input));
+    }
+    for (; i < size; i++)
+    {
+        hash = mix64(hash ^ (bytes[i] * LanePrime1));
+    }
+
+    return mix64(hash);
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <stdint.h>
+#include <stddef.h>
 
 // Undefine min and max, because they mess up with the required type interface
 // UniformRandomBitGenerator
@@ -12,6 +13,30 @@
 #undef max
 #endif
 
+// Finalizer of MurmurHash3. Every input bit affects every output bit, which makes
+// the result usable as such for power-of-two sized hash tables.
+inline uint64_t mix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+// Hashes three 32-bit values, e.g. index triplets
+inline uint64_t hash3x32(uint32_t a, uint32_t b, uint32_t c)
+{
+    uint64_t h = (static_cast<uint64_t>(a) << 32) | b;
+    h = mix64(h ^ (static_cast<uint64_t>(c) * 0x9e3779b97f4a7c15ULL));
+    return h;
+}
+
+// Hashes a block of memory, e.g. the contents of a file. Processes 32 bytes per
+// iteration in four independent lanes, so it runs close to memory bandwidth.
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0);
+
 class FNV1a
 {
 public:
@@ -0,0 +1,35 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    Log.cpp
+*/
+
+#include "Log.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <cstdio>
+#endif
+
+void logError(const std::string& msg)
+{
+#ifdef _WIN32
+    OutputDebugString(msg.c_str());
+#else
+    fputs(msg.c_str(), stderr);
+#endif
+}
+
+void logInfo(const std::string& msg)
+{
+#ifdef SP_VERBOSE_LOG
+#ifdef _WIN32
+    OutputDebugString(msg.c_str());
+#else
+    fputs(msg.c_str(), stdout);
+#endif
+#else
+    (void)msg;
+#endif
+}
@@ -0,0 +1,15 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    Log.hpp
+
+    Messages go to the debugger output on Windows, and to stderr (errors) or
+    stdout (info) elsewhere. Info messages are only written, when the project
+    is built with SP_VERBOSE_LOG.
+*/
+
+#pragma once
+
+#include <string>
+
+void logError(const std::string& msg);
+void logInfo(const std::string& msg);
@@ -0,0 +1,184 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    Lz4.cpp
+*/
+
+#include "Lz4.hpp"
+
+#include <cstring>
+
+namespace
+{
+    constexpr uint32_t MinMatch         = 4;
+    constexpr uint32_t HashBits         = 16;
+    constexpr uint32_t MaxOffset        = 65535;
+
+    // The format requires the last match to start this far from the end,
+    // and the last bytes to be literals
+    constexpr size_t   MatchSearchLimit = 12;
+    constexpr size_t   LastLiterals     = 5;
+
+    uint32_t read32(const uint8_t* p)
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    uint32_t hash4(uint32_t sequence)
+    {
+        return (sequence * 2654435761u) >> (32 - HashBits);
+    }
+
+    void writeLength(std::vector<uint8_t>& dst, size_t length)
+    {
+        for (; length >= 255; length -= 255) dst.emplace_back(static_cast<uint8_t>(255));
+        dst.emplace_back(static_cast<uint8_t>(length));
+    }
+
+    void writeSequence(std::vector<uint8_t>& dst, const uint8_t* literals, size_t numLiterals,
+                       size_t offset, size_t matchLength)
+    {
+        size_t extraMatch = (matchLength >= MinMatch) ? matchLength - MinMatch : 0;
+        uint8_t token = static_cast<uint8_t>(((numLiterals < 15) ? numLiterals : 15) << 4);
+        if (matchLength > 0) token |= static_cast<uint8_t>((extraMatch < 15) ? extraMatch : 15);
+        dst.emplace_back(token);
+
+        if (numLiterals >= 15) writeLength(dst, numLiterals - 15);
+        dst.insert(dst.end(), literals, literals + numLiterals);
+
+        if (matchLength == 0) return;   // The last sequence has only literals
+
+        dst.emplace_back(static_cast<uint8_t>(offset & 0xff));
+        dst.emplace_back(static_cast<uint8_t>(offset >> 8));
+        if (extraMatch >= 15) writeLength(dst, extraMatch - 15);
+    }
+
+    // Returns false, if the length runs past the end of the input
+    bool readLength(const uint8_t*& p, const uint8_t* end, size_t& length)
+    {
+        uint8_t byte;
+        do
+        {
+            if (p >= end) return false;
+            byte    = *p++;
+            length  += byte;
+        } while (byte == 255);
+        return true;
+    }
+}
+
+namespace lz4
+{
+    size_t maxCompressedSize(size_t size)
+    {
+        return size + size / 255 + 16;
+    }
+
+    size_t compress(Range<const uint8_t> src, std::vector<uint8_t>& dst)
+    {
+        size_t startSize = dst.size();
+        dst.reserve(startSize + maxCompressedSize(src.size()));
+
+        const uint8_t* begin    = src.begin();
+        const uint8_t* anchor   = begin;
+        size_t size             = src.size();
+
+        if (size > MatchSearchLimit)
+        {
+            std::vector<uint32_t> table(static_cast<size_t>(1) << HashBits, 0);
+            const uint8_t* matchLimit = begin + size - LastLiterals;
+
+            size_t pos = 0;
+            while (pos + MatchSearchLimit <= size)
+            {
+                const uint8_t* p    = begin + pos;
+                uint32_t sequence   = read32(p);
+                uint32_t& slot      = table[hash4(sequence)];
+                size_t candidate    = slot;
+                slot                = static_cast<uint32_t>(pos);
+
+                if ((candidate >= pos) || (pos - candidate > MaxOffset) || (read32(begin + candidate) != sequence))
+                {
+                    pos++;
+                    continue;
+                }
+
+                // Extend the match forwards, and backwards over the pending literals
+                const uint8_t* match    = begin + candidate;
+                size_t length           = MinMatch;
+                while ((p + length < matchLimit) && (p[length] == match[length])) length++;
+                while ((p > anchor) && (match > begin) && (p[-1] == match[-1]))
+                {
+                    p--;
+                    match--;
+                    length++;
+                }
+
+                writeSequence(dst, anchor, static_cast<size_t>(p - anchor), static_cast<size_t>(p - match), length);
+
+                pos     = static_cast<size_t>(p - begin) + length;
+                anchor  = begin + pos;
+
+                // Index a position inside the match, so that repeating data is found quickly
+                if (pos >= 2 && pos + MatchSearchLimit <= size)
+                {
+                    table[hash4(read32(begin + pos - 2))] = static_cast<uint32_t>(pos - 2);
+                }
+            }
+        }
+
+        writeSequence(dst, anchor, static_cast<size_t>(begin + size - anchor), 0, 0);
+        return dst.size() - startSize;
+    }
+
+    bool decompress(Range<const uint8_t> src, Range<uint8_t> dst)
+    {
+        const uint8_t* p    = src.begin();
+        const uint8_t* end  = src.end();
+        uint8_t* out        = dst.begin();
+        uint8_t* outEnd     = dst.end();
+
+        while (p < end)
+        {
+            uint8_t token = *p++;
+
+            size_t numLiterals = token >> 4;
+            if ((numLiterals == 15) && !readLength(p, end, numLiterals)) return false;
+            if ((numLiterals > static_cast<size_t>(end - p)) || (numLiterals > static_cast<size_t>(outEnd - out)))
+            {
+                return false;
+            }
+            memcpy(out, p, numLiterals);
+            p   += numLiterals;
+            out += numLiterals;
+
+            if (p == end) break;    // The last sequence has only literals
+
+            if (end - p < 2) return false;
+            size_t offset = p[0] | (static_cast<size_t>(p[1]) << 8);
+            p += 2;
+            if ((offset == 0) || (offset > static_cast<size_t>(out - dst.begin()))) return false;
+
+            size_t length = token & 15;
+            if ((length == 15) && !readLength(p, end, length)) return false;
+            length += MinMatch;
+            if (length > static_cast<size_t>(outEnd - out)) return false;
+
+            // Matches may overlap their output, e.g. runs have offset 1, so copy byte by byte
+            // unless the source is far enough behind
+            const uint8_t* match = out - offset;
+            if (offset >= length)
+            {
+                memcpy(out, match, length);
+                out += length;
+            }
+            else
+            {
+                for (size_t i = 0; i < length; i++) *out++ = *match++;
+            }
+        }
+
+        return out == outEnd;
+    }
+}
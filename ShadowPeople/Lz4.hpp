@@ -0,0 +1,28 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    Lz4.hpp
+
+    Compression in the LZ4 block format. The compressor is the fast greedy
+    one with a single hash table, which favours speed over ratio. The
+    decompressor checks all the offsets and lengths, so corrupted data
+    fails instead of reading or writing out of bounds.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "Types.hpp"
+
+namespace lz4
+{
+    // Upper bound of the compressed size, for incompressible data
+    size_t maxCompressedSize(size_t size);
+
+    // Appends the compressed block to dst, returns its size
+    size_t compress(Range<const uint8_t> src, std::vector<uint8_t>& dst);
+
+    // The size of the decompressed data must be known, and dst must be exactly that size
+    bool decompress(Range<const uint8_t> src, Range<uint8_t> dst);
+}
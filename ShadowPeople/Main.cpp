@@ -9,6 +9,9 @@
 #include "graphics/Graphics.hpp"
 
 #include "asset/AssetLoader.hpp"
+#include "asset/AssetStreamer.hpp"
+#include "asset/AssetCache.hpp"
+#include "asset/PackFile.hpp"
 
 #include "input/InputHandler.hpp"
 #include "input/ImGuiInputHandler.hpp"
@@ -52,12 +55,20 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
     HWND hWnd = createWindow(hInstance);
     SP_EXPECT_NOT_NULL_RET(hWnd, ERROR_CODE_WINDOW_CREATION_FAILED, ERROR_CODE_WINDOW_CREATION_FAILED);
 
+    // Mount the asset pack, if one has been built with PackTool. Files missing from it are
+    // read from the data directory.
+    asset::PackFile assetPack;
+    assetPack.open("data.pack");
+
+    // Create the cache of processed assets first, because the device uses it for shaders
+    asset::AssetCache assetCache("data/cache", &assetPack);
+
     // Create graphics device
     int2 screenSize = getScreenSize(hWnd);
-    graphics::Device device(hWnd, screenSize);
+    graphics::Device device(hWnd, screenSize, &assetCache);
 
     // Create caches for geometry and material
-    rendering::GeometryCache geometry(device);
+    rendering::GeometryCache geometry(device, rendering::VertexFormat::Packed);
     rendering::MaterialCache materials(device);
     rendering::PatchCache patches(device);
 
@@ -65,8 +76,9 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
     sound::SoundDevice soundDevice;
     sound::Mixer soundMixer(soundDevice.getFormat());
 
-    // Create asset loader
-    asset::AssetLoader assetLoader(geometry, materials);
+    // Create asset loader and the background streamer that uses it
+    asset::AssetLoader assetLoader(geometry, materials, &assetCache, &assetPack);
+    asset::AssetStreamer assetStreamer(assetLoader);
 
     // Create terrain patch generator
     rendering::PatchGenerator patchGenerator(patches);
@@ -74,9 +86,9 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
     // Initialize game logic
     std::shared_ptr<game::GameLogic> gameLogic = std::make_shared<game::GameLogic>(screenSize);
 
-    // Load test scene
+    // Start streaming the test scene - it fills in while we render
     rendering::Scene scene(gameLogic->camera());
-    if (!assetLoader.loadScene("data/scenes/testscene.scn", scene))
+    if (!assetLoader.streamScene("data/scenes/testscene.scn", scene, assetStreamer))
     {
         OutputDebugString("Scene load failed!");
     }
@@ -99,6 +111,7 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
 
     // Main loop
     MSG msg	= {};
+    std::vector<rendering::AtlasRelocation> materialRelocations;
     while (!exitApplication)
     {
         // Check if the GUI has captured input devices, so that they don't go to he game input handler
@@ -123,6 +136,14 @@ int CALLBACK WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
         gameInputHandler->tick();
         imGuiInputHandler->tick(hWnd);
 
+        // Hand the finished assets over to the caches
+        assetStreamer.dispatchCompleted();
+
+        // Compact the material cache a little at a time, and point the materials to where they moved
+        materialRelocations.clear();
+        materials.defragment(materialRelocations);
+        scene.patchMaterialRects(materialRelocations);
+
         // Draw frame
         graphics::CommandBuffer gfx = device.createCommandBuffer();
         sceneRenderer.render(gfx, scene);
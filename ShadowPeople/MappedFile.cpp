@@ -0,0 +1,300 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    MappedFile.cpp
+*/
+
+#include "MappedFile.hpp"
+#include "Log.hpp"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef _WIN32
+
+// The OS specific part of the mapping. Only this class touches the OS handles.
+class MappedFile::Mapping
+{
+public:
+    Mapping(const std::string& filename, AccessPattern pattern)
+    {
+        DWORD flags = FILE_ATTRIBUTE_NORMAL;
+        if (pattern == AccessPattern::Sequential) flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+        if (pattern == AccessPattern::Random)     flags |= FILE_FLAG_RANDOM_ACCESS;
+
+        m_file = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+                            OPEN_EXISTING, flags, NULL);
+        if (m_file == INVALID_HANDLE_VALUE)
+        {
+            if (GetLastError() == ERROR_FILE_NOT_FOUND)
+            {
+                logError(std::string("Could not find ").append(filename).append("\n"));
+            }
+            return;
+        }
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(m_file, &fileSize))
+        {
+            logError("Unable to read file size\n");
+            return;
+        }
+        m_size = static_cast<uint64_t>(fileSize.QuadPart);
+
+        // Empty files cannot be mapped, but they are still valid files
+        if (m_size == 0)
+        {
+            m_valid = true;
+            return;
+        }
+
+        if (m_size > static_cast<uint64_t>(SIZE_MAX))
+        {
+            logError(std::string("File too big to map into the address space: ").append(filename).append("\n"));
+            return;
+        }
+
+        m_fileMapping = CreateFileMapping(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (m_fileMapping == NULL)
+        {
+            logError(std::string("Could not create file mapping for ").append(filename).append("\n"));
+            return;
+        }
+
+        m_data = static_cast<const uint8_t*>(MapViewOfFile(m_fileMapping, FILE_MAP_READ, 0, 0, 0));
+        if (m_data == nullptr)
+        {
+            logError(std::string("Could not map view of ").append(filename).append("\n"));
+            return;
+        }
+
+        m_valid = true;
+    }
+
+    ~Mapping()
+    {
+        if (m_data)                         UnmapViewOfFile(m_data);
+        if (m_fileMapping)                  CloseHandle(m_fileMapping);
+        if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+    }
+
+    Mapping(const Mapping&)             = delete;
+    Mapping& operator=(const Mapping&)  = delete;
+
+    void prefetch(const uint8_t* begin, uint64_t size) const
+    {
+        // PrefetchVirtualMemory() exists only on Windows 8 and later, so look it up at runtime
+        struct MemoryRange
+        {
+            PVOID   address;
+            SIZE_T  numberOfBytes;
+        };
+        using PrefetchFunc = BOOL (WINAPI *)(HANDLE, ULONG_PTR, MemoryRange*, ULONG);
+        static PrefetchFunc prefetchVirtualMemory = reinterpret_cast<PrefetchFunc>(
+            GetProcAddress(GetModuleHandle("kernel32.dll"), "PrefetchVirtualMemory"));
+
+        if (prefetchVirtualMemory)
+        {
+            MemoryRange range = { const_cast<uint8_t*>(begin), static_cast<SIZE_T>(size) };
+            prefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+        }
+    }
+
+    bool            valid() const   { return m_valid; }
+    const uint8_t*  data() const    { return m_data; }
+    uint64_t        size() const    { return m_size; }
+private:
+    HANDLE          m_file          = INVALID_HANDLE_VALUE;
+    HANDLE          m_fileMapping   = NULL;
+    const uint8_t*  m_data          = nullptr;
+    uint64_t        m_size          = 0;
+    bool            m_valid         = false;
+};
+
+bool MappedFile::lastWriteTime(const std::string& filename, uint64_t& time)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesEx(filename.c_str(), GetFileExInfoStandard, &attributes)) return false;
+
+    ULARGE_INTEGER u;
+    u.LowPart   = attributes.ftLastWriteTime.dwLowDateTime;
+    u.HighPart  = attributes.ftLastWriteTime.dwHighDateTime;
+    time        = u.QuadPart;
+    return true;
+}
+
+bool MappedFile::exists(const std::string& filename)
+{
+    DWORD attributes = GetFileAttributes(filename.c_str());
+    return (attributes != INVALID_FILE_ATTRIBUTES) && !(attributes & FILE_ATTRIBUTE_DIRECTORY);
+}
+
+#else   // POSIX
+
+class MappedFile::Mapping
+{
+public:
+    Mapping(const std::string& filename, AccessPattern pattern)
+    {
+        m_file = open(filename.c_str(), O_RDONLY);
+        if (m_file < 0)
+        {
+            logError(std::string("Could not find ").append(filename).append("\n"));
+            return;
+        }
+
+        struct stat fileStat;
+        if (fstat(m_file, &fileStat) != 0)
+        {
+            logError("Unable to read file size\n");
+            return;
+        }
+        m_size = static_cast<uint64_t>(fileStat.st_size);
+
+        // Empty files cannot be mapped, but they are still valid files
+        if (m_size == 0)
+        {
+            m_valid = true;
+            return;
+        }
+
+        if (m_size > static_cast<uint64_t>(SIZE_MAX))
+        {
+            logError(std::string("File too big to map into the address space: ").append(filename).append("\n"));
+            return;
+        }
+
+        void* data = mmap(nullptr, static_cast<size_t>(m_size), PROT_READ, MAP_PRIVATE, m_file, 0);
+        if (data == MAP_FAILED)
+        {
+            logError(std::string("Could not map ").append(filename).append("\n"));
+            return;
+        }
+        m_data = static_cast<const uint8_t*>(data);
+
+        int advice = (pattern == AccessPattern::Sequential) ? MADV_SEQUENTIAL :
+                     (pattern == AccessPattern::Random)     ? MADV_RANDOM :
+                     MADV_NORMAL;
+        madvise(data, static_cast<size_t>(m_size), advice);
+
+        m_valid = true;
+    }
+
+    ~Mapping()
+    {
+        if (m_data)         munmap(const_cast<uint8_t*>(m_data), static_cast<size_t>(m_size));
+        if (m_file >= 0)    close(m_file);
+    }
+
+    Mapping(const Mapping&)             = delete;
+    Mapping& operator=(const Mapping&)  = delete;
+
+    void prefetch(const uint8_t* begin, uint64_t size) const
+    {
+        // madvise() requires a page aligned start address
+        static const uintptr_t PageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        uintptr_t start = reinterpret_cast<uintptr_t>(begin) & ~(PageSize - 1);
+        uintptr_t end   = reinterpret_cast<uintptr_t>(begin) + static_cast<uintptr_t>(size);
+        madvise(reinterpret_cast<void*>(start), static_cast<size_t>(end - start), MADV_WILLNEED);
+    }
+
+    bool            valid() const   { return m_valid; }
+    const uint8_t*  data() const    { return m_data; }
+    uint64_t        size() const    { return m_size; }
+private:
+    int             m_file  = -1;
+    const uint8_t*  m_data  = nullptr;
+    uint64_t        m_size  = 0;
+    bool            m_valid = false;
+};
+
+bool MappedFile::lastWriteTime(const std::string& filename, uint64_t& time)
+{
+    struct stat fileStat;
+    if (stat(filename.c_str(), &fileStat) != 0) return false;
+
+    // Convert from the Unix epoch to the Win32 epoch, so that the times are comparable on all platforms
+    constexpr uint64_t SecondsFrom1601To1970 = 11644473600ULL;
+    constexpr uint64_t TicksPerSecond        = 10000000ULL;
+    uint64_t seconds = static_cast<uint64_t>(fileStat.st_mtime) + SecondsFrom1601To1970;
+#ifdef __APPLE__
+    uint64_t subSecondTicks = static_cast<uint64_t>(fileStat.st_mtimespec.tv_nsec) / 100;
+#else
+    uint64_t subSecondTicks = static_cast<uint64_t>(fileStat.st_mtim.tv_nsec) / 100;
+#endif
+    time = seconds * TicksPerSecond + subSecondTicks;
+    return true;
+}
+
+bool MappedFile::exists(const std::string& filename)
+{
+    struct stat fileStat;
+    return (stat(filename.c_str(), &fileStat) == 0) && S_ISREG(fileStat.st_mode);
+}
+
+#endif
+
+MappedFile::MappedFile(const std::string& filename, AccessPattern pattern)
+{
+    auto mapping = std::make_shared<Mapping>(filename, pattern);
+    if (!mapping->valid()) return;
+
+    m_mapping   = mapping;
+    m_begin     = mapping->data();
+    m_size      = mapping->size();
+}
+
+MappedFile MappedFile::fromMemory(std::vector<uint8_t>&& data)
+{
+    MappedFile file;
+    auto memory     = std::make_shared<const std::vector<uint8_t>>(std::move(data));
+    file.m_begin    = memory->data();
+    file.m_size     = memory->size();
+    file.m_memory   = memory;
+    return file;
+}
+
+Range<const uint8_t> MappedFile::bytes() const
+{
+    return Range<const uint8_t>(m_begin, static_cast<size_t>(m_size));
+}
+
+Range<const uint8_t> MappedFile::bytes(uint64_t offset, uint64_t size) const
+{
+    if (offset >= m_size) return Range<const uint8_t>();
+    size = std::min<uint64_t>(size, m_size - offset);
+    return Range<const uint8_t>(m_begin + offset, static_cast<size_t>(size));
+}
+
+MappedFile MappedFile::subRange(uint64_t offset, uint64_t size) const
+{
+    MappedFile view;
+    if (!valid() || (offset > m_size)) return view;
+
+    view.m_mapping  = m_mapping;
+    view.m_memory   = m_memory;
+    view.m_begin    = m_begin + offset;
+    view.m_size     = std::min<uint64_t>(size, m_size - offset);
+    return view;
+}
+
+void MappedFile::prefetch() const
+{
+    prefetch(0, m_size);
+}
+
+void MappedFile::prefetch(uint64_t offset, uint64_t size) const
+{
+    // Memory buffers are resident already
+    if (!m_mapping || (offset >= m_size) || (m_begin == nullptr)) return;
+    size = std::min<uint64_t>(size, m_size - offset);
+    m_mapping->prefetch(m_begin + offset, size);
+}
@@ -0,0 +1,71 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    MappedFile.hpp
+
+    Read-only memory-mapped file access. The file contents are exposed as
+    Range views directly into the mapping, so nothing is copied. Copies of a
+    MappedFile share the same mapping, which is released when the last copy
+    goes away. The backend is POSIX mmap or Win32 file mapping, depending on
+    the platform.
+
+    A MappedFile can also own a buffer in memory, e.g. a decompressed entry
+    of a pack file, so that the users do not need to care where the bytes
+    came from.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <memory>
+#include <vector>
+
+#include "Types.hpp"
+
+class MappedFile
+{
+public:
+    // Hints to the OS about how the mapping is going to be accessed
+    enum class AccessPattern
+    {
+        Normal,
+        Sequential,
+        Random
+    };
+
+    MappedFile() = default;
+    MappedFile(const std::string& filename, AccessPattern pattern = AccessPattern::Normal);
+
+    // Takes the ownership of the data
+    static MappedFile fromMemory(std::vector<uint8_t>&& data);
+
+    bool     valid() const { return (m_mapping != nullptr) || (m_memory != nullptr); }
+    uint64_t size() const  { return m_size; }
+
+    Range<const uint8_t> bytes() const;
+    Range<const uint8_t> bytes(uint64_t offset, uint64_t size) const;
+
+    template<typename T>
+    Range<const T> asRange() const
+    {
+        return Range<const T>(reinterpret_cast<const T*>(m_begin), static_cast<size_t>(m_size));
+    }
+
+    // Returns a view to a part of this file that keeps the whole mapping alive
+    MappedFile subRange(uint64_t offset, uint64_t size) const;
+
+    // Asks the OS to start paging in the given part of the file in the background
+    void prefetch() const;
+    void prefetch(uint64_t offset, uint64_t size) const;
+
+    // Modification time in 100 ns ticks since 1601-01-01 (the Win32 FILETIME epoch) on all platforms
+    static bool lastWriteTime(const std::string& filename, uint64_t& time);
+    static bool exists(const std::string& filename);
+private:
+    class Mapping;
+
+    std::shared_ptr<Mapping>                    m_mapping;
+    std::shared_ptr<const std::vector<uint8_t>> m_memory;
+    const uint8_t*                              m_begin = nullptr;
+    uint64_t                                    m_size  = 0;
+};
@@ -2,6 +2,10 @@
 #include "Errors.hpp"
 #include <intrin.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
 namespace math
 {
     uint32_t log2(uint32_t value)
@@ -47,13 +51,34 @@ namespace math
 		return mat;
 	}
 
-	Matrix4x4 rotationMatrix(float yaw, float pitch, float roll)
-	{
-		Matrix4x4 mat = rotateAroundY(yaw);
-		if (pitch != 0.f) mat = rotateAroundX(pitch) * mat;
-		if (roll != 0.f) mat = rotateAroundZ(roll) * mat;
-		return mat;
-	}
+    // The products written out, so that there are no matrix multiplications, and each angle
+    // needs one sincos
+    template<Accuracy A>
+    Matrix4x4 rotationMatrix(float yaw, float pitch, float roll)
+    {
+        float sy, cy, sp, cp, sr, cr;
+        sincos<A>(yaw, sy, cy);
+        sincos<A>(pitch, sp, cp);
+        sincos<A>(roll, sr, cr);
+
+        // Rows of rotateAroundX(pitch) * rotateAroundY(yaw)
+        float3 r0{ cy, 0.f, -sy };
+        float3 r1{ -sp * sy, cp, -sp * cy };
+        float3 r2{ cp * sy, sp, cp * cy };
+
+        Matrix4x4 mat;
+        for (int i = 0; i < 3; i++)
+        {
+            mat(0, i) = cr * r0[i] - sr * r1[i];
+            mat(1, i) = sr * r0[i] + cr * r1[i];
+            mat(2, i) = r2[i];
+        }
+        return mat;
+    }
+
+    template Matrix4x4 rotationMatrix<Accuracy::Full>(float yaw, float pitch, float roll);
+    template Matrix4x4 rotationMatrix<Accuracy::High>(float yaw, float pitch, float roll);
+    template Matrix4x4 rotationMatrix<Accuracy::Low>(float yaw, float pitch, float roll);
 
     float2 octaWrap(float2 v)
     {
@@ -91,4 +116,109 @@ namespace math
         n[1] += n[1] >= 0.f ? -t : t;
         return normalize(n);
     }
+
+    uint16_t floatToHalf(float f)
+    {
+        uint32_t bits;
+        memcpy(&bits, &f, sizeof(bits));
+
+        uint32_t sign       = (bits >> 16) & 0x8000;
+        uint32_t mantissa   = bits & 0x7fffff;
+        int32_t exponent    = static_cast<int32_t>((bits >> 23) & 0xff) - 127 + 15;
+
+        // Infinity and NaN
+        if (((bits >> 23) & 0xff) == 0xff) return static_cast<uint16_t>(sign | 0x7c00 | (mantissa ? 0x200 : 0));
+
+        if (exponent >= 31) return static_cast<uint16_t>(sign | 0x7c00);
+
+        uint32_t half;
+        uint32_t shift;
+        if (exponent <= 0)
+        {
+            // Denormal, or zero if less than half of the smallest denormal
+            if (exponent < -10) return static_cast<uint16_t>(sign);
+            mantissa |= 0x800000;
+            shift = static_cast<uint32_t>(14 - exponent);
+            half = mantissa >> shift;
+        }
+        else
+        {
+            shift = 13;
+            half = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> shift);
+        }
+
+        // Rounding may carry to the exponent, which is still correct
+        uint32_t rest       = mantissa & ((1u << shift) - 1);
+        uint32_t halfway    = 1u << (shift - 1);
+        if ((rest > halfway) || ((rest == halfway) && (half & 1))) half++;
+
+        return static_cast<uint16_t>(sign | half);
+    }
+
+    float halfToFloat(uint16_t h)
+    {
+        uint32_t sign       = static_cast<uint32_t>(h & 0x8000) << 16;
+        uint32_t exponent   = (h >> 10) & 0x1f;
+        uint32_t mantissa   = h & 0x3ff;
+
+        if (exponent == 0)
+        {
+            float f = ldexpf(static_cast<float>(mantissa), -24);
+            return sign ? -f : f;
+        }
+
+        uint32_t bits = (exponent == 31) ? (sign | 0x7f800000 | (mantissa << 13)) :
+                                           (sign | ((exponent + 112) << 23) | (mantissa << 13));
+        float f;
+        memcpy(&f, &bits, sizeof(f));
+        return f;
+    }
+
+    uint32_t encodeQTangent(float4 q, float bitangentSign)
+    {
+        // The other components are within +-1/sqrt(2), so they are scaled to fill the range
+        const float Sqrt2 = 1.41421356f;
+
+        int largest = 0;
+        for (int i = 1; i < 4; i++)
+        {
+            if (fabsf(q[i]) > fabsf(q[largest])) largest = i;
+        }
+        float length = q.length();
+        float scale = ((q[largest] < 0.f) ? -Sqrt2 : Sqrt2) / ((length > 0.f) ? length : 1.f);
+
+        uint32_t packed = (static_cast<uint32_t>(largest) << 27) | ((bitangentSign < 0.f) ? (1u << 29) : 0u);
+        uint32_t shift = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            if (i == largest) continue;
+
+            float c = std::max<float>(-1.f, std::min<float>(1.f, q[i] * scale));
+            packed |= static_cast<uint32_t>(static_cast<int>(roundf(c * 255.f)) + 256) << shift;
+            shift += 9;
+        }
+        return packed;
+    }
+
+    float4 decodeQTangent(uint32_t packed, float& bitangentSign)
+    {
+        const float InvSqrt2 = 0.70710678f;
+
+        int largest     = (packed >> 27) & 3;
+        bitangentSign   = ((packed >> 29) & 1) ? -1.f : 1.f;
+
+        float4 q;
+        float sum = 0.f;
+        uint32_t shift = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            if (i == largest) continue;
+
+            q[i] = (static_cast<int>((packed >> shift) & 0x1ff) - 256) / 255.f * InvSqrt2;
+            sum += q[i] * q[i];
+            shift += 9;
+        }
+        q[largest] = sqrtf(std::max<float>(0.f, 1.f - sum));
+        return q;
+    }
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 #pragma once
 
 #include "Types.hpp"
+#include "FastMath.hpp"
 
 namespace math
 {
@@ -30,8 +31,21 @@ namespace math
 	Matrix4x4 rotateAroundY(float angle);
 	Matrix4x4 rotateAroundX(float angle);
 	Matrix4x4 rotateAroundZ(float angle);
+
+    // Same as rotateAroundZ(roll) * rotateAroundX(pitch) * rotateAroundY(yaw)
+    template<Accuracy A = Accuracy::Full>
 	Matrix4x4 rotationMatrix(float yaw, float pitch = 0.f, float roll = 0.f);
 
     float2 encodeOctahedral(float3 n);
     float3 decodeOctahedral(float2 f);
+
+    // IEEE half precision, rounded to nearest even. Decodes like f16tof32() in HLSL.
+    uint16_t floatToHalf(float f);
+    float halfToFloat(uint16_t h);
+
+    // Tangent frame quaternion and bitangent sign in 32 bits. The three smallest components
+    // take 9 bits each, followed by the index of the largest one in 2 bits and the sign in 1 bit.
+    // The largest component is made positive, which does not change the rotation.
+    uint32_t encodeQTangent(float4 q, float bitangentSign);
+    float4 decodeQTangent(uint32_t packed, float& bitangentSign);
 }
@@ -0,0 +1,141 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    Parallel.cpp
+*/
+
+#include "Parallel.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+    struct Job
+    {
+        const std::function<void(uint32_t begin, uint32_t end)>* body;
+        uint32_t count;
+        uint32_t numBatches;
+        uint32_t nextBatch;     // The rest are guarded by the mutex of the pool
+        uint32_t unfinished;
+    };
+
+    // Workers for the batches of all the calls, started on the first call. A job is in the queue
+    // until all its batches have been taken, and the callers take batches of their own jobs too.
+    // Nobody waits for a batch that has not been taken, so nested calls cannot deadlock.
+    class ThreadPool
+    {
+    public:
+        explicit ThreadPool(uint32_t numThreads) :
+            m_quit(false)
+        {
+            for (uint32_t i = 0; i < numThreads; i++) m_threads.emplace_back(&ThreadPool::workerThread, this);
+        }
+
+        ~ThreadPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_quit = true;
+            }
+            m_workAvailable.notify_all();
+            for (auto& thread : m_threads) thread.join();
+        }
+
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        void run(Job& job)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_jobs.emplace_back(&job);
+            }
+            m_workAvailable.notify_all();
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            while (job.nextBatch < job.numBatches)
+            {
+                uint32_t batch = takeBatch(job);
+                lock.unlock();
+                runBatch(job, batch);
+                lock.lock();
+                job.unfinished--;
+            }
+            m_jobDone.wait(lock, [&job] { return job.unfinished == 0; });
+        }
+    private:
+        // Called with the mutex held
+        uint32_t takeBatch(Job& job)
+        {
+            uint32_t batch = job.nextBatch++;
+            if (job.nextBatch == job.numBatches) m_jobs.erase(std::find(m_jobs.begin(), m_jobs.end(), &job));
+            return batch;
+        }
+
+        void runBatch(const Job& job, uint32_t batch)
+        {
+            uint32_t begin  = static_cast<uint32_t>(static_cast<uint64_t>(job.count) * batch / job.numBatches);
+            uint32_t end    = static_cast<uint32_t>(static_cast<uint64_t>(job.count) * (batch + 1) / job.numBatches);
+            (*job.body)(begin, end);
+        }
+
+        void workerThread()
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            for (;;)
+            {
+                m_workAvailable.wait(lock, [this] { return m_quit || !m_jobs.empty(); });
+                if (m_quit) return;
+
+                Job& job = *m_jobs.front();
+                uint32_t batch = takeBatch(job);
+                lock.unlock();
+                runBatch(job, batch);
+                lock.lock();
+
+                // The caller may return as soon as this is zero, so the job is not touched after it
+                if (--job.unfinished == 0) m_jobDone.notify_all();
+            }
+        }
+
+        std::mutex                  m_mutex;
+        std::condition_variable     m_workAvailable;
+        std::condition_variable     m_jobDone;
+        std::deque<Job*>            m_jobs;
+        bool                        m_quit;
+
+        std::vector<std::thread>    m_threads;
+    };
+
+    uint32_t hardwareThreads()
+    {
+        return std::max(std::thread::hardware_concurrency(), 1u);
+    }
+
+    ThreadPool& threadPool()
+    {
+        static ThreadPool pool(hardwareThreads() - 1);
+        return pool;
+    }
+}
+
+void parallelFor(uint32_t count, uint32_t minBatchSize,
+                 const std::function<void(uint32_t begin, uint32_t end)>& body)
+{
+    if (count == 0) return;
+
+    uint32_t maxBatches      = (count + std::max(minBatchSize, 1u) - 1) / std::max(minBatchSize, 1u);
+    uint32_t numBatches      = std::min(hardwareThreads(), maxBatches);
+    if (numBatches <= 1)
+    {
+        body(0, count);
+        return;
+    }
+
+    Job job{ &body, count, numBatches, 0, numBatches };
+    threadPool().run(job);
+}
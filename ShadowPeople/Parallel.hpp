@@ -0,0 +1,17 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    Parallel.hpp
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+
+// Splits the range [0, count) into contiguous batches, and runs them on all hardware threads.
+// The batches go to a pool of worker threads, which is started on the first call, so calling
+// this every frame does not create threads. The calling thread takes part in the work, and the
+// call returns when all batches are done. The body may call parallelFor again.
+// Batches are never smaller than minBatchSize, so small ranges run on the calling thread only.
+void parallelFor(uint32_t count, uint32_t minBatchSize,
+                 const std::function<void(uint32_t begin, uint32_t end)>& body);
@@ -0,0 +1,51 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    Simd.cpp
+*/
+
+#include "Simd.hpp"
+
+#ifdef SP_SIMD_SSE
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace
+{
+    // ECX bits of CPUID leaf 1
+    constexpr unsigned SSSE3Bit = 1u << 9;
+    constexpr unsigned SSE41Bit = 1u << 19;
+
+    unsigned cpuFeatures()
+    {
+#if defined(SP_SIMD_SSE) && defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        return static_cast<unsigned>(info[2]);
+#elif defined(SP_SIMD_SSE)
+        unsigned eax, ebx, ecx, edx;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return 0;
+        return ecx;
+#else
+        return 0;
+#endif
+    }
+}
+
+namespace simd
+{
+    bool hasSSSE3()
+    {
+        static const bool supported = (cpuFeatures() & SSSE3Bit) != 0;
+        return supported;
+    }
+
+    bool hasSSE41()
+    {
+        static const bool supported = (cpuFeatures() & SSE41Bit) != 0;
+        return supported;
+    }
+}
@@ -0,0 +1,277 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    Simd.hpp
+
+    Compile time detection of the SIMD instruction set, and runtime queries
+    for the extensions that cannot be assumed on every CPU of the target
+    architecture. x86-64 guarantees only SSE2, so the functions that use
+    later extensions are tagged with the SP_TARGET_* macros and must only be
+    called after checking the corresponding simd::has*() function.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SP_SIMD_SSE
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#define SP_TARGET_SSSE3
+#define SP_TARGET_SSE41
+#else
+#define SP_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define SP_TARGET_SSE41 __attribute__((target("sse4.1")))
+#endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define SP_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+namespace simd
+{
+    bool hasSSSE3();
+    bool hasSSE41();
+}
+
+#if defined(SP_SIMD_SSE) || defined(SP_SIMD_NEON)
+#define SP_SIMD_FLOAT4
+
+// Four floats in a register, for the vector and matrix types. Loads and stores are unaligned,
+// so that the types keep the alignment of float, which the structures shared with the GPU need.
+// Unaligned loads of aligned data are as fast as the aligned ones.
+namespace simd
+{
+#if defined(SP_SIMD_SSE)
+    using Float4 = __m128;
+
+    inline Float4 load(const float* p)              { return _mm_loadu_ps(p); }
+    inline void store(float* p, Float4 a)           { _mm_storeu_ps(p, a); }
+    inline Float4 splat(float a)                    { return _mm_set1_ps(a); }
+    inline Float4 set(float x, float y, float z, float w) { return _mm_setr_ps(x, y, z, w); }
+    inline Float4 zero()                            { return _mm_setzero_ps(); }
+
+    inline Float4 add(Float4 a, Float4 b)           { return _mm_add_ps(a, b); }
+    inline Float4 sub(Float4 a, Float4 b)           { return _mm_sub_ps(a, b); }
+    inline Float4 mul(Float4 a, Float4 b)           { return _mm_mul_ps(a, b); }
+    inline Float4 div(Float4 a, Float4 b)           { return _mm_div_ps(a, b); }
+    inline Float4 sqrt(Float4 a)                    { return _mm_sqrt_ps(a); }
+    inline Float4 minimum(Float4 a, Float4 b)       { return _mm_min_ps(a, b); }
+    inline Float4 maximum(Float4 a, Float4 b)       { return _mm_max_ps(a, b); }
+    inline Float4 madd(Float4 a, Float4 b, Float4 c){ return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    inline Float4 abs(Float4 a)                     { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+
+    // Lane i of the result is lane I<i> of a
+    template<int X, int Y, int Z, int W>
+    inline Float4 permute(Float4 a)                 { return _mm_shuffle_ps(a, a, _MM_SHUFFLE(W, Z, Y, X)); }
+
+    // The sum of the lanes
+    inline float sum(Float4 a)
+    {
+        Float4 pairs = _mm_add_ps(a, _mm_movehl_ps(a, a));
+        return _mm_cvtss_f32(_mm_add_ss(pairs, _mm_shuffle_ps(pairs, pairs, _MM_SHUFFLE(1, 1, 1, 1))));
+    }
+
+    inline float dot(Float4 a, Float4 b)            { return sum(_mm_mul_ps(a, b)); }
+
+    // Bit i is set, if lane i of a is less than lane i of b
+    inline int lessMask(Float4 a, Float4 b)         { return _mm_movemask_ps(_mm_cmplt_ps(a, b)); }
+    inline bool allEqual(Float4 a, Float4 b)        { return _mm_movemask_ps(_mm_cmpeq_ps(a, b)) == 0xf; }
+
+    inline void transpose(Float4& r0, Float4& r1, Float4& r2, Float4& r3)
+    {
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    }
+
+    // 12 bits of precision
+    inline Float4 rsqrtEstimate(Float4 a)           { return _mm_rsqrt_ps(a); }
+
+    // Masks have all the bits of a lane set, where the comparison is true
+    inline Float4 greater(Float4 a, Float4 b)       { return _mm_cmpgt_ps(a, b); }
+    inline Float4 equal(Float4 a, Float4 b)         { return _mm_cmpeq_ps(a, b); }
+    inline Float4 notEqual(Float4 a, Float4 b)      { return _mm_cmpneq_ps(a, b); }
+    inline Float4 select(Float4 mask, Float4 a, Float4 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    inline Float4 bitAnd(Float4 a, Float4 b)        { return _mm_and_ps(a, b); }
+    inline Float4 bitXor(Float4 a, Float4 b)        { return _mm_xor_ps(a, b); }
+
+    // The bits of the lanes as integers, e.g. for building floats from their exponents
+    using Int4 = __m128i;
+
+    inline Int4 splatInt(uint32_t a)                { return _mm_set1_epi32(static_cast<int>(a)); }
+    inline Int4 asInt(Float4 a)                     { return _mm_castps_si128(a); }
+    inline Float4 asFloat(Int4 a)                   { return _mm_castsi128_ps(a); }
+    inline Int4 add(Int4 a, Int4 b)                 { return _mm_add_epi32(a, b); }
+    inline Int4 bitAnd(Int4 a, Int4 b)              { return _mm_and_si128(a, b); }
+
+    // The right shift is arithmetic
+    template<int N>
+    inline Int4 shiftLeft(Int4 a)                   { return _mm_slli_epi32(a, N); }
+    template<int N>
+    inline Int4 shiftRight(Int4 a)                  { return _mm_srai_epi32(a, N); }
+
+    // Four bytes, e.g. the channels of an RGBA8 texel, as floats and back. The stores round to
+    // the nearest integer and saturate to 0-255.
+    inline Float4 loadBytes(const uint8_t* p)
+    {
+        int32_t packed;
+        memcpy(&packed, p, 4);
+        __m128i zero = _mm_setzero_si128();
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), zero));
+    }
+
+    inline void storeBytes(uint8_t* p, Float4 a)
+    {
+        __m128i rounded = _mm_cvtps_epi32(a);
+        rounded = _mm_packs_epi32(rounded, rounded);
+        rounded = _mm_packus_epi16(rounded, rounded);
+        int32_t packed = _mm_cvtsi128_si32(rounded);
+        memcpy(p, &packed, 4);
+    }
+#else
+    using Float4 = float32x4_t;
+
+    inline Float4 load(const float* p)              { return vld1q_f32(p); }
+    inline void store(float* p, Float4 a)           { vst1q_f32(p, a); }
+    inline Float4 splat(float a)                    { return vdupq_n_f32(a); }
+    inline Float4 zero()                            { return vdupq_n_f32(0.f); }
+
+    inline Float4 set(float x, float y, float z, float w)
+    {
+        float lanes[4] = { x, y, z, w };
+        return vld1q_f32(lanes);
+    }
+
+    inline Float4 add(Float4 a, Float4 b)           { return vaddq_f32(a, b); }
+    inline Float4 sub(Float4 a, Float4 b)           { return vsubq_f32(a, b); }
+    inline Float4 mul(Float4 a, Float4 b)           { return vmulq_f32(a, b); }
+    inline Float4 minimum(Float4 a, Float4 b)       { return vminq_f32(a, b); }
+    inline Float4 maximum(Float4 a, Float4 b)       { return vmaxq_f32(a, b); }
+    inline Float4 madd(Float4 a, Float4 b, Float4 c){ return vmlaq_f32(c, a, b); }
+    inline Float4 abs(Float4 a)                     { return vabsq_f32(a); }
+
+    template<int X, int Y, int Z, int W>
+    inline Float4 permute(Float4 a)
+    {
+        Float4 r = vdupq_n_f32(vgetq_lane_f32(a, X));
+        r = vsetq_lane_f32(vgetq_lane_f32(a, Y), r, 1);
+        r = vsetq_lane_f32(vgetq_lane_f32(a, Z), r, 2);
+        return vsetq_lane_f32(vgetq_lane_f32(a, W), r, 3);
+    }
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+    inline Float4 div(Float4 a, Float4 b)           { return vdivq_f32(a, b); }
+    inline Float4 sqrt(Float4 a)                    { return vsqrtq_f32(a); }
+    inline float sum(Float4 a)                      { return vaddvq_f32(a); }
+#else
+    // ARMv7 has no division, so the reciprocal estimate is refined to full precision
+    inline Float4 div(Float4 a, Float4 b)
+    {
+        Float4 reciprocal = vrecpeq_f32(b);
+        reciprocal = vmulq_f32(vrecpsq_f32(b, reciprocal), reciprocal);
+        reciprocal = vmulq_f32(vrecpsq_f32(b, reciprocal), reciprocal);
+        return vmulq_f32(a, reciprocal);
+    }
+
+    // Nor square root, so the reciprocal square root is refined instead. It is infinite for zero,
+    // so zero is passed through as is.
+    inline Float4 sqrt(Float4 a)
+    {
+        Float4 estimate = vrsqrteq_f32(a);
+        estimate = vmulq_f32(vrsqrtsq_f32(vmulq_f32(a, estimate), estimate), estimate);
+        estimate = vmulq_f32(vrsqrtsq_f32(vmulq_f32(a, estimate), estimate), estimate);
+        uint32x4_t zero = vceqq_f32(a, vdupq_n_f32(0.f));
+        return vbslq_f32(zero, a, vmulq_f32(a, estimate));
+    }
+
+    inline float sum(Float4 a)
+    {
+        float32x2_t pairs = vadd_f32(vget_low_f32(a), vget_high_f32(a));
+        return vget_lane_f32(vpadd_f32(pairs, pairs), 0);
+    }
+#endif
+
+    inline float dot(Float4 a, Float4 b)            { return sum(vmulq_f32(a, b)); }
+
+    inline int lessMask(Float4 a, Float4 b)
+    {
+        static const uint32_t bits[4] = { 1, 2, 4, 8 };
+        uint32x4_t masked = vandq_u32(vcltq_f32(a, b), vld1q_u32(bits));
+        uint32x2_t pairs = vorr_u32(vget_low_u32(masked), vget_high_u32(masked));
+        return static_cast<int>(vget_lane_u32(pairs, 0) | vget_lane_u32(pairs, 1));
+    }
+
+    inline bool allEqual(Float4 a, Float4 b)
+    {
+        uint32x4_t equal = vceqq_f32(a, b);
+        uint32x2_t pairs = vand_u32(vget_low_u32(equal), vget_high_u32(equal));
+        return (vget_lane_u32(pairs, 0) & vget_lane_u32(pairs, 1)) == 0xffffffffu;
+    }
+
+    inline void transpose(Float4& r0, Float4& r1, Float4& r2, Float4& r3)
+    {
+        float32x4x2_t t01 = vtrnq_f32(r0, r1);
+        float32x4x2_t t23 = vtrnq_f32(r2, r3);
+        r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+        r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+        r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+        r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+    }
+
+    // 8 bits of precision
+    inline Float4 rsqrtEstimate(Float4 a)           { return vrsqrteq_f32(a); }
+
+    inline Float4 greater(Float4 a, Float4 b)       { return vreinterpretq_f32_u32(vcgtq_f32(a, b)); }
+    inline Float4 equal(Float4 a, Float4 b)         { return vreinterpretq_f32_u32(vceqq_f32(a, b)); }
+    inline Float4 notEqual(Float4 a, Float4 b)      { return vreinterpretq_f32_u32(vmvnq_u32(vceqq_f32(a, b))); }
+    inline Float4 select(Float4 mask, Float4 a, Float4 b)
+    {
+        return vbslq_f32(vreinterpretq_u32_f32(mask), a, b);
+    }
+
+    inline Float4 bitAnd(Float4 a, Float4 b)
+    {
+        return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+    }
+
+    inline Float4 bitXor(Float4 a, Float4 b)
+    {
+        return vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+    }
+
+    using Int4 = int32x4_t;
+
+    inline Int4 splatInt(uint32_t a)                { return vdupq_n_s32(static_cast<int32_t>(a)); }
+    inline Int4 asInt(Float4 a)                     { return vreinterpretq_s32_f32(a); }
+    inline Float4 asFloat(Int4 a)                   { return vreinterpretq_f32_s32(a); }
+    inline Int4 add(Int4 a, Int4 b)                 { return vaddq_s32(a, b); }
+    inline Int4 bitAnd(Int4 a, Int4 b)              { return vandq_s32(a, b); }
+
+    template<int N>
+    inline Int4 shiftLeft(Int4 a)                   { return vshlq_n_s32(a, N); }
+    template<int N>
+    inline Int4 shiftRight(Int4 a)                  { return vshrq_n_s32(a, N); }
+
+    inline Float4 loadBytes(const uint8_t* p)
+    {
+        uint32_t packed;
+        memcpy(&packed, p, 4);
+        uint8x8_t bytes = vreinterpret_u8_u32(vdup_n_u32(packed));
+        return vcvtq_f32_u32(vmovl_u16(vget_low_u16(vmovl_u8(bytes))));
+    }
+
+    inline void storeBytes(uint8_t* p, Float4 a)
+    {
+        a = vminq_f32(vmaxq_f32(a, vdupq_n_f32(0.f)), vdupq_n_f32(255.f));
+        uint16x4_t narrow = vmovn_u32(vcvtq_u32_f32(vaddq_f32(a, vdupq_n_f32(0.5f))));
+        uint8x8_t bytes = vmovn_u16(vcombine_u16(narrow, narrow));
+        uint32_t packed = vget_lane_u32(vreinterpret_u32_u8(bytes), 0);
+        memcpy(p, &packed, 4);
+    }
+#endif
+}
+#endif
@@ -0,0 +1,254 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    Streams.cpp
+*/
+
+#include "Streams.hpp"
+#include "Errors.hpp"
+#include "Simd.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// The kernels process four elements at a time with SIMD, and the rest one by one. Without SIMD
+// the scalar loops over the separate arrays are simple enough for the compiler to vectorize.
+namespace
+{
+#ifdef SP_SIMD_FLOAT4
+    using simd::Float4;
+
+    struct Float4x3
+    {
+        Float4 x, y, z;
+    };
+
+    Float4x3 load4x3(const ConstFloat3StreamRange& src, size_t i)
+    {
+        return { simd::load(src.component(0) + i), simd::load(src.component(1) + i), simd::load(src.component(2) + i) };
+    }
+
+    void store4x3(const Float3StreamRange& dst, size_t i, const Float4x3& v)
+    {
+        simd::store(dst.component(0) + i, v.x);
+        simd::store(dst.component(1) + i, v.y);
+        simd::store(dst.component(2) + i, v.z);
+    }
+
+    Float4 dot4x3(const Float4x3& a, const Float4x3& b)
+    {
+        return simd::madd(a.z, b.z, simd::madd(a.y, b.y, simd::mul(a.x, b.x)));
+    }
+
+    float minLane(Float4 a)
+    {
+        a = simd::minimum(a, simd::permute<2, 3, 0, 1>(a));
+        a = simd::minimum(a, simd::permute<1, 0, 3, 2>(a));
+        float lanes[4];
+        simd::store(lanes, a);
+        return lanes[0];
+    }
+
+    float maxLane(Float4 a)
+    {
+        a = simd::maximum(a, simd::permute<2, 3, 0, 1>(a));
+        a = simd::maximum(a, simd::permute<1, 0, 3, 2>(a));
+        float lanes[4];
+        simd::store(lanes, a);
+        return lanes[0];
+    }
+#endif
+
+    float3 get(const ConstFloat3StreamRange& src, size_t i)
+    {
+        return float3{ src.component(0)[i], src.component(1)[i], src.component(2)[i] };
+    }
+
+    void set(const Float3StreamRange& dst, size_t i, const float3& v)
+    {
+        dst.component(0)[i] = v[0];
+        dst.component(1)[i] = v[1];
+        dst.component(2)[i] = v[2];
+    }
+
+    // The three rows of an affine transform applied to the components of a point or a direction
+    template<bool Point>
+    void transform(const Matrix4x4& m, ConstFloat3StreamRange src, Float3StreamRange dst)
+    {
+        SP_ASSERT(dst.size() == src.size(), "Destination must have as many elements as the source");
+
+        size_t n = src.size();
+        size_t i = 0;
+#ifdef SP_SIMD_FLOAT4
+        Float4 rows[3][4];
+        for (int r = 0; r < 3; r++)
+        {
+            for (int c = 0; c < 4; c++) rows[r][c] = simd::splat((Point || (c < 3)) ? m(r, c) : 0.f);
+        }
+        for (; i + 4 <= n; i += 4)
+        {
+            Float4x3 v = load4x3(src, i);
+            Float4x3 result;
+            Float4* out[3] = { &result.x, &result.y, &result.z };
+            for (int r = 0; r < 3; r++)
+            {
+                *out[r] = simd::madd(rows[r][2], v.z, simd::madd(rows[r][1], v.y, simd::madd(rows[r][0], v.x, rows[r][3])));
+            }
+            store4x3(dst, i, result);
+        }
+#endif
+        float w = Point ? 1.f : 0.f;
+        for (; i < n; i++)
+        {
+            float3 v = get(src, i);
+            float3 result;
+            for (int r = 0; r < 3; r++) result[r] = m(r, 0) * v[0] + m(r, 1) * v[1] + m(r, 2) * v[2] + m(r, 3) * w;
+            set(dst, i, result);
+        }
+    }
+}
+
+namespace math
+{
+    void dot(ConstFloat3StreamRange a, ConstFloat3StreamRange b, Range<float> dst)
+    {
+        SP_ASSERT((b.size() == a.size()) && (dst.size() == a.size()), "Streams must have the same size");
+
+        size_t n = a.size();
+        size_t i = 0;
+#ifdef SP_SIMD_FLOAT4
+        for (; i + 4 <= n; i += 4)
+        {
+            simd::store(&dst[i], dot4x3(load4x3(a, i), load4x3(b, i)));
+        }
+#endif
+        for (; i < n; i++) dst[i] = get(a, i).dot(get(b, i));
+    }
+
+    void cross(ConstFloat3StreamRange a, ConstFloat3StreamRange b, Float3StreamRange dst)
+    {
+        SP_ASSERT((b.size() == a.size()) && (dst.size() == a.size()), "Streams must have the same size");
+
+        size_t n = a.size();
+        size_t i = 0;
+#ifdef SP_SIMD_FLOAT4
+        for (; i + 4 <= n; i += 4)
+        {
+            Float4x3 u = load4x3(a, i);
+            Float4x3 v = load4x3(b, i);
+            store4x3(dst, i, { simd::sub(simd::mul(u.y, v.z), simd::mul(u.z, v.y)),
+                               simd::sub(simd::mul(u.z, v.x), simd::mul(u.x, v.z)),
+                               simd::sub(simd::mul(u.x, v.y), simd::mul(u.y, v.x)) });
+        }
+#endif
+        for (; i < n; i++) set(dst, i, ::cross(get(a, i), get(b, i)));
+    }
+
+    // The squared length is clamped to the smallest normal float, so that zero vectors are scaled by
+    // a large finite number instead of infinity
+    void normalize(ConstFloat3StreamRange src, Float3StreamRange dst)
+    {
+        SP_ASSERT(dst.size() == src.size(), "Destination must have as many elements as the source");
+
+        size_t n = src.size();
+        size_t i = 0;
+#ifdef SP_SIMD_FLOAT4
+        Float4 one      = simd::splat(1.f);
+        Float4 smallest = simd::splat(FLT_MIN);
+        for (; i + 4 <= n; i += 4)
+        {
+            Float4x3 v = load4x3(src, i);
+            Float4 scale = simd::div(one, simd::sqrt(simd::maximum(dot4x3(v, v), smallest)));
+            store4x3(dst, i, { simd::mul(v.x, scale), simd::mul(v.y, scale), simd::mul(v.z, scale) });
+        }
+#endif
+        for (; i < n; i++)
+        {
+            float3 v = get(src, i);
+            set(dst, i, v * (1.f / sqrtf(std::max<float>(v.dot(v), FLT_MIN))));
+        }
+    }
+
+    void transformPoints(const Matrix4x4& m, ConstFloat3StreamRange src, Float3StreamRange dst)
+    {
+        transform<true>(m, src, dst);
+    }
+
+    void transformDirections(const Matrix4x4& m, ConstFloat3StreamRange src, Float3StreamRange dst)
+    {
+        transform<false>(m, src, dst);
+    }
+
+    float3 minimum(ConstFloat3StreamRange src)
+    {
+        return bounds(src).minCorner();
+    }
+
+    float3 maximum(ConstFloat3StreamRange src)
+    {
+        return bounds(src).maxCorner();
+    }
+
+    // Both in one pass, since the loads cost more than the comparisons
+    AABB bounds(ConstFloat3StreamRange src)
+    {
+        float3 minCorner(FLT_MAX);
+        float3 maxCorner(-FLT_MAX);
+
+        size_t n = src.size();
+        size_t i = 0;
+#ifdef SP_SIMD_FLOAT4
+        if (n >= 4)
+        {
+            Float4x3 lo = load4x3(src, 0);
+            Float4x3 hi = lo;
+            for (i = 4; i + 4 <= n; i += 4)
+            {
+                Float4x3 v = load4x3(src, i);
+                lo = { simd::minimum(lo.x, v.x), simd::minimum(lo.y, v.y), simd::minimum(lo.z, v.z) };
+                hi = { simd::maximum(hi.x, v.x), simd::maximum(hi.y, v.y), simd::maximum(hi.z, v.z) };
+            }
+            minCorner = float3{ minLane(lo.x), minLane(lo.y), minLane(lo.z) };
+            maxCorner = float3{ maxLane(hi.x), maxLane(hi.y), maxLane(hi.z) };
+        }
+#endif
+        for (; i < n; i++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                float value = src.component(c)[i];
+                minCorner[c] = std::min<float>(minCorner[c], value);
+                maxCorner[c] = std::max<float>(maxCorner[c], value);
+            }
+        }
+        return AABB(minCorner, maxCorner);
+    }
+
+    float maxDistance(ConstFloat3StreamRange src, const float3& point)
+    {
+        float maxDistanceSq = 0.f;
+
+        size_t n = src.size();
+        size_t i = 0;
+#ifdef SP_SIMD_FLOAT4
+        if (n >= 4)
+        {
+            Float4x3 p = { simd::splat(point[0]), simd::splat(point[1]), simd::splat(point[2]) };
+            Float4 result = simd::zero();
+            for (; i + 4 <= n; i += 4)
+            {
+                Float4x3 v = load4x3(src, i);
+                Float4x3 d = { simd::sub(v.x, p.x), simd::sub(v.y, p.y), simd::sub(v.z, p.z) };
+                result = simd::maximum(result, dot4x3(d, d));
+            }
+            maxDistanceSq = maxLane(result);
+        }
+#endif
+        for (; i < n; i++)
+        {
+            float3 d = get(src, i) - point;
+            maxDistanceSq = std::max<float>(maxDistanceSq, d.dot(d));
+        }
+        return sqrtf(maxDistanceSq);
+    }
+}
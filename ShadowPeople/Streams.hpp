@@ -0,0 +1,167 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    Streams.hpp
+
+    Vectors as structure of arrays, each component in an array of its own.
+    The batch math over them handles four vectors per register, instead of
+    one vector with an unused lane, as with float3. The stream ranges are
+    the non-owning views, which the kernels take, so that they work on any
+    part of a stream.
+*/
+
+#pragma once
+
+#include <vector>
+#include <type_traits>
+
+#include "Types.hpp"
+#include "Bounds.hpp"
+
+template<int N>
+class Stream;
+
+// Non-owning view of N component arrays of the same size. T is float or const float.
+template<typename T, int N>
+class StreamRange
+{
+public:
+    StreamRange() :
+        m_size(0)
+    {
+        for (int i = 0; i < N; i++) m_components[i] = nullptr;
+    }
+
+    StreamRange(T* const (&components)[N], size_t size) :
+        m_size(size)
+    {
+        for (int i = 0; i < N; i++) m_components[i] = components[i];
+    }
+
+    StreamRange(Stream<N>& stream) :
+        m_size(stream.size())
+    {
+        for (int i = 0; i < N; i++) m_components[i] = stream.component(i);
+    }
+
+    // Read-only ranges can be made of mutable data
+    template<typename U = T, typename = typename std::enable_if<std::is_const<U>::value>::type>
+    StreamRange(const Stream<N>& stream) :
+        m_size(stream.size())
+    {
+        for (int i = 0; i < N; i++) m_components[i] = stream.component(i);
+    }
+
+    template<typename U, typename = typename std::enable_if<std::is_same<const U, T>::value>::type>
+    StreamRange(const StreamRange<U, N>& other) :
+        m_size(other.size())
+    {
+        for (int i = 0; i < N; i++) m_components[i] = other.component(i);
+    }
+
+    size_t  size() const            { return m_size; }
+    T*      component(int i) const  { return m_components[i]; }
+
+    ArithmeticVector<float, N> operator[](size_t i) const
+    {
+        ArithmeticVector<float, N> v;
+        for (int c = 0; c < N; c++) v[c] = m_components[c][i];
+        return v;
+    }
+
+    void set(size_t i, const ArithmeticVector<float, N>& v) const
+    {
+        for (int c = 0; c < N; c++) m_components[c][i] = v[c];
+    }
+
+    StreamRange subRange(size_t begin, size_t count) const
+    {
+        T* components[N];
+        for (int i = 0; i < N; i++) components[i] = m_components[i] + begin;
+        return StreamRange(components, count);
+    }
+private:
+    T*      m_components[N];
+    size_t  m_size;
+};
+
+// Owning container of N component arrays
+template<int N>
+class Stream
+{
+public:
+    Stream() = default;
+
+    explicit Stream(size_t size)
+    {
+        resize(size);
+    }
+
+    // New elements are zero
+    void resize(size_t size)
+    {
+        for (auto& component : m_components) component.resize(size);
+    }
+
+    void reserve(size_t size)
+    {
+        for (auto& component : m_components) component.reserve(size);
+    }
+
+    void clear()
+    {
+        for (auto& component : m_components) component.clear();
+    }
+
+    void append(const ArithmeticVector<float, N>& v)
+    {
+        for (int i = 0; i < N; i++) m_components[i].emplace_back(v[i]);
+    }
+
+    size_t  size() const                    { return m_components[0].size(); }
+    float*  component(int i)                { return m_components[i].data(); }
+    const float* component(int i) const     { return m_components[i].data(); }
+
+    ArithmeticVector<float, N> operator[](size_t i) const
+    {
+        return StreamRange<const float, N>(*this)[i];
+    }
+
+    void set(size_t i, const ArithmeticVector<float, N>& v)
+    {
+        StreamRange<float, N>(*this).set(i, v);
+    }
+private:
+    std::vector<float> m_components[N];
+};
+
+using Float2Stream              = Stream<2>;
+using Float3Stream              = Stream<3>;
+using Float4Stream              = Stream<4>;
+using Float2StreamRange         = StreamRange<float, 2>;
+using Float3StreamRange         = StreamRange<float, 3>;
+using Float4StreamRange         = StreamRange<float, 4>;
+using ConstFloat2StreamRange    = StreamRange<const float, 2>;
+using ConstFloat3StreamRange    = StreamRange<const float, 3>;
+using ConstFloat4StreamRange    = StreamRange<const float, 4>;
+
+// Dst must have as many elements as the sources, and may be the same range as either of them.
+namespace math
+{
+    void dot(ConstFloat3StreamRange a, ConstFloat3StreamRange b, Range<float> dst);
+    void cross(ConstFloat3StreamRange a, ConstFloat3StreamRange b, Float3StreamRange dst);
+
+    // Zero vectors stay zero
+    void normalize(ConstFloat3StreamRange src, Float3StreamRange dst);
+
+    // The last row of the matrix is dropped, as with the float3 versions in Transform.hpp
+    void transformPoints(const Matrix4x4& m, ConstFloat3StreamRange src, Float3StreamRange dst);
+    void transformDirections(const Matrix4x4& m, ConstFloat3StreamRange src, Float3StreamRange dst);
+
+    // Per component. An empty range gives FLT_MAX and -FLT_MAX, like an empty AABB.
+    float3 minimum(ConstFloat3StreamRange src);
+    float3 maximum(ConstFloat3StreamRange src);
+    AABB bounds(ConstFloat3StreamRange src);
+
+    // The radius of the smallest sphere around the point, which contains all the points
+    float maxDistance(ConstFloat3StreamRange src, const float3& point);
+}
@@ -0,0 +1,258 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    Transform.cpp
+*/
+
+#include "Transform.hpp"
+#include "Errors.hpp"
+
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    constexpr float SingularEpsilon = 1e-12f;
+
+    // The kernels are written with these, so that they are the same with and without SIMD
+#ifdef SP_SIMD_FLOAT4
+    using Vec = simd::Float4;
+
+    Vec load(const float4& v)               { return v.load(); }
+    float4 toFloat4(Vec v)                  { return float4(v); }
+    Vec splat(float a)                      { return simd::splat(a); }
+    Vec add(Vec a, Vec b)                   { return simd::add(a, b); }
+    Vec sub(Vec a, Vec b)                   { return simd::sub(a, b); }
+    Vec mul(Vec a, Vec b)                   { return simd::mul(a, b); }
+    Vec madd(Vec a, Vec b, Vec c)           { return simd::madd(a, b, c); }
+    Vec abs(Vec a)                          { return simd::abs(a); }
+    float dot(Vec a, Vec b)                 { return simd::dot(a, b); }
+
+    Vec cross3(Vec a, Vec b)
+    {
+        Vec c = sub(mul(a, simd::permute<1, 2, 0, 3>(b)), mul(simd::permute<1, 2, 0, 3>(a), b));
+        return simd::permute<1, 2, 0, 3>(c);
+    }
+
+    Vec loadRow(const Matrix4x4& m, int row)        { return simd::load(&m(row, 0)); }
+    void storeRow(Matrix4x4& m, int row, Vec v)     { simd::store(&m(row, 0), v); }
+    void transpose(Vec& r0, Vec& r1, Vec& r2, Vec& r3)  { simd::transpose(r0, r1, r2, r3); }
+#else
+    using Vec = float4;
+
+    Vec load(const float4& v)               { return v; }
+    float4 toFloat4(Vec v)                  { return v; }
+    Vec splat(float a)                      { return float4(a); }
+    Vec add(Vec a, Vec b)                   { return a + b; }
+    Vec sub(Vec a, Vec b)                   { return a - b; }
+    Vec mul(Vec a, Vec b)                   { return a * b; }
+    Vec madd(Vec a, Vec b, Vec c)           { return a * b + c; }
+    Vec abs(Vec a)                          { return { fabsf(a[0]), fabsf(a[1]), fabsf(a[2]), fabsf(a[3]) }; }
+    float dot(Vec a, Vec b)                 { return a.dot(b); }
+    Vec cross3(Vec a, Vec b)                { return cross(a, b); }
+
+    Vec loadRow(const Matrix4x4& m, int row)        { return m.row(row); }
+    void storeRow(Matrix4x4& m, int row, Vec v)     { memcpy(&m(row, 0), &v, sizeof(float4)); }
+
+    void transpose(Vec& r0, Vec& r1, Vec& r2, Vec& r3)
+    {
+        Matrix4x4 t = Matrix4x4(r0, r1, r2, r3).transpose();
+        r0 = t.row(0);
+        r1 = t.row(1);
+        r2 = t.row(2);
+        r3 = t.row(3);
+    }
+#endif
+
+    struct Columns
+    {
+        Vec c[4];
+
+        explicit Columns(const Matrix4x4& m)
+        {
+            for (int i = 0; i < 4; i++) c[i] = loadRow(m, i);
+            transpose(c[0], c[1], c[2], c[3]);
+        }
+
+        Vec direction(float x, float y, float z) const
+        {
+            return madd(c[2], splat(z), madd(c[1], splat(y), mul(c[0], splat(x))));
+        }
+
+        Vec point(float x, float y, float z) const
+        {
+            return add(direction(x, y, z), c[3]);
+        }
+    };
+
+    // Writes only the three elements of the float3, so that the next element is not touched
+    void store3(float3& dst, Vec v)
+    {
+        float4 result = toFloat4(v);
+        dst[0] = result[0];
+        dst[1] = result[1];
+        dst[2] = result[2];
+    }
+}
+
+namespace math
+{
+    bool inverse(const Matrix4x4& m, Matrix4x4& inv)
+    {
+        float4 rows[4]      = { toFloat4(loadRow(m, 0)), toFloat4(loadRow(m, 1)),
+                                toFloat4(loadRow(m, 2)), toFloat4(loadRow(m, 3)) };
+        float4 invRows[4]   = { { 1.f, 0.f, 0.f, 0.f }, { 0.f, 1.f, 0.f, 0.f },
+                                { 0.f, 0.f, 1.f, 0.f }, { 0.f, 0.f, 0.f, 1.f } };
+
+        for (int col = 0; col < 4; col++)
+        {
+            int pivot = col;
+            for (int row = col + 1; row < 4; row++)
+            {
+                if (fabsf(rows[row][col]) > fabsf(rows[pivot][col])) pivot = row;
+            }
+            if (fabsf(rows[pivot][col]) < SingularEpsilon) return false;
+
+            std::swap(rows[col], rows[pivot]);
+            std::swap(invRows[col], invRows[pivot]);
+
+            float scale     = 1.f / rows[col][col];
+            rows[col]       *= scale;
+            invRows[col]    *= scale;
+
+            // Each elimination is a whole row at a time
+            for (int row = 0; row < 4; row++)
+            {
+                if (row == col) continue;
+                float factor    = rows[row][col];
+                rows[row]       -= rows[col] * factor;
+                invRows[row]    -= invRows[col] * factor;
+            }
+        }
+
+        for (int row = 0; row < 4; row++) storeRow(inv, row, load(invRows[row]));
+        return true;
+    }
+
+    // The inverse of the 3x3 part has the cross products of its rows as columns, divided by the
+    // determinant. The translation is then the negated columns weighted by the old translation.
+    bool affineInverse(const Matrix4x4& m, Matrix4x4& inv)
+    {
+        SP_ASSERT((m(3, 0) == 0.f) && (m(3, 1) == 0.f) && (m(3, 2) == 0.f) && (m(3, 3) == 1.f),
+                  "Matrix must be affine");
+
+        // The translation in the last lanes does not change the cross products, whose last
+        // lanes are zero
+        Vec a0 = loadRow(m, 0);
+        Vec a1 = loadRow(m, 1);
+        Vec a2 = loadRow(m, 2);
+
+        Vec c0 = cross3(a1, a2);
+        Vec c1 = cross3(a2, a0);
+        Vec c2 = cross3(a0, a1);
+
+        float det = dot(a0, c0);
+        if (fabsf(det) < SingularEpsilon) return false;
+
+        Vec invDet = splat(1.f / det);
+        c0 = mul(c0, invDet);
+        c1 = mul(c1, invDet);
+        c2 = mul(c2, invDet);
+
+        Vec t = madd(c2, splat(-m(2, 3)), madd(c1, splat(-m(1, 3)), mul(c0, splat(-m(0, 3)))));
+
+        // The columns are transposed to rows
+        transpose(c0, c1, c2, t);
+        storeRow(inv, 0, c0);
+        storeRow(inv, 1, c1);
+        storeRow(inv, 2, c2);
+        storeRow(inv, 3, load(float4{ 0.f, 0.f, 0.f, 1.f }));
+        return true;
+    }
+
+    void transformPoints(const Matrix4x4& m, Range<const float3> src, Range<float3> dst)
+    {
+        SP_ASSERT(dst.size() == src.size(), "Destination must have as many points as the source");
+
+        Columns columns(m);
+        for (size_t i = 0; i < src.size(); i++)
+        {
+            const float3& p = src[i];
+            store3(dst[i], columns.point(p[0], p[1], p[2]));
+        }
+    }
+
+    void transformPoints(const Matrix4x4& m, Range<const float4> src, Range<float4> dst)
+    {
+        SP_ASSERT(dst.size() == src.size(), "Destination must have as many points as the source");
+
+        Columns columns(m);
+        for (size_t i = 0; i < src.size(); i++)
+        {
+            const float4& p = src[i];
+            dst[i] = toFloat4(columns.point(p[0], p[1], p[2]));
+        }
+    }
+
+    void transformDirections(const Matrix4x4& m, Range<const float3> src, Range<float3> dst)
+    {
+        SP_ASSERT(dst.size() == src.size(), "Destination must have as many directions as the source");
+
+        Columns columns(m);
+        for (size_t i = 0; i < src.size(); i++)
+        {
+            const float3& d = src[i];
+            store3(dst[i], columns.direction(d[0], d[1], d[2]));
+        }
+    }
+
+    void transformDirections(const Matrix4x4& m, Range<const float4> src, Range<float4> dst)
+    {
+        SP_ASSERT(dst.size() == src.size(), "Destination must have as many directions as the source");
+
+        Columns columns(m);
+        for (size_t i = 0; i < src.size(); i++)
+        {
+            const float4& d = src[i];
+            dst[i] = toFloat4(columns.direction(d[0], d[1], d[2]));
+        }
+    }
+
+    AABB transformAABB(const Matrix4x4& m, const AABB& box)
+    {
+        AABB result;
+        transformAABBs(m, Range<const AABB>(&box, sizeof(AABB)), Range<AABB>(&result, sizeof(AABB)));
+        return result;
+    }
+
+    // Arvo, "Transforming Axis-Aligned Bounding Boxes". The center is transformed as a point, and
+    // the extents by the absolute values of the matrix.
+    void transformAABBs(const Matrix4x4& m, Range<const AABB> src, Range<AABB> dst)
+    {
+        SP_ASSERT(dst.size() == src.size(), "Destination must have as many boxes as the source");
+
+        Columns columns(m);
+        Vec abs0 = abs(columns.c[0]);
+        Vec abs1 = abs(columns.c[1]);
+        Vec abs2 = abs(columns.c[2]);
+        for (size_t i = 0; i < src.size(); i++)
+        {
+            const AABB& box = src[i];
+            if (box.empty())
+            {
+                dst[i] = AABB();
+                continue;
+            }
+
+            float3 c = box.center();
+            float3 e = box.extents();
+            Vec center  = columns.point(c[0], c[1], c[2]);
+            Vec extents = madd(abs2, splat(e[2]), madd(abs1, splat(e[1]), mul(abs0, splat(e[0]))));
+
+            float3 minCorner;
+            float3 maxCorner;
+            store3(minCorner, sub(center, extents));
+            store3(maxCorner, add(center, extents));
+            dst[i] = AABB(minCorner, maxCorner);
+        }
+    }
+}
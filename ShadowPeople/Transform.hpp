@@ -0,0 +1,36 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    Transform.hpp
+
+    Matrix inverses, and transforms of arrays of points, directions and
+    bounding boxes. The matrices are row-major and multiply column vectors,
+    as in Matrix4x4 * float4. The array versions load the matrix once, and
+    are meant for the loops of culling, picking and skinning.
+*/
+
+#pragma once
+
+#include "Types.hpp"
+#include "Bounds.hpp"
+
+namespace math
+{
+    // Gauss-Jordan elimination with partial pivoting. Returns false, if the matrix is singular.
+    bool inverse(const Matrix4x4& m, Matrix4x4& inv);
+
+    // For matrices, whose last row is (0, 0, 0, 1). Cheaper than the general inverse, and the
+    // upper 3x3 part does not need to be a rotation. Returns false, if the matrix is singular.
+    bool affineInverse(const Matrix4x4& m, Matrix4x4& inv);
+
+    // Points have w = 1 and directions w = 0. The float3 versions drop the last row of the
+    // matrix, so they are for affine matrices. Dst must have as many elements as src, and may
+    // be the same range.
+    void transformPoints(const Matrix4x4& m, Range<const float3> src, Range<float3> dst);
+    void transformPoints(const Matrix4x4& m, Range<const float4> src, Range<float4> dst);
+    void transformDirections(const Matrix4x4& m, Range<const float3> src, Range<float3> dst);
+    void transformDirections(const Matrix4x4& m, Range<const float4> src, Range<float4> dst);
+
+    // The smallest box, which contains the transformed box. The matrix must be affine.
+    AABB transformAABB(const Matrix4x4& m, const AABB& box);
+    void transformAABBs(const Matrix4x4& m, Range<const AABB> src, Range<AABB> dst);
+}
@@ -1,6 +1,7 @@
 #include "Types.hpp"
 #include "Errors.hpp"
 #include "Math.hpp"
+#include <algorithm>
 #include <cmath>
 
 static const float Epsilon = 1e-6f;
@@ -143,8 +144,18 @@ const float& Matrix4x4::operator()(int row, int column) const
 	return m_elements[row * 4 + column];
 }
 
-float4 Matrix4x4::operator*(float4 vec)
+float4 Matrix4x4::operator*(float4 vec) const
 {
+#ifdef SP_SIMD_FLOAT4
+	// The products of the rows are transposed, so that the dot products are sums of the registers
+	simd::Float4 v	= vec.load();
+	simd::Float4 r0	= simd::mul(simd::load(&m_elements[0]), v);
+	simd::Float4 r1	= simd::mul(simd::load(&m_elements[4]), v);
+	simd::Float4 r2	= simd::mul(simd::load(&m_elements[8]), v);
+	simd::Float4 r3	= simd::mul(simd::load(&m_elements[12]), v);
+	simd::transpose(r0, r1, r2, r3);
+	return float4(simd::add(simd::add(r0, r1), simd::add(r2, r3)));
+#else
 	float4 result({0.f, 0.f, 0.f, 0.f});
 	for (uint32_t i = 0; i < 4; i++)
 	{
@@ -154,6 +165,35 @@ float4 Matrix4x4::operator*(float4 vec)
 		}
 	}
 	return result;
+#endif
+}
+
+void Matrix4x4::transform(Range<const float4> src, Range<float4> dst) const
+{
+	SP_ASSERT(dst.size() == src.size(), "Destination must have as many vectors as the source");
+
+#ifdef SP_SIMD_FLOAT4
+	// The columns are loaded once, and each vector is their sum weighted by its elements
+	Matrix4x4 columns = transpose();
+	simd::Float4 c0 = simd::load(&columns.m_elements[0]);
+	simd::Float4 c1 = simd::load(&columns.m_elements[4]);
+	simd::Float4 c2 = simd::load(&columns.m_elements[8]);
+	simd::Float4 c3 = simd::load(&columns.m_elements[12]);
+	for (size_t i = 0; i < src.size(); i++)
+	{
+		const float4& v = src[i];
+		simd::Float4 result = simd::mul(c0, simd::splat(v[0]));
+		result = simd::madd(c1, simd::splat(v[1]), result);
+		result = simd::madd(c2, simd::splat(v[2]), result);
+		result = simd::madd(c3, simd::splat(v[3]), result);
+		dst[i] = float4(result);
+	}
+#else
+	for (size_t i = 0; i < src.size(); i++)
+	{
+		dst[i] = *this * src[i];
+	}
+#endif
 }
 
 float4 Matrix4x4::row(int row) const
@@ -192,6 +232,21 @@ std::string Matrix4x4::debugOutput() const
 Matrix4x4 operator*(const Matrix4x4& lhs, const Matrix4x4& rhs)
 {
 	Matrix4x4 result;
+#ifdef SP_SIMD_FLOAT4
+	// Each row of the result is the rows of rhs weighted by the elements of the row of lhs
+	simd::Float4 r0 = simd::load(&rhs.m_elements[0]);
+	simd::Float4 r1 = simd::load(&rhs.m_elements[4]);
+	simd::Float4 r2 = simd::load(&rhs.m_elements[8]);
+	simd::Float4 r3 = simd::load(&rhs.m_elements[12]);
+	for (int i = 0; i < 4; i++)
+	{
+		simd::Float4 row = simd::mul(simd::splat(lhs(i, 0)), r0);
+		row = simd::madd(simd::splat(lhs(i, 1)), r1, row);
+		row = simd::madd(simd::splat(lhs(i, 2)), r2, row);
+		row = simd::madd(simd::splat(lhs(i, 3)), r3, row);
+		simd::store(&result.m_elements[i * 4], row);
+	}
+#else
 	for (int i = 0; i < 4; i++)
 	{
 		for (int j = 0; j < 4; j++)
@@ -204,6 +259,7 @@ Matrix4x4 operator*(const Matrix4x4& lhs, const Matrix4x4& rhs)
 			result(i, j) = dot;
 		}
 	}
+#endif
 	return result;
 }
 
@@ -227,8 +283,10 @@ Quaternion::Quaternion(float4 axis, float angle)
 	m_rotation[3] = c;
 }
 
-// This uses the "alternative method" in
-// http://www.euclideanspace.com/maths/geometry/rotations/conversions/matrixToQuaternion/
+// Shepperd, "Quaternion from Rotation Matrix". The largest component comes from the diagonal,
+// and the rest from the off-diagonal terms, which are four times its products with them. The
+// largest component is at least 0.5, so the division is accurate, also for rotations of 180
+// degrees, where w is zero. W is kept positive.
 Quaternion::Quaternion(const Matrix3x3& rotation)
 {
     float qx = 1.f + rotation(0, 0) - rotation(1, 1) - rotation(2, 2);
@@ -239,10 +297,27 @@ Quaternion::Quaternion(const Matrix3x3& rotation)
     qy = sqrtf(qy < 0.f ? 0.f : qy) * 0.5f;
     qz = sqrtf(qz < 0.f ? 0.f : qz) * 0.5f;
     qw = sqrtf(qw < 0.f ? 0.f : qw) * 0.5f;
-    m_rotation[0] = qx * math::sign(rotation(1, 2) - rotation(2, 1));
-    m_rotation[1] = qy * math::sign(rotation(2, 0) - rotation(0, 2));
-    m_rotation[2] = qz * math::sign(rotation(0, 1) - rotation(1, 0));
-    m_rotation[3] = qw;
+
+    float largest   = std::max<float>(std::max<float>(qx, qy), std::max<float>(qz, qw));
+    float scale     = 0.25f / largest;
+    float wx        = (rotation(1, 2) - rotation(2, 1)) * scale;
+    float wy        = (rotation(2, 0) - rotation(0, 2)) * scale;
+    float wz        = (rotation(0, 1) - rotation(1, 0)) * scale;
+    float xy        = (rotation(0, 1) + rotation(1, 0)) * scale;
+    float xz        = (rotation(0, 2) + rotation(2, 0)) * scale;
+    float yz        = (rotation(1, 2) + rotation(2, 1)) * scale;
+
+    // Ties go to w, then x, y and z
+    float4 q = { xz, yz, largest, wz };
+    if (qy == largest) q = { xy, largest, yz, wy };
+    if (qx == largest) q = { largest, xy, xz, wx };
+    if (qw == largest) q = { wx, wy, wz, largest };
+
+    float s = (q[3] < 0.f) ? -1.f : 1.f;
+    m_rotation[0] = q[0] * s;
+    m_rotation[1] = q[1] * s;
+    m_rotation[2] = q[2] * s;
+    m_rotation[3] = q[3] * s;
 }
 
 bool Quaternion::operator==(const Quaternion& q) const
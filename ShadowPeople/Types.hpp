@@ -9,6 +9,12 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <type_traits>
+#include <utility>
+#include <cmath>
+
+#include "Hash.hpp"
+#include "Simd.hpp"
 
 template<int N>
 class BooleanVector
@@ -136,47 +142,39 @@ private:
 	std::array<bool, N>	m_elements;
 };
 
+template<typename T, int N, typename Op, typename L, typename R>
+class VectorExpression;
+
 template<typename T, int N>
 class ArithmeticVector
 {
 public:
-	ArithmeticVector()
-	{
-		for (int i = 0; i < N; i++)
-		{
-			m_elements[i] = 0;
-		}
-	}
+	constexpr ArithmeticVector() :
+		m_elements{}
+	{}
 
-	ArithmeticVector(T fillValue)
-	{
-		for (int i = 0; i < N; i++)
-		{
-			m_elements[i] = fillValue;
-		}
-	}
+	constexpr ArithmeticVector(T fillValue) :
+		ArithmeticVector(fillValue, std::make_index_sequence<N>())
+	{}
 
-	ArithmeticVector(std::initializer_list<T> elements)
+	constexpr ArithmeticVector(std::initializer_list<T> elements) :
+		ArithmeticVector(elements, std::make_index_sequence<N>())
+	{}
+
+	// Evaluates the expression one element at a time, see VectorExpression
+	template<typename Op, typename L, typename R>
+	constexpr ArithmeticVector(const VectorExpression<T, N, Op, L, R>& expression) :
+		ArithmeticVector(expression, std::make_index_sequence<N>())
+	{}
+
+	template<typename Op, typename L, typename R>
+	ArithmeticVector& operator=(const VectorExpression<T, N, Op, L, R>& expression)
 	{
-		if (elements.size() <= N)
-		{
-			int i = 0;
-			for (; i < static_cast<int>(elements.size()); i++)
-			{
-				m_elements[i] = elements.begin()[i];
-			}
-			for (; i < N; i++)
-			{
-				m_elements[i] = 0;
-			}
-		}
-		else
-		{
-			for (int i = 0; i < N; i++)
-			{
-				m_elements[i] = elements.begin()[i];
-			}
-		}
+		// Evaluated to a local first, so that the compiler knows the stores do not change the
+		// operands, and can keep the whole result in registers
+		ArithmeticVector result(expression);
+		*this = result;
+		return *this;
 	}
 
 	std::string debugOutput() const
@@ -191,13 +189,6 @@ public:
 		return s;
 	}
 
-	/*
-	ArithmeticVector(const ArithmeticVector&) = default;
-	ArithmeticVector(const ArithmeticVector&&) = default;
-
-	ArithmeticVector& operator=(const ArithmeticVector&) = default;
-	ArithmeticVector& operator=(const ArithmeticVector&&) = default;
-	*/
 	bool operator==(const ArithmeticVector& rhs) const
 	{
 		for (int i = 0; i < N; i++)
@@ -207,12 +198,12 @@ public:
 		return true;
 	}
 
-	T& operator[](const int i)
+	constexpr T& operator[](const int i)
 	{
 		return m_elements[i];
 	}
 
-	const T& operator[](const int i) const
+	constexpr const T& operator[](const int i) const
 	{
 		return m_elements[i];
 	}
@@ -273,61 +264,404 @@ public:
 		return *this;
 	}
 
-	BooleanVector<N> operator<(const ArithmeticVector& a)
+	template<typename Op, typename L, typename R>
+	ArithmeticVector& operator+=(const VectorExpression<T, N, Op, L, R>& a)
 	{
-		BooleanVector<N> b(false);
 		for (int i = 0; i < N; i++)
 		{
-			if (m_elements[i] < a.m_elements[i]) b[i] = true;
+			m_elements[i] += a[i];
 		}
-		return b;
+		return *this;
 	}
 
-	friend ArithmeticVector normalize(const ArithmeticVector& a)
+	template<typename Op, typename L, typename R>
+	ArithmeticVector& operator-=(const VectorExpression<T, N, Op, L, R>& a)
 	{
-		return a / a.length();
+		for (int i = 0; i < N; i++)
+		{
+			m_elements[i] -= a[i];
+		}
+		return *this;
 	}
 
-	// Binary operations
-	friend ArithmeticVector operator+(ArithmeticVector lhs, const ArithmeticVector& rhs)
+	template<typename Op, typename L, typename R>
+	ArithmeticVector& operator*=(const VectorExpression<T, N, Op, L, R>& a)
 	{
 		for (int i = 0; i < N; i++)
 		{
-			lhs.m_elements[i] += rhs.m_elements[i];
+			m_elements[i] *= a[i];
 		}
-		return lhs;
+		return *this;
 	}
 
-	friend ArithmeticVector operator-(ArithmeticVector lhs, const ArithmeticVector& rhs)
+	template<typename Op, typename L, typename R>
+	ArithmeticVector& operator/=(const VectorExpression<T, N, Op, L, R>& a)
 	{
 		for (int i = 0; i < N; i++)
 		{
-			lhs.m_elements[i] -= rhs.m_elements[i];
+			m_elements[i] /= a[i];
 		}
-		return lhs;
+		return *this;
 	}
 
-	friend const ArithmeticVector operator*(ArithmeticVector lhs, const ArithmeticVector& rhs)
+	BooleanVector<N> operator<(const ArithmeticVector& a)
 	{
+		BooleanVector<N> b(false);
 		for (int i = 0; i < N; i++)
 		{
-			lhs.m_elements[i] *= rhs.m_elements[i];
+			if (m_elements[i] < a.m_elements[i]) b[i] = true;
 		}
-		return lhs;
+		return b;
 	}
 
-	friend const ArithmeticVector operator/(ArithmeticVector lhs, const ArithmeticVector& rhs)
+	friend ArithmeticVector normalize(const ArithmeticVector& a)
 	{
+		T length = static_cast<T>(a.length());
+		ArithmeticVector result;
 		for (int i = 0; i < N; i++)
 		{
-			lhs.m_elements[i] /= rhs.m_elements[i];
+			result.m_elements[i] = a.m_elements[i] / length;
 		}
-		return lhs;
+		return result;
 	}
+
+	// The binary operations are the expression templates below
 private:
-	std::array<T, N>	m_elements;
+	template<size_t... I>
+	constexpr ArithmeticVector(T fillValue, std::index_sequence<I...>) :
+		m_elements{ (static_cast<void>(I), fillValue)... }
+	{}
+
+	// Missing elements are zero, and extra ones are ignored
+	template<size_t... I>
+	constexpr ArithmeticVector(std::initializer_list<T> elements, std::index_sequence<I...>) :
+		m_elements{ ((I < elements.size()) ? elements.begin()[I] : static_cast<T>(0))... }
+	{}
+
+	template<typename Expression, size_t... I>
+	constexpr ArithmeticVector(const Expression& expression, std::index_sequence<I...>) :
+		m_elements{ expression[static_cast<int>(I)]... }
+	{}
+
+	T	m_elements[N];
 };
 
+#ifdef SP_SIMD_FLOAT4
+// float4 in a SIMD register for the arithmetic. The elements are stored as in the generic
+// vector, so the size and alignment are the same as those of four floats.
+template<>
+class ArithmeticVector<float, 4>
+{
+public:
+	ArithmeticVector()
+	{
+		simd::store(m_elements.data(), simd::zero());
+	}
+
+	ArithmeticVector(float fillValue)
+	{
+		simd::store(m_elements.data(), simd::splat(fillValue));
+	}
+
+	ArithmeticVector(std::initializer_list<float> elements)
+	{
+		simd::store(m_elements.data(), simd::zero());
+		size_t count = (elements.size() < 4) ? elements.size() : 4;
+		for (size_t i = 0; i < count; i++)
+		{
+			m_elements[i] = elements.begin()[i];
+		}
+	}
+
+	std::string debugOutput() const
+	{
+		std::string s("(");
+		for (int i = 0; i < 4; i++)
+		{
+			s += std::to_string(m_elements[i]);
+			if (i < 3) s += ", ";
+		}
+		s += ")";
+		return s;
+	}
+
+	bool operator==(const ArithmeticVector& rhs) const
+	{
+		return simd::allEqual(load(), rhs.load());
+	}
+
+	float& operator[](const int i)
+	{
+		return m_elements[i];
+	}
+
+	const float& operator[](const int i) const
+	{
+		return m_elements[i];
+	}
+
+	float dot(const ArithmeticVector& a) const
+	{
+		return simd::dot(load(), a.load());
+	}
+
+	float length() const
+	{
+		return sqrtf(dot(*this));
+	}
+
+	ArithmeticVector& operator+=(const ArithmeticVector& a)
+	{
+		simd::store(m_elements.data(), simd::add(load(), a.load()));
+		return *this;
+	}
+
+	ArithmeticVector& operator-=(const ArithmeticVector& a)
+	{
+		simd::store(m_elements.data(), simd::sub(load(), a.load()));
+		return *this;
+	}
+
+	ArithmeticVector& operator*=(const ArithmeticVector& a)
+	{
+		simd::store(m_elements.data(), simd::mul(load(), a.load()));
+		return *this;
+	}
+
+	ArithmeticVector& operator/=(const ArithmeticVector& a)
+	{
+		simd::store(m_elements.data(), simd::div(load(), a.load()));
+		return *this;
+	}
+
+	BooleanVector<4> operator<(const ArithmeticVector& a)
+	{
+		int mask = simd::lessMask(load(), a.load());
+		return BooleanVector<4>({ (mask & 1) != 0, (mask & 2) != 0, (mask & 4) != 0, (mask & 8) != 0 });
+	}
+
+	friend ArithmeticVector normalize(const ArithmeticVector& a)
+	{
+		simd::Float4 v = a.load();
+		return ArithmeticVector(simd::div(v, simd::splat(sqrtf(simd::dot(v, v)))));
+	}
+
+	// Binary operations
+	friend ArithmeticVector operator+(const ArithmeticVector& lhs, const ArithmeticVector& rhs)
+	{
+		return ArithmeticVector(simd::add(lhs.load(), rhs.load()));
+	}
+
+	friend ArithmeticVector operator-(const ArithmeticVector& lhs, const ArithmeticVector& rhs)
+	{
+		return ArithmeticVector(simd::sub(lhs.load(), rhs.load()));
+	}
+
+	friend const ArithmeticVector operator*(const ArithmeticVector& lhs, const ArithmeticVector& rhs)
+	{
+		return ArithmeticVector(simd::mul(lhs.load(), rhs.load()));
+	}
+
+	friend const ArithmeticVector operator/(const ArithmeticVector& lhs, const ArithmeticVector& rhs)
+	{
+		return ArithmeticVector(simd::div(lhs.load(), rhs.load()));
+	}
+
+	// Access to the register for the SIMD code of the math types
+	explicit ArithmeticVector(simd::Float4 v)
+	{
+		simd::store(m_elements.data(), v);
+	}
+
+	simd::Float4 load() const
+	{
+		return simd::load(m_elements.data());
+	}
+private:
+	std::array<float, 4>	m_elements;
+};
+#endif
+
+// Expression templates for the element-wise operators. An operator of vectors, expressions and
+// scalars returns an expression, which is evaluated only when it is assigned to a vector, one
+// element at a time. A chain like c1 * e1 + c2 * e2 is then a single loop without temporary
+// vectors. Expressions refer to the vectors in them, so they must not outlive the statement,
+// i.e. they must not be stored with auto.
+namespace expr
+{
+	struct Add { template<typename T> static constexpr T apply(T a, T b) { return a + b; } };
+	struct Sub { template<typename T> static constexpr T apply(T a, T b) { return a - b; } };
+	struct Mul { template<typename T> static constexpr T apply(T a, T b) { return a * b; } };
+	struct Div { template<typename T> static constexpr T apply(T a, T b) { return a / b; } };
+
+	// The same value in every element
+	template<typename T>
+	struct Scalar
+	{
+		T value;
+
+		constexpr T operator[](int) const { return value; }
+	};
+
+	// Vectors are referred to, and the small expressions and scalars copied
+	template<typename X>
+	struct Operand
+	{
+		using Type = const X;
+	};
+
+	template<typename T, int N>
+	struct Operand<ArithmeticVector<T, N>>
+	{
+		using Type = const ArithmeticVector<T, N>&;
+	};
+
+	template<typename X>
+	struct Traits
+	{
+		static constexpr bool Fused = false;
+		using Element = void;
+		static constexpr int Size = 0;
+	};
+
+	template<typename T, int N>
+	struct Traits<ArithmeticVector<T, N>>
+	{
+		static constexpr bool Fused = true;
+		using Element = T;
+		static constexpr int Size = N;
+	};
+
+#ifdef SP_SIMD_FLOAT4
+	// Already one register per operation
+	template<>
+	struct Traits<ArithmeticVector<float, 4>>
+	{
+		static constexpr bool Fused = false;
+		using Element = void;
+		static constexpr int Size = 0;
+	};
+#endif
+
+	template<typename T, int N, typename Op, typename L, typename R>
+	struct Traits<VectorExpression<T, N, Op, L, R>>
+	{
+		static constexpr bool Fused = true;
+		using Element = T;
+		static constexpr int Size = N;
+	};
+
+	template<typename Op, typename L, typename R, typename = void>
+	struct VectorResult {};
+
+	template<typename Op, typename L, typename R>
+	struct VectorResult<Op, L, R, typename std::enable_if<
+		Traits<L>::Fused && Traits<R>::Fused &&
+		std::is_same<typename Traits<L>::Element, typename Traits<R>::Element>::value &&
+		(Traits<L>::Size == Traits<R>::Size)>::type>
+	{
+		using Type = VectorExpression<typename Traits<L>::Element, Traits<L>::Size, Op, L, R>;
+	};
+
+	template<typename V, typename S, typename = void>
+	struct ScalarOperand {};
+
+	template<typename V, typename S>
+	struct ScalarOperand<V, S, typename std::enable_if<Traits<V>::Fused && std::is_arithmetic<S>::value>::type>
+	{
+		using Element = typename Traits<V>::Element;
+	};
+}
+
+template<typename T, int N, typename Op, typename L, typename R>
+class VectorExpression
+{
+public:
+	constexpr VectorExpression(const L& lhs, const R& rhs) :
+		m_lhs(lhs),
+		m_rhs(rhs)
+	{}
+
+	constexpr T operator[](const int i) const
+	{
+		return Op::apply(static_cast<T>(m_lhs[i]), static_cast<T>(m_rhs[i]));
+	}
+
+	float dot(const ArithmeticVector<T, N>& a) const
+	{
+		return ArithmeticVector<T, N>(*this).dot(a);
+	}
+
+	float length() const
+	{
+		return ArithmeticVector<T, N>(*this).length();
+	}
+private:
+	typename expr::Operand<L>::Type m_lhs;
+	typename expr::Operand<R>::Type m_rhs;
+};
+
+template<typename L, typename R, typename Result = typename expr::VectorResult<expr::Add, L, R>::Type>
+constexpr Result operator+(const L& lhs, const R& rhs) { return Result(lhs, rhs); }
+
+template<typename L, typename R, typename Result = typename expr::VectorResult<expr::Sub, L, R>::Type>
+constexpr Result operator-(const L& lhs, const R& rhs) { return Result(lhs, rhs); }
+
+template<typename L, typename R, typename Result = typename expr::VectorResult<expr::Mul, L, R>::Type>
+constexpr Result operator*(const L& lhs, const R& rhs) { return Result(lhs, rhs); }
+
+template<typename L, typename R, typename Result = typename expr::VectorResult<expr::Div, L, R>::Type>
+constexpr Result operator/(const L& lhs, const R& rhs) { return Result(lhs, rhs); }
+
+// Scalars, like 0.5f * v, are the same in every element
+template<typename L, typename S, typename T = typename expr::ScalarOperand<L, S>::Element>
+constexpr VectorExpression<T, expr::Traits<L>::Size, expr::Add, L, expr::Scalar<T>> operator+(const L& lhs, S rhs)
+{
+	return { lhs, expr::Scalar<T>{ static_cast<T>(rhs) } };
+}
+
+template<typename S, typename R, typename T = typename expr::ScalarOperand<R, S>::Element>
+constexpr VectorExpression<T, expr::Traits<R>::Size, expr::Add, expr::Scalar<T>, R> operator+(S lhs, const R& rhs)
+{
+	return { expr::Scalar<T>{ static_cast<T>(lhs) }, rhs };
+}
+
+template<typename L, typename S, typename T = typename expr::ScalarOperand<L, S>::Element>
+constexpr VectorExpression<T, expr::Traits<L>::Size, expr::Sub, L, expr::Scalar<T>> operator-(const L& lhs, S rhs)
+{
+	return { lhs, expr::Scalar<T>{ static_cast<T>(rhs) } };
+}
+
+template<typename S, typename R, typename T = typename expr::ScalarOperand<R, S>::Element>
+constexpr VectorExpression<T, expr::Traits<R>::Size, expr::Sub, expr::Scalar<T>, R> operator-(S lhs, const R& rhs)
+{
+	return { expr::Scalar<T>{ static_cast<T>(lhs) }, rhs };
+}
+
+template<typename L, typename S, typename T = typename expr::ScalarOperand<L, S>::Element>
+constexpr VectorExpression<T, expr::Traits<L>::Size, expr::Mul, L, expr::Scalar<T>> operator*(const L& lhs, S rhs)
+{
+	return { lhs, expr::Scalar<T>{ static_cast<T>(rhs) } };
+}
+
+template<typename S, typename R, typename T = typename expr::ScalarOperand<R, S>::Element>
+constexpr VectorExpression<T, expr::Traits<R>::Size, expr::Mul, expr::Scalar<T>, R> operator*(S lhs, const R& rhs)
+{
+	return { expr::Scalar<T>{ static_cast<T>(lhs) }, rhs };
+}
+
+template<typename L, typename S, typename T = typename expr::ScalarOperand<L, S>::Element>
+constexpr VectorExpression<T, expr::Traits<L>::Size, expr::Div, L, expr::Scalar<T>> operator/(const L& lhs, S rhs)
+{
+	return { lhs, expr::Scalar<T>{ static_cast<T>(rhs) } };
+}
+
+template<typename S, typename R, typename T = typename expr::ScalarOperand<R, S>::Element>
+constexpr VectorExpression<T, expr::Traits<R>::Size, expr::Div, expr::Scalar<T>, R> operator/(S lhs, const R& rhs)
+{
+	return { expr::Scalar<T>{ static_cast<T>(lhs) }, rhs };
+}
+
 // Common specializations - corrspond to HLSL types
 using int2 = ArithmeticVector<int, 2>;
 using int3 = ArithmeticVector<int, 3>;
@@ -348,14 +682,14 @@ namespace std
 	{
 		std::size_t operator()(const uint3& i) const noexcept
 		{
-			std::size_t h = std::hash<uint32_t>{}(i[0]);
-			h ^= std::hash<uint32_t>{}(i[1]);
-			h ^= std::hash<uint32_t>{}(i[2]);
-			return h;
+			return static_cast<std::size_t>(hash3x32(i[0], i[1], i[2]));
 		}
 	};
 }
 
+template<typename T>
+class Range;
+
 float3 cross(const float3& a, const float3& b);
 float4 cross(const float4& a, const float4& b);
 
@@ -391,7 +725,11 @@ public:
 	float& operator()(int row, int column);
 	const float& operator()(int row, int column) const;
 
-	float4 operator*(float4 vec);
+	float4 operator*(float4 vec) const;
+
+    // Multiplies each vector of src with the matrix. Dst must have as many vectors as src,
+    // and may be the same range.
+    void transform(Range<const float4> src, Range<float4> dst) const;
 
     float4 row(int row) const;
     Matrix4x4 transpose() const;
@@ -440,6 +778,11 @@ public:
 
 	ArithmeticVector<T, N> minCorner() const	{ return m_minCorner; }
 	ArithmeticVector<T, N> size() const			{ return m_size; }
+
+	bool operator==(const Rect& rhs) const
+	{
+		return (m_minCorner == rhs.m_minCorner) && (m_size == rhs.m_size);
+	}
 private:
 	ArithmeticVector<T, N> m_minCorner;
 	ArithmeticVector<T, N> m_size;
@@ -469,14 +812,30 @@ public:
 		m_byteSize(vector.size() * sizeof(T))
 	{}
 
+	// Read-only ranges can be made of mutable data
+	template<typename U, typename = typename std::enable_if<std::is_same<const U, T>::value>::type>
+	Range(const std::vector<U>& vector) :
+		m_begin(vector.data()),
+		m_byteSize(vector.size() * sizeof(U))
+	{}
+
+	template<typename U, typename = typename std::enable_if<std::is_same<const U, T>::value>::type>
+	Range(const Range<U>& other) :
+		m_begin(other.begin()),
+		m_byteSize(other.byteSize())
+	{}
+
 	T*		begin()		{ return m_begin; }
 	T*		end()		{ return m_begin + size(); }
 
+	const T* begin() const	{ return m_begin; }
+	const T* end() const	{ return m_begin + size(); }
+
 	size_t	size() const		{ return m_byteSize / sizeof(T); }
 	size_t  byteSize() const	{ return m_byteSize; }
 
-	const T& operator[](uint32_t i) const { return m_begin[i]; }
-    T& operator[](uint32_t i) { return m_begin[i]; }
+	const T& operator[](size_t i) const { return m_begin[i]; }
+    T& operator[](size_t i) { return m_begin[i]; }
 
 	// TODO: Fill other member as required
 private:
@@ -0,0 +1,354 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    AssetCache.cpp
+*/
+
+#include "AssetCache.hpp"
+#include "PackFile.hpp"
+
+#include "../MappedFile.hpp"
+#include "../Hash.hpp"
+#include "../Log.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+    constexpr uint32_t ManifestMagic    = 0x43415053;   // "SPAC"
+    constexpr uint32_t ManifestVersion  = 1;
+
+    // Bump the version of a kind, when the format of its processed output changes.
+    // This invalidates all the cached outputs of that kind.
+    constexpr uint32_t KindVersions[] =
+    {
+        6,  // Mesh
+        1,  // MaterialTile
+        1,  // Shader
+        1   // Scene
+    };
+    static_assert(sizeof(KindVersions) / sizeof(KindVersions[0]) ==
+                  static_cast<size_t>(asset::AssetKind::Count), "Every asset kind needs a version");
+
+    void createDirectory(const std::string& directory)
+    {
+#ifdef _WIN32
+        CreateDirectory(directory.c_str(), NULL);
+#else
+        mkdir(directory.c_str(), 0755);
+#endif
+    }
+
+    // Writes to a temporary file first, so that a crash never leaves a half written file behind
+    bool writeFile(const std::string& filename, const std::string& tempFilename, Range<const uint8_t> data)
+    {
+        {
+            std::ofstream file(tempFilename, std::ios::binary | std::ios::trunc);
+            if (!file) return false;
+            file.write(reinterpret_cast<const char*>(data.begin()), static_cast<std::streamsize>(data.byteSize()));
+            if (!file) return false;
+        }
+
+        // Note: rename() does not replace an existing file on Windows
+        std::remove(filename.c_str());
+        if (std::rename(tempFilename.c_str(), filename.c_str()) != 0)
+        {
+            std::remove(tempFilename.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    class ManifestWriter
+    {
+    public:
+        void u32(uint32_t value) { append(&value, sizeof(value)); }
+        void u64(uint64_t value) { append(&value, sizeof(value)); }
+        void string(const std::string& value)
+        {
+            u32(static_cast<uint32_t>(value.size()));
+            append(value.data(), value.size());
+        }
+
+        Range<const uint8_t> bytes() const { return m_bytes; }
+    private:
+        void append(const void* data, size_t size)
+        {
+            const uint8_t* bytes = static_cast<const uint8_t*>(data);
+            m_bytes.insert(m_bytes.end(), bytes, bytes + size);
+        }
+
+        std::vector<uint8_t> m_bytes;
+    };
+
+    // Reads fail, instead of running past the end, if the manifest is truncated
+    class ManifestReader
+    {
+    public:
+        ManifestReader(Range<const uint8_t> bytes) : m_bytes(bytes), m_pos(0) {}
+
+        bool u32(uint32_t& value) { return read(&value, sizeof(value)); }
+        bool u64(uint64_t& value) { return read(&value, sizeof(value)); }
+        bool string(std::string& value)
+        {
+            uint32_t size;
+            if (!u32(size) || (m_pos + size > m_bytes.size())) return false;
+            value.assign(reinterpret_cast<const char*>(m_bytes.begin() + m_pos), size);
+            m_pos += size;
+            return true;
+        }
+    private:
+        bool read(void* data, size_t size)
+        {
+            if (m_pos + size > m_bytes.size()) return false;
+            memcpy(data, m_bytes.begin() + m_pos, size);
+            m_pos += size;
+            return true;
+        }
+
+        Range<const uint8_t>    m_bytes;
+        size_t                  m_pos;
+    };
+}
+
+namespace asset
+{
+    AssetCache::AssetCache(const std::string& directory, const PackFile* pack) :
+        m_directory(directory),
+        m_pack(pack),
+        m_dirty(false),
+        m_tempCounter(0)
+    {
+        if (!m_directory.empty() && (m_directory.back() != '/') && (m_directory.back() != '\\'))
+        {
+            m_directory.push_back('/');
+        }
+        createDirectory(m_directory);
+        loadManifest();
+    }
+
+    AssetCache::~AssetCache()
+    {
+        save();
+    }
+
+    bool AssetCache::lookup(AssetKind kind, const std::string& name, MappedFile& output)
+    {
+        // The dependencies are hashed without holding the lock, so the entry is copied
+        Entry entry;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            auto found = m_entries.find(entryName(kind, name));
+            if (found == m_entries.end()) return false;
+            entry = found->second;
+        }
+
+        for (const auto& dependency : entry.dependencies)
+        {
+            if (contentHash(dependency.filename) != dependency.hash) return false;
+        }
+
+        std::string filename = outputFilename(entry.key);
+        if (!MappedFile::exists(filename)) return false;
+
+        output = MappedFile(filename, MappedFile::AccessPattern::Sequential);
+        return output.valid();
+    }
+
+    bool AssetCache::store(AssetKind kind, const std::string& name, const std::vector<std::string>& dependencies,
+                           Range<const uint8_t> output)
+    {
+        Entry entry;
+        for (const auto& filename : dependencies)
+        {
+            entry.dependencies.emplace_back(Dependency{ filename, contentHash(filename) });
+        }
+        entry.key = outputKey(kind, name, entry.dependencies);
+
+        std::string tempFilename;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            tempFilename = m_directory + std::to_string(m_tempCounter++) + ".tmp";
+        }
+
+        // The output is addressed by its inputs, so an existing file already has the right contents
+        std::string filename = outputFilename(entry.key);
+        if (!MappedFile::exists(filename) && !writeFile(filename, tempFilename, output))
+        {
+            logError(std::string("Unable to write cache file ").append(filename).append("\n"));
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::string fullName = entryName(kind, name);
+        auto old = m_entries.find(fullName);
+        uint64_t oldKey = (old != m_entries.end()) ? old->second.key : entry.key;
+        m_entries[fullName] = entry;
+
+        // Remove the stale output, unless another asset has the same inputs
+        if ((oldKey != entry.key) && !keyInUse(oldKey)) std::remove(outputFilename(oldKey).c_str());
+
+        m_dirty = true;
+        return true;
+    }
+
+    bool AssetCache::save()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_dirty) return true;
+
+        ManifestWriter writer;
+        writer.u32(ManifestMagic);
+        writer.u32(ManifestVersion);
+
+        writer.u32(static_cast<uint32_t>(m_files.size()));
+        for (const auto& file : m_files)
+        {
+            writer.string(file.first);
+            writer.u64(file.second.writeTime);
+            writer.u64(file.second.hash);
+        }
+
+        writer.u32(static_cast<uint32_t>(m_entries.size()));
+        for (const auto& entry : m_entries)
+        {
+            writer.string(entry.first);
+            writer.u64(entry.second.key);
+            writer.u32(static_cast<uint32_t>(entry.second.dependencies.size()));
+            for (const auto& dependency : entry.second.dependencies)
+            {
+                writer.string(dependency.filename);
+                writer.u64(dependency.hash);
+            }
+        }
+
+        if (!writeFile(m_directory + "manifest.bin", m_directory + "manifest.tmp", writer.bytes()))
+        {
+            logError("Unable to write asset cache manifest\n");
+            return false;
+        }
+
+        m_dirty = false;
+        return true;
+    }
+
+    uint64_t AssetCache::contentHash(const std::string& filename)
+    {
+        uint64_t packHash;
+        if (m_pack && m_pack->contentHash(filename, packHash)) return packHash;
+
+        uint64_t writeTime;
+        if (!MappedFile::lastWriteTime(filename, writeTime) || !MappedFile::exists(filename))
+        {
+            return 0;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            auto stamp = m_files.find(filename);
+            if ((stamp != m_files.end()) && (stamp->second.writeTime == writeTime)) return stamp->second.hash;
+        }
+
+        // Two threads may hash the same file at once, but then they also get the same hash
+        MappedFile file(filename, MappedFile::AccessPattern::Sequential);
+        Range<const uint8_t> bytes = file.bytes();
+        uint64_t hash = hashBytes(bytes.begin(), bytes.byteSize());
+        if (hash == 0) hash = 1;    // Zero is reserved for missing files
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_files[filename] = FileStamp{ writeTime, hash };
+        m_dirty = true;
+        return hash;
+    }
+
+    uint64_t AssetCache::outputKey(AssetKind kind, const std::string& name,
+                                   const std::vector<Dependency>& dependencies) const
+    {
+        uint64_t key = hashBytes(name.data(), name.size(),
+                                 (static_cast<uint64_t>(kind) << 32) | KindVersions[static_cast<size_t>(kind)]);
+        for (const auto& dependency : dependencies)
+        {
+            key = mix64(key ^ dependency.hash) + 0x9e3779b97f4a7c15ULL;
+        }
+        return key;
+    }
+
+    std::string AssetCache::entryName(AssetKind kind, const std::string& name) const
+    {
+        return std::to_string(static_cast<uint32_t>(kind)).append(":").append(name);
+    }
+
+    std::string AssetCache::outputFilename(uint64_t key) const
+    {
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(key));
+        return m_directory + hex + ".bin";
+    }
+
+    bool AssetCache::keyInUse(uint64_t key) const
+    {
+        for (const auto& entry : m_entries)
+        {
+            if (entry.second.key == key) return true;
+        }
+        return false;
+    }
+
+    bool AssetCache::loadManifest()
+    {
+        std::string filename = m_directory + "manifest.bin";
+        if (!MappedFile::exists(filename)) return false;
+
+        MappedFile file(filename, MappedFile::AccessPattern::Sequential);
+        if (!file.valid()) return false;
+
+        // An unreadable manifest only means a cold cache
+        ManifestReader reader(file.bytes());
+        uint32_t magic, version;
+        if (!reader.u32(magic) || (magic != ManifestMagic) ||
+            !reader.u32(version) || (version != ManifestVersion)) return false;
+
+        std::unordered_map<std::string, FileStamp> files;
+        uint32_t numFiles;
+        if (!reader.u32(numFiles)) return false;
+        for (uint32_t i = 0; i < numFiles; i++)
+        {
+            std::string name;
+            FileStamp stamp;
+            if (!reader.string(name) || !reader.u64(stamp.writeTime) || !reader.u64(stamp.hash)) return false;
+            files[name] = stamp;
+        }
+
+        std::unordered_map<std::string, Entry> entries;
+        uint32_t numEntries;
+        if (!reader.u32(numEntries)) return false;
+        for (uint32_t i = 0; i < numEntries; i++)
+        {
+            std::string name;
+            Entry entry;
+            uint32_t numDependencies;
+            if (!reader.string(name) || !reader.u64(entry.key) || !reader.u32(numDependencies)) return false;
+            for (uint32_t d = 0; d < numDependencies; d++)
+            {
+                Dependency dependency;
+                if (!reader.string(dependency.filename) || !reader.u64(dependency.hash)) return false;
+                entry.dependencies.emplace_back(dependency);
+            }
+            entries[name] = entry;
+        }
+
+        m_files.swap(files);
+        m_entries.swap(entries);
+        return true;
+    }
+}
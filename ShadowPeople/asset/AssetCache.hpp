@@ -0,0 +1,101 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    AssetCache.hpp
+
+    Disk cache for processed assets: meshes, material tiles and compiled
+    shaders. Each output is stored in a file named by a hash of everything
+    it was built from, i.e. the contents of its source files and the format
+    version of the output. The manifest records the files each output
+    depends on, e.g. an OBJ, its MTL library and the textures the library
+    refers to, so an output is reused only if none of them has changed.
+
+    File contents are hashed only when their modification time changes, so
+    validating a warm entry does not read the sources at all. Files in the
+    pack, if one is given, use the hashes recorded in the pack instead, as
+    the asset loader reads them from the pack too.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+#include "../Types.hpp"
+
+class MappedFile;
+
+namespace asset
+{
+    class PackFile;
+
+    enum class AssetKind : uint32_t
+    {
+        Mesh,
+        MaterialTile,
+        Shader,
+        Scene,
+        Count
+    };
+
+    class AssetCache
+    {
+    public:
+        // The directory is created, if it does not exist
+        AssetCache(const std::string& directory, const PackFile* pack = nullptr);
+        ~AssetCache();
+
+        AssetCache(const AssetCache&)               = delete;
+        AssetCache& operator=(const AssetCache&)    = delete;
+
+        // Maps the cached output, if the named asset and all its dependencies are unchanged
+        bool lookup(AssetKind kind, const std::string& name, MappedFile& output);
+
+        // Writes the output of the named asset. The dependencies are the files it was built
+        // from. Missing dependencies are recorded too, so that creating them invalidates the output.
+        bool store(AssetKind kind, const std::string& name, const std::vector<std::string>& dependencies,
+                   Range<const uint8_t> output);
+
+        // Writes the manifest, if anything has changed. Called also by the destructor.
+        bool save();
+    private:
+        // Content hash of a source file, with the modification time it was computed at
+        struct FileStamp
+        {
+            uint64_t    writeTime;
+            uint64_t    hash;
+        };
+
+        struct Dependency
+        {
+            std::string filename;
+            uint64_t    hash;
+        };
+
+        struct Entry
+        {
+            uint64_t                key;
+            std::vector<Dependency> dependencies;
+        };
+
+        // Hash of the current contents of the file, or zero if it does not exist. Locks the mutex
+        // only around the stamps, so that other threads are not blocked while a file is hashed.
+        uint64_t contentHash(const std::string& filename);
+        uint64_t outputKey(AssetKind kind, const std::string& name, const std::vector<Dependency>& dependencies) const;
+        std::string entryName(AssetKind kind, const std::string& name) const;
+        std::string outputFilename(uint64_t key) const;
+        bool keyInUse(uint64_t key) const;
+
+        bool loadManifest();
+
+        std::string                                 m_directory;
+        const PackFile*                             m_pack;
+        std::unordered_map<std::string, FileStamp>  m_files;
+        std::unordered_map<std::string, Entry>      m_entries;
+        bool                                        m_dirty;
+        uint32_t                                    m_tempCounter;
+        std::mutex                                  m_mutex;
+    };
+}
@@ -4,6 +4,13 @@
 */
 
 #include "AssetLoader.hpp"
+#include "AssetStreamer.hpp"
+#include "AssetCache.hpp"
+#include "SceneFile.hpp"
+#include "PackFile.hpp"
+#include "VertexWelder.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
 
 #include "../rendering/Mesh.hpp"
 #include "../rendering/Scene.hpp"
@@ -13,142 +20,379 @@
 
 #include "../Math.hpp"
 
-// File operations requires OS specific stuff, move it later to a separate file
-#define WIN32_LEAN_AND_MEAN
-#include <Windows.h>
+#include "../MappedFile.hpp"
+#include "../Log.hpp"
 
-#include <unordered_map>
+namespace
+{
+    // Splits the line in place at whitespace, like strtok_s, which only MSVC has. Returns
+    // nullptr after the last token.
+    char* nextToken(char*& pos)
+    {
+        auto whitespace = [](char c) { return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r'); };
+
+        while (whitespace(*pos)) pos++;
+        if (*pos == '\0') return nullptr;
 
-#define VERBOSE_MODE
+        char* token = pos;
+        while ((*pos != '\0') && !whitespace(*pos)) pos++;
+        if (*pos != '\0') *pos++ = '\0';
+        return token;
+    }
+}
 
 namespace asset
 {
-    AssetLoader::AssetLoader(rendering::GeometryCache& geometry, rendering::MaterialCache& materials) :
+    // Header of the cached meshes, followed by the vertices, the indices, the meshlets and the LODs
+    struct CachedMeshHeader
+    {
+        uint32_t numVertices;
+        uint32_t numIndices;
+        uint32_t numMeshlets;
+        uint32_t numLods;
+    };
+
+    AssetLoader::AssetLoader(rendering::GeometryCache& geometry, rendering::MaterialCache& materials,
+                             AssetCache* cache, const PackFile* pack) :
         m_geometry(geometry),
-        m_materials(materials)
+        m_materials(materials),
+        m_cache(cache),
+        m_pack(pack)
     {}
 
-    DataBlob<> AssetLoader::fileToBlob(const std::string& filename)
+    MappedFile AssetLoader::openFile(const std::string& filename) const
+    {
+        MappedFile file;
+        if (m_pack && m_pack->read(filename, file)) return file;
+
+        return MappedFile(filename, MappedFile::AccessPattern::Sequential);
+    }
+
+    bool AssetLoader::loadModel(const std::string& filename, rendering::Mesh& mesh)
     {
-        HANDLE file = CreateFile(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
-                                 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-        if (file == INVALID_HANDLE_VALUE)
+        if (readCachedMesh(filename, mesh)) return true;
+
+        MappedFile file = openFile(filename);
+        if (!file.valid()) return false;
+
+        return decodeModel(filename, file.asRange<char>(), mesh);
+    }
+
+    bool AssetLoader::decodeModel(const std::string& filename, Range<const char> buffer, rendering::Mesh& mesh)
+    {
+        if (readCachedMesh(filename, mesh)) return true;
+
+        std::string materialLibrary;
+        if (!parseObj(buffer, filename, mesh, materialLibrary)) return false;
+
+        storeCachedMesh(filename, materialLibrary, mesh);
+        return true;
+    }
+
+    bool AssetLoader::readCachedMesh(const std::string& filename, rendering::Mesh& mesh)
+    {
+        MappedFile cached;
+        if (!m_cache || !m_cache->lookup(AssetKind::Mesh, filename, cached)) return false;
+
+        Range<const uint8_t> bytes = cached.bytes();
+        CachedMeshHeader header;
+        if (bytes.byteSize() < sizeof(header)) return false;
+        memcpy(&header, bytes.begin(), sizeof(header));
+
+        size_t vertexBytes  = header.numVertices * sizeof(Vertex);
+        size_t indexBytes   = header.numIndices * sizeof(uint32_t);
+        size_t meshletBytes = header.numMeshlets * sizeof(rendering::Meshlet);
+        size_t lodBytes     = header.numLods * sizeof(rendering::MeshLod);
+        if (bytes.byteSize() != sizeof(header) + vertexBytes + indexBytes + meshletBytes + lodBytes) return false;
+
+        // Note: The mapping is page aligned, and the header keeps everything 4-byte aligned
+        const uint8_t* data = bytes.begin() + sizeof(header);
+        const Vertex* vertices              = reinterpret_cast<const Vertex*>(data);
+        const uint32_t* indices             = reinterpret_cast<const uint32_t*>(data + vertexBytes);
+        const rendering::Meshlet* meshlets  = reinterpret_cast<const rendering::Meshlet*>(data + vertexBytes + indexBytes);
+        const rendering::MeshLod* lods      = reinterpret_cast<const rendering::MeshLod*>(data + vertexBytes + indexBytes + meshletBytes);
+        mesh.assign(Range<const Vertex>(vertices, vertexBytes), Range<const uint32_t>(indices, indexBytes),
+                    Range<const rendering::Meshlet>(meshlets, meshletBytes), Range<const rendering::MeshLod>(lods, lodBytes));
+        return true;
+    }
+
+    void AssetLoader::storeCachedMesh(const std::string& filename, const std::string& materialLibrary,
+                                      const rendering::Mesh& mesh)
+    {
+        if (!m_cache) return;
+
+        CachedMeshHeader header{ static_cast<uint32_t>(mesh.vertices().size()),
+                                 static_cast<uint32_t>(mesh.indices().size()),
+                                 static_cast<uint32_t>(mesh.meshlets().size()),
+                                 static_cast<uint32_t>(mesh.lods().size()) };
+        size_t vertexBytes  = header.numVertices * sizeof(Vertex);
+        size_t indexBytes   = header.numIndices * sizeof(uint32_t);
+        size_t meshletBytes = header.numMeshlets * sizeof(rendering::Meshlet);
+        size_t lodBytes     = header.numLods * sizeof(rendering::MeshLod);
+
+        std::vector<uint8_t> bytes(sizeof(header) + vertexBytes + indexBytes + meshletBytes + lodBytes);
+        uint8_t* data = bytes.data() + sizeof(header);
+        memcpy(bytes.data(), &header, sizeof(header));
+        memcpy(data, mesh.vertices().data(), vertexBytes);
+        memcpy(data + vertexBytes, mesh.indices().data(), indexBytes);
+        memcpy(data + vertexBytes + indexBytes, mesh.meshlets().data(), meshletBytes);
+        memcpy(data + vertexBytes + indexBytes + meshletBytes, mesh.lods().data(), lodBytes);
+
+        std::vector<std::string> dependencies{ filename };
+        if (!materialLibrary.empty()) dependencies.emplace_back(materialLibrary);
+        m_cache->store(AssetKind::Mesh, filename, dependencies, bytes);
+    }
+
+    bool AssetLoader::loadScene(const std::string& filename, rendering::Scene& scene)
+    {
+        MappedFile file;
+        std::vector<uint8_t> converted;
+        SceneFile sceneFile;
+        if (!readSceneFile(filename, file, converted, sceneFile)) return false;
+
+        int firstObject = addSceneObjects(sceneFile, scene);
+
+        // Each mesh is loaded once, however many objects use it
+        for (uint32_t m = 0; m < sceneFile.numMeshes(); m++)
         {
-            if (GetLastError() == ERROR_FILE_NOT_FOUND)
+            std::string modelFileName = sceneFile.meshName(m);
+            rendering::Mesh mesh;
+            if (!loadModel(modelFileName, mesh))
+            {
+                std::string err("File not found: ");
+                err.append(modelFileName).append("\n");
+                logError(err);
+                return false;
+            }
+
+            // Pre-load the mesh now - later, implement proper streaming and only give a virtual offset here
+            int2 meshStartSize = m_geometry.preloadMesh(mesh);
+            const SceneFileMesh& sceneMesh = sceneFile.mesh(m);
+            for (uint32_t i = 0; i < sceneMesh.numObjects; i++)
             {
-                std::string err("Could not find ");
-                err.append(filename).append("\n");
-                OutputDebugString(err.c_str());
+                scene.object(firstObject + sceneMesh.firstObject + i).meshStartSize = meshStartSize;
             }
-            return DataBlob<>();
         }
 
-        LARGE_INTEGER fileSize;
-        if (!GetFileSizeEx(file, &fileSize))
+        Rect<int, 2> materialRect;
+        if (!loadMaterialToCache("data/models/house/house_obj.mtl",
+                                 "data/models/house/house_diffuse.tga",
+                                 "data/models/house/house_spec.tga",
+                                 "data/models/house/house_normal.tga", materialRect)) return false;
+
+        int materialOffset = scene.addMaterial(rendering::Material(materialRect));
+
+        return true;
+    }
+
+    bool AssetLoader::streamScene(const std::string& filename, rendering::Scene& scene, AssetStreamer& streamer)
+    {
+        MappedFile file;
+        std::vector<uint8_t> converted;
+        SceneFile sceneFile;
+        if (!readSceneFile(filename, file, converted, sceneFile)) return false;
+
+        // The objects are placed right away, and become visible when their mesh arrives
+        int firstObject = addSceneObjects(sceneFile, scene);
+
+        for (uint32_t m = 0; m < sceneFile.numMeshes(); m++)
         {
-            OutputDebugString("Unable to read file size\n");
-            CloseHandle(file);
-            return DataBlob<>();
+            int meshFirstObject = firstObject + static_cast<int>(sceneFile.mesh(m).firstObject);
+            uint32_t numObjects = sceneFile.mesh(m).numObjects;
+            streamer.requestMesh(sceneFile.meshName(m), StreamPriority::High,
+                                 [this, &scene, meshFirstObject, numObjects](rendering::Mesh& mesh)
+            {
+                int2 meshStartSize = m_geometry.preloadMesh(mesh);
+                for (uint32_t i = 0; i < numObjects; i++)
+                {
+                    scene.object(meshFirstObject + i).meshStartSize = meshStartSize;
+                }
+            });
         }
 
-        if (fileSize.QuadPart > (1 << 30))
+        const std::string library = "data/models/house/house_obj.mtl";
+        const std::vector<std::string> textures{ "data/models/house/house_diffuse.tga",
+                                                 "data/models/house/house_spec.tga",
+                                                 "data/models/house/house_normal.tga" };
+
+        // A cached tile is small compared to the textures, so it is read right away
+        Rect<int, 2> cachedRect;
+        if (readCachedMaterialTile(library, cachedRect))
         {
-            OutputDebugString("File too big to read\n");
-            CloseHandle(file);
-            return DataBlob<>();
+            scene.addMaterial(rendering::Material(cachedRect));
+            return true;
         }
 
-        DWORD bytesToRead = fileSize.LowPart;
+        // The material rectangle is allocated by whichever texture arrives first. The tile is
+        // cached, when all the channels have been decoded. The rectangle is read from the scene,
+        // because defragmenting the material cache can move it in between.
+        struct PendingMaterial
+        {
+            int             index;
+            uint32_t        channelsLeft;
+            bool            failed;
+        };
+        auto material = std::make_shared<PendingMaterial>(PendingMaterial{ -1, 3, false });
+        auto preloadChannel = [this, &scene, material, library, textures](rendering::MaterialChannel channel)
+        {
+            return [this, &scene, material, library, textures, channel](Range<const uint8_t> tga)
+            {
+                // The rows are decoded straight into the material cache, like in loadTextureToCache()
+                Rect<int, 2> rect = (material->index < 0) ? Rect<int, 2>() : scene.material(material->index).materialRect;
+                if (!decodeTextureToCache(tga, channel, rect)) material->failed = true;
+                if ((material->index < 0) && (rect.size()[0] > 0))
+                {
+                    material->index = scene.addMaterial(rendering::Material(rect));
+                }
+
+                if ((--material->channelsLeft == 0) && !material->failed)
+                {
+                    storeCachedMaterialTile(library, textures, rect);
+                }
+            };
+        };
+
+        // Textures have lower priority than geometry, so that the shape of the scene appears first
+        streamer.requestTexture(textures[0], StreamPriority::Normal, preloadChannel(rendering::MaterialChannel::Albedo));
+        streamer.requestTexture(textures[1], StreamPriority::Normal, preloadChannel(rendering::MaterialChannel::Roughness));
+        streamer.requestTexture(textures[2], StreamPriority::Normal, preloadChannel(rendering::MaterialChannel::Normal));
 
-        DataBlob<> dataBlob(bytesToRead);
+        return true;
+    }
 
-        DWORD bytesActualRead;
-        if (!ReadFile(file, dataBlob.data(), bytesToRead, &bytesActualRead, NULL))
+    bool AssetLoader::readSceneFile(const std::string& filename, MappedFile& file, std::vector<uint8_t>& converted,
+                                    SceneFile& sceneFile)
+    {
+        file = openFile(filename);
+        if (!file.valid()) return false;
+
+        // Text scenes are converted, and the result is kept in the asset cache
+        if (!isBinaryScene(file.bytes()))
         {
-            OutputDebugString("Could not read file contents\n");
-            CloseHandle(file);
-            return DataBlob<>();
+            MappedFile text = file;
+            if (!m_cache || !m_cache->lookup(AssetKind::Scene, filename, file))
+            {
+                if (!convertTextScene(text.asRange<char>(), converted)) return false;
+                if (m_cache) m_cache->store(AssetKind::Scene, filename, { filename }, converted);
+                file = MappedFile();
+                return sceneFile.open(converted);
+            }
         }
 
-        CloseHandle(file);
-
-        dataBlob.resize(bytesActualRead);
+        if (!sceneFile.open(file.bytes()))
+        {
+            logError(std::string("Invalid scene file: ").append(filename).append("\n"));
+            return false;
+        }
+        return true;
+    }
 
-        return dataBlob;
+    int AssetLoader::addSceneObjects(const SceneFile& sceneFile, rendering::Scene& scene)
+    {
+        Range<const SceneFileObject> objects = sceneFile.objects();
+        int firstObject = scene.addObjects(static_cast<uint32_t>(objects.size()));
+        for (size_t i = 0; i < objects.size(); i++)
+        {
+            const SceneFileObject& src  = objects[i];
+            rendering::Transform& dst   = scene.object(firstObject + static_cast<int>(i)).transform;
+            dst.position    = float3{ src.position[0], src.position[1], src.position[2] };
+            dst.scale       = src.scale;
+            dst.rotation    = Quaternion(float4{ src.rotation[0], src.rotation[1], src.rotation[2], src.rotation[3] });
+        }
+        return firstObject;
     }
 
-    bool AssetLoader::loadModel(const std::string& filename, rendering::Mesh& mesh)
+    bool AssetLoader::loadImage(const std::string& filename, graphics::Image& image)
     {
-        DataBlob<> buffer = fileToBlob(filename);
-        if (buffer.data() == nullptr) return false;
+        MappedFile file = openFile(filename);
+        if (!file.valid()) return false;
 
-        if (!parseObj(buffer, mesh)) return false;
+        if (!parseTga(file.bytes(), image)) return false;
 
         return true;
     }
 
-    bool AssetLoader::loadScene(const std::string& filename, rendering::Scene& scene)
+    bool AssetLoader::loadTextureToCache(const std::string& filename, rendering::MaterialChannel channel,
+                                         Rect<int, 2>& dstRect)
     {
-        DataBlob<> buffer = fileToBlob(filename);
-        if (buffer.data() == nullptr) return false;
+        MappedFile file = openFile(filename);
+        if (!file.valid()) return false;
 
-        char line[256];
+        return decodeTextureToCache(file.bytes(), channel, dstRect);
+    }
 
-        uint32_t index = 0;
-        while(index < buffer.size())
+    bool AssetLoader::decodeTextureToCache(Range<const uint8_t> buffer, rendering::MaterialChannel channel,
+                                           Rect<int, 2>& dstRect)
+    {
+        uint32_t srcBytesPerPixel = 0;
+        uint32_t width = 0;
+        auto onHeader = [this, &dstRect, &srcBytesPerPixel, &width](const TgaHeader& header)
         {
-            int bytesRead = getLine(line, Range<const char>(buffer.data(), buffer.size()), index);
-            index += bytesRead;
-
-            // Parse line
-			char *next_token = NULL;
-			char *token = strtok_s(line, " \t\n\r", &next_token);
-			if (token == NULL) continue;		// Empty line
-
-            std::string modelFileName(token);
-            rendering::Mesh mesh;
-            if (!loadModel(modelFileName, mesh))
+            int2 size{ header.widthInPixels, header.heightInPixels };
+            if (dstRect.size()[0] == 0)
             {
-                std::string err("File not found: ");
-                err.append(modelFileName).append("\n");
-                OutputDebugString(err.c_str());
+                dstRect = m_materials.allocate(size);
+                if (dstRect.size()[0] == 0) return false;
+            }
+            else if ((size[0] > dstRect.size()[0]) || (size[1] > dstRect.size()[1]))
+            {
+                logError("Texture does not fit into its material rectangle\n");
                 return false;
             }
 
-            // Pre-load the mesh now - later, implement proper streaming and only give a virtual offset here
-            int2 meshStartSize = m_geometry.preloadMesh(mesh);
-            rendering::Transform transform; // TODO: Fill
-            int objectOffset = scene.addObject(rendering::Object(meshStartSize, transform));
-        }
+            srcBytesPerPixel = math::divRoundUp<uint32_t>(header.bitsPerPixel, 8);
+            if ((srcBytesPerPixel != 1) && (srcBytesPerPixel != 3) && (srcBytesPerPixel != 4))
+            {
+                logError("Unsupported TGA pixel format for material textures\n");
+                return false;
+            }
+            width = header.widthInPixels;
+            return true;
+        };
 
-        
-        graphics::Image image;
-        if (!loadImage("data/models/house/house_diffuse.tga", image)) return false;
+        auto onRow = [this, &dstRect, &srcBytesPerPixel, &width, channel](uint32_t y, const uint8_t* row)
+        {
+            int2 dstPos{ dstRect.minCorner()[0], dstRect.minCorner()[1] + static_cast<int>(y) };
+            m_materials.preloadMaterialRow(row, srcBytesPerPixel, width, dstPos, channel);
+        };
 
-        int2 size{ image.width(), image.height() };
-        Rect<int, 2> materialRect = m_materials.allocate(size);
+        return decodeTga(buffer, onHeader, onRow);
+    }
 
-        m_materials.preloadMaterial(image, materialRect, rendering::MaterialChannel::Albedo);
+    bool AssetLoader::loadMaterialToCache(const std::string& library, const std::string& albedo,
+                                          const std::string& roughness, const std::string& normal,
+                                          Rect<int, 2>& dstRect)
+    {
+        if (readCachedMaterialTile(library, dstRect)) return true;
 
-        if (!loadImage("data/models/house/house_spec.tga", image)) return false;
-        m_materials.preloadMaterial(image, materialRect, rendering::MaterialChannel::Roughness);
+        // The first texture allocates the material rectangle
+        if (!loadTextureToCache(albedo, rendering::MaterialChannel::Albedo, dstRect)) return false;
+        if (!loadTextureToCache(roughness, rendering::MaterialChannel::Roughness, dstRect)) return false;
+        if (!loadTextureToCache(normal, rendering::MaterialChannel::Normal, dstRect)) return false;
 
-        if (!loadImage("data/models/house/house_normal.tga", image)) return false;
-        m_materials.preloadMaterial(image, materialRect, rendering::MaterialChannel::Normal);
+        storeCachedMaterialTile(library, { albedo, roughness, normal }, dstRect);
+        return true;
+    }
 
-        int materialOffset = scene.addMaterial(rendering::Material(materialRect));
+    bool AssetLoader::readCachedMaterialTile(const std::string& library, Rect<int, 2>& dstRect)
+    {
+        MappedFile cached;
+        if (!m_cache || !m_cache->lookup(AssetKind::MaterialTile, library, cached)) return false;
 
-        return true;
+        return m_materials.preloadMaterialTile(cached.bytes(), dstRect);
     }
 
-    bool AssetLoader::loadImage(const std::string& filename, graphics::Image& image)
+    void AssetLoader::storeCachedMaterialTile(const std::string& library, const std::vector<std::string>& textures,
+                                              Rect<int, 2> rect)
     {
-        DataBlob<> buffer = fileToBlob(filename);
-        if (buffer.data() == nullptr) return false;
+        if (!m_cache) return;
 
-        if (!parseTga(buffer, image)) return false;
+        // The tile depends on the library too, because it decides which textures are used
+        std::vector<std::string> dependencies{ library };
+        dependencies.insert(dependencies.end(), textures.begin(), textures.end());
 
-        return true;
+        std::vector<uint8_t> tile = m_materials.materialTile(rect);
+        m_cache->store(AssetKind::MaterialTile, library, dependencies, tile);
     }
 
     bool AssetLoader::loadMaterial(const std::string& filename, rendering::Material& material)
@@ -157,36 +401,38 @@ namespace asset
         return true;
     }
 
-	bool AssetLoader::parseObj(DataBlob<> buffer, rendering::Mesh& mesh)
+	bool AssetLoader::parseObj(Range<const char> buffer, const std::string& filename, rendering::Mesh& mesh,
+							   std::string& materialLibrary)
 	{
 		std::vector<float3>	vtxPositions;
 		std::vector<float2>	vtxTexCoords;
 		std::vector<float3>	vtxNormals;
+		std::vector<uint3>	corners;
 		std::vector<Face>	faces;
 		std::string			materialName;
 
 		char line[256];
 
-		uint32_t index = 0;
+		size_t index = 0;
 		while (index < buffer.size())
 		{
-            int bytesRead = getLine(line, Range<const char>(buffer.data(), buffer.size()), index);
+            size_t bytesRead = getLine(line, buffer, index);
             index += bytesRead;
 
 			// Parse line
-			char *next_token = NULL;
-			char *token = strtok_s(line, " \t\n\r", &next_token);
+			char* pos = line;
+			char* token = nextToken(pos);
 			if (token == NULL) continue;		// Empty line
 			if (token[0] == '#') continue;		// Skip comments
 			if (strcmp(token, "v") == 0)		// Vertex position
 			{
-				token = strtok_s(NULL, " \t\n\r", &next_token);
+				token = nextToken(pos);
 				float x = static_cast<float>(atof(token));
-				token = strtok_s(NULL, " \t\n\r", &next_token);
+				token = nextToken(pos);
 				float y = static_cast<float>(atof(token));
-				token = strtok_s(NULL, " \t\n\r", &next_token);
+				token = nextToken(pos);
 				float z = static_cast<float>(atof(token));
-				token = strtok_s(NULL, " \t\n\r", &next_token);
+				token = nextToken(pos);
 				if (token)
 				{
 					// If there is w coordinate, normalize the position, so that w == 1
@@ -200,20 +446,20 @@ namespace asset
 			}
 			else if (strcmp(token, "vt") == 0)		// Vertex texture coordinates
 			{
-				token = strtok_s(NULL, " \t\n\r", &next_token);
+				token = nextToken(pos);
 				float u = static_cast<float>(atof(token));
-				token = strtok_s(NULL, " \t\n\r", &next_token);
+				token = nextToken(pos);
 				float v = static_cast<float>(atof(token));
 				float2 texcoords{ u, v };
 				vtxTexCoords.emplace_back(texcoords);
 			}
 			else if (strcmp(token, "vn") == 0)		// Vertex normals
 			{
-				token = strtok_s(NULL, " \t\n\r", &next_token);
+				token = nextToken(pos);
 				float x = static_cast<float>(atof(token));
-				token = strtok_s(NULL, " \t\n\r", &next_token);
+				token = nextToken(pos);
 				float y = static_cast<float>(atof(token));
-				token = strtok_s(NULL, " \t\n\r", &next_token);
+				token = nextToken(pos);
 				float z = static_cast<float>(atof(token));
 				float3 normals{ x, y, z };
 				vtxNormals.emplace_back(normals);
@@ -221,7 +467,8 @@ namespace asset
 			else if (strcmp(token, "f") == 0)		// Face - not necessarily a triangle
 			{
 				Face f;
-				token = strtok_s(NULL, " \t\n\r", &next_token);
+				f.firstCorner = static_cast<uint32_t>(corners.size());
+				token = nextToken(pos);
 				while (token)
 				{
 					uint3 indices{ 0, 0, 0 };
@@ -255,9 +502,10 @@ namespace asset
                             indices[2]--;   // Obj-indices are 1-based, while ours are 0-based
 						}
 					}
-					f.indices.emplace_back(indices);
-					token = strtok_s(NULL, " \t\n\r", &next_token);
+					corners.emplace_back(indices);
+					token = nextToken(pos);
 				}
+				f.numCorners = static_cast<uint32_t>(corners.size()) - f.firstCorner;
 				faces.emplace_back(f);
 			}
 			else if (strcmp(token, "l") == 0)		// Line
@@ -278,8 +526,13 @@ namespace asset
 			}
 			else if (strcmp(token, "mtllib") == 0)	// Material library
 			{
-				token = strtok_s(NULL, " \t\n\r", &next_token);
+				token = nextToken(pos);
 				materialName = token;
+
+				// The library is relative to the OBJ file
+				size_t directoryEnd = filename.find_last_of("/\\");
+				materialLibrary = (directoryEnd == std::string::npos) ? materialName :
+					filename.substr(0, directoryEnd + 1).append(materialName);
 			}
 			else if (strcmp(token, "usemtl") == 0)	// Use material
 			{
@@ -291,61 +544,52 @@ namespace asset
 			}
 		}
 
-#ifdef VERBOSE_MODE
 		std::string msg("Read ");
 		msg.append(std::to_string(vtxPositions.size())).append(" vertex positions, ");
 		msg.append(std::to_string(vtxTexCoords.size())).append(" vertex texture coordinates, ");
 		msg.append(std::to_string(vtxNormals.size())).append(" vertex normals, ");
 		msg.append(std::to_string(faces.size())).append(" polygons\n");
 		msg.append(std::string("Using material ").append(materialName).append("\n"));
-		OutputDebugString(msg.c_str());
-#endif
+		logInfo(msg);
 
-		return constructMesh(vtxPositions, vtxTexCoords, vtxNormals, faces, mesh);
+		return constructMesh(vtxPositions, vtxTexCoords, vtxNormals, corners, faces, mesh);
 	}
 
 	bool AssetLoader::constructMesh(Range<float3> positions, Range<float2> texcoords, Range<float3> normals,
-									Range<Face> faces, rendering::Mesh& mesh)
+									Range<const uint3> corners, Range<Face> faces, rendering::Mesh& mesh)
 	{
-		std::unordered_map<uint3, uint32_t> uniqueIndices;
-		std::vector<Vertex> vertices;
-		std::vector<uint32_t> indices;
-		std::vector<uint32_t> faceIndices;
-		for (auto &face : faces)
+		// Weld all face corners at once, vertices are numbered in the order of first use
+		std::vector<uint32_t> remap(corners.size());
+		VertexWelder welder(corners.size());
+		uint32_t numVertices = welder.weld(corners, remap);
+
+		std::vector<Vertex> vertices(numVertices);
+		const std::vector<uint32_t>& firstOccurrences = welder.firstOccurrences();
+		for (uint32_t i = 0; i < numVertices; i++)
 		{
-			faceIndices.clear();
-			for (auto indexTrio : face.indices)
-			{
-				uint32_t index;
-				auto it = uniqueIndices.find(indexTrio);
-				if (it == uniqueIndices.end())
-				{
-					Vertex vtx;
-					vtx.position	= positions[indexTrio[0]];
-					vtx.uv			= texcoords[indexTrio[1]];
-					vtx.normal		= normals[indexTrio[2]];
+			const uint3& indexTrio = corners[firstOccurrences[i]];
 
-					index = static_cast<uint32_t>(vertices.size());
-					uniqueIndices[indexTrio] = index;
+			Vertex& vtx		= vertices[i];
+			vtx.position	= positions[indexTrio[0]];
+			vtx.uv			= texcoords[indexTrio[1]];
+			vtx.normal		= normals[indexTrio[2]];
+		}
 
-					vertices.emplace_back(vtx);
-				}
-				else
-				{
-					index = it->second;
-				}
-				faceIndices.emplace_back(index);
-			}
+		std::vector<uint32_t> indices;
+		indices.reserve(corners.size() * 3 / 2);
+		for (auto &face : faces)
+		{
+			const uint32_t* faceIndices = remap.data() + face.firstCorner;
 
             // Note: Obj-files store vertices in counter-clockwise order by default, and
             //       may have arbitrary polygons.
-			if (faceIndices.size() == 3)
+			if (face.numCorners == 3)
 			{
                 indices.emplace_back(faceIndices[0]);
 				indices.emplace_back(faceIndices[2]);
 				indices.emplace_back(faceIndices[1]);
 			}
-			else if (faceIndices.size() == 4)
+			else if (face.numCorners == 4)
 			{
 				indices.emplace_back(faceIndices[0]);
 				indices.emplace_back(faceIndices[2]);
@@ -358,27 +602,39 @@ namespace asset
 			else
 			{
 				std::string err("Complex polygons not yet supported: ");
-				err.append(std::to_string(faceIndices.size())).append(" vertices\n");
-				OutputDebugString(err.c_str());
+				err.append(std::to_string(face.numCorners)).append(" vertices\n");
+				logError(err);
 				return false;
 			}
 		}
 
-		mesh.fill(vertices, indices);
+        // Reorder for the vertex cache, overdraw and vertex fetch, and cluster into meshlets
+        std::vector<rendering::Meshlet> meshlets;
+        VertexCacheStatistics before, after;
+        optimizeMesh(vertices, indices, meshlets, &before, &after);
+
+        // Coarser levels of detail go after the full mesh in the same index buffer
+        std::vector<rendering::MeshLod> lods;
+        buildLodChain(vertices, indices, lods);
+
+		mesh.fill(vertices, indices, lods);
+        mesh.setMeshlets(std::move(meshlets));
 
-#ifdef VERBOSE_MODE
 		std::string msg("Loaded model with ");
 		msg.append(std::to_string(vertices.size())).append(" unique vertices and ");
-		msg.append(std::to_string(indices.size())).append(" triangles\n");
-		OutputDebugString(msg.c_str());
-#endif
+		msg.append(std::to_string(lods[0].numIndices / 3)).append(" triangles in ");
+		msg.append(std::to_string(mesh.meshlets().size())).append(" meshlets and ");
+		msg.append(std::to_string(lods.size())).append(" LODs, ACMR ");
+		msg.append(std::to_string(before.acmr)).append(" -> ").append(std::to_string(after.acmr)).append(", ATVR ");
+		msg.append(std::to_string(before.atvr)).append(" -> ").append(std::to_string(after.atvr)).append("\n");
+		logInfo(msg);
 
 		return true;
 	}
 
-    int AssetLoader::getLine(char *lineBuffer, Range<const char> sourceBuffer, int pos)
+    size_t AssetLoader::getLine(char *lineBuffer, Range<const char> sourceBuffer, size_t pos)
     {
-        int i = 0;
+        size_t i = 0;
 		do
 		{
 			lineBuffer[i] = sourceBuffer[pos + i];
@@ -390,21 +646,45 @@ namespace asset
 		return i;
     }
 
-    bool AssetLoader::parseTga(DataBlob<> buffer, graphics::Image& image)
+    bool AssetLoader::parseTga(Range<const uint8_t> buffer, graphics::Image& image)
+    {
+        auto onHeader = [&image](const TgaHeader& header)
+        {
+            // Every row is written by the decoder
+            image.setDimensions(header.bitsPerPixel, header.widthInPixels, header.heightInPixels, 1,
+                                graphics::ImageMemory::Uninitialized);
+            return true;
+        };
+
+        auto onRow = [&image](uint32_t y, const uint8_t* row)
+        {
+            memcpy(image.asRange<uint8_t>().begin() + image.byteOffset(0, y), row, image.stride());
+        };
+
+        return decodeTga(buffer, onHeader, onRow);
+    }
+
+    bool AssetLoader::decodeTga(Range<const uint8_t> buffer, const TgaHeaderFunc& onHeader, const TgaRowFunc& onRow)
     {
+        if (buffer.size() < sizeof(TgaHeader)) return false;
+
         TgaHeader header;
-        memcpy(&header, buffer.data(), sizeof(TgaHeader));
+        memcpy(&header, buffer.begin(), sizeof(TgaHeader));
 
         bool imageIDExists   = (header.idLength != 0);
         bool colorMapExists  = (header.colorMapType != 0);
         bool imageDataExists = (header.imageType != 0);
+        bool runLengthEncoded = (header.imageType & 8) != 0;    // Types 9, 10 and 11
 
         TgaFooter footer;
-        memcpy(&footer, buffer.data() + buffer.size() - sizeof(TgaFooter), sizeof(TgaFooter));
-
-        bool footerValid = (strncmp(footer.signature, "TRUEVISION-XFILE", 16) == 0);        
+        bool footerValid = false;
+        if (buffer.size() >= sizeof(TgaHeader) + sizeof(TgaFooter))
+        {
+            memcpy(&footer, buffer.end() - sizeof(TgaFooter), sizeof(TgaFooter));
+            footerValid = (strncmp(footer.signature, "TRUEVISION-XFILE", 16) == 0);
+        }
 
-        uint32_t index = sizeof(TgaHeader);
+        size_t index = sizeof(TgaHeader);
 
         // Image ID
         if (imageIDExists)
@@ -424,32 +704,99 @@ namespace asset
         if (imageDataExists)
         {
             uint8_t bytesPerPixel   = math::divRoundUp<uint8_t>(header.bitsPerPixel, 8);
-            size_t imageDataSize  = header.widthInPixels * header.heightInPixels * bytesPerPixel;
+            size_t rowSize          = header.widthInPixels * bytesPerPixel;
+            size_t imageDataSize    = rowSize * header.heightInPixels;
 
-#ifdef VERBOSE_MODE
             std::string msg("Image data: ");
             msg.append(std::to_string(header.widthInPixels)).append(" x ");
             msg.append(std::to_string(header.heightInPixels)).append(" @ ");
-            msg.append(std::to_string(header.bitsPerPixel)).append(" bpp\n");
-            OutputDebugString(msg.c_str());
-#endif
-            image.setDimensions(header.bitsPerPixel, header.widthInPixels, header.heightInPixels);
-            auto bytes = blobAsByteRange(buffer);
-            image.fillData(Range<const uint8_t>(bytes.begin() + index, imageDataSize));
+            msg.append(std::to_string(header.bitsPerPixel)).append(" bpp");
+            msg.append(runLengthEncoded ? ", RLE\n" : "\n");
+            logInfo(msg);
+            if (!runLengthEncoded && (index + imageDataSize > buffer.size()))
+            {
+                logError("TGA image data truncated\n");
+                return false;
+            }
+
+            if (!onHeader(header)) return false;
+
+            if (!runLengthEncoded)
+            {
+                for (uint32_t y = 0; y < header.heightInPixels; y++)
+                {
+                    onRow(y, buffer.begin() + index + y * rowSize);
+                }
+            }
+            else
+            {
+                // Packets may continue from one row to the next, so the packet state is kept over rows
+                std::vector<uint8_t> row(rowSize);
+                uint32_t packetPixels   = 0;
+                bool     packetIsRun    = false;
+                for (uint32_t y = 0; y < header.heightInPixels; y++)
+                {
+                    uint32_t x = 0;
+                    while (x < header.widthInPixels)
+                    {
+                        if (packetPixels == 0)
+                        {
+                            if (index >= buffer.size())
+                            {
+                                logError("TGA image data truncated\n");
+                                return false;
+                            }
+                            uint8_t packetHeader = buffer[index++];
+                            packetIsRun  = (packetHeader & 0x80) != 0;
+                            packetPixels = (packetHeader & 0x7f) + 1u;
+                        }
+
+                        uint32_t pixels     = std::min<uint32_t>(packetPixels, header.widthInPixels - x);
+                        size_t srcBytes     = packetIsRun ? bytesPerPixel : pixels * bytesPerPixel;
+                        if (index + srcBytes > buffer.size())
+                        {
+                            logError("TGA image data truncated\n");
+                            return false;
+                        }
+
+                        uint8_t* dst = row.data() + x * bytesPerPixel;
+                        if (packetIsRun)
+                        {
+                            for (uint32_t i = 0; i < pixels; i++)
+                            {
+                                memcpy(dst + i * bytesPerPixel, buffer.begin() + index, bytesPerPixel);
+                            }
+                            // The run value is read again, if the run continues on the next row
+                            if (pixels == packetPixels) index += srcBytes;
+                        }
+                        else
+                        {
+                            memcpy(dst, buffer.begin() + index, srcBytes);
+                            index += srcBytes;
+                        }
+
+                        x               += pixels;
+                        packetPixels    -= pixels;
+                    }
+                    onRow(y, row.data());
+                }
+            }
         }
 
         if (footerValid)
         {
-#ifdef VERBOSE_MODE
-            OutputDebugString("Valid TGA 2.0 file\n");
-#endif
+            logInfo("Valid TGA 2.0 file\n");
             // Developer area
 
             // Extension area
-            TgaExtension extension;
-            memcpy(&extension, buffer.data() + footer.extensionOffset, sizeof(TgaExtension));
+            if ((footer.extensionOffset != 0) &&
+                (footer.extensionOffset + sizeof(TgaExtension) <= buffer.size()))
+            {
+                TgaExtension extension;
+                memcpy(&extension, buffer.begin() + footer.extensionOffset, sizeof(TgaExtension));
+            }
         }
 
         return true;
     }
-}
+}
\ No newline at end of file
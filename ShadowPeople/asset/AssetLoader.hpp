@@ -8,9 +8,12 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <functional>
 
 #include "../Types.hpp"
 
+class MappedFile;
+
 namespace graphics
 {
     class Image;
@@ -23,31 +26,81 @@ namespace rendering
     class GeometryCache;
     struct Material;
     class MaterialCache;
+    enum class MaterialChannel;
 }
 
 namespace asset
 {
+    class AssetStreamer;
+    class AssetCache;
+    class SceneFile;
+    class PackFile;
+
     class AssetLoader
     {
     public:
-        AssetLoader(rendering::GeometryCache& geometry, rendering::MaterialCache& materials);
+        // Without an asset cache, everything is processed from the source files on every load.
+        // Files are looked up from the pack first, and then from the file system.
+        AssetLoader(rendering::GeometryCache& geometry, rendering::MaterialCache& materials,
+                    AssetCache* cache = nullptr, const PackFile* pack = nullptr);
 
         bool loadModel(const std::string& filename, rendering::Mesh& mesh);
+        // Scenes may be either text or binary, see SceneFile.hpp
         bool loadScene(const std::string& filename, rendering::Scene& scene);
+
+        // Reads the scene description and requests its assets from the streamer. The scene
+        // is filled in by the completion callbacks, as the data arrives.
+        bool streamScene(const std::string& filename, rendering::Scene& scene, AssetStreamer& streamer);
         bool loadImage(const std::string& filename, graphics::Image& image);
+
+        // Decodes a TGA file straight into the material cache. An empty destination rectangle
+        // is allocated from the cache to the size of the image.
+        bool loadTextureToCache(const std::string& filename, rendering::MaterialChannel channel,
+                                Rect<int, 2>& dstRect);
         bool loadMaterial(const std::string& filename, rendering::Material& material);
     private:
+        friend class AssetStreamer;
+
+        MappedFile openFile(const std::string& filename) const;
+
+        // Corners of the polygon are stored contiguously in a shared array
         struct Face 
         {
-            std::vector<uint3> indices;
+            uint32_t firstCorner;
+            uint32_t numCorners;
         };
 
-        bool parseObj(DataBlob<> buffer, rendering::Mesh& mesh);
+        // Maps a binary scene, or converts a text one. The file or the converted data backs the scene file.
+        bool readSceneFile(const std::string& filename, MappedFile& file, std::vector<uint8_t>& converted,
+                           SceneFile& sceneFile);
+
+        // Adds all the objects of the scene file without meshes, returns the index of the first one
+        int addSceneObjects(const SceneFile& sceneFile, rendering::Scene& scene);
+
+        // Reads the mesh from the asset cache, or parses the OBJ and caches the result
+        bool decodeModel(const std::string& filename, Range<const char> buffer, rendering::Mesh& mesh);
+        bool readCachedMesh(const std::string& filename, rendering::Mesh& mesh);
+        void storeCachedMesh(const std::string& filename, const std::string& materialLibrary,
+                             const rendering::Mesh& mesh);
+
+        // Loads all the channels of a material to the cache, or its converted tile from the asset cache
+        bool loadMaterialToCache(const std::string& library, const std::string& albedo,
+                                 const std::string& roughness, const std::string& normal, Rect<int, 2>& dstRect);
+        bool readCachedMaterialTile(const std::string& library, Rect<int, 2>& dstRect);
+        void storeCachedMaterialTile(const std::string& library, const std::vector<std::string>& textures,
+                                     Rect<int, 2> rect);
+
+        // Like loadTextureToCache(), from the contents of the file
+        bool decodeTextureToCache(Range<const uint8_t> buffer, rendering::MaterialChannel channel,
+                                  Rect<int, 2>& dstRect);
+
+        // The material library is returned relative to the working directory, like the OBJ filename
+        bool parseObj(Range<const char> buffer, const std::string& filename, rendering::Mesh& mesh,
+                      std::string& materialLibrary);
         bool constructMesh(Range<float3> positions, Range<float2> texcoords, Range<float3> normals,
-                           Range<Face> faces, rendering::Mesh& mesh);
+                           Range<const uint3> corners, Range<Face> faces, rendering::Mesh& mesh);
 
-        DataBlob<> fileToBlob(const std::string& filename);
-        int getLine(char *lineBuffer, Range<const char> sourceBuffer, int pos);
+        size_t getLine(char *lineBuffer, Range<const char> sourceBuffer, size_t pos);
 
 #pragma pack(push, 1)   // This is required, because the TGA fields are not aligned
         struct TgaHeader
@@ -94,9 +147,18 @@ namespace asset
             uint8_t     attributesType;
         };
 #pragma pack(pop)
-        bool parseTga(DataBlob<> buffer, graphics::Image& image);
+        bool parseTga(Range<const uint8_t> buffer, graphics::Image& image);
+
+        // Decodes both uncompressed and run-length encoded image data. Rows are passed to the
+        // callback in file order, uncompressed ones directly from the buffer. The header callback
+        // may reject the image by returning false.
+        using TgaHeaderFunc = std::function<bool(const TgaHeader& header)>;
+        using TgaRowFunc    = std::function<void(uint32_t y, const uint8_t* row)>;
+        bool decodeTga(Range<const uint8_t> buffer, const TgaHeaderFunc& onHeader, const TgaRowFunc& onRow);
 
         rendering::GeometryCache& m_geometry;
         rendering::MaterialCache& m_materials;
+        AssetCache*               m_cache;
+        const PackFile*           m_pack;
     };
 }
@@ -0,0 +1,246 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    AssetStreamer.cpp
+*/
+
+#include "AssetStreamer.hpp"
+#include "AssetLoader.hpp"
+
+#include "../rendering/Mesh.hpp"
+#include "../graphics/Image.hpp"
+#include "../MappedFile.hpp"
+#include "../Log.hpp"
+
+namespace asset
+{
+    enum class RequestType
+    {
+        Mesh,
+        Image,
+        Texture
+    };
+
+    struct AssetStreamer::Request
+    {
+        RequestType                         type;
+        std::string                         filename;
+        StreamPriority                      priority;
+        uint64_t                            sequence;
+
+        MappedFile                          file;
+        bool                                success = false;
+
+        std::unique_ptr<rendering::Mesh>    mesh;
+        std::unique_ptr<graphics::Image>    image;
+        MeshCallback                        onMeshComplete;
+        ImageCallback                       onImageComplete;
+        FileCallback                        onTextureComplete;
+    };
+
+    bool AssetStreamer::RequestOrder::operator()(const std::shared_ptr<Request>& a,
+                                                 const std::shared_ptr<Request>& b) const
+    {
+        // std::priority_queue pops the largest element first
+        if (a->priority != b->priority) return a->priority < b->priority;
+        return a->sequence > b->sequence;
+    }
+
+    AssetStreamer::AssetStreamer(AssetLoader& loader, uint32_t decodeThreads) :
+        m_loader(loader),
+        m_nextSequence(0),
+        m_requestsInFlight(0),
+        m_quit(false)
+    {
+        if (decodeThreads == 0)
+        {
+            uint32_t hardwareThreads = std::thread::hardware_concurrency();
+            decodeThreads = (hardwareThreads > 1) ? hardwareThreads - 1 : 1;
+        }
+
+        m_ioThread = std::thread(&AssetStreamer::ioThread, this);
+        for (uint32_t i = 0; i < decodeThreads; i++)
+        {
+            m_decodeThreads.emplace_back(&AssetStreamer::decodeThread, this);
+        }
+    }
+
+    AssetStreamer::~AssetStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_ioAvailable.notify_all();
+        m_decodeAvailable.notify_all();
+
+        m_ioThread.join();
+        for (auto& thread : m_decodeThreads)
+        {
+            thread.join();
+        }
+    }
+
+    void AssetStreamer::requestMesh(const std::string& filename, StreamPriority priority, MeshCallback onComplete)
+    {
+        auto request = std::make_shared<Request>();
+        request->type           = RequestType::Mesh;
+        request->filename       = filename;
+        request->priority       = priority;
+        request->onMeshComplete = onComplete;
+        enqueue(request);
+    }
+
+    void AssetStreamer::requestImage(const std::string& filename, StreamPriority priority, ImageCallback onComplete)
+    {
+        auto request = std::make_shared<Request>();
+        request->type               = RequestType::Image;
+        request->filename           = filename;
+        request->priority           = priority;
+        request->onImageComplete    = onComplete;
+        enqueue(request);
+    }
+
+    void AssetStreamer::requestTexture(const std::string& filename, StreamPriority priority, FileCallback onComplete)
+    {
+        auto request = std::make_shared<Request>();
+        request->type               = RequestType::Texture;
+        request->filename           = filename;
+        request->priority           = priority;
+        request->onTextureComplete  = onComplete;
+        enqueue(request);
+    }
+
+    void AssetStreamer::enqueue(std::shared_ptr<Request> request)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            request->sequence = m_nextSequence++;
+            m_ioQueue.push(request);
+            m_requestsInFlight++;
+        }
+        m_ioAvailable.notify_one();
+    }
+
+    uint32_t AssetStreamer::dispatchCompleted(uint32_t maxCallbacks)
+    {
+        std::vector<std::shared_ptr<Request>> completed;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_completed.size() <= maxCallbacks)
+            {
+                completed.swap(m_completed);
+            }
+            else
+            {
+                completed.assign(m_completed.begin(), m_completed.begin() + maxCallbacks);
+                m_completed.erase(m_completed.begin(), m_completed.begin() + maxCallbacks);
+            }
+        }
+
+        // Callbacks are run without holding the lock, so that they may issue new requests
+        for (auto& request : completed)
+        {
+            if (!request->success)
+            {
+                std::string err("Streaming failed: ");
+                err.append(request->filename).append("\n");
+                logError(err);
+                continue;
+            }
+
+            if ((request->type == RequestType::Mesh) && request->onMeshComplete)
+            {
+                request->onMeshComplete(*request->mesh);
+            }
+            else if ((request->type == RequestType::Image) && request->onImageComplete)
+            {
+                request->onImageComplete(*request->image);
+            }
+            else if ((request->type == RequestType::Texture) && request->onTextureComplete)
+            {
+                request->onTextureComplete(request->file.bytes());
+            }
+        }
+
+        return static_cast<uint32_t>(completed.size());
+    }
+
+    bool AssetStreamer::idle() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return (m_requestsInFlight == 0) && m_completed.empty();
+    }
+
+    void AssetStreamer::ioThread()
+    {
+        while (true)
+        {
+            std::shared_ptr<Request> request;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_ioAvailable.wait(lock, [this] { return m_quit || !m_ioQueue.empty(); });
+                if (m_quit) return;
+
+                request = m_ioQueue.top();
+                m_ioQueue.pop();
+            }
+
+            // Map the file and let the OS start paging it in, while the decoders are busy.
+            // Compressed pack entries are decompressed here, off the decode threads.
+            request->file = m_loader.openFile(request->filename);
+            request->file.prefetch();
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_decodeQueue.push(request);
+            }
+            m_decodeAvailable.notify_one();
+        }
+    }
+
+    void AssetStreamer::decodeThread()
+    {
+        while (true)
+        {
+            std::shared_ptr<Request> request;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_decodeAvailable.wait(lock, [this] { return m_quit || !m_decodeQueue.empty(); });
+                if (m_quit) return;
+
+                request = m_decodeQueue.top();
+                m_decodeQueue.pop();
+            }
+
+            request->success = decode(*request);
+
+            // The mapping is no longer needed after decoding, except by the texture callbacks
+            if (request->type != RequestType::Texture) request->file = MappedFile();
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_completed.emplace_back(request);
+                m_requestsInFlight--;
+            }
+        }
+    }
+
+    bool AssetStreamer::decode(Request& request)
+    {
+        if (!request.file.valid()) return false;
+
+        switch (request.type)
+        {
+        case RequestType::Mesh:
+            request.mesh = std::make_unique<rendering::Mesh>();
+            return m_loader.decodeModel(request.filename, request.file.asRange<char>(), *request.mesh);
+        case RequestType::Image:
+            request.image = std::make_unique<graphics::Image>();
+            return m_loader.parseTga(request.file.bytes(), *request.image);
+        case RequestType::Texture:
+            return true;
+        default:
+            return false;
+        }
+    }
+}
@@ -0,0 +1,106 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    AssetStreamer.hpp
+
+    Asynchronous asset loading. Requests go through a priority queue to an
+    I/O thread, which maps the files, and then to a pool of decode threads,
+    which parse them. The completion callbacks are run on the thread that
+    calls dispatchCompleted(), i.e. the render thread, so they may freely
+    touch the geometry and material caches.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "../Types.hpp"
+
+namespace graphics
+{
+    class Image;
+}
+
+namespace rendering
+{
+    class Mesh;
+}
+
+namespace asset
+{
+    class AssetLoader;
+
+    // Higher priority requests are served first, equal priorities in request order
+    enum class StreamPriority
+    {
+        Low,
+        Normal,
+        High
+    };
+
+    class AssetStreamer
+    {
+    public:
+        using MeshCallback  = std::function<void(rendering::Mesh& mesh)>;
+        using ImageCallback = std::function<void(graphics::Image& image)>;
+        using FileCallback  = std::function<void(Range<const uint8_t> data)>;
+
+        // Zero decode threads means one less than the number of hardware threads
+        AssetStreamer(AssetLoader& loader, uint32_t decodeThreads = 0);
+        ~AssetStreamer();
+
+        AssetStreamer(const AssetStreamer&)             = delete;
+        AssetStreamer& operator=(const AssetStreamer&)  = delete;
+
+        void requestMesh(const std::string& filename, StreamPriority priority, MeshCallback onComplete);
+        void requestImage(const std::string& filename, StreamPriority priority, ImageCallback onComplete);
+
+        // Textures are only mapped, and decoded by the callback, so that it can write the rows
+        // straight to their destination, e.g. the material cache, without an intermediate image
+        void requestTexture(const std::string& filename, StreamPriority priority, FileCallback onComplete);
+
+        // Runs the callbacks of the finished requests, returns the number of callbacks run
+        uint32_t dispatchCompleted(uint32_t maxCallbacks = ~0u);
+
+        // True, if there are no requests in flight and no undispatched completions
+        bool idle() const;
+    private:
+        struct Request;
+        struct RequestOrder
+        {
+            bool operator()(const std::shared_ptr<Request>& a, const std::shared_ptr<Request>& b) const;
+        };
+        using RequestQueue = std::priority_queue<std::shared_ptr<Request>,
+                                                 std::vector<std::shared_ptr<Request>>,
+                                                 RequestOrder>;
+
+        void enqueue(std::shared_ptr<Request> request);
+
+        void ioThread();
+        void decodeThread();
+        bool decode(Request& request);
+
+        AssetLoader&                            m_loader;
+
+        mutable std::mutex                      m_mutex;
+        std::condition_variable                 m_ioAvailable;
+        std::condition_variable                 m_decodeAvailable;
+
+        RequestQueue                            m_ioQueue;
+        RequestQueue                            m_decodeQueue;
+        std::vector<std::shared_ptr<Request>>   m_completed;
+
+        uint64_t                                m_nextSequence;
+        uint32_t                                m_requestsInFlight;
+        bool                                    m_quit;
+
+        std::thread                             m_ioThread;
+        std::vector<std::thread>                m_decodeThreads;
+    };
+}
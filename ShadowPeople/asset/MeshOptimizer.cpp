@@ -0,0 +1,434 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    MeshOptimizer.cpp
+*/
+
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+    constexpr uint32_t Unused = ~0u;
+
+    // FIFO cache, in which a vertex is resident if it was loaded less than cacheSize misses ago
+    class VertexCacheSimulator
+    {
+    public:
+        VertexCacheSimulator(uint32_t numVertices, uint32_t cacheSize) :
+            m_loadTimes(numVertices, 0),
+            m_time(cacheSize + 1),
+            m_cacheSize(cacheSize)
+        {}
+
+        // Returns the number of misses
+        uint32_t triangle(const uint32_t* corners)
+        {
+            uint32_t misses = 0;
+            for (int i = 0; i < 3; i++)
+            {
+                uint32_t& loadTime = m_loadTimes[corners[i]];
+                if (m_time - loadTime > m_cacheSize)
+                {
+                    loadTime = m_time++;
+                    misses++;
+                }
+            }
+            return misses;
+        }
+
+        void flush() { m_time += m_cacheSize + 1; }
+    private:
+        std::vector<uint32_t>   m_loadTimes;
+        uint32_t                m_time;
+        uint32_t                m_cacheSize;
+    };
+
+    // Triangles around each vertex, in compressed rows
+    struct VertexTriangles
+    {
+        VertexTriangles(Range<const uint32_t> indices, uint32_t numVertices) :
+            offsets(numVertices + 1, 0),
+            triangles(indices.size())
+        {
+            for (auto index : indices) offsets[index + 1]++;
+            for (uint32_t v = 0; v < numVertices; v++) offsets[v + 1] += offsets[v];
+
+            std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); i++)
+            {
+                triangles[cursors[indices[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+        }
+
+        std::vector<uint32_t> offsets;
+        std::vector<uint32_t> triangles;
+    };
+
+    struct Cluster
+    {
+        uint32_t    firstTriangle;
+        uint32_t    numTriangles;
+        float       sortKey;
+    };
+
+    // Cosine of the widest angle between a triangle and the average normal of its meshlet, about
+    // 25 degrees. Meshlets with wider normal cones are seldom culled by them.
+    constexpr float MeshletMinConeDot = 0.9f;
+
+    // Triangles are clockwise, as in Mesh
+    float3 triangleNormal(Range<const Vertex> vertices, const uint32_t* corners)
+    {
+        float3 p0 = vertices[corners[0]].position;
+        float3 p1 = vertices[corners[1]].position;
+        float3 p2 = vertices[corners[2]].position;
+        return cross(p2 - p0, p1 - p0);
+    }
+
+    void meshletBounds(Range<const Vertex> vertices, Range<const uint32_t> indices, rendering::Meshlet& meshlet)
+    {
+        const uint32_t* begin   = &indices[meshlet.firstIndex];
+        const uint32_t* end     = begin + meshlet.numIndices;
+
+        // Sphere around the bounding box
+        float3 minCorner(FLT_MAX);
+        float3 maxCorner(-FLT_MAX);
+        for (const uint32_t* index = begin; index < end; index++)
+        {
+            const float3& position = vertices[*index].position;
+            for (int i = 0; i < 3; i++)
+            {
+                minCorner[i] = std::min<float>(minCorner[i], position[i]);
+                maxCorner[i] = std::max<float>(maxCorner[i], position[i]);
+            }
+        }
+        meshlet.center = 0.5f * (minCorner + maxCorner);
+        meshlet.radius = 0.f;
+        for (const uint32_t* index = begin; index < end; index++)
+        {
+            meshlet.radius = std::max<float>(meshlet.radius, (vertices[*index].position - meshlet.center).length());
+        }
+
+        // The cone axis is the average normal, and its opening the widest deviation from it.
+        // Degenerate triangles are never visible, so they do not count.
+        float3 axis(0.f);
+        std::vector<float3> normals;
+        for (const uint32_t* corners = begin; corners < end; corners += 3)
+        {
+            float3 n        = triangleNormal(vertices, corners);
+            float length    = n.length();
+            if (length > 0.f)
+            {
+                normals.emplace_back(n / length);
+                axis += normals.back();
+            }
+        }
+
+        // A cutoff of one never culls
+        meshlet.coneAxis    = float3(0.f);
+        meshlet.coneCutoff  = 1.f;
+        float axisLength = axis.length();
+        if (axisLength <= 0.f) return;
+        axis = axis / axisLength;
+
+        float minDot = 1.f;
+        for (const auto& n : normals) minDot = std::min<float>(minDot, n.dot(axis));
+        if (minDot <= 0.f) return;
+
+        // Every triangle faces away, if the view direction is within 90 degrees minus the
+        // cone opening of the axis
+        meshlet.coneAxis    = axis;
+        meshlet.coneCutoff  = sqrtf(1.f - minDot * minDot);
+    }
+}
+
+namespace asset
+{
+    VertexCacheStatistics analyzeVertexCache(Range<const uint32_t> indices, uint32_t numVertices, uint32_t cacheSize)
+    {
+        VertexCacheSimulator cache(numVertices, cacheSize);
+        uint32_t transforms = 0;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            transforms += cache.triangle(&indices[i]);
+        }
+
+        VertexCacheStatistics statistics;
+        statistics.vertexTransforms = transforms;
+        statistics.acmr = (indices.size() >= 3) ? static_cast<float>(transforms) / (indices.size() / 3) : 0.f;
+        statistics.atvr = (numVertices > 0) ? static_cast<float>(transforms) / numVertices : 0.f;
+        return statistics;
+    }
+
+    void optimizeVertexCache(Range<const uint32_t> indices, uint32_t numVertices, Range<uint32_t> output,
+                             uint32_t cacheSize)
+    {
+        uint32_t numTriangles = static_cast<uint32_t>(indices.size() / 3);
+        VertexTriangles adjacency(indices, numVertices);
+
+        // Number of triangles not yet emitted around each vertex
+        std::vector<uint32_t> liveTriangles(numVertices);
+        for (uint32_t v = 0; v < numVertices; v++) liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+
+        std::vector<uint32_t>   cacheTimes(numVertices, 0);
+        std::vector<uint8_t>    emitted(numTriangles, 0);
+        std::vector<uint32_t>   deadEnds;
+        std::vector<uint32_t>   candidates;
+        uint32_t time   = cacheSize + 1;
+        uint32_t cursor = 0;
+        size_t out      = 0;
+
+        // When the neighbourhood runs out, continue from the most recently used vertex that still
+        // has triangles left, or as the last resort, from the next one in input order
+        auto skipDeadEnd = [&]() -> uint32_t
+        {
+            while (!deadEnds.empty())
+            {
+                uint32_t vertex = deadEnds.back();
+                deadEnds.pop_back();
+                if (liveTriangles[vertex] > 0) return vertex;
+            }
+            for (; cursor < numVertices; cursor++)
+            {
+                if (liveTriangles[cursor] > 0) return cursor;
+            }
+            return Unused;
+        };
+
+        uint32_t fanning = skipDeadEnd();
+        while (fanning != Unused)
+        {
+            // Emit all the remaining triangles around the fanning vertex
+            candidates.clear();
+            for (uint32_t i = adjacency.offsets[fanning]; i < adjacency.offsets[fanning + 1]; i++)
+            {
+                uint32_t triangle = adjacency.triangles[i];
+                if (emitted[triangle]) continue;
+                emitted[triangle] = 1;
+
+                for (int c = 0; c < 3; c++)
+                {
+                    uint32_t vertex = indices[triangle * 3 + c];
+                    output[out++] = vertex;
+                    deadEnds.emplace_back(vertex);
+                    candidates.emplace_back(vertex);
+                    liveTriangles[vertex]--;
+                    if (time - cacheTimes[vertex] > cacheSize) cacheTimes[vertex] = time++;
+                }
+            }
+
+            // The next fanning vertex is the oldest one among the candidates, that will still be
+            // in the cache after its remaining triangles have been emitted
+            uint32_t next   = Unused;
+            int bestPriority = -1;
+            for (auto vertex : candidates)
+            {
+                if (liveTriangles[vertex] == 0) continue;
+
+                int priority = 0;
+                if (time - cacheTimes[vertex] + 2 * liveTriangles[vertex] <= cacheSize)
+                {
+                    priority = static_cast<int>(time - cacheTimes[vertex]);
+                }
+                if (priority > bestPriority)
+                {
+                    bestPriority    = priority;
+                    next            = vertex;
+                }
+            }
+
+            fanning = (next != Unused) ? next : skipDeadEnd();
+        }
+    }
+
+    void optimizeOverdraw(Range<const uint32_t> indices, Range<const Vertex> vertices, Range<uint32_t> output,
+                          float threshold, uint32_t cacheSize)
+    {
+        uint32_t numTriangles   = static_cast<uint32_t>(indices.size() / 3);
+        uint32_t numVertices    = static_cast<uint32_t>(vertices.size());
+
+        // Hard boundaries are where the cache starts over, i.e. all the corners miss
+        std::vector<uint32_t> hardBoundaries;
+        std::vector<uint32_t> misses(numTriangles);
+        {
+            VertexCacheSimulator cache(numVertices, cacheSize);
+            for (uint32_t t = 0; t < numTriangles; t++)
+            {
+                misses[t] = cache.triangle(&indices[t * 3]);
+                if ((t == 0) || (misses[t] == 3)) hardBoundaries.emplace_back(t);
+            }
+            hardBoundaries.emplace_back(numTriangles);
+        }
+
+        // Soft boundaries split the hard clusters, as soon as the part so far has an ACMR within
+        // the threshold. The cache is flushed at each split, as the parts may end up far apart.
+        std::vector<Cluster> clusters;
+        VertexCacheSimulator cache(numVertices, cacheSize);
+        for (size_t h = 0; h + 1 < hardBoundaries.size(); h++)
+        {
+            uint32_t begin  = hardBoundaries[h];
+            uint32_t end    = hardBoundaries[h + 1];
+
+            uint32_t clusterMisses = 0;
+            for (uint32_t t = begin; t < end; t++) clusterMisses += misses[t];
+            float maxMisses = threshold * clusterMisses / (end - begin);
+
+            cache.flush();
+            uint32_t start      = begin;
+            uint32_t partMisses = 0;
+            for (uint32_t t = begin; t < end; t++)
+            {
+                partMisses += cache.triangle(&indices[t * 3]);
+                if ((t + 1 < end) && (partMisses <= maxMisses * (t + 1 - start)))
+                {
+                    clusters.emplace_back(Cluster{ start, t + 1 - start, 0.f });
+                    cache.flush();
+                    start       = t + 1;
+                    partMisses  = 0;
+                }
+            }
+            clusters.emplace_back(Cluster{ start, end - start, 0.f });
+        }
+
+        // Clusters facing away from the center of the mesh are likely to occlude the others.
+        // Everything is weighted by area, so that slivers do not skew the result.
+        std::vector<float3> centroids(clusters.size());
+        std::vector<float3> normals(clusters.size());
+        float3 meshCentroid(0.f);
+        float meshArea = 0.f;
+        for (size_t c = 0; c < clusters.size(); c++)
+        {
+            float3 centroid(0.f);
+            float3 normal(0.f);
+            float area = 0.f;
+            for (uint32_t t = clusters[c].firstTriangle; t < clusters[c].firstTriangle + clusters[c].numTriangles; t++)
+            {
+                float3 p0 = vertices[indices[t * 3 + 0]].position;
+                float3 p1 = vertices[indices[t * 3 + 1]].position;
+                float3 p2 = vertices[indices[t * 3 + 2]].position;
+
+                // Triangles are clockwise, as in Mesh
+                float3 n            = cross(p2 - p0, p1 - p0);
+                float triangleArea  = 0.5f * n.length();
+                centroid    += (triangleArea / 3.f) * (p0 + p1 + p2);
+                normal      += n;
+                area        += triangleArea;
+            }
+
+            meshCentroid    += centroid;
+            meshArea        += area;
+            centroids[c]    = (area > 0.f) ? centroid / area : vertices[indices[clusters[c].firstTriangle * 3]].position;
+            normals[c]      = normal;
+        }
+        if (meshArea > 0.f) meshCentroid = meshCentroid / meshArea;
+
+        for (size_t c = 0; c < clusters.size(); c++)
+        {
+            float normalLength = normals[c].length();
+            clusters[c].sortKey = (normalLength > 0.f) ? (centroids[c] - meshCentroid).dot(normals[c]) / normalLength : 0.f;
+        }
+
+        std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b)
+        {
+            return a.sortKey > b.sortKey;
+        });
+
+        size_t out = 0;
+        for (const auto& cluster : clusters)
+        {
+            const uint32_t* begin = &indices[cluster.firstTriangle * 3];
+            std::copy(begin, begin + cluster.numTriangles * 3, &output[out]);
+            out += cluster.numTriangles * 3;
+        }
+    }
+
+    void buildMeshlets(Range<const Vertex> vertices, Range<const uint32_t> indices,
+                       std::vector<rendering::Meshlet>& meshlets, uint32_t maxVertices, uint32_t maxTriangles)
+    {
+        uint32_t numTriangles = static_cast<uint32_t>(indices.size() / 3);
+
+        // Meshlet that each vertex was last added to
+        std::vector<uint32_t> vertexMeshlet(vertices.size(), Unused);
+        meshlets.clear();
+
+        rendering::Meshlet current  = {};
+        uint32_t meshletVertices    = 0;
+        float3 normalSum(0.f);
+        for (uint32_t t = 0; t < numTriangles; t++)
+        {
+            uint32_t meshletId      = static_cast<uint32_t>(meshlets.size());
+            const uint32_t* corners = &indices[t * 3];
+
+            uint32_t newVertices = 0;
+            for (int c = 0; c < 3; c++)
+            {
+                if (vertexMeshlet[corners[c]] != meshletId) newVertices++;
+            }
+
+            // Degenerate triangles fit any cone
+            float3 normal       = triangleNormal(vertices, corners);
+            float length        = normal.length();
+            float axisLength    = normalSum.length();
+            if (length > 0.f) normal = normal / length;
+            bool bent = (length > 0.f) && (axisLength > 0.f) && (normal.dot(normalSum / axisLength) < MeshletMinConeDot);
+
+            // The first triangle that does not fit starts the next meshlet
+            if ((current.numIndices == maxTriangles * 3) || (meshletVertices + newVertices > maxVertices) || bent)
+            {
+                meshlets.emplace_back(current);
+                current             = {};
+                current.firstIndex  = t * 3;
+                meshletVertices     = 0;
+                normalSum           = float3(0.f);
+                meshletId++;
+            }
+
+            for (int c = 0; c < 3; c++)
+            {
+                if (vertexMeshlet[corners[c]] == meshletId) continue;
+                vertexMeshlet[corners[c]] = meshletId;
+                meshletVertices++;
+            }
+            if (length > 0.f) normalSum += normal;
+            current.numIndices += 3;
+        }
+        if (current.numIndices > 0) meshlets.emplace_back(current);
+
+        for (auto& meshlet : meshlets) meshletBounds(vertices, indices, meshlet);
+    }
+
+    void optimizeVertexFetch(std::vector<Vertex>& vertices, Range<uint32_t> indices)
+    {
+        std::vector<uint32_t> remap(vertices.size(), Unused);
+        std::vector<Vertex> reordered;
+        reordered.reserve(vertices.size());
+        for (auto& index : indices)
+        {
+            if (remap[index] == Unused)
+            {
+                remap[index] = static_cast<uint32_t>(reordered.size());
+                reordered.emplace_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(reordered);
+    }
+
+    void optimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+                      std::vector<rendering::Meshlet>& meshlets,
+                      VertexCacheStatistics* before, VertexCacheStatistics* after)
+    {
+        uint32_t numVertices = static_cast<uint32_t>(vertices.size());
+        if (before) *before = analyzeVertexCache(indices, numVertices);
+
+        std::vector<uint32_t> cacheOptimized(indices.size());
+        optimizeVertexCache(indices, numVertices, cacheOptimized);
+        optimizeOverdraw(cacheOptimized, vertices, indices);
+        buildMeshlets(vertices, indices, meshlets);
+        optimizeVertexFetch(vertices, indices);
+
+        if (after) *after = analyzeVertexCache(indices, static_cast<uint32_t>(vertices.size()));
+    }
+}
@@ -0,0 +1,69 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    MeshOptimizer.hpp
+
+    Import time reordering of triangles and vertices for the GPU. Triangles
+    are first ordered for the post-transform vertex cache with Tipsify
+    (Sander et al. 2007, "Fast Triangle Reordering for Vertex Locality and
+    Reduced Overdraw"). The result is split into clusters, which are sorted
+    so that outward facing ones come first and occlude the rest, trading a
+    bounded loss of cache efficiency for less overdraw. The optimized order
+    is then cut into meshlets for culling, which keeps the cache efficiency
+    and the overdraw order of the whole mesh. Last, the vertices are renumbered in
+    the order of first use, so that vertex fetches walk through memory
+    linearly.
+
+    Cache efficiency is measured with a FIFO cache simulation. ACMR is the
+    average number of vertex shader invocations per triangle, and ATVR the
+    same per unique vertex. The ideal ATVR is 1.0.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "../Types.hpp"
+#include "../cpugpu/GeometryTypes.h"
+#include "../rendering/Mesh.hpp"
+
+namespace asset
+{
+    constexpr uint32_t VertexCacheSize = 16;
+
+    struct VertexCacheStatistics
+    {
+        uint32_t    vertexTransforms;
+        float       acmr;
+        float       atvr;
+    };
+
+    VertexCacheStatistics analyzeVertexCache(Range<const uint32_t> indices, uint32_t numVertices,
+                                             uint32_t cacheSize = VertexCacheSize);
+
+    // Reorders the triangles with Tipsify. The output must have as many indices as the input.
+    void optimizeVertexCache(Range<const uint32_t> indices, uint32_t numVertices, Range<uint32_t> output,
+                             uint32_t cacheSize = VertexCacheSize);
+
+    // Reorders the clusters of cache optimized triangles from the outside in. Clusters are split
+    // further as long as the ACMR of each stays within the threshold of what it was.
+    void optimizeOverdraw(Range<const uint32_t> indices, Range<const Vertex> vertices, Range<uint32_t> output,
+                          float threshold = 1.05f, uint32_t cacheSize = VertexCacheSize);
+
+    // Cuts the triangles into meshlets of at most the given size in their current order, so that
+    // the triangles of each meshlet are contiguous. Tipsify fans are local, so the meshlets are
+    // compact in the cache optimized order. A meshlet also ends before a triangle, which would
+    // open its normal cone too wide for culling.
+    void buildMeshlets(Range<const Vertex> vertices, Range<const uint32_t> indices,
+                       std::vector<rendering::Meshlet>& meshlets,
+                       uint32_t maxVertices = rendering::MeshletMaxVertices,
+                       uint32_t maxTriangles = rendering::MeshletMaxTriangles);
+
+    // Renumbers the vertices in the order of first use, and drops the unused ones
+    void optimizeVertexFetch(std::vector<Vertex>& vertices, Range<uint32_t> indices);
+
+    // All the above in order. The statistics are optional.
+    void optimizeMesh(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+                      std::vector<rendering::Meshlet>& meshlets,
+                      VertexCacheStatistics* before = nullptr, VertexCacheStatistics* after = nullptr);
+}
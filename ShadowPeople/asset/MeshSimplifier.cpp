@@ -0,0 +1,330 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    MeshSimplifier.cpp
+*/
+
+#include "MeshSimplifier.hpp"
+#include "MeshOptimizer.hpp"
+#include "VertexWelder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+namespace
+{
+    constexpr uint32_t Unused           = ~0u;
+    constexpr uint32_t MinLodTriangles  = 64;
+    constexpr float    MinLodReduction  = 0.75f;   // Otherwise the level is not worth its memory
+    constexpr float    MaxNormalTurn    = 0.25f;   // Cosine of the largest rotation of a triangle in a collapse
+
+    // Squared distance to a set of planes, weighted by triangle area
+    struct Quadric
+    {
+        double a00 = 0.0, a01 = 0.0, a02 = 0.0, a11 = 0.0, a12 = 0.0, a22 = 0.0;
+        double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+        double c = 0.0;
+        double weight = 0.0;
+
+        // Plane dot(n, p) + d = 0, with unit normal
+        void addPlane(const float3& n, float d, double w)
+        {
+            a00 += w * n[0] * n[0];
+            a01 += w * n[0] * n[1];
+            a02 += w * n[0] * n[2];
+            a11 += w * n[1] * n[1];
+            a12 += w * n[1] * n[2];
+            a22 += w * n[2] * n[2];
+            b0  += w * n[0] * d;
+            b1  += w * n[1] * d;
+            b2  += w * n[2] * d;
+            c   += w * d * d;
+            weight += w;
+        }
+
+        void add(const Quadric& q)
+        {
+            a00 += q.a00; a01 += q.a01; a02 += q.a02;
+            a11 += q.a11; a12 += q.a12; a22 += q.a22;
+            b0 += q.b0; b1 += q.b1; b2 += q.b2;
+            c += q.c;
+            weight += q.weight;
+        }
+
+        // Mean squared distance
+        double error(const float3& p) const
+        {
+            if (weight <= 0.0) return 0.0;
+
+            double x = p[0], y = p[1], z = p[2];
+            double e = a00 * x * x + a11 * y * y + a22 * z * z +
+                       2.0 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                       2.0 * (b0 * x + b1 * y + b2 * z) + c;
+            return std::max(e, 0.0) / weight;
+        }
+    };
+
+    struct Collapse
+    {
+        uint32_t    from;
+        uint32_t    to;
+        float       error;
+    };
+
+    // Vertices with the same position share one representative, so that the quadrics and the
+    // topology do not see the UV seams
+    std::vector<uint32_t> positionRepresentatives(Range<const Vertex> vertices)
+    {
+        uint32_t numVertices = static_cast<uint32_t>(vertices.size());
+        std::vector<uint3> positions(numVertices);
+        for (uint32_t v = 0; v < numVertices; v++)
+        {
+            for (int i = 0; i < 3; i++) memcpy(&positions[v][i], &vertices[v].position[i], sizeof(uint32_t));
+        }
+
+        std::vector<uint32_t> representatives(numVertices);
+        asset::VertexWelder welder(numVertices);
+        welder.weld(positions, representatives);
+        for (auto& representative : representatives) representative = welder.firstOccurrences()[representative];
+        return representatives;
+    }
+
+    // Vertices on UV seams and open borders never move
+    std::vector<uint8_t> lockedVertices(Range<const uint32_t> indices, const std::vector<uint32_t>& representatives)
+    {
+        uint32_t numVertices = static_cast<uint32_t>(representatives.size());
+        std::vector<uint8_t> lockedRepresentatives(numVertices, 0);
+
+        std::vector<uint32_t> users(numVertices, Unused);
+        for (auto index : indices)
+        {
+            uint32_t& user = users[representatives[index]];
+            if (user == Unused) user = index;
+            else if (user != index) lockedRepresentatives[representatives[index]] = 1;
+        }
+
+        auto edgeKey = [](uint32_t a, uint32_t b) { return (static_cast<uint64_t>(a) << 32) | b; };
+
+        std::vector<uint64_t> edges;
+        edges.reserve(indices.size());
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            for (int e = 0; e < 3; e++)
+            {
+                edges.emplace_back(edgeKey(representatives[indices[i + e]], representatives[indices[i + (e + 1) % 3]]));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+
+        // An edge without its opposite is on a border
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            for (int e = 0; e < 3; e++)
+            {
+                uint32_t a = representatives[indices[i + e]];
+                uint32_t b = representatives[indices[i + (e + 1) % 3]];
+                if (!std::binary_search(edges.begin(), edges.end(), edgeKey(b, a)))
+                {
+                    lockedRepresentatives[a] = 1;
+                    lockedRepresentatives[b] = 1;
+                }
+            }
+        }
+
+        std::vector<uint8_t> locked(numVertices);
+        for (uint32_t v = 0; v < numVertices; v++) locked[v] = lockedRepresentatives[representatives[v]];
+        return locked;
+    }
+
+    std::vector<Quadric> vertexQuadrics(Range<const Vertex> vertices, Range<const uint32_t> indices,
+                                        const std::vector<uint32_t>& representatives)
+    {
+        std::vector<Quadric> quadrics(vertices.size());
+        for (size_t i = 0; i < indices.size(); i += 3)
+        {
+            const float3& p0 = vertices[indices[i + 0]].position;
+            const float3& p1 = vertices[indices[i + 1]].position;
+            const float3& p2 = vertices[indices[i + 2]].position;
+
+            float3 n = cross(p1 - p0, p2 - p0);
+            float length = n.length();
+            if (length <= 0.f) continue;
+
+            n = (1.f / length) * n;
+            float d = -n.dot(p0);
+            for (int c = 0; c < 3; c++)
+            {
+                quadrics[representatives[indices[i + c]]].addPlane(n, d, 0.5 * length);
+            }
+        }
+        return quadrics;
+    }
+
+    uint32_t resolve(const std::vector<uint32_t>& remap, uint32_t v)
+    {
+        while (remap[v] != v) v = remap[v];
+        return v;
+    }
+}
+
+namespace asset
+{
+    float simplifyMesh(Range<const Vertex> vertices, Range<const uint32_t> indices, uint32_t targetIndices,
+                       std::vector<uint32_t>& output)
+    {
+        uint32_t numVertices = static_cast<uint32_t>(vertices.size());
+
+        std::vector<uint32_t> representatives   = positionRepresentatives(vertices);
+        std::vector<uint8_t> locked             = lockedVertices(indices, representatives);
+        std::vector<Quadric> quadrics           = vertexQuadrics(vertices, indices, representatives);
+
+        output.assign(indices.begin(), indices.end());
+
+        std::vector<uint32_t> remap(numVertices);
+        std::vector<uint8_t> touched(numVertices);
+        std::vector<uint32_t> offsets(numVertices + 1);
+        std::vector<uint32_t> triangles;
+        std::vector<Collapse> collapses;
+
+        double maxError = 0.0;
+        while (output.size() > targetIndices)
+        {
+            // Triangles around each vertex
+            std::fill(offsets.begin(), offsets.end(), 0);
+            for (auto index : output) offsets[index + 1]++;
+            for (uint32_t v = 0; v < numVertices; v++) offsets[v + 1] += offsets[v];
+            triangles.resize(output.size());
+            {
+                std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+                for (size_t i = 0; i < output.size(); i++) triangles[cursors[output[i]]++] = static_cast<uint32_t>(i / 3);
+            }
+
+            // Both directions of every edge. An edge inside the mesh is in two triangles, but the
+            // other one has it the other way around.
+            collapses.clear();
+            auto addCollapse = [&](uint32_t from, uint32_t to)
+            {
+                if (locked[from] || (representatives[from] == representatives[to])) return;
+
+                Quadric quadric = quadrics[representatives[from]];
+                quadric.add(quadrics[representatives[to]]);
+                collapses.emplace_back(Collapse{ from, to, static_cast<float>(quadric.error(vertices[to].position)) });
+            };
+            for (size_t i = 0; i < output.size(); i += 3)
+            {
+                for (int e = 0; e < 3; e++)
+                {
+                    uint32_t a = output[i + e];
+                    uint32_t b = output[i + (e + 1) % 3];
+                    if (a < b)
+                    {
+                        addCollapse(a, b);
+                        addCollapse(b, a);
+                    }
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b)
+            {
+                return a.error < b.error;
+            });
+
+            // Cheapest collapses first, each vertex at most once per pass
+            std::iota(remap.begin(), remap.end(), 0);
+            std::fill(touched.begin(), touched.end(), 0);
+
+            size_t trianglesToRemove = (output.size() - targetIndices + 2) / 3;
+            size_t removed = 0;
+            for (const auto& collapse : collapses)
+            {
+                if (removed >= trianglesToRemove) break;
+                if (touched[collapse.from] || touched[collapse.to]) continue;
+
+                // Moving the vertex must not turn any remaining triangle too much
+                bool flips = false;
+                uint32_t degenerates = 0;
+                for (uint32_t t = offsets[collapse.from]; t < offsets[collapse.from + 1]; t++)
+                {
+                    const uint32_t* corners = output.data() + triangles[t] * 3;
+                    uint32_t c[3];
+                    for (int k = 0; k < 3; k++) c[k] = resolve(remap, corners[k]);
+                    if ((c[0] == collapse.to) || (c[1] == collapse.to) || (c[2] == collapse.to))
+                    {
+                        degenerates++;
+                        continue;
+                    }
+
+                    float3 p[3], q[3];
+                    for (int k = 0; k < 3; k++)
+                    {
+                        p[k] = vertices[c[k]].position;
+                        q[k] = vertices[(c[k] == collapse.from) ? collapse.to : c[k]].position;
+                    }
+                    float3 before   = cross(p[1] - p[0], p[2] - p[0]);
+                    float3 after    = cross(q[1] - q[0], q[2] - q[0]);
+                    if (before.dot(after) < MaxNormalTurn * before.length() * after.length())
+                    {
+                        flips = true;
+                        break;
+                    }
+                }
+                if (flips) continue;
+
+                remap[collapse.from]    = collapse.to;
+                touched[collapse.from]  = 1;
+                touched[collapse.to]    = 1;
+                quadrics[representatives[collapse.to]].add(quadrics[representatives[collapse.from]]);
+
+                removed += degenerates;
+                maxError = std::max<double>(maxError, collapse.error);
+            }
+            if (removed == 0) break;
+
+            // Drop the triangles that lost an edge
+            size_t numIndices = 0;
+            for (size_t i = 0; i < output.size(); i += 3)
+            {
+                uint32_t a = resolve(remap, output[i + 0]);
+                uint32_t b = resolve(remap, output[i + 1]);
+                uint32_t c = resolve(remap, output[i + 2]);
+                if ((a == b) || (b == c) || (c == a)) continue;
+
+                output[numIndices++] = a;
+                output[numIndices++] = b;
+                output[numIndices++] = c;
+            }
+            output.resize(numIndices);
+        }
+
+        return static_cast<float>(std::sqrt(maxError));
+    }
+
+    void buildLodChain(Range<const Vertex> vertices, std::vector<uint32_t>& indices,
+                       std::vector<rendering::MeshLod>& lods, uint32_t maxLods)
+    {
+        lods.clear();
+        lods.emplace_back(rendering::MeshLod{ 0, static_cast<uint32_t>(indices.size()), 0.f });
+
+        std::vector<uint32_t> simplified;
+        std::vector<uint32_t> optimized;
+        while (lods.size() < maxLods)
+        {
+            rendering::MeshLod previous = lods.back();
+            if (previous.numIndices / 3 < 2 * MinLodTriangles) break;
+
+            uint32_t targetIndices = previous.numIndices / 6 * 3;
+            Range<const uint32_t> source(indices.data() + previous.firstIndex, previous.numIndices * sizeof(uint32_t));
+            float error = simplifyMesh(vertices, source, targetIndices, simplified);
+            if (simplified.size() > MinLodReduction * previous.numIndices) break;
+
+            optimized.resize(simplified.size());
+            optimizeVertexCache(simplified, static_cast<uint32_t>(vertices.size()), optimized);
+
+            // Each level is simplified from the previous one, so the errors add up
+            lods.emplace_back(rendering::MeshLod{ static_cast<uint32_t>(indices.size()),
+                                                  static_cast<uint32_t>(optimized.size()),
+                                                  previous.error + error });
+            indices.insert(indices.end(), optimized.begin(), optimized.end());
+        }
+    }
+}
@@ -0,0 +1,35 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    MeshSimplifier.hpp
+
+    Import time generation of levels of detail. Triangles are simplified by
+    collapsing edges in the order of their quadric error (Garland & Heckbert
+    1997, "Surface Simplification Using Quadric Error Metrics"). Collapses
+    move a vertex onto one of its neighbours, so the vertices never change,
+    and all levels share the same vertex buffer with their tangent frames.
+    Vertices on UV seams and open borders stay in place, which keeps the
+    seams and the silhouette of open meshes intact.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "../Types.hpp"
+#include "../cpugpu/GeometryTypes.h"
+#include "../rendering/Mesh.hpp"
+
+namespace asset
+{
+    // Simplifies the triangles towards the target number of indices, and returns the error of the
+    // result as a distance. The output can have more indices than the target, if no collapse is
+    // possible any more.
+    float simplifyMesh(Range<const Vertex> vertices, Range<const uint32_t> indices, uint32_t targetIndices,
+                       std::vector<uint32_t>& output);
+
+    // Appends coarser levels of detail after the indices, each with half the triangles of the
+    // previous one. The first level is the original mesh.
+    void buildLodChain(Range<const Vertex> vertices, std::vector<uint32_t>& indices,
+                       std::vector<rendering::MeshLod>& lods, uint32_t maxLods = rendering::MeshMaxLods);
+}
@@ -0,0 +1,280 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    PackFile.cpp
+*/
+
+#include "PackFile.hpp"
+
+#include "../Hash.hpp"
+#include "../Lz4.hpp"
+#include "../Log.hpp"
+
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+    constexpr uint32_t EmptySlot = 0xffffffff;
+
+    uint64_t alignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    // At most half full, so that the probe sequences stay short
+    uint32_t hashTableSize(uint32_t numEntries)
+    {
+        uint32_t size = 1;
+        while (size < 2 * numEntries) size <<= 1;
+        return size;
+    }
+}
+
+namespace asset
+{
+    std::string normalizePackPath(const std::string& path)
+    {
+        std::string normalized(path);
+        for (auto& c : normalized)
+        {
+            if (c == '\\') c = '/';
+        }
+        while (normalized.compare(0, 2, "./") == 0) normalized.erase(0, 2);
+        return normalized;
+    }
+
+    uint64_t packPathHash(const std::string& normalizedPath)
+    {
+        return hashBytes(normalizedPath.data(), normalizedPath.size());
+    }
+
+    bool PackFile::open(const std::string& filename)
+    {
+        MappedFile file(filename, MappedFile::AccessPattern::Random);
+        if (!file.valid() || (file.size() < sizeof(PackFileHeader))) return false;
+
+        PackFileHeader header;
+        memcpy(&header, file.bytes().begin(), sizeof(PackFileHeader));
+        if ((header.magic != PackFileMagic) || (header.version != PackFileVersion))
+        {
+            logError(std::string("Unsupported pack file ").append(filename).append("\n"));
+            return false;
+        }
+
+        uint64_t entriesSize    = static_cast<uint64_t>(header.numEntries) * sizeof(PackFileEntry);
+        uint64_t hashTableSize  = static_cast<uint64_t>(header.hashTableSize) * sizeof(uint32_t);
+        if ((header.hashTableSize == 0) || ((header.hashTableSize & (header.hashTableSize - 1)) != 0) ||
+            (header.hashTableSize < header.numEntries) ||
+            (header.entriesOffset % 8 != 0) || (header.hashTableOffset % 4 != 0) ||
+            (header.entriesOffset + entriesSize > file.size()) ||
+            (header.stringsOffset + header.stringsSize > file.size()) ||
+            (header.hashTableOffset + hashTableSize > file.size()))
+        {
+            logError(std::string("Corrupted pack file ").append(filename).append("\n"));
+            return false;
+        }
+
+        Range<const PackFileEntry> entries(
+            reinterpret_cast<const PackFileEntry*>(file.bytes().begin() + header.entriesOffset),
+            static_cast<size_t>(entriesSize));
+        for (const auto& entry : entries)
+        {
+            if ((static_cast<uint64_t>(entry.pathOffset) + entry.pathLength > header.stringsSize) ||
+                (entry.offset > file.size()) || (entry.storedSize > file.size() - entry.offset) ||
+                ((entry.compression == PackCompression::None) && (entry.storedSize != entry.size)) ||
+                (entry.compression > PackCompression::Lz4))
+            {
+                logError(std::string("Corrupted pack file ").append(filename).append("\n"));
+                return false;
+            }
+        }
+
+        m_file      = file;
+        m_header    = header;
+        m_entries   = entries;
+        m_strings   = Range<const char>(
+            reinterpret_cast<const char*>(file.bytes().begin() + header.stringsOffset),
+            static_cast<size_t>(header.stringsSize));
+        m_hashTable = Range<const uint32_t>(
+            reinterpret_cast<const uint32_t*>(file.bytes().begin() + header.hashTableOffset),
+            static_cast<size_t>(hashTableSize));
+        return true;
+    }
+
+    bool PackFile::contains(const std::string& path) const
+    {
+        return find(path) >= 0;
+    }
+
+    bool PackFile::read(const std::string& path, MappedFile& output) const
+    {
+        int index = find(path);
+        if (index < 0) return false;
+
+        const PackFileEntry& entry = m_entries[index];
+        MappedFile stored = m_file.subRange(entry.offset, entry.storedSize);
+        if (entry.compression == PackCompression::None)
+        {
+            output = stored;
+            return true;
+        }
+
+        std::vector<uint8_t> data(static_cast<size_t>(entry.size));
+        if (!lz4::decompress(stored.bytes(), Range<uint8_t>(data)))
+        {
+            logError(std::string("Corrupted pack entry ").append(path).append("\n"));
+            return false;
+        }
+
+        output = MappedFile::fromMemory(std::move(data));
+        return true;
+    }
+
+    bool PackFile::contentHash(const std::string& path, uint64_t& hash) const
+    {
+        int index = find(path);
+        if (index < 0) return false;
+
+        hash = m_entries[index].contentHash;
+        return true;
+    }
+
+    std::string PackFile::path(uint32_t index) const
+    {
+        const PackFileEntry& entry = m_entries[index];
+        return std::string(m_strings.begin() + entry.pathOffset, entry.pathLength);
+    }
+
+    int PackFile::find(const std::string& path) const
+    {
+        if (!valid()) return -1;
+
+        std::string normalized  = normalizePackPath(path);
+        uint64_t hash           = packPathHash(normalized);
+        uint32_t mask           = m_header.hashTableSize - 1;
+
+        // Linear probing, the writer leaves at least one empty slot
+        for (uint32_t i = 0; i < m_header.hashTableSize; i++)
+        {
+            uint32_t index = m_hashTable[static_cast<uint32_t>(hash + i) & mask];
+            if ((index == EmptySlot) || (index >= m_header.numEntries)) return -1;
+
+            const PackFileEntry& entry = m_entries[index];
+            if ((entry.pathHash == hash) && (entry.pathLength == normalized.size()) &&
+                (memcmp(m_strings.begin() + entry.pathOffset, normalized.data(), normalized.size()) == 0))
+            {
+                return static_cast<int>(index);
+            }
+        }
+        return -1;
+    }
+
+    bool PackWriter::add(const std::string& path, Range<const uint8_t> data, bool compress)
+    {
+        Entry entry;
+        entry.path          = normalizePackPath(path);
+        entry.pathHash      = packPathHash(entry.path);
+        entry.size          = data.byteSize();
+        entry.contentHash   = hashBytes(data.begin(), data.byteSize());
+        if (entry.contentHash == 0) entry.contentHash = 1;
+
+        for (const auto& other : m_entries)
+        {
+            if ((other.pathHash == entry.pathHash) && (other.path == entry.path)) return false;
+        }
+
+        if (compress)
+        {
+            lz4::compress(data, entry.data);
+            entry.compression = PackCompression::Lz4;
+        }
+        if (!compress || (entry.data.size() > data.byteSize() - data.byteSize() / 8))
+        {
+            entry.data.assign(data.begin(), data.end());
+            entry.compression = PackCompression::None;
+        }
+
+        m_entries.emplace_back(std::move(entry));
+        return true;
+    }
+
+    bool PackWriter::write(const std::string& filename) const
+    {
+        PackFileHeader header;
+        header.magic            = PackFileMagic;
+        header.version          = PackFileVersion;
+        header.numEntries       = static_cast<uint32_t>(m_entries.size());
+        header.hashTableSize    = hashTableSize(header.numEntries);
+        header.entriesOffset    = sizeof(PackFileHeader);
+        header.stringsOffset    = header.entriesOffset + m_entries.size() * sizeof(PackFileEntry);
+
+        std::string strings;
+        for (const auto& entry : m_entries) strings.append(entry.path);
+        header.stringsSize      = strings.size();
+        header.hashTableOffset  = alignUp(header.stringsOffset + header.stringsSize, sizeof(uint32_t));
+
+        std::vector<uint32_t> hashTable(header.hashTableSize, EmptySlot);
+        std::vector<PackFileEntry> entries;
+        uint32_t pathOffset = 0;
+        uint64_t dataOffset = alignUp(header.hashTableOffset + hashTable.size() * sizeof(uint32_t), PackAlignment);
+        for (uint32_t i = 0; i < header.numEntries; i++)
+        {
+            const Entry& source = m_entries[i];
+
+            PackFileEntry entry = {};
+            entry.pathHash      = source.pathHash;
+            entry.pathOffset    = pathOffset;
+            entry.pathLength    = static_cast<uint32_t>(source.path.size());
+            entry.offset        = dataOffset;
+            entry.storedSize    = source.data.size();
+            entry.size          = source.size;
+            entry.contentHash   = source.contentHash;
+            entry.compression   = source.compression;
+            entries.emplace_back(entry);
+
+            uint32_t mask = header.hashTableSize - 1;
+            uint32_t slot = static_cast<uint32_t>(source.pathHash) & mask;
+            while (hashTable[slot] != EmptySlot) slot = (slot + 1) & mask;
+            hashTable[slot] = i;
+
+            pathOffset += entry.pathLength;
+            dataOffset = alignUp(dataOffset + entry.storedSize, PackAlignment);
+        }
+
+        std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            logError(std::string("Unable to write pack file ").append(filename).append("\n"));
+            return false;
+        }
+
+        // Writes zeros up to the given offset, so that the tables and entries land at their offsets
+        const char zeros[PackAlignment] = {};
+        auto padTo = [&](uint64_t offset)
+        {
+            uint64_t pos = static_cast<uint64_t>(file.tellp());
+            file.write(zeros, static_cast<std::streamsize>(offset - pos));
+        };
+
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(entries.data()),
+                   static_cast<std::streamsize>(entries.size() * sizeof(PackFileEntry)));
+        file.write(strings.data(), static_cast<std::streamsize>(strings.size()));
+        padTo(header.hashTableOffset);
+        file.write(reinterpret_cast<const char*>(hashTable.data()),
+                   static_cast<std::streamsize>(hashTable.size() * sizeof(uint32_t)));
+        for (uint32_t i = 0; i < header.numEntries; i++)
+        {
+            padTo(entries[i].offset);
+            file.write(reinterpret_cast<const char*>(m_entries[i].data.data()),
+                       static_cast<std::streamsize>(m_entries[i].data.size()));
+        }
+
+        if (!file)
+        {
+            logError(std::string("Unable to write pack file ").append(filename).append("\n"));
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,126 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    PackFile.hpp
+
+    Single-file asset archive. The pack is memory mapped as a whole, and
+    stored entries are returned as views into the mapping, so opening an
+    asset is a hash table lookup instead of a file system call. Entries
+    compressed with LZ4 are decompressed into memory on access.
+
+    The file starts with a header, followed by the table of contents, the
+    path strings, an open addressing hash table of entry indices, and the
+    entry data. Each entry starts at a multiple of PackAlignment, so the
+    data of an entry can be used in place, e.g. as a binary scene.
+
+    Paths are stored as given to PackWriter, with backslashes turned to
+    slashes, e.g. "data/models/house/house_obj.obj".
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "../MappedFile.hpp"
+#include "../Types.hpp"
+
+namespace asset
+{
+    constexpr uint32_t PackFileMagic    = 0x4b505053;   // "SPPK"
+    constexpr uint32_t PackFileVersion  = 1;
+    constexpr uint32_t PackAlignment    = 64;
+
+    enum class PackCompression : uint32_t
+    {
+        None,
+        Lz4
+    };
+
+    struct PackFileHeader
+    {
+        uint32_t    magic;
+        uint32_t    version;
+        uint32_t    numEntries;
+        uint32_t    hashTableSize;  // Power of two
+        uint64_t    entriesOffset;
+        uint64_t    stringsOffset;
+        uint64_t    stringsSize;
+        uint64_t    hashTableOffset;
+    };
+
+    struct PackFileEntry
+    {
+        uint64_t        pathHash;
+        uint32_t        pathOffset;     // From the start of the string table
+        uint32_t        pathLength;
+        uint64_t        offset;         // From the start of the file
+        uint64_t        storedSize;
+        uint64_t        size;           // Decompressed
+        uint64_t        contentHash;    // hashBytes() of the decompressed data
+        PackCompression compression;
+        uint32_t        padding;
+    };
+
+    // Lookups are by normalized paths, so "data\\a.obj" and "./data/a.obj" find the same entry
+    std::string normalizePackPath(const std::string& path);
+    uint64_t packPathHash(const std::string& normalizedPath);
+
+    class PackFile
+    {
+    public:
+        PackFile() = default;
+
+        // Checks that all the tables and entries are within the file
+        bool open(const std::string& filename);
+
+        bool valid() const { return m_file.valid(); }
+
+        bool contains(const std::string& path) const;
+
+        // Stored entries are views into the pack, compressed ones are decompressed into memory.
+        // Returns false, if the path is not in the pack or the entry is corrupted.
+        bool read(const std::string& path, MappedFile& output) const;
+
+        // Hash of the contents recorded when the pack was written, never zero
+        bool contentHash(const std::string& path, uint64_t& hash) const;
+
+        uint32_t                numEntries() const { return m_header.numEntries; }
+        const PackFileEntry&    entry(uint32_t index) const { return m_entries[index]; }
+        std::string             path(uint32_t index) const;
+    private:
+        // Index of the entry, or -1 if the path is not in the pack
+        int find(const std::string& path) const;
+
+        MappedFile                  m_file;
+        PackFileHeader              m_header = {};
+        Range<const PackFileEntry>  m_entries;
+        Range<const char>           m_strings;
+        Range<const uint32_t>       m_hashTable;
+    };
+
+    // Collects the entries in memory, and writes the whole pack at once
+    class PackWriter
+    {
+    public:
+        // Compressed entries are stored as such, if compression saves at least an eighth of the size.
+        // Returns false, if the path is already in the pack.
+        bool add(const std::string& path, Range<const uint8_t> data, bool compress);
+
+        bool write(const std::string& filename) const;
+
+        size_t numEntries() const { return m_entries.size(); }
+    private:
+        struct Entry
+        {
+            std::string             path;
+            uint64_t                pathHash;
+            std::vector<uint8_t>    data;
+            uint64_t                size;
+            uint64_t                contentHash;
+            PackCompression         compression;
+        };
+
+        std::vector<Entry> m_entries;
+    };
+}
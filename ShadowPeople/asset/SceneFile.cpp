@@ -0,0 +1,212 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    SceneFile.cpp
+*/
+
+#include "SceneFile.hpp"
+
+#include "../MappedFile.hpp"
+#include "../Math.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <unordered_map>
+
+namespace
+{
+    bool isSpace(char c)
+    {
+        return (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n');
+    }
+
+    // Reads the numbers of a parenthesized group, e.g. "(1.0 2.0 3.0)". Returns false, if there
+    // is no group on the rest of the line. Missing numbers keep their old values.
+    bool parseGroup(const char*& pos, const char* lineEnd, float* values, int count)
+    {
+        while ((pos < lineEnd) && (*pos != '(')) pos++;
+        if (pos >= lineEnd) return false;
+        pos++;
+
+        // The line is copied, so that strtof() cannot run past it
+        const char* groupEnd = pos;
+        while ((groupEnd < lineEnd) && (*groupEnd != ')')) groupEnd++;
+        std::string group(pos, groupEnd);
+
+        const char* number = group.c_str();
+        for (int i = 0; i < count; i++)
+        {
+            char* next;
+            float value = strtof(number, &next);
+            if (next == number) break;
+            values[i]   = value;
+            number      = next;
+        }
+
+        pos = (groupEnd < lineEnd) ? groupEnd + 1 : lineEnd;
+        return true;
+    }
+
+    Quaternion eulerToQuaternion(const float* degrees)
+    {
+        const float DegreesToRadians = math::Pi / 180.f;
+        Quaternion x(float4{ 1.f, 0.f, 0.f, 0.f }, degrees[0] * DegreesToRadians);
+        Quaternion y(float4{ 0.f, 1.f, 0.f, 0.f }, degrees[1] * DegreesToRadians);
+        Quaternion z(float4{ 0.f, 0.f, 1.f, 0.f }, degrees[2] * DegreesToRadians);
+
+        // Rotates first around X, then Y and last Z
+        return z * y * x;
+    }
+
+    template<typename T>
+    void append(std::vector<uint8_t>& bytes, const T* data, size_t count)
+    {
+        const uint8_t* begin = reinterpret_cast<const uint8_t*>(data);
+        bytes.insert(bytes.end(), begin, begin + count * sizeof(T));
+    }
+}
+
+namespace asset
+{
+    bool convertTextScene(Range<const char> text, std::vector<uint8_t>& binary)
+    {
+        std::vector<std::string>                    meshNames;
+        std::unordered_map<std::string, uint32_t>   meshIndices;
+        std::vector<std::vector<SceneFileObject>>   meshObjects;
+
+        const char* pos = text.begin();
+        const char* end = text.end();
+        while (pos < end)
+        {
+            const char* lineEnd = pos;
+            while ((lineEnd < end) && (*lineEnd != '\n')) lineEnd++;
+
+            while ((pos < lineEnd) && isSpace(*pos)) pos++;
+            if ((pos < lineEnd) && (*pos != '#'))
+            {
+                const char* nameEnd = pos;
+                while ((nameEnd < lineEnd) && !isSpace(*nameEnd) && (*nameEnd != '(')) nameEnd++;
+                std::string meshName(pos, nameEnd);
+                pos = nameEnd;
+
+                float position[3]   = { 0.f, 0.f, 0.f };
+                float rotation[3]   = { 0.f, 0.f, 0.f };
+                float scale         = 1.f;
+                if (parseGroup(pos, lineEnd, position, 3) && parseGroup(pos, lineEnd, rotation, 3))
+                {
+                    parseGroup(pos, lineEnd, &scale, 1);
+                }
+
+                auto mesh = meshIndices.find(meshName);
+                if (mesh == meshIndices.end())
+                {
+                    mesh = meshIndices.emplace(meshName, static_cast<uint32_t>(meshNames.size())).first;
+                    meshNames.emplace_back(meshName);
+                    meshObjects.emplace_back();
+                }
+
+                SceneFileObject object;
+                memcpy(object.position, position, sizeof(position));
+                object.scale = scale;
+                float4 quaternion = eulerToQuaternion(rotation).toFloat4();
+                for (int i = 0; i < 4; i++) object.rotation[i] = quaternion[i];
+                meshObjects[mesh->second].emplace_back(object);
+            }
+
+            pos = lineEnd + 1;
+        }
+
+        uint32_t numObjects = 0;
+        std::string strings;
+        std::vector<SceneFileMesh> meshes;
+        for (size_t i = 0; i < meshNames.size(); i++)
+        {
+            SceneFileMesh mesh;
+            mesh.nameOffset     = static_cast<uint32_t>(strings.size());
+            mesh.nameLength     = static_cast<uint32_t>(meshNames[i].size());
+            mesh.firstObject    = numObjects;
+            mesh.numObjects     = static_cast<uint32_t>(meshObjects[i].size());
+            meshes.emplace_back(mesh);
+
+            strings.append(meshNames[i]);
+            numObjects += mesh.numObjects;
+        }
+
+        SceneFileHeader header;
+        header.magic            = SceneFileMagic;
+        header.version          = SceneFileVersion;
+        header.numMeshes        = static_cast<uint32_t>(meshes.size());
+        header.numObjects       = numObjects;
+        header.meshesOffset     = sizeof(SceneFileHeader);
+        header.objectsOffset    = header.meshesOffset + header.numMeshes * sizeof(SceneFileMesh);
+        header.stringsOffset    = header.objectsOffset + numObjects * sizeof(SceneFileObject);
+        header.stringsSize      = static_cast<uint32_t>(strings.size());
+
+        binary.clear();
+        binary.reserve(header.stringsOffset + header.stringsSize);
+        append(binary, &header, 1);
+        append(binary, meshes.data(), meshes.size());
+        for (const auto& objects : meshObjects) append(binary, objects.data(), objects.size());
+        append(binary, strings.data(), strings.size());
+
+        return true;
+    }
+
+    bool convertSceneFile(const std::string& textFilename, const std::string& binaryFilename)
+    {
+        MappedFile text(textFilename, MappedFile::AccessPattern::Sequential);
+        if (!text.valid()) return false;
+
+        std::vector<uint8_t> binary;
+        if (!convertTextScene(text.asRange<char>(), binary)) return false;
+
+        std::ofstream file(binaryFilename, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+        file.write(reinterpret_cast<const char*>(binary.data()), static_cast<std::streamsize>(binary.size()));
+        return static_cast<bool>(file);
+    }
+
+    bool isBinaryScene(Range<const uint8_t> data)
+    {
+        uint32_t magic;
+        if (data.byteSize() < sizeof(magic)) return false;
+        memcpy(&magic, data.begin(), sizeof(magic));
+        return magic == SceneFileMagic;
+    }
+
+    bool SceneFile::open(Range<const uint8_t> data)
+    {
+        if (data.byteSize() < sizeof(SceneFileHeader)) return false;
+        memcpy(&m_header, data.begin(), sizeof(SceneFileHeader));
+        if ((m_header.magic != SceneFileMagic) || (m_header.version != SceneFileVersion)) return false;
+
+        uint64_t meshesSize     = static_cast<uint64_t>(m_header.numMeshes) * sizeof(SceneFileMesh);
+        uint64_t objectsSize    = static_cast<uint64_t>(m_header.numObjects) * sizeof(SceneFileObject);
+        if ((m_header.meshesOffset % 4 != 0) || (m_header.objectsOffset % 4 != 0) ||
+            (m_header.meshesOffset + meshesSize > data.byteSize()) ||
+            (m_header.objectsOffset + objectsSize > data.byteSize()) ||
+            (static_cast<uint64_t>(m_header.stringsOffset) + m_header.stringsSize > data.byteSize())) return false;
+
+        m_meshes    = Range<const SceneFileMesh>(
+            reinterpret_cast<const SceneFileMesh*>(data.begin() + m_header.meshesOffset), meshesSize);
+        m_objects   = Range<const SceneFileObject>(
+            reinterpret_cast<const SceneFileObject*>(data.begin() + m_header.objectsOffset), objectsSize);
+        m_strings   = Range<const char>(
+            reinterpret_cast<const char*>(data.begin() + m_header.stringsOffset), m_header.stringsSize);
+
+        // The meshes must refer to valid names and objects
+        for (const auto& mesh : m_meshes)
+        {
+            if ((static_cast<uint64_t>(mesh.nameOffset) + mesh.nameLength > m_header.stringsSize) ||
+                (static_cast<uint64_t>(mesh.firstObject) + mesh.numObjects > m_header.numObjects)) return false;
+        }
+
+        return true;
+    }
+
+    std::string SceneFile::meshName(uint32_t index) const
+    {
+        const SceneFileMesh& mesh = m_meshes[index];
+        return std::string(m_strings.begin() + mesh.nameOffset, mesh.nameLength);
+    }
+}
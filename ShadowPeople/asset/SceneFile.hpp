@@ -0,0 +1,86 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    SceneFile.hpp
+
+    Text and binary scene formats. The text format is the source, which is
+    written by hand or by tools. It has one object per line:
+
+        mesh.obj (x y z) (rx ry rz) (scale)
+
+    where the rotation is given as XYZ Euler angles in degrees. The binary
+    format is what the engine loads. It lists each mesh only once, and the
+    objects grouped by mesh, so that the objects of a mesh can be placed
+    as soon as it has been loaded. All the fields are 4-byte aligned, so the
+    file can be used directly from a memory mapping.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "../Types.hpp"
+
+namespace asset
+{
+    constexpr uint32_t SceneFileMagic   = 0x42535053;   // "SPSB"
+    constexpr uint32_t SceneFileVersion = 1;
+
+    struct SceneFileHeader
+    {
+        uint32_t    magic;
+        uint32_t    version;
+        uint32_t    numMeshes;
+        uint32_t    numObjects;
+        uint32_t    meshesOffset;
+        uint32_t    objectsOffset;
+        uint32_t    stringsOffset;
+        uint32_t    stringsSize;
+    };
+
+    struct SceneFileMesh
+    {
+        uint32_t    nameOffset;     // From the start of the string table
+        uint32_t    nameLength;
+        uint32_t    firstObject;
+        uint32_t    numObjects;
+    };
+
+    struct SceneFileObject
+    {
+        float       position[3];
+        float       scale;
+        float       rotation[4];    // Quaternion
+    };
+
+    // Converts a text scene to the binary format. Objects are sorted by mesh, and otherwise
+    // kept in file order.
+    bool convertTextScene(Range<const char> text, std::vector<uint8_t>& binary);
+
+    // Converts a text scene file to a binary scene file, e.g. as a build step
+    bool convertSceneFile(const std::string& textFilename, const std::string& binaryFilename);
+
+    // True, if the data starts like a binary scene
+    bool isBinaryScene(Range<const uint8_t> data);
+
+    // Read-only view to a binary scene. The data must stay alive as long as the view is used.
+    class SceneFile
+    {
+    public:
+        SceneFile() = default;
+
+        // Checks that all the tables are within the data
+        bool open(Range<const uint8_t> data);
+
+        uint32_t                    numMeshes() const { return m_header.numMeshes; }
+        const SceneFileMesh&        mesh(uint32_t index) const { return m_meshes[index]; }
+        std::string                 meshName(uint32_t index) const;
+        Range<const SceneFileObject> objects() const { return m_objects; }
+    private:
+        SceneFileHeader                 m_header = {};
+        Range<const SceneFileMesh>      m_meshes;
+        Range<const SceneFileObject>    m_objects;
+        Range<const char>               m_strings;
+    };
+}
@@ -0,0 +1,92 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    VertexWelder.cpp
+*/
+
+#include "VertexWelder.hpp"
+
+#include "../Hash.hpp"
+#include "../Errors.hpp"
+
+namespace
+{
+    // Smallest table size in slots. The table is grown, when it gets half full.
+    constexpr size_t MinCapacity = 1024;
+
+    size_t roundUpToPowerOfTwo(size_t value)
+    {
+        size_t result = MinCapacity;
+        while (result < value) result <<= 1;
+        return result;
+    }
+
+    bool sameKey(const uint3& a, const uint3& b)
+    {
+        return (a[0] == b[0]) && (a[1] == b[1]) && (a[2] == b[2]);
+    }
+}
+
+namespace asset
+{
+    VertexWelder::VertexWelder(size_t expectedCorners)
+    {
+        // Typical closed meshes have about six corners per unique vertex
+        reset(roundUpToPowerOfTwo(expectedCorners / 3));
+    }
+
+    void VertexWelder::reset(size_t capacity)
+    {
+        m_slots.assign(capacity, Slot{ uint3(), EmptySlot });
+        m_mask = capacity - 1;
+    }
+
+    void VertexWelder::grow()
+    {
+        std::vector<Slot> oldSlots;
+        oldSlots.swap(m_slots);
+        reset(oldSlots.size() * 2);
+
+        for (const auto& slot : oldSlots)
+        {
+            if (slot.vertex == EmptySlot) continue;
+
+            uint64_t i = hash3x32(slot.key[0], slot.key[1], slot.key[2]) & m_mask;
+            while (m_slots[i].vertex != EmptySlot) i = (i + 1) & m_mask;
+            m_slots[i] = slot;
+        }
+    }
+
+    uint32_t VertexWelder::weld(Range<const uint3> keys, Range<uint32_t> remap)
+    {
+        SP_ASSERT(remap.size() == keys.size(), "Remap table must have an entry per key");
+
+        // Clear the table, but keep the capacity reached by earlier welds
+        for (auto& slot : m_slots) slot.vertex = EmptySlot;
+        m_firstOccurrences.clear();
+
+        uint32_t numVertices = 0;
+        for (size_t k = 0; k < keys.size(); k++)
+        {
+            if (2 * static_cast<size_t>(numVertices) >= m_slots.size()) grow();
+
+            const uint3& key = keys[k];
+            uint64_t i = hash3x32(key[0], key[1], key[2]) & m_mask;
+            while (true)
+            {
+                Slot& slot = m_slots[i];
+                if (slot.vertex == EmptySlot)
+                {
+                    slot.key    = key;
+                    slot.vertex = numVertices++;
+                    m_firstOccurrences.emplace_back(static_cast<uint32_t>(k));
+                    break;
+                }
+                if (sameKey(slot.key, key)) break;
+                i = (i + 1) & m_mask;
+            }
+            remap[k] = m_slots[i].vertex;
+        }
+
+        return numVertices;
+    }
+}
@@ -0,0 +1,49 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    VertexWelder.hpp
+
+    Finds the unique (position, uv, normal) index triplets of a mesh. Uses a
+    flat open addressing hash table with linear probing, so there is no
+    allocation per vertex, and the work is linear in the number of face
+    corners.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "../Types.hpp"
+
+namespace asset
+{
+    class VertexWelder
+    {
+    public:
+        // Expected number of corners is only a hint for the initial table size
+        VertexWelder(size_t expectedCorners = 0);
+
+        // For each key, writes its unique vertex index to remap. Unique vertices are
+        // numbered in the order of their first occurrence. Returns the number of unique
+        // vertices. Remap must have as many elements as keys.
+        uint32_t weld(Range<const uint3> keys, Range<uint32_t> remap);
+
+        // Index of the first occurrence of each unique vertex in the keys of the last weld()
+        const std::vector<uint32_t>& firstOccurrences() const { return m_firstOccurrences; }
+    private:
+        static constexpr uint32_t EmptySlot = ~0u;
+
+        struct Slot
+        {
+            uint3       key;
+            uint32_t    vertex;
+        };
+
+        void reset(size_t capacity);
+        void grow();
+
+        std::vector<Slot>       m_slots;
+        uint64_t                m_mask;
+        std::vector<uint32_t>   m_firstOccurrences;
+    };
+}
@@ -19,6 +19,17 @@
 		float2	uv;
     };
 
+    // Compact alternative to Vertex, a third of its size. The position is quantized to 16 bits
+    // per axis within the bounds of its mesh, the tangent frame is a quaternion packed with the
+    // bitangent sign by math::encodeQTangent(), and the UV is two halfs. There is no bent normal.
+    struct PackedVertex
+    {
+        uint    positionXY;     // Low 16 bits X, high 16 bits Y
+        uint    positionZ;      // Low 16 bits Z, high 16 bits unused
+        uint    qTangent;
+        uint    uv;             // Low 16 bits U, high 16 bits V
+    };
+
     struct Patch
     {
         uint    id1;
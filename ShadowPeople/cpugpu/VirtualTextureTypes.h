@@ -0,0 +1,36 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    VirtualTextureTypes.h
+
+    Layouts of the virtual texture feedback and indirection table, for the
+    page residency manager and the shaders that write and read them.
+
+    Feedback is one uint per sample the renderer wants to make:
+        bits  0-11  page x at the mip
+        bits 12-23  page y at the mip
+        bits 24-27  mip, 0 is the finest
+    Entries without a request are VirtualFeedbackNone.
+
+    The indirection table has one RGBA8 UInt texel per page of each mip.
+    R and G are the position of a physical page in the page cache, and B is
+    the mip of the page in it, which is the page itself or its nearest
+    resident ancestor. A is 1, when there is such a page.
+*/
+
+#ifndef SP_VIRTUAL_TEXTURE_TYPES_H
+#define SP_VIRTUAL_TEXTURE_TYPES_H
+
+#ifdef __cplusplus
+using uint = unsigned;
+#endif
+
+    static const uint VirtualPageSize       = 128;  // Texels of content
+    static const uint VirtualPageBorder     = 4;    // Texels on each side, so that filtering stays in the page
+    static const uint PhysicalPageSize      = VirtualPageSize + 2 * VirtualPageBorder;
+
+    static const uint VirtualPageCoordBits  = 12;
+    static const uint VirtualPageCoordMask  = (1 << VirtualPageCoordBits) - 1;
+    static const uint VirtualMaxMipLevels   = 16;
+    static const uint VirtualFeedbackNone   = 0xffffffff;
+
+#endif
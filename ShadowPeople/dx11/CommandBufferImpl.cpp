@@ -139,15 +139,25 @@ namespace graphics
 								 int3 dstCorner, Rect<int, 3> srcRect,
 								 Subresource dstSubresource, Subresource srcSubresource)
 	{
-		// TODO: Asserts
+		SP_ASSERT((srcRect.size()[0] > 0) && (srcRect.size()[1] > 0) && (srcRect.size()[2] > 0),
+				  "Copy source rectangle cannot be empty.");
+		SP_ASSERT((dst.m_texture != src.m_texture) || (dstSubresource.mipLevel != srcSubresource.mipLevel) ||
+				  (dstSubresource.arraySlice != srcSubresource.arraySlice),
+				  "Copy source and destination cannot be the same subresource.");
 		UINT dstSubresourceIndex = D3D11CalcSubresource(dstSubresource.mipLevel,
 														dstSubresource.arraySlice,
 														dst.descriptor().mipLevels);
 		UINT srcSubresourceIndex = D3D11CalcSubresource(srcSubresource.mipLevel,
 														srcSubresource.arraySlice,
 														src.descriptor().mipLevels);
+		// The box is in texels, also for block compressed textures
 		D3D11_BOX srcBox;
-		// TODO
+		srcBox.left		= srcRect.minCorner()[0];
+		srcBox.right	= srcRect.minCorner()[0] + srcRect.size()[0];
+		srcBox.top		= srcRect.minCorner()[1];
+		srcBox.bottom	= srcRect.minCorner()[1] + srcRect.size()[1];
+		srcBox.front	= srcRect.minCorner()[2];
+		srcBox.back		= srcRect.minCorner()[2] + srcRect.size()[2];
 		m_context.CopySubresourceRegion(dst.m_texture, dstSubresourceIndex,
 										dstCorner[0], dstCorner[1], dstCorner[2],
 										src.m_texture, srcSubresourceIndex, &srcBox);
@@ -176,12 +186,18 @@ namespace graphics
 
         // If the source rectangle is assume the whole image is copied
         if (srcRect.size()[0] == 0)  srcRect = int2{src.width(), src.height()};
+
+        // The pixels of block compressed images are 4x4 blocks, but the box is given in texels
+        int texelsPerPixel = dst.descriptor().format.blockCompressed() ? 4 : 1;
         
+        int mipWidth    = std::max<int>(dst.descriptor().width >> dstSubresource.mipLevel, 1);
+        int mipHeight   = std::max<int>(dst.descriptor().height >> dstSubresource.mipLevel, 1);
+
         D3D11_BOX dstBox;
-        dstBox.left     = dstCorner[0];
-        dstBox.right    = std::min<int>(dstCorner[0] + srcRect.size()[0], dst.descriptor().width);
-        dstBox.top      = dstCorner[1];
-        dstBox.bottom   = std::min<int>(dstCorner[1] + srcRect.size()[1], dst.descriptor().height);
+        dstBox.left     = dstCorner[0] * texelsPerPixel;
+        dstBox.right    = std::min<int>((dstCorner[0] + srcRect.size()[0]) * texelsPerPixel, mipWidth);
+        dstBox.top      = dstCorner[1] * texelsPerPixel;
+        dstBox.bottom   = std::min<int>((dstCorner[1] + srcRect.size()[1]) * texelsPerPixel, mipHeight);
         dstBox.front    = 0;
         dstBox.back     = 1;
 
@@ -197,7 +213,7 @@ namespace graphics
     {
         D3D11_BOX dstBox;
         dstBox.left     = dstOffset;
-        dstBox.right    = cpuData.byteSize();
+        dstBox.right    = dstOffset + static_cast<UINT>(cpuData.byteSize());
         dstBox.top      = 0;
         dstBox.bottom   = 1;
         dstBox.front    = 0;
@@ -542,6 +558,21 @@ namespace graphics
 		clearResources(pipeline);
 	}
 
+    void CommandBufferImpl::drawIndexed(GraphicsPipelineImpl& pipeline, Range<const IndexRange> ranges,
+                                        uint32_t vertexOffset)
+    {
+        setupResources(pipeline);
+        setDepthStencilState(pipeline);
+        setBlendState(pipeline);
+        setPrimitiveTopology(pipeline);
+        setRasterizerState(pipeline);
+        for (const auto& range : ranges)
+        {
+            m_context.DrawIndexed(range.numIndices, range.firstIndex, vertexOffset);
+        }
+        clearResources(pipeline);
+    }
+
 	void CommandBufferImpl::drawInstanced(GraphicsPipelineImpl& pipeline, uint32_t vertexCountPerInstance,
 										  uint32_t instanceCount, uint32_t startVextexOffset,
 										  uint32_t startInstanceOffset)
@@ -78,6 +78,7 @@ namespace graphics
         void draw(GraphicsPipelineImpl& pipeline, uint32_t vertexCount, uint32_t startVertexOffset);
         void drawIndexed(GraphicsPipelineImpl& pipeline, uint32_t indexCount, uint32_t startIndexOffset,
                          uint32_t vertexOffset);
+        void drawIndexed(GraphicsPipelineImpl& pipeline, Range<const IndexRange> ranges, uint32_t vertexOffset);
         void drawInstanced(GraphicsPipelineImpl& pipeline, uint32_t vertexCountPerInstance, uint32_t instanceCount,
                            uint32_t startVextexOffset, uint32_t startInstanceOffset);
         void drawIndexedInstanced(GraphicsPipelineImpl& pipeline, uint32_t vertexCountPerInstance,
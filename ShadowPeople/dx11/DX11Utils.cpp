@@ -47,6 +47,16 @@ namespace graphics
 
 	DXGI_FORMAT dxgiFormat(const desc::Format& format)
 	{
+		switch (format.descriptor().type)
+		{
+		case desc::FormatType::BC1:	return DXGI_FORMAT_BC1_UNORM;
+		case desc::FormatType::BC3:	return DXGI_FORMAT_BC3_UNORM;
+		case desc::FormatType::BC4:	return DXGI_FORMAT_BC4_UNORM;
+		case desc::FormatType::BC5:	return DXGI_FORMAT_BC5_UNORM;
+		case desc::FormatType::BC7:	return DXGI_FORMAT_BC7_UNORM;
+		default:					break;
+		}
+
 		switch (format.descriptor().bytes)
 		{
 		case desc::FormatBytesPerChannel::B8:
@@ -4,24 +4,74 @@
 #include "ShaderResourcesImpl.hpp"
 #include "BufferImpl.hpp"
 #include "../Errors.hpp"
+#include "../MappedFile.hpp"
+#include "../asset/AssetCache.hpp"
 
 #include <d3d11.h>
 #include <d3dcompiler.h>
 
-namespace graphics
-{
-	ShaderManagerImpl::ShaderManagerImpl(DeviceImpl& device) :
-		m_device(device)
-	{}
+#include <vector>
+#include <algorithm>
 
-	std::wstring s2ws(const std::string& str)
+namespace
+{
+	std::string directoryOf(const std::string& filename)
 	{
-		int size_needed = MultiByteToWideChar(CP_UTF8, 0, &str[0], (int)str.size(), NULL, 0);
-		std::wstring wstrTo(size_needed, 0);
-		MultiByteToWideChar(CP_UTF8, 0, &str[0], (int)str.size(), &wstrTo[0], size_needed);
-		return wstrTo;
+		size_t directoryEnd = filename.find_last_of("/\\");
+		return (directoryEnd == std::string::npos) ? std::string() : filename.substr(0, directoryEnd + 1);
 	}
 
+	// Resolves includes relative to the including file, like D3D_COMPILE_STANDARD_FILE_INCLUDE,
+	// and records every file that was opened. They are the dependencies of the compiled shader.
+	class IncludeRecorder : public ID3DInclude
+	{
+	public:
+		IncludeRecorder(const std::string& shaderName) :
+			m_shaderDirectory(directoryOf(shaderName)),
+			m_files{ shaderName }
+		{}
+
+		HRESULT __stdcall Open(D3D_INCLUDE_TYPE includeType, LPCSTR fileName, LPCVOID parentData,
+							   LPCVOID* data, UINT* bytes) override
+		{
+			auto parent = m_directories.find(parentData);
+			std::string directory = (parent != m_directories.end()) ? parent->second : m_shaderDirectory;
+			std::string filename = directory + fileName;
+
+			MappedFile file(filename, MappedFile::AccessPattern::Sequential);
+			if (!file.valid()) return E_FAIL;
+
+			*data	= file.bytes().begin();
+			*bytes	= static_cast<UINT>(file.size());
+
+			m_directories[*data]	= directoryOf(filename);
+			m_openFiles[*data]		= file;
+			if (std::find(m_files.begin(), m_files.end(), filename) == m_files.end()) m_files.emplace_back(filename);
+			return S_OK;
+		}
+
+		HRESULT __stdcall Close(LPCVOID data) override
+		{
+			m_openFiles.erase(data);
+			return S_OK;
+		}
+
+		const std::vector<std::string>& files() const { return m_files; }
+	private:
+		std::string								m_shaderDirectory;
+		std::vector<std::string>				m_files;
+		std::unordered_map<LPCVOID, std::string> m_directories;
+		std::unordered_map<LPCVOID, MappedFile>	m_openFiles;
+	};
+}
+
+namespace graphics
+{
+	ShaderManagerImpl::ShaderManagerImpl(DeviceImpl& device, asset::AssetCache* assetCache) :
+		m_device(device),
+		m_assetCache(assetCache)
+	{}
+
 	uint64_t fileTimeToUInt64(FILETIME ft)
 	{
 		ULARGE_INTEGER u;
@@ -35,17 +85,49 @@ namespace graphics
 		std::string shaderName	= getShaderName(shader.m_bindingName, shader.m_type);
 		std::string target		= getShaderTarget(shader.m_type);
 
+		// The same source may be compiled to several targets
+		std::string cacheName	= std::string(shaderName).append("@").append(target);
+
+		shader.m_compiledSource = nullptr;
+
+		if (readCachedShader(shader, cacheName))
+		{
+			OutputDebugString(std::string("Using cached shader ").append(shaderName).append("\n").c_str());
+		}
+		else if (!compileSource(shader, shaderName, target, cacheName))
+		{
+			return false;
+		}
+
+		SYSTEMTIME compilationTime;
+		GetSystemTime(&compilationTime);
+
+		FILETIME ft;
+		SP_ASSERT(SystemTimeToFileTime(&compilationTime, &ft), "Time conversion failed.");		
+
+		ShaderReference ref = { &shader, fileTimeToUInt64(ft) };
+		m_shaderNameToShader[shaderName] = ref;
+
+		return true;
+	}
+
+	bool ShaderManagerImpl::compileSource(ShaderImpl& shader, const std::string& shaderName,
+										  const std::string& target, const std::string& cacheName)
+	{
 		uint32_t flags1 = D3DCOMPILE_PACK_MATRIX_ROW_MAJOR;
 		uint32_t flags2 = 0;
 
-		shader.m_compiledSource = nullptr;
 		ID3DBlob* errorBlob		= nullptr;
 
 		OutputDebugString(std::string("Compiling shader ").append(shaderName).append("\n").c_str());
 
-		HRESULT hr = D3DCompileFromFile(s2ws(shaderName).c_str(), NULL,
-										D3D_COMPILE_STANDARD_FILE_INCLUDE, "main", target.c_str(),
-										flags1, flags2, &shader.m_compiledSource, &errorBlob);
+		MappedFile source(shaderName, MappedFile::AccessPattern::Sequential);
+		IncludeRecorder includes(shaderName);
+
+		HRESULT hr = source.valid() ?
+			D3DCompile(source.bytes().begin(), static_cast<SIZE_T>(source.size()), shaderName.c_str(), NULL,
+					   &includes, "main", target.c_str(), flags1, flags2, &shader.m_compiledSource, &errorBlob) :
+			E_FAIL;
 
 		if (FAILED(hr))
 		{
@@ -72,15 +154,26 @@ namespace graphics
 
 		OutputDebugString("Success.\n");
 
-		SYSTEMTIME compilationTime;
-		GetSystemTime(&compilationTime);
+		// Every file that was included is a dependency of the compiled shader
+		if (m_assetCache)
+		{
+			Range<const uint8_t> compiled(static_cast<const uint8_t*>(shader.m_compiledSource->GetBufferPointer()),
+										  shader.m_compiledSource->GetBufferSize());
+			m_assetCache->store(asset::AssetKind::Shader, cacheName, includes.files(), compiled);
+		}
 
-		FILETIME ft;
-		SP_ASSERT(SystemTimeToFileTime(&compilationTime, &ft), "Time conversion failed.");		
+		return true;
+	}
 
-		ShaderReference ref = { &shader, fileTimeToUInt64(ft) };
-		m_shaderNameToShader[shaderName] = ref;
+	bool ShaderManagerImpl::readCachedShader(ShaderImpl& shader, const std::string& cacheName)
+	{
+		MappedFile cached;
+		if (!m_assetCache || !m_assetCache->lookup(asset::AssetKind::Shader, cacheName, cached)) return false;
+
+		HRESULT hr = D3DCreateBlob(static_cast<SIZE_T>(cached.size()), &shader.m_compiledSource);
+		if (FAILED(hr)) return false;
 
+		memcpy(shader.m_compiledSource->GetBufferPointer(), cached.bytes().begin(), static_cast<size_t>(cached.size()));
 		return true;
 	}
 
@@ -91,25 +184,13 @@ namespace graphics
 			auto& name	= shader.first;
 			auto& ref	= shader.second;
 
-			HANDLE file = CreateFile(name.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
-									 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-			if (file == INVALID_HANDLE_VALUE)
-			{
-				OutputDebugString(std::string("Could not find: ").append(name).append("\n").c_str());
-				continue;
-			}
-
-			FILETIME lastWriteTime;
-			if (!GetFileTime(file, NULL, NULL, &lastWriteTime))
+			uint64_t modificationTime;
+			if (!MappedFile::lastWriteTime(name, modificationTime))
 			{
 				OutputDebugString(std::string("Unable to read modification time for ").append(name).append("\n").c_str());
-				CloseHandle(file);
 				continue;
 			}
 
-			CloseHandle(file);
-
-			uint64_t modificationTime = fileTimeToUInt64(lastWriteTime);
 			if (modificationTime > ref.compilationTime)
 			{
 				// Store the old shader code, so that we may recover if the compilation fails
@@ -11,6 +11,11 @@
 
 #include <unordered_map>
 
+namespace asset
+{
+	class AssetCache;
+}
+
 namespace graphics
 {
 	class DeviceImpl;
@@ -20,7 +25,7 @@ namespace graphics
 	class ShaderManagerImpl
 	{
 	public:
-		ShaderManagerImpl(DeviceImpl& device);
+		ShaderManagerImpl(DeviceImpl& device, asset::AssetCache* assetCache);
 
 		NO_COPY_CLASS(ShaderManagerImpl);
 
@@ -36,7 +41,14 @@ namespace graphics
 		std::string getShaderTarget(desc::ShaderType type);
         void setShaderDebugName(ShaderImpl& shader);
 
-		DeviceImpl& m_device;
+		bool compileSource(ShaderImpl& shader, const std::string& shaderName,
+						   const std::string& target, const std::string& cacheName);
+
+		// Fills in the compiled source from the asset cache, if the shader and its includes are unchanged
+		bool readCachedShader(ShaderImpl& shader, const std::string& cacheName);
+
+		DeviceImpl&			m_device;
+		asset::AssetCache*	m_assetCache;
 
 		struct ShaderReference
 		{
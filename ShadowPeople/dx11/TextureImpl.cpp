@@ -110,6 +110,9 @@ namespace graphics
 		setUsageFlags(desc.descriptor().usage,
 					  dxdesc.Usage, dxdesc.CPUAccessFlags, dxdesc.BindFlags);
 
+		// Block compressed textures cannot be bound for unordered access
+		if (format.blockCompressed()) dxdesc.BindFlags &= ~D3D11_BIND_UNORDERED_ACCESS;
+
 		dxdesc.MiscFlags = 0;
 		if (desc.descriptor().dimension == desc::Dimension::TextureCube)
 		{
@@ -148,6 +151,9 @@ namespace graphics
 		setUsageFlags(desc.descriptor().usage,
 					  dxdesc.Usage, dxdesc.CPUAccessFlags, dxdesc.BindFlags);
 
+		// Block compressed textures cannot be bound for unordered access
+		if (desc.descriptor().format.blockCompressed()) dxdesc.BindFlags &= ~D3D11_BIND_UNORDERED_ACCESS;
+
 		dxdesc.MiscFlags	= 0;
 
 		D3D11_SUBRESOURCE_DATA dxInit;
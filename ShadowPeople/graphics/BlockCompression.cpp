@@ -0,0 +1,948 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    BlockCompression.cpp
+*/
+
+#include "BlockCompression.hpp"
+#include "Image.hpp"
+#include "../Parallel.hpp"
+#include "../Simd.hpp"
+#include "../Errors.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    using namespace graphics;
+
+    constexpr int TexelsPerBlock = BlockDim * BlockDim;
+
+    // Fractions towards the second endpoint for each palette index
+    constexpr float BC1Weights[4]  = { 0.f, 1.f, 1.f / 3.f, 2.f / 3.f };
+    constexpr float BC4Weights[8]  = { 0.f, 1.f, 1.f / 7.f, 2.f / 7.f, 3.f / 7.f, 4.f / 7.f, 5.f / 7.f, 6.f / 7.f };
+    constexpr int   BC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    // The high quality searches the quantized endpoints for at most this many rounds
+    constexpr int MaxEndpointSearchRounds = 4;
+
+    // Palette indices in the order of the interpolation steps from the first endpoint to the second
+    constexpr uint8_t BC1StepToIndex[4] = { 0, 2, 3, 1 };
+    constexpr uint8_t BC4StepToIndex[8] = { 0, 2, 3, 4, 5, 6, 7, 1 };
+
+    uint8_t clampByte(float value)
+    {
+        return static_cast<uint8_t>(std::min(std::max(value + 0.5f, 0.f), 255.f));
+    }
+
+    int squaredDistance(const uint8_t* a, const uint8_t* b, int channels)
+    {
+        int sum = 0;
+        for (int c = 0; c < channels; c++)
+        {
+            int d = static_cast<int>(a[c]) - static_cast<int>(b[c]);
+            sum += d * d;
+        }
+        return sum;
+    }
+
+    // Per channel minimum and maximum of the 16 texels
+    void blockMinMax(const uint8_t* rgba, uint8_t minColor[4], uint8_t maxColor[4])
+    {
+#if defined(SP_SIMD_SSE)
+        const __m128i* src = reinterpret_cast<const __m128i*>(rgba);
+        __m128i t0 = _mm_loadu_si128(src);
+        __m128i t1 = _mm_loadu_si128(src + 1);
+        __m128i t2 = _mm_loadu_si128(src + 2);
+        __m128i t3 = _mm_loadu_si128(src + 3);
+
+        __m128i mn = _mm_min_epu8(_mm_min_epu8(t0, t1), _mm_min_epu8(t2, t3));
+        __m128i mx = _mm_max_epu8(_mm_max_epu8(t0, t1), _mm_max_epu8(t2, t3));
+        mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 8));
+        mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 8));
+        mn = _mm_min_epu8(mn, _mm_srli_si128(mn, 4));
+        mx = _mm_max_epu8(mx, _mm_srli_si128(mx, 4));
+
+        uint32_t packedMin = static_cast<uint32_t>(_mm_cvtsi128_si32(mn));
+        uint32_t packedMax = static_cast<uint32_t>(_mm_cvtsi128_si32(mx));
+        memcpy(minColor, &packedMin, 4);
+        memcpy(maxColor, &packedMax, 4);
+#elif defined(SP_SIMD_NEON)
+        uint8x16_t t0 = vld1q_u8(rgba);
+        uint8x16_t t1 = vld1q_u8(rgba + 16);
+        uint8x16_t t2 = vld1q_u8(rgba + 32);
+        uint8x16_t t3 = vld1q_u8(rgba + 48);
+
+        uint8x16_t mn = vminq_u8(vminq_u8(t0, t1), vminq_u8(t2, t3));
+        uint8x16_t mx = vmaxq_u8(vmaxq_u8(t0, t1), vmaxq_u8(t2, t3));
+        uint8x8_t mn8 = vmin_u8(vget_low_u8(mn), vget_high_u8(mn));
+        uint8x8_t mx8 = vmax_u8(vget_low_u8(mx), vget_high_u8(mx));
+        mn8 = vmin_u8(mn8, vreinterpret_u8_u32(vrev64_u32(vreinterpret_u32_u8(mn8))));
+        mx8 = vmax_u8(mx8, vreinterpret_u8_u32(vrev64_u32(vreinterpret_u32_u8(mx8))));
+
+        uint32_t packedMin = vget_lane_u32(vreinterpret_u32_u8(mn8), 0);
+        uint32_t packedMax = vget_lane_u32(vreinterpret_u32_u8(mx8), 0);
+        memcpy(minColor, &packedMin, 4);
+        memcpy(maxColor, &packedMax, 4);
+#else
+        for (int c = 0; c < 4; c++)
+        {
+            minColor[c] = 255;
+            maxColor[c] = 0;
+        }
+        for (int i = 0; i < TexelsPerBlock; i++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                minColor[c] = std::min(minColor[c], rgba[i * 4 + c]);
+                maxColor[c] = std::max(maxColor[c], rgba[i * 4 + c]);
+            }
+        }
+#endif
+    }
+
+    // Projects the texels to the line from start to start + axis, and rounds the
+    // position to one of steps + 1 evenly spaced points. Channels with zero axis
+    // component are ignored.
+    void projectToSteps(const uint8_t* rgba, const int start[4], const int axis[4], int steps, uint8_t* stepsOut)
+    {
+        int lengthSquared = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] + axis[3] * axis[3];
+        if (lengthSquared == 0)
+        {
+            memset(stepsOut, 0, TexelsPerBlock);
+            return;
+        }
+        float scale = static_cast<float>(steps) / static_cast<float>(lengthSquared);
+
+#if defined(SP_SIMD_SSE)
+        __m128i zero    = _mm_setzero_si128();
+        __m128i base    = _mm_setr_epi16(static_cast<short>(start[0]), static_cast<short>(start[1]),
+                                         static_cast<short>(start[2]), static_cast<short>(start[3]),
+                                         static_cast<short>(start[0]), static_cast<short>(start[1]),
+                                         static_cast<short>(start[2]), static_cast<short>(start[3]));
+        __m128i dir     = _mm_setr_epi16(static_cast<short>(axis[0]), static_cast<short>(axis[1]),
+                                         static_cast<short>(axis[2]), static_cast<short>(axis[3]),
+                                         static_cast<short>(axis[0]), static_cast<short>(axis[1]),
+                                         static_cast<short>(axis[2]), static_cast<short>(axis[3]));
+        __m128  scaleV  = _mm_set1_ps(scale);
+        __m128  half    = _mm_set1_ps(0.5f);
+        __m128  maxStep = _mm_set1_ps(static_cast<float>(steps));
+
+        for (int i = 0; i < TexelsPerBlock; i += 4)
+        {
+            __m128i texels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgba + i * 4));
+            __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(texels, zero), base);
+            __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(texels, zero), base);
+
+            // Each madd gives the partial dot products (rg, ba) of two texels
+            __m128 partialLo = _mm_castsi128_ps(_mm_madd_epi16(lo, dir));
+            __m128 partialHi = _mm_castsi128_ps(_mm_madd_epi16(hi, dir));
+            __m128i rg = _mm_castps_si128(_mm_shuffle_ps(partialLo, partialHi, _MM_SHUFFLE(2, 0, 2, 0)));
+            __m128i ba = _mm_castps_si128(_mm_shuffle_ps(partialLo, partialHi, _MM_SHUFFLE(3, 1, 3, 1)));
+            __m128i dot = _mm_add_epi32(rg, ba);
+
+            __m128 t = _mm_add_ps(_mm_mul_ps(_mm_cvtepi32_ps(dot), scaleV), half);
+            t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), maxStep);
+            __m128i ti = _mm_cvttps_epi32(t);
+            ti = _mm_packs_epi32(ti, ti);
+            ti = _mm_packus_epi16(ti, ti);
+
+            uint32_t packed = static_cast<uint32_t>(_mm_cvtsi128_si32(ti));
+            memcpy(stepsOut + i, &packed, 4);
+        }
+#else
+        for (int i = 0; i < TexelsPerBlock; i++)
+        {
+            int dot = 0;
+            for (int c = 0; c < 4; c++)
+            {
+                dot += (static_cast<int>(rgba[i * 4 + c]) - start[c]) * axis[c];
+            }
+            float t = static_cast<float>(dot) * scale + 0.5f;
+            stepsOut[i] = static_cast<uint8_t>(std::min(std::max(t, 0.f), static_cast<float>(steps)));
+        }
+#endif
+    }
+
+    // Endpoints along the principal axis of the first N channels of the texels
+    template<int N>
+    void principalEndpoints(const uint8_t* rgba, float e0[N], float e1[N])
+    {
+        float mean[N] = {};
+        for (int i = 0; i < TexelsPerBlock; i++)
+        {
+            for (int c = 0; c < N; c++) mean[c] += rgba[i * 4 + c];
+        }
+        for (int c = 0; c < N; c++) mean[c] /= TexelsPerBlock;
+
+        float covariance[N][N] = {};
+        for (int i = 0; i < TexelsPerBlock; i++)
+        {
+            float d[N];
+            for (int c = 0; c < N; c++) d[c] = rgba[i * 4 + c] - mean[c];
+            for (int a = 0; a < N; a++)
+            {
+                for (int b = a; b < N; b++) covariance[a][b] += d[a] * d[b];
+            }
+        }
+        for (int a = 0; a < N; a++)
+        {
+            for (int b = 0; b < a; b++) covariance[a][b] = covariance[b][a];
+        }
+
+        // Power iteration, starting from the bounding box diagonal
+        uint8_t minColor[4], maxColor[4];
+        blockMinMax(rgba, minColor, maxColor);
+        float axis[N];
+        for (int c = 0; c < N; c++) axis[c] = static_cast<float>(maxColor[c] - minColor[c]);
+        for (int iter = 0; iter < 8; iter++)
+        {
+            float next[N] = {};
+            float maxComponent = 0.f;
+            for (int a = 0; a < N; a++)
+            {
+                for (int b = 0; b < N; b++) next[a] += covariance[a][b] * axis[b];
+                maxComponent = std::max(maxComponent, std::abs(next[a]));
+            }
+            if (maxComponent < 1e-6f) break;
+            for (int c = 0; c < N; c++) axis[c] = next[c] / maxComponent;
+        }
+
+        float lengthSquared = 0.f;
+        for (int c = 0; c < N; c++) lengthSquared += axis[c] * axis[c];
+        if (lengthSquared < 1e-12f)
+        {
+            for (int c = 0; c < N; c++) e0[c] = e1[c] = mean[c];
+            return;
+        }
+
+        float tMin = 1e30f;
+        float tMax = -1e30f;
+        for (int i = 0; i < TexelsPerBlock; i++)
+        {
+            float t = 0.f;
+            for (int c = 0; c < N; c++) t += (rgba[i * 4 + c] - mean[c]) * axis[c];
+            tMin = std::min(tMin, t);
+            tMax = std::max(tMax, t);
+        }
+        tMin /= lengthSquared;
+        tMax /= lengthSquared;
+        for (int c = 0; c < N; c++)
+        {
+            e0[c] = mean[c] + tMax * axis[c];
+            e1[c] = mean[c] + tMin * axis[c];
+        }
+    }
+
+    // Solves the endpoints that minimize the squared error for the given palette indices.
+    // Returns false, if the indices do not determine the endpoints, e.g. all are the same.
+    template<int N>
+    bool leastSquaresEndpoints(const uint8_t* rgba, const uint8_t* indices, int channelOffset,
+                               const float* weights, float e0[N], float e1[N])
+    {
+        float aa = 0.f, bb = 0.f, ab = 0.f;
+        float ax[N] = {};
+        float bx[N] = {};
+        for (int i = 0; i < TexelsPerBlock; i++)
+        {
+            float beta  = weights[indices[i]];
+            float alpha = 1.f - beta;
+            aa += alpha * alpha;
+            bb += beta * beta;
+            ab += alpha * beta;
+            for (int c = 0; c < N; c++)
+            {
+                float x = rgba[i * 4 + channelOffset + c];
+                ax[c] += alpha * x;
+                bx[c] += beta * x;
+            }
+        }
+
+        float det = aa * bb - ab * ab;
+        if (std::abs(det) < 1e-6f) return false;
+
+        float invDet = 1.f / det;
+        for (int c = 0; c < N; c++)
+        {
+            e0[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) * invDet, 0.f), 255.f);
+            e1[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) * invDet, 0.f), 255.f);
+        }
+        return true;
+    }
+
+    class BitWriter
+    {
+    public:
+        BitWriter(uint8_t* dst, int bytes) : m_dst(dst), m_bit(0) { memset(dst, 0, bytes); }
+
+        void write(uint32_t value, int bits)
+        {
+            for (int i = 0; i < bits; i++, m_bit++)
+            {
+                m_dst[m_bit >> 3] |= static_cast<uint8_t>(((value >> i) & 1) << (m_bit & 7));
+            }
+        }
+    private:
+        uint8_t*    m_dst;
+        int         m_bit;
+    };
+
+    class BitReader
+    {
+    public:
+        BitReader(const uint8_t* src) : m_src(src), m_bit(0) {}
+
+        uint32_t read(int bits)
+        {
+            uint32_t value = 0;
+            for (int i = 0; i < bits; i++, m_bit++)
+            {
+                value |= static_cast<uint32_t>((m_src[m_bit >> 3] >> (m_bit & 7)) & 1) << i;
+            }
+            return value;
+        }
+    private:
+        const uint8_t*  m_src;
+        int             m_bit;
+    };
+
+    // BC1
+
+    uint16_t to565(const float color[3])
+    {
+        uint16_t r = static_cast<uint16_t>(clampByte(color[0]) * 31 + 127) / 255;
+        uint16_t g = static_cast<uint16_t>(clampByte(color[1]) * 63 + 127) / 255;
+        uint16_t b = static_cast<uint16_t>(clampByte(color[2]) * 31 + 127) / 255;
+        return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+    }
+
+    void from565(uint16_t packed, uint8_t color[4])
+    {
+        uint8_t r = (packed >> 11) & 31;
+        uint8_t g = (packed >> 5) & 63;
+        uint8_t b = packed & 31;
+        color[0] = static_cast<uint8_t>((r << 3) | (r >> 2));
+        color[1] = static_cast<uint8_t>((g << 2) | (g >> 4));
+        color[2] = static_cast<uint8_t>((b << 3) | (b >> 2));
+        color[3] = 255;
+    }
+
+    void bc1Palette(uint16_t c0, uint16_t c1, bool allowTransparent, uint8_t palette[4][4])
+    {
+        from565(c0, palette[0]);
+        from565(c1, palette[1]);
+        if ((c0 > c1) || !allowTransparent)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                palette[2][c] = static_cast<uint8_t>((2 * palette[0][c] + palette[1][c] + 1) / 3);
+                palette[3][c] = static_cast<uint8_t>((palette[0][c] + 2 * palette[1][c] + 1) / 3);
+            }
+            palette[2][3] = palette[3][3] = 255;
+        }
+        else
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                palette[2][c] = static_cast<uint8_t>((palette[0][c] + palette[1][c]) / 2);
+                palette[3][c] = 0;
+            }
+            palette[2][3] = 255;
+            palette[3][3] = 0;
+        }
+    }
+
+    int nearestBC1Indices(const uint8_t* rgba, uint16_t c0, uint16_t c1, uint8_t indices[16])
+    {
+        uint8_t palette[4][4];
+        bc1Palette(c0, c1, false, palette);
+        int totalError = 0;
+        for (int i = 0; i < TexelsPerBlock; i++)
+        {
+            int bestError = INT32_MAX;
+            for (uint8_t p = 0; p < 4; p++)
+            {
+                int error = squaredDistance(rgba + i * 4, palette[p], 3);
+                if (error < bestError)
+                {
+                    bestError   = error;
+                    indices[i]  = p;
+                }
+            }
+            totalError += bestError;
+        }
+        return totalError;
+    }
+
+    // Least squares endpoints are rounded to 565 channel by channel, which is often not the best
+    // pair. Moves the endpoints one step at a time in each channel, while the error decreases.
+    void searchBC1Endpoints(const uint8_t* rgba, uint16_t& c0, uint16_t& c1, uint8_t indices[16])
+    {
+        const int shifts[3]   = { 11, 5, 0 };
+        const int maxValues[3] = { 31, 63, 31 };
+
+        int error = nearestBC1Indices(rgba, c0, c1, indices);
+        for (int round = 0; round < MaxEndpointSearchRounds; round++)
+        {
+            bool improved = false;
+            for (int e = 0; e < 2; e++)
+            {
+                for (int c = 0; c < 3; c++)
+                {
+                    for (int delta = -1; delta <= 1; delta += 2)
+                    {
+                        uint16_t endpoints[2] = { c0, c1 };
+                        int value = ((endpoints[e] >> shifts[c]) & maxValues[c]) + delta;
+                        if ((value < 0) || (value > maxValues[c])) continue;
+                        endpoints[e] = static_cast<uint16_t>((endpoints[e] & ~(maxValues[c] << shifts[c])) |
+                                                             (value << shifts[c]));
+
+                        uint8_t newIndices[TexelsPerBlock];
+                        int newError = nearestBC1Indices(rgba, endpoints[0], endpoints[1], newIndices);
+                        if (newError >= error) continue;
+
+                        c0          = endpoints[0];
+                        c1          = endpoints[1];
+                        error       = newError;
+                        improved    = true;
+                        memcpy(indices, newIndices, sizeof(newIndices));
+                    }
+                }
+            }
+            if (!improved) break;
+        }
+    }
+
+    void encodeBC1(const uint8_t* rgba, CompressionQuality quality, uint8_t* block)
+    {
+        float e0[3], e1[3];
+        uint8_t indices[TexelsPerBlock];
+        if (quality == CompressionQuality::Fast)
+        {
+            // Bounding box, inset by a half of the palette step to reduce the average error
+            uint8_t minColor[4], maxColor[4];
+            blockMinMax(rgba, minColor, maxColor);
+            for (int c = 0; c < 3; c++)
+            {
+                float inset = (maxColor[c] - minColor[c]) / 16.f;
+                e0[c] = maxColor[c] - inset;
+                e1[c] = minColor[c] + inset;
+            }
+        }
+        else
+        {
+            principalEndpoints<3>(rgba, e0, e1);
+        }
+
+        uint16_t c0 = to565(e0);
+        uint16_t c1 = to565(e1);
+
+        if (quality == CompressionQuality::Fast)
+        {
+            uint8_t p0[4], p1[4];
+            from565(c0, p0);
+            from565(c1, p1);
+            int start[4] = { p0[0], p0[1], p0[2], 0 };
+            int axis[4]  = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2], 0 };
+            uint8_t steps[TexelsPerBlock];
+            projectToSteps(rgba, start, axis, 3, steps);
+            for (int i = 0; i < TexelsPerBlock; i++) indices[i] = BC1StepToIndex[steps[i]];
+        }
+        else
+        {
+            nearestBC1Indices(rgba, c0, c1, indices);
+
+            int refinements = (quality == CompressionQuality::High) ? 3 : 1;
+            for (int iter = 0; iter < refinements; iter++)
+            {
+                if (!leastSquaresEndpoints<3>(rgba, indices, 0, BC1Weights, e0, e1)) break;
+                uint16_t n0 = to565(e0);
+                uint16_t n1 = to565(e1);
+                if ((n0 == c0) && (n1 == c1)) break;
+                c0 = n0;
+                c1 = n1;
+                nearestBC1Indices(rgba, c0, c1, indices);
+            }
+
+            if (quality == CompressionQuality::High) searchBC1Endpoints(rgba, c0, c1, indices);
+        }
+
+        // The four color mode requires c0 > c1, swapping the endpoints swaps the index pairs
+        if (c0 < c1)
+        {
+            std::swap(c0, c1);
+            for (int i = 0; i < TexelsPerBlock; i++) indices[i] ^= 1;
+        }
+        else if (c0 == c1)
+        {
+            memset(indices, 0, sizeof(indices));
+        }
+
+        uint32_t packedIndices = 0;
+        for (int i = 0; i < TexelsPerBlock; i++) packedIndices |= static_cast<uint32_t>(indices[i]) << (2 * i);
+
+        memcpy(block,     &c0, 2);
+        memcpy(block + 2, &c1, 2);
+        memcpy(block + 4, &packedIndices, 4);
+    }
+
+    void decodeBC1(const uint8_t* block, bool allowTransparent, uint8_t* rgba)
+    {
+        uint16_t c0, c1;
+        uint32_t packedIndices;
+        memcpy(&c0, block, 2);
+        memcpy(&c1, block + 2, 2);
+        memcpy(&packedIndices, block + 4, 4);
+
+        uint8_t palette[4][4];
+        bc1Palette(c0, c1, allowTransparent, palette);
+        for (int i = 0; i < TexelsPerBlock; i++)
+        {
+            uint32_t index = (packedIndices >> (2 * i)) & 3;
+            for (int c = 0; c < 3; c++) rgba[i * 4 + c] = palette[index][c];
+            if (allowTransparent) rgba[i * 4 + 3] = palette[index][3];
+        }
+    }
+
+    // BC4 - one channel of the RGBA texels
+
+    void bc4Palette(uint8_t a0, uint8_t a1, uint8_t palette[8])
+    {
+        palette[0] = a0;
+        palette[1] = a1;
+        if (a0 > a1)
+        {
+            for (int i = 1; i < 7; i++) palette[i + 1] = static_cast<uint8_t>(((7 - i) * a0 + i * a1 + 3) / 7);
+        }
+        else
+        {
+            for (int i = 1; i < 5; i++) palette[i + 1] = static_cast<uint8_t>(((5 - i) * a0 + i * a1 + 2) / 5);
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    void nearestBC4Indices(const uint8_t* rgba, int channel, uint8_t a0, uint8_t a1, uint8_t indices[16])
+    {
+        uint8_t palette[8];
+        bc4Palette(a0, a1, palette);
+        for (int i = 0; i < TexelsPerBlock; i++)
+        {
+            int bestError = INT32_MAX;
+            for (uint8_t p = 0; p < 8; p++)
+            {
+                int error = std::abs(static_cast<int>(rgba[i * 4 + channel]) - palette[p]);
+                if (error < bestError)
+                {
+                    bestError   = error;
+                    indices[i]  = p;
+                }
+            }
+        }
+    }
+
+    void encodeBC4(const uint8_t* rgba, int channel, CompressionQuality quality, uint8_t* block)
+    {
+        uint8_t minColor[4], maxColor[4];
+        blockMinMax(rgba, minColor, maxColor);
+        uint8_t a0 = maxColor[channel];
+        uint8_t a1 = minColor[channel];
+
+        uint8_t indices[TexelsPerBlock];
+        if (a0 == a1)
+        {
+            memset(indices, 0, sizeof(indices));
+        }
+        else if (quality == CompressionQuality::Fast)
+        {
+            int start[4] = {};
+            int axis[4]  = {};
+            start[channel] = a0;
+            axis[channel]  = a1 - a0;
+            uint8_t steps[TexelsPerBlock];
+            projectToSteps(rgba, start, axis, 7, steps);
+            for (int i = 0; i < TexelsPerBlock; i++) indices[i] = BC4StepToIndex[steps[i]];
+        }
+        else
+        {
+            nearestBC4Indices(rgba, channel, a0, a1, indices);
+            if (quality == CompressionQuality::High)
+            {
+                float e0, e1;
+                if (leastSquaresEndpoints<1>(rgba, indices, channel, BC4Weights, &e0, &e1))
+                {
+                    uint8_t n0 = clampByte(e0);
+                    uint8_t n1 = clampByte(e1);
+                    if (n0 > n1)
+                    {
+                        a0 = n0;
+                        a1 = n1;
+                        nearestBC4Indices(rgba, channel, a0, a1, indices);
+                    }
+                }
+            }
+        }
+
+        block[0] = a0;
+        block[1] = a1;
+        uint64_t packedIndices = 0;
+        for (int i = 0; i < TexelsPerBlock; i++) packedIndices |= static_cast<uint64_t>(indices[i]) << (3 * i);
+        for (int i = 0; i < 6; i++) block[2 + i] = static_cast<uint8_t>(packedIndices >> (8 * i));
+    }
+
+    void decodeBC4(const uint8_t* block, int channel, uint8_t* rgba)
+    {
+        uint8_t palette[8];
+        bc4Palette(block[0], block[1], palette);
+        uint64_t packedIndices = 0;
+        for (int i = 0; i < 6; i++) packedIndices |= static_cast<uint64_t>(block[2 + i]) << (8 * i);
+        for (int i = 0; i < TexelsPerBlock; i++)
+        {
+            rgba[i * 4 + channel] = palette[(packedIndices >> (3 * i)) & 7];
+        }
+    }
+
+    // BC7 mode 6: RGBA endpoints of 7 bits and a shared lowest bit for each endpoint, 4-bit indices
+
+    struct BC7Endpoint
+    {
+        uint8_t color[4];   // 7 bits
+        uint8_t pbit;
+
+        uint8_t value(int c) const { return static_cast<uint8_t>((color[c] << 1) | pbit); }
+    };
+
+    BC7Endpoint quantizeBC7Endpoint(const float e[4])
+    {
+        BC7Endpoint best = {};
+        float bestError = 1e30f;
+        for (uint8_t pbit = 0; pbit < 2; pbit++)
+        {
+            BC7Endpoint candidate;
+            candidate.pbit = pbit;
+            float error = 0.f;
+            for (int c = 0; c < 4; c++)
+            {
+                float q = std::floor((e[c] - pbit) * 0.5f + 0.5f);
+                candidate.color[c] = static_cast<uint8_t>(std::min(std::max(q, 0.f), 127.f));
+                float d = candidate.value(c) - e[c];
+                error += d * d;
+            }
+            if (error < bestError)
+            {
+                bestError   = error;
+                best        = candidate;
+            }
+        }
+        return best;
+    }
+
+    void bc7Palette(const BC7Endpoint& e0, const BC7Endpoint& e1, uint8_t palette[16][4])
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                palette[i][c] = static_cast<uint8_t>(((64 - BC7Weights[i]) * e0.value(c) +
+                                                      BC7Weights[i] * e1.value(c) + 32) >> 6);
+            }
+        }
+    }
+
+    int nearestBC7Indices(const uint8_t* rgba, const BC7Endpoint& e0, const BC7Endpoint& e1, uint8_t indices[16])
+    {
+        uint8_t palette[16][4];
+        bc7Palette(e0, e1, palette);
+        int totalError = 0;
+        for (int i = 0; i < TexelsPerBlock; i++)
+        {
+            int bestError = INT32_MAX;
+            for (uint8_t p = 0; p < 16; p++)
+            {
+                int error = squaredDistance(rgba + i * 4, palette[p], 4);
+                if (error < bestError)
+                {
+                    bestError   = error;
+                    indices[i]  = p;
+                }
+            }
+            totalError += bestError;
+        }
+        return totalError;
+    }
+
+    // The same search as for BC1, over the 7-bit channels and the p-bits of the endpoints
+    void searchBC7Endpoints(const uint8_t* rgba, BC7Endpoint& q0, BC7Endpoint& q1, uint8_t indices[16], int error)
+    {
+        for (int round = 0; round < MaxEndpointSearchRounds; round++)
+        {
+            bool improved = false;
+            auto tryEndpoints = [&](const BC7Endpoint& n0, const BC7Endpoint& n1)
+            {
+                uint8_t newIndices[TexelsPerBlock];
+                int newError = nearestBC7Indices(rgba, n0, n1, newIndices);
+                if (newError >= error) return;
+
+                q0          = n0;
+                q1          = n1;
+                error       = newError;
+                improved    = true;
+                memcpy(indices, newIndices, sizeof(newIndices));
+            };
+
+            for (int e = 0; e < 2; e++)
+            {
+                for (int c = 0; c < 4; c++)
+                {
+                    for (int delta = -1; delta <= 1; delta += 2)
+                    {
+                        BC7Endpoint endpoints[2] = { q0, q1 };
+                        int value = endpoints[e].color[c] + delta;
+                        if ((value < 0) || (value > 127)) continue;
+                        endpoints[e].color[c] = static_cast<uint8_t>(value);
+                        tryEndpoints(endpoints[0], endpoints[1]);
+                    }
+                }
+
+                BC7Endpoint endpoints[2] = { q0, q1 };
+                endpoints[e].pbit ^= 1;
+                tryEndpoints(endpoints[0], endpoints[1]);
+            }
+            if (!improved) break;
+        }
+    }
+
+    void encodeBC7(const uint8_t* rgba, CompressionQuality quality, uint8_t* block)
+    {
+        float e0[4], e1[4];
+        if (quality == CompressionQuality::Fast)
+        {
+            uint8_t minColor[4], maxColor[4];
+            blockMinMax(rgba, minColor, maxColor);
+            for (int c = 0; c < 4; c++)
+            {
+                e0[c] = minColor[c];
+                e1[c] = maxColor[c];
+            }
+        }
+        else
+        {
+            principalEndpoints<4>(rgba, e0, e1);
+        }
+
+        BC7Endpoint q0 = quantizeBC7Endpoint(e0);
+        BC7Endpoint q1 = quantizeBC7Endpoint(e1);
+        uint8_t indices[TexelsPerBlock];
+        int error = nearestBC7Indices(rgba, q0, q1, indices);
+
+        int refinements = (quality == CompressionQuality::High) ? 3 :
+                          (quality == CompressionQuality::Normal) ? 1 : 0;
+        float weights[16];
+        for (int i = 0; i < 16; i++) weights[i] = BC7Weights[i] / 64.f;
+        for (int iter = 0; iter < refinements; iter++)
+        {
+            if (!leastSquaresEndpoints<4>(rgba, indices, 0, weights, e0, e1)) break;
+
+            BC7Endpoint n0 = quantizeBC7Endpoint(e0);
+            BC7Endpoint n1 = quantizeBC7Endpoint(e1);
+            uint8_t newIndices[TexelsPerBlock];
+            int newError = nearestBC7Indices(rgba, n0, n1, newIndices);
+            if (newError >= error) break;
+
+            q0      = n0;
+            q1      = n1;
+            error   = newError;
+            memcpy(indices, newIndices, sizeof(indices));
+        }
+
+        if (quality == CompressionQuality::High) searchBC7Endpoints(rgba, q0, q1, indices, error);
+
+        // The highest bit of the first index is implicitly zero
+        if (indices[0] & 8)
+        {
+            std::swap(q0, q1);
+            for (int i = 0; i < TexelsPerBlock; i++) indices[i] = 15 - indices[i];
+        }
+
+        BitWriter bits(block, 16);
+        bits.write(1 << 6, 7);      // Mode 6
+        for (int c = 0; c < 4; c++)
+        {
+            bits.write(q0.color[c], 7);
+            bits.write(q1.color[c], 7);
+        }
+        bits.write(q0.pbit, 1);
+        bits.write(q1.pbit, 1);
+        bits.write(indices[0], 3);
+        for (int i = 1; i < TexelsPerBlock; i++) bits.write(indices[i], 4);
+    }
+
+    void decodeBC7(const uint8_t* block, uint8_t* rgba)
+    {
+        BitReader bits(block);
+        if (bits.read(7) != (1 << 6))
+        {
+            // Only mode 6 is ever produced here
+            memset(rgba, 0, TexelsPerBlock * 4);
+            return;
+        }
+
+        BC7Endpoint e0, e1;
+        for (int c = 0; c < 4; c++)
+        {
+            e0.color[c] = static_cast<uint8_t>(bits.read(7));
+            e1.color[c] = static_cast<uint8_t>(bits.read(7));
+        }
+        e0.pbit = static_cast<uint8_t>(bits.read(1));
+        e1.pbit = static_cast<uint8_t>(bits.read(1));
+
+        uint8_t palette[16][4];
+        bc7Palette(e0, e1, palette);
+        for (int i = 0; i < TexelsPerBlock; i++)
+        {
+            uint32_t index = bits.read(i == 0 ? 3 : 4);
+            memcpy(rgba + i * 4, palette[index], 4);
+        }
+    }
+
+    // Gathers a block of texels from the source image, replicating the edge texels
+    void loadBlock(const Image& src, PixelLayout layout, int blockX, int blockY, uint8_t* rgba)
+    {
+        for (int y = 0; y < BlockDim; y++)
+        {
+            int srcY = std::min(blockY * BlockDim + y, src.height() - 1);
+            for (int x = 0; x < BlockDim; x++)
+            {
+                int srcX = std::min(blockX * BlockDim + x, src.width() - 1);
+                const uint8_t* texel = src.data() + src.byteOffset(srcX, srcY);
+                uint8_t* dst = rgba + (y * BlockDim + x) * 4;
+                if (layout == PixelLayout::RG16)
+                {
+                    uint16_t rg[2];
+                    memcpy(rg, texel, 4);
+                    dst[0] = static_cast<uint8_t>((rg[0] * 255u + 32767u) / 65535u);
+                    dst[1] = static_cast<uint8_t>((rg[1] * 255u + 32767u) / 65535u);
+                    dst[2] = 0;
+                    dst[3] = 255;
+                }
+                else
+                {
+                    memcpy(dst, texel, 4);
+                }
+            }
+        }
+    }
+}
+
+namespace graphics
+{
+    uint32_t blockBytes(BlockFormat format)
+    {
+        return ((format == BlockFormat::BC1) || (format == BlockFormat::BC4)) ? 8 : 16;
+    }
+
+    void encodeBlock(BlockFormat format, CompressionQuality quality, const uint8_t* rgba, uint8_t* block)
+    {
+        switch (format)
+        {
+        case BlockFormat::BC1:
+            encodeBC1(rgba, quality, block);
+            break;
+        case BlockFormat::BC3:
+            encodeBC4(rgba, 3, quality, block);
+            encodeBC1(rgba, quality, block + 8);
+            break;
+        case BlockFormat::BC4:
+            encodeBC4(rgba, 0, quality, block);
+            break;
+        case BlockFormat::BC5:
+            encodeBC4(rgba, 0, quality, block);
+            encodeBC4(rgba, 1, quality, block + 8);
+            break;
+        case BlockFormat::BC7:
+            encodeBC7(rgba, quality, block);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void decodeBlock(BlockFormat format, const uint8_t* block, uint8_t* rgba)
+    {
+        // Channels that the format does not store are decoded as in the GPU, i.e. zero or one
+        for (int i = 0; i < TexelsPerBlock; i++)
+        {
+            rgba[i * 4]     = 0;
+            rgba[i * 4 + 1] = 0;
+            rgba[i * 4 + 2] = 0;
+            rgba[i * 4 + 3] = 255;
+        }
+
+        switch (format)
+        {
+        case BlockFormat::BC1:
+            decodeBC1(block, true, rgba);
+            break;
+        case BlockFormat::BC3:
+            decodeBC4(block, 3, rgba);
+            decodeBC1(block + 8, false, rgba);
+            break;
+        case BlockFormat::BC4:
+            decodeBC4(block, 0, rgba);
+            break;
+        case BlockFormat::BC5:
+            decodeBC4(block, 0, rgba);
+            decodeBC4(block + 8, 1, rgba);
+            break;
+        case BlockFormat::BC7:
+            decodeBC7(block, rgba);
+            break;
+        default:
+            break;
+        }
+    }
+
+    Image createBlockImage(BlockFormat format, uint16_t width, uint16_t height, ImageMemory memory)
+    {
+        return Image(static_cast<uint8_t>(blockBytes(format) * 8),
+                     static_cast<uint16_t>((width + BlockDim - 1) / BlockDim),
+                     static_cast<uint16_t>((height + BlockDim - 1) / BlockDim),
+                     1, memory);
+    }
+
+    Rect<int, 2> compressRect(const Image& src, PixelLayout layout, Rect<int, 2> texelRect,
+                              Image& dst, BlockFormat format, CompressionQuality quality)
+    {
+        int2 minTexel = texelRect.minCorner();
+        int2 maxTexel = texelRect.minCorner() + texelRect.size();
+
+        int2 minBlock{ std::max(minTexel[0], 0) / BlockDim, std::max(minTexel[1], 0) / BlockDim };
+        int2 maxBlock{ std::min((maxTexel[0] + BlockDim - 1) / BlockDim, static_cast<int>(dst.width())),
+                       std::min((maxTexel[1] + BlockDim - 1) / BlockDim, static_cast<int>(dst.height())) };
+        if ((maxBlock[0] <= minBlock[0]) || (maxBlock[1] <= minBlock[1])) return Rect<int, 2>();
+
+        uint32_t bytes = blockBytes(format);
+        SP_ASSERT(dst.bpp() == bytes * 8, "Block image does not match the block format");
+
+        uint8_t* dstData = dst.asRange<uint8_t>().begin();
+        uint32_t numRows = static_cast<uint32_t>(maxBlock[1] - minBlock[1]);
+
+        // A batch of 4 block rows is a few hundred blocks even for small materials
+        parallelFor(numRows, 4, [&](uint32_t begin, uint32_t end)
+        {
+            uint8_t rgba[TexelsPerBlock * 4];
+            for (uint32_t row = begin; row < end; row++)
+            {
+                int blockY = minBlock[1] + static_cast<int>(row);
+                for (int blockX = minBlock[0]; blockX < maxBlock[0]; blockX++)
+                {
+                    loadBlock(src, layout, blockX, blockY, rgba);
+                    encodeBlock(format, quality, rgba, dstData + dst.byteOffset(blockX, blockY));
+                }
+            }
+        });
+
+        return Rect<int, 2>(minBlock, maxBlock - minBlock);
+    }
+}
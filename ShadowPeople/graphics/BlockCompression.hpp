@@ -0,0 +1,70 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    BlockCompression.hpp
+
+    CPU encoders for the BCn texture formats. Blocks are 4x4 texels, and a
+    block compressed image is stored as an Image, whose pixels are the
+    blocks, i.e. width and height are in blocks and bpp is the block size.
+
+    BC1 and BC3 use the bounding box of the block at the fast quality, and
+    the principal axis with least squares refinement at the higher ones.
+    BC7 is always encoded in mode 6, one subset with 4-bit indices, which
+    suits the smooth albedo and roughness data of the material cache.
+    The high quality also searches the neighbouring quantized endpoints of
+    BC1, BC3 and BC7 blocks, which is several times slower.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "../Types.hpp"
+#include "ImagePool.hpp"
+
+namespace graphics
+{
+    class Image;
+
+    enum class BlockFormat
+    {
+        BC1,    // RGB
+        BC3,    // RGB + A
+        BC4,    // R
+        BC5,    // R + G
+        BC7     // RGBA, mode 6 only
+    };
+
+    enum class CompressionQuality
+    {
+        Fast,
+        Normal,
+        High
+    };
+
+    // Layout of the uncompressed source images
+    enum class PixelLayout
+    {
+        RGBA8,
+        RG16
+    };
+
+    constexpr int BlockDim = 4;
+
+    uint32_t blockBytes(BlockFormat format);
+
+    // Blocks are encoded from and decoded to 16 RGBA8 texels in row order. BC4 uses only R,
+    // and BC5 R and G.
+    void encodeBlock(BlockFormat format, CompressionQuality quality, const uint8_t* rgba, uint8_t* block);
+    void decodeBlock(BlockFormat format, const uint8_t* block, uint8_t* rgba);
+
+    // Creates an image of zero blocks, which covers the given size in texels. The blocks are left
+    // uninitialized with ImageMemory::Uninitialized, when they are all written right after.
+    Image createBlockImage(BlockFormat format, uint16_t width, uint16_t height,
+                           ImageMemory memory = ImageMemory::Zeroed);
+
+    // Compresses a rectangle of the source image to the same location in the block image.
+    // The rectangle is grown to whole blocks. Returns the written rectangle in blocks.
+    // Block rows are compressed in parallel.
+    Rect<int, 2> compressRect(const Image& src, PixelLayout layout, Rect<int, 2> texelRect,
+                              Image& dst, BlockFormat format, CompressionQuality quality);
+}
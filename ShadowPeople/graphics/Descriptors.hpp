@@ -18,6 +18,13 @@ namespace graphics
 		int arraySlice  = 0;
 	};
 
+    // Part of the index buffer, e.g. one of several drawn with the same bindings
+    struct IndexRange
+    {
+        uint32_t    firstIndex;
+        uint32_t    numIndices;
+    };
+
 	class Buffer;
 	class ResourceView;
 	class Sampler;
@@ -137,7 +144,11 @@ namespace graphics
 			SNorm,
 			UInt,
 			SInt,
-			BlockCompressed
+			BC1,
+			BC3,
+			BC4,
+			BC5,
+			BC7
 		};
 
 		class Format
@@ -163,8 +174,14 @@ namespace graphics
 				return true;
 			}
 
+			// For block compressed formats the width of one 4x4 block
 			uint32_t byteWidth() const
 			{
+				if (blockCompressed())
+				{
+					return ((desc.type == FormatType::BC1) || (desc.type == FormatType::BC4)) ? 8 : 16;
+				}
+
 				uint32_t channelFactor = 
 					(desc.channels == FormatChannels::RG) ? 2 :
 					(desc.channels == FormatChannels::RGB) ? 3 :
@@ -185,6 +202,18 @@ namespace graphics
 
             // TODO: Helper functions for most common formats
 
+            static Format bc1() { return Format(FormatChannels::RGB,  FormatBytesPerChannel::B8, FormatType::BC1); }
+            static Format bc3() { return Format(FormatChannels::RGBA, FormatBytesPerChannel::B8, FormatType::BC3); }
+            static Format bc4() { return Format(FormatChannels::R,    FormatBytesPerChannel::B8, FormatType::BC4); }
+            static Format bc5() { return Format(FormatChannels::RG,   FormatBytesPerChannel::B8, FormatType::BC5); }
+            static Format bc7() { return Format(FormatChannels::RGBA, FormatBytesPerChannel::B8, FormatType::BC7); }
+
+            bool blockCompressed() const
+            {
+                return (desc.type == FormatType::BC1) || (desc.type == FormatType::BC3) || (desc.type == FormatType::BC4) ||
+                       (desc.type == FormatType::BC5) || (desc.type == FormatType::BC7);
+            }
+
 			static Format unknown()
 			{
 				Format f;
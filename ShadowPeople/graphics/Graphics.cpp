@@ -319,6 +319,18 @@ namespace graphics
 		clearResourceBindings(binding);
 	}
 
+    void CommandBuffer::drawIndexed(desc::ShaderBinding& binding, Range<const IndexRange> ranges, uint32_t vertexOffset)
+    {
+        SP_EXPECT_NOT_NULL(pImpl, ERROR_CODE_COMMAND_BUFFER_NULL);
+        SP_ASSERT(binding.graphicsPipeline() != nullptr, "GraphicsPipeline must be bound defore calling draw().");
+
+        setupResourceBindings(binding);
+
+        pImpl->drawIndexed(*binding.graphicsPipeline()->pImpl, ranges, vertexOffset);
+
+        clearResourceBindings(binding);
+    }
+
 	void CommandBuffer::drawInstanced(desc::ShaderBinding& binding, uint32_t vertexCountPerInstance,
 									  uint32_t instanceCount, uint32_t startVextexOffset,
 									  uint32_t startInstanceOffset)
@@ -407,10 +419,10 @@ namespace graphics
 		return pImpl->descriptor().descriptor();
 	}
 
-	Device::Device(HWND hWnd, int2 screenSize)
+	Device::Device(HWND hWnd, int2 screenSize, asset::AssetCache* assetCache)
 	{
 		pImpl			= std::make_shared<DeviceImpl>(hWnd, screenSize);
-		m_shaderManager	= std::make_shared<ShaderManager>(*this);
+		m_shaderManager	= std::make_shared<ShaderManager>(*this, assetCache);
 	}
 
 	Texture Device::createTexture(const desc::Texture& desc)
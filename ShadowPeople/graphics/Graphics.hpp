@@ -15,6 +15,11 @@
 #include "Image.hpp"
 #include "../Types.hpp"
 
+namespace asset
+{
+	class AssetCache;
+}
+
 namespace graphics
 {
 	// Forward declare implementation classes for pointer to implementation scheme
@@ -200,6 +205,8 @@ namespace graphics
 		void draw(desc::ShaderBinding& binding, uint32_t vertexCount, uint32_t startVertexOffset);
 		void drawIndexed(desc::ShaderBinding& binding, uint32_t indexCount, uint32_t startIndexOffset,
 						 uint32_t vertexOffset);
+        // The bindings and the pipeline state are set up once for all the ranges
+        void drawIndexed(desc::ShaderBinding& binding, Range<const IndexRange> ranges, uint32_t vertexOffset);
 		void drawInstanced(desc::ShaderBinding& binding, uint32_t vertexCountPerInstance, uint32_t instanceCount,
 						   uint32_t startVextexOffset, uint32_t startInstanceOffset);
 		void drawIndexedInstanced(desc::ShaderBinding& binding, uint32_t vertexCountPerInstance,
@@ -309,7 +316,8 @@ namespace graphics
 	class Device
 	{
 	public:
-		Device(HWND hWnd, int2 screenSize);
+		// Compiled shaders are kept in the asset cache, if one is given
+		Device(HWND hWnd, int2 screenSize, asset::AssetCache* assetCache = nullptr);
 
 		bool				valid() const { return (pImpl != nullptr); }
 
@@ -5,19 +5,80 @@
 
 #include "Image.hpp"
 #include "../Math.hpp"
+#include "../Simd.hpp"
+#include "../Errors.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    // Modified Bessel function of the first kind, order zero
+    float besselI0(float x)
+    {
+        float sum   = 1.f;
+        float term  = 1.f;
+        for (int k = 1; k < 20; k++)
+        {
+            float f = x / (2.f * k);
+            term *= f * f;
+            sum  += term;
+        }
+        return sum;
+    }
+
+    // Weights of the 6 source texels of the 2:1 Kaiser windowed sinc. The texels are at
+    // distances 2.5, 1.5 and 0.5 on both sides of the destination texel center.
+    constexpr int KaiserTaps = 6;
+
+    struct KaiserWeights
+    {
+        float w[KaiserTaps];
+
+        KaiserWeights()
+        {
+            const float Alpha   = 4.f;
+            const float Radius  = 3.f;
+            float sum = 0.f;
+            for (int k = 0; k < KaiserTaps; k++)
+            {
+                float d         = std::abs(k - 2.5f);
+                float x         = d * 0.5f;         // Cutoff at half of the source frequency
+                float sinc      = std::sin(math::Pi * x) / (math::Pi * x);
+                float r         = d / Radius;
+                float window    = besselI0(Alpha * std::sqrt(1.f - r * r)) / besselI0(Alpha);
+                w[k]            = sinc * window;
+                sum             += w[k];
+            }
+            for (int k = 0; k < KaiserTaps; k++) w[k] /= sum;
+        }
+    };
+
+    const KaiserWeights& kaiserWeights()
+    {
+        static const KaiserWeights weights;
+        return weights;
+    }
+
+    int clampInt(int value, int minValue, int maxValue)
+    {
+        return std::min(std::max(value, minValue), maxValue);
+    }
+}
 
 namespace graphics
 {
-    Image::Image(uint8_t bpp, uint16_t width, uint16_t height, uint16_t depth) :
+    Image::Image(uint8_t bpp, uint16_t width, uint16_t height, uint16_t depth, ImageMemory memory) :
         m_width(0), // Note: Set everything to zero so that setDimensions() detects a change
         m_height(0),
         m_depth(0),
         m_bpp(0)
     {
-        setDimensions(bpp, width, height, depth);
+        setDimensions(bpp, width, height, depth, memory);
     }
 
-    void Image::setDimensions(uint8_t bpp, uint16_t width, uint16_t height, uint16_t depth)
+    void Image::setDimensions(uint8_t bpp, uint16_t width, uint16_t height, uint16_t depth, ImageMemory memory)
     {
         if ((m_bpp != bpp) || (m_width != width) || (m_height != height) || (m_depth != depth))
         {
@@ -26,41 +87,65 @@ namespace graphics
             m_depth     = depth;
             m_bpp       = bpp;
 
-            m_data = std::make_shared<std::vector<uint8_t>>(dataSize());
+            m_data = ImagePool::instance().allocate(dataSize(), memory);
         }
     }
 
     void Image::fillData(Range<const uint8_t> data)
     {
-        memcpy(m_data->data(), data.begin(), dataSize());
+        memcpy(m_data.get(), data.begin(), dataSize());
     }
 
-    void Image::copy(const Image& srcImage, Rect<int, 2> dstRect,
-                     std::function<void(void* dst, const void* src)> convertAndAssign)
+    template<PixelFormat Src, PixelConversion Conversion>
+    Rect<int, 2> Image::copy(const Image& srcImage, Rect<int, 2> srcRect, int2 dstPos)
     {
-        uint8_t srcElemSize = math::divRoundUp<uint8_t>(srcImage.bpp(), 8);
-        uint8_t dstElemSize = math::divRoundUp<uint8_t>(m_bpp, 8);
-        
-        for (uint32_t y = 0; y < srcImage.height(); y++)
+        SP_ASSERT(srcImage.bpp() == 8 * pixelBytes(Src), "Source image must be in the source format");
+        SP_ASSERT(m_bpp == 8 * pixelBytes(conversionDestination(Conversion)),
+                  "Destination image must be in the destination format of the conversion");
+
+        int2 srcMin = srcRect.minCorner();
+        int2 srcMax = srcRect.minCorner() + srcRect.size();
+        int2 srcSize{ srcImage.width(), srcImage.height() };
+        int2 dstSize{ m_width, m_height };
+        for (int i = 0; i < 2; i++)
         {
-            uint32_t dstY = y + dstRect.minCorner()[1];
-            uint32_t srcY = y;
-            for (uint32_t x = 0; x < srcImage.width(); x++)
+            if (srcMin[i] < 0)
             {
-                uint32_t dstX = x + dstRect.minCorner()[0];
-                uint32_t srcX = x;
-                
-                void *dstPtr        = m_data->data() + (dstY * m_width + dstX) * dstElemSize;
-                const void *srcPtr  = srcImage.data() + (srcY * srcImage.width() + srcX) * srcElemSize;
-
-                convertAndAssign(dstPtr, srcPtr);
+                dstPos[i]   -= srcMin[i];
+                srcMin[i]   = 0;
+            }
+            if (dstPos[i] < 0)
+            {
+                srcMin[i]   -= dstPos[i];
+                dstPos[i]   = 0;
             }
+            srcMax[i] = std::min<int>(std::min<int>(srcMax[i], srcSize[i]), srcMin[i] + dstSize[i] - dstPos[i]);
+            if (srcMax[i] <= srcMin[i]) return Rect<int, 2>();
         }
+
+        int2 size = srcMax - srcMin;
+        const uint8_t* srcRow   = srcImage.data() + srcImage.byteOffset(srcMin[0], srcMin[1]);
+        uint8_t* dstRow         = m_data.get() + byteOffset(dstPos[0], dstPos[1]);
+        for (int y = 0; y < size[1]; y++, srcRow += srcImage.stride(), dstRow += stride())
+        {
+            convertRow<Src, Conversion>(dstRow, srcRow, static_cast<uint32_t>(size[0]));
+        }
+        return Rect<int, 2>(dstPos, size);
     }
 
+    template Rect<int, 2> Image::copy<PixelFormat::R8,    PixelConversion::RGB>(const Image&, Rect<int, 2>, int2);
+    template Rect<int, 2> Image::copy<PixelFormat::BGR8,  PixelConversion::RGB>(const Image&, Rect<int, 2>, int2);
+    template Rect<int, 2> Image::copy<PixelFormat::BGRA8, PixelConversion::RGB>(const Image&, Rect<int, 2>, int2);
+    template Rect<int, 2> Image::copy<PixelFormat::R8,    PixelConversion::RedToAlpha>(const Image&, Rect<int, 2>, int2);
+    template Rect<int, 2> Image::copy<PixelFormat::BGR8,  PixelConversion::RedToAlpha>(const Image&, Rect<int, 2>, int2);
+    template Rect<int, 2> Image::copy<PixelFormat::BGRA8, PixelConversion::RedToAlpha>(const Image&, Rect<int, 2>, int2);
+    template Rect<int, 2> Image::copy<PixelFormat::R8,    PixelConversion::Octahedral>(const Image&, Rect<int, 2>, int2);
+    template Rect<int, 2> Image::copy<PixelFormat::BGR8,  PixelConversion::Octahedral>(const Image&, Rect<int, 2>, int2);
+    template Rect<int, 2> Image::copy<PixelFormat::BGRA8, PixelConversion::Octahedral>(const Image&, Rect<int, 2>, int2);
+
     const uint8_t* Image::data() const
     {
-        return m_data->data();
+        return m_data.get();
     }
 
     uint32_t Image::dataSize() const
@@ -87,4 +172,234 @@ namespace graphics
         uint32_t bytesPerPixel  = math::divRoundUp<uint8_t>(m_bpp, 8);
         return ((z * m_height + y) * m_width + x) * bytesPerPixel;
     }
-}
\ No newline at end of file
+
+    Rect<int, 2> Image::mipRect(Rect<int, 2> rect)
+    {
+        int2 minCorner = rect.minCorner();
+        int2 maxCorner = rect.minCorner() + rect.size();
+        int2 mipMin{ minCorner[0] / 2, minCorner[1] / 2 };
+        int2 mipMax{ (maxCorner[0] + 1) / 2, (maxCorner[1] + 1) / 2 };
+        return Rect<int, 2>(mipMin, mipMax - mipMin);
+    }
+
+    Rect<int, 2> Image::downsample(Rect<int, 2> rect, Image& dst, MipFilter colorFilter, MipFilter alphaFilter) const
+    {
+        SP_ASSERT((dst.width() == (m_width + 1) / 2) && (dst.height() == (m_height + 1) / 2),
+                  "Destination must be the next mip level");
+        SP_ASSERT(dst.bpp() == m_bpp, "Mip levels must have the same format");
+
+        Rect<int, 2> dstRect = mipRect(rect);
+        int x0 = rect.minCorner()[0];
+        int y0 = rect.minCorner()[1];
+        int x1 = std::min(x0 + rect.size()[0], static_cast<int>(m_width)) - 1;
+        int y1 = std::min(y0 + rect.size()[1], static_cast<int>(m_height)) - 1;
+        int dstX0 = dstRect.minCorner()[0];
+        int dstY0 = dstRect.minCorner()[1];
+        int dstX1 = std::min(dstX0 + dstRect.size()[0], static_cast<int>(dst.width())) - 1;
+        int dstY1 = std::min(dstY0 + dstRect.size()[1], static_cast<int>(dst.height())) - 1;
+        if ((x1 < x0) || (y1 < y0)) return Rect<int, 2>();
+
+        uint8_t* dstData = dst.m_data.get();
+        const uint8_t* srcData = m_data.get();
+
+        if (colorFilter == MipFilter::OctahedralNormal)
+        {
+            SP_ASSERT(m_bpp == 32, "Octahedral normals must be RG16");
+            for (int y = dstY0; y <= dstY1; y++)
+            {
+                int sy0 = clampInt(2 * y, y0, y1);
+                int sy1 = clampInt(2 * y + 1, y0, y1);
+                for (int x = dstX0; x <= dstX1; x++)
+                {
+                    int sx0 = clampInt(2 * x, x0, x1);
+                    int sx1 = clampInt(2 * x + 1, x0, x1);
+
+                    uint16_t encoded[4][2];
+                    memcpy(encoded[0], srcData + byteOffset(sx0, sy0), 4);
+                    memcpy(encoded[1], srcData + byteOffset(sx1, sy0), 4);
+                    memcpy(encoded[2], srcData + byteOffset(sx0, sy1), 4);
+                    memcpy(encoded[3], srcData + byteOffset(sx1, sy1), 4);
+
+                    float3 sum;
+#if defined(SP_SIMD_SSE)
+                    // Decode the four normals at once, one component per register
+                    __m128 fx = _mm_setr_ps(encoded[0][0], encoded[1][0], encoded[2][0], encoded[3][0]);
+                    __m128 fy = _mm_setr_ps(encoded[0][1], encoded[1][1], encoded[2][1], encoded[3][1]);
+                    __m128 scale = _mm_set1_ps(2.f / 65535.f);
+                    __m128 one = _mm_set1_ps(1.f);
+                    __m128 signMask = _mm_set1_ps(-0.f);
+                    fx = _mm_sub_ps(_mm_mul_ps(fx, scale), one);
+                    fy = _mm_sub_ps(_mm_mul_ps(fy, scale), one);
+                    __m128 absX = _mm_andnot_ps(signMask, fx);
+                    __m128 absY = _mm_andnot_ps(signMask, fy);
+                    __m128 nz = _mm_sub_ps(_mm_sub_ps(one, absX), absY);
+                    __m128 t  = _mm_max_ps(_mm_sub_ps(_mm_setzero_ps(), nz), _mm_setzero_ps());
+                    __m128 nx = _mm_sub_ps(fx, _mm_or_ps(t, _mm_and_ps(signMask, fx)));
+                    __m128 ny = _mm_sub_ps(fy, _mm_or_ps(t, _mm_and_ps(signMask, fy)));
+                    __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)),
+                                                           _mm_mul_ps(nz, nz)));
+                    nx = _mm_div_ps(nx, length);
+                    ny = _mm_div_ps(ny, length);
+                    nz = _mm_div_ps(nz, length);
+
+                    alignas(16) float sx[4], sy[4], sz[4];
+                    _mm_store_ps(sx, nx);
+                    _mm_store_ps(sy, ny);
+                    _mm_store_ps(sz, nz);
+                    sum = float3{ sx[0] + sx[1] + sx[2] + sx[3],
+                                  sy[0] + sy[1] + sy[2] + sy[3],
+                                  sz[0] + sz[1] + sz[2] + sz[3] };
+#else
+                    for (int i = 0; i < 4; i++)
+                    {
+                        sum += math::decodeOctahedral(float2{ encoded[i][0] / 65535.f, encoded[i][1] / 65535.f });
+                    }
+#endif
+                    // Opposite normals cancel out, fall back to the first one
+                    if (sum.dot(sum) < 1e-8f)
+                    {
+                        sum = math::decodeOctahedral(float2{ encoded[0][0] / 65535.f, encoded[0][1] / 65535.f });
+                    }
+                    float2 octa = math::encodeOctahedral(normalize(sum));
+                    uint16_t result[2] = { static_cast<uint16_t>(octa[0] * 65535.f + 0.5f),
+                                           static_cast<uint16_t>(octa[1] * 65535.f + 0.5f) };
+                    memcpy(dstData + dst.byteOffset(x, y), result, 4);
+                }
+            }
+            return dstRect;
+        }
+
+        SP_ASSERT(m_bpp == 32, "Only RGBA8 images can be box or Kaiser filtered");
+
+        if (colorFilter == MipFilter::Box)
+        {
+            for (int y = dstY0; y <= dstY1; y++)
+            {
+                const uint8_t* row0 = srcData + byteOffset(0, clampInt(2 * y, y0, y1));
+                const uint8_t* row1 = srcData + byteOffset(0, clampInt(2 * y + 1, y0, y1));
+                uint8_t* dstRow = dstData + dst.byteOffset(0, y);
+
+                int x = dstX0;
+#if defined(SP_SIMD_SSE)
+                // Two destination texels from four source texels of both rows
+                __m128i zero = _mm_setzero_si128();
+                __m128i two  = _mm_set1_epi16(2);
+                for (; (x + 1 <= dstX1) && (2 * x + 3 <= x1); x += 2)
+                {
+                    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + 8 * x));
+                    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + 8 * x));
+                    __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                    __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+                    lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+                    hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+                    __m128i sum = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(lo, hi), two), 2);
+                    _mm_storel_epi64(reinterpret_cast<__m128i*>(dstRow + 4 * x), _mm_packus_epi16(sum, sum));
+                }
+#elif defined(SP_SIMD_NEON)
+                for (; (x + 1 <= dstX1) && (2 * x + 3 <= x1); x += 2)
+                {
+                    uint8x16_t a = vld1q_u8(row0 + 8 * x);
+                    uint8x16_t b = vld1q_u8(row1 + 8 * x);
+                    uint16x8_t lo = vaddl_u8(vget_low_u8(a), vget_low_u8(b));
+                    uint16x8_t hi = vaddl_u8(vget_high_u8(a), vget_high_u8(b));
+                    uint16x4_t s0 = vadd_u16(vget_low_u16(lo), vget_high_u16(lo));
+                    uint16x4_t s1 = vadd_u16(vget_low_u16(hi), vget_high_u16(hi));
+                    vst1_u8(dstRow + 4 * x, vrshrn_n_u16(vcombine_u16(s0, s1), 2));
+                }
+#endif
+                for (; x <= dstX1; x++)
+                {
+                    int sx0 = clampInt(2 * x, x0, x1);
+                    int sx1 = clampInt(2 * x + 1, x0, x1);
+                    for (int c = 0; c < 4; c++)
+                    {
+                        uint32_t sum = row0[sx0 * 4 + c] + row0[sx1 * 4 + c] + row1[sx0 * 4 + c] + row1[sx1 * 4 + c];
+                        dstRow[x * 4 + c] = static_cast<uint8_t>((sum + 2) / 4);
+                    }
+                }
+            }
+            return dstRect;
+        }
+
+        // Separable Kaiser filter: horizontal pass to a temporary of half width, then vertical
+        const float* w = kaiserWeights().w;
+        int dstWidth = dstX1 - dstX0 + 1;
+        int srcHeight = y1 - y0 + 1;
+        std::vector<float> horizontal(static_cast<size_t>(dstWidth) * srcHeight * 4);
+        for (int y = y0; y <= y1; y++)
+        {
+            const uint8_t* row = srcData + byteOffset(0, y);
+            float* out = horizontal.data() + static_cast<size_t>(y - y0) * dstWidth * 4;
+            for (int x = dstX0; x <= dstX1; x++)
+            {
+#ifdef SP_SIMD_FLOAT4
+                simd::Float4 acc = simd::zero();
+                for (int k = 0; k < KaiserTaps; k++)
+                {
+                    int sx = clampInt(2 * x + k - 2, x0, x1);
+                    acc = simd::madd(simd::loadBytes(row + sx * 4), simd::splat(w[k]), acc);
+                }
+                simd::store(out + (x - dstX0) * 4, acc);
+#else
+                float acc[4] = { 0.f, 0.f, 0.f, 0.f };
+                for (int k = 0; k < KaiserTaps; k++)
+                {
+                    int sx = clampInt(2 * x + k - 2, x0, x1);
+                    for (int c = 0; c < 4; c++) acc[c] += static_cast<float>(row[sx * 4 + c]) * w[k];
+                }
+                memcpy(out + (x - dstX0) * 4, acc, sizeof(acc));
+#endif
+            }
+        }
+
+        for (int y = dstY0; y <= dstY1; y++)
+        {
+            uint8_t* dstRow = dstData + dst.byteOffset(0, y);
+            for (int x = dstX0; x <= dstX1; x++)
+            {
+#ifdef SP_SIMD_FLOAT4
+                simd::Float4 acc = simd::zero();
+                for (int k = 0; k < KaiserTaps; k++)
+                {
+                    int sy = clampInt(2 * y + k - 2, y0, y1);
+                    const float* texel = horizontal.data() + (static_cast<size_t>(sy - y0) * dstWidth + (x - dstX0)) * 4;
+                    acc = simd::madd(simd::load(texel), simd::splat(w[k]), acc);
+                }
+                simd::storeBytes(dstRow + x * 4, acc);
+#else
+                float acc[4] = { 0.f, 0.f, 0.f, 0.f };
+                for (int k = 0; k < KaiserTaps; k++)
+                {
+                    int sy = clampInt(2 * y + k - 2, y0, y1);
+                    const float* texel = horizontal.data() + (static_cast<size_t>(sy - y0) * dstWidth + (x - dstX0)) * 4;
+                    for (int c = 0; c < 4; c++) acc[c] += texel[c] * w[k];
+                }
+                for (int c = 0; c < 4; c++)
+                {
+                    dstRow[x * 4 + c] = static_cast<uint8_t>(std::min(std::max(acc[c] + 0.5f, 0.f), 255.f));
+                }
+#endif
+            }
+        }
+
+        // Alpha, i.e. roughness, is averaged. The sharpening of Kaiser would make it noisy.
+        if (alphaFilter == MipFilter::Box)
+        {
+            for (int y = dstY0; y <= dstY1; y++)
+            {
+                const uint8_t* row0 = srcData + byteOffset(0, clampInt(2 * y, y0, y1));
+                const uint8_t* row1 = srcData + byteOffset(0, clampInt(2 * y + 1, y0, y1));
+                uint8_t* dstRow = dstData + dst.byteOffset(0, y);
+                for (int x = dstX0; x <= dstX1; x++)
+                {
+                    int sx0 = clampInt(2 * x, x0, x1);
+                    int sx1 = clampInt(2 * x + 1, x0, x1);
+                    uint32_t sum = row0[sx0 * 4 + 3] + row0[sx1 * 4 + 3] + row1[sx0 * 4 + 3] + row1[sx1 * 4 + 3];
+                    dstRow[x * 4 + 3] = static_cast<uint8_t>((sum + 2) / 4);
+                }
+            }
+        }
+
+        return dstRect;
+    }
+}
@@ -8,32 +8,48 @@
 #include <stdint.h>
 #include <memory>
 #include <vector>
-#include <functional>
 
 #include "../Types.hpp"
+#include "PixelConversion.hpp"
+#include "ImagePool.hpp"
 
 namespace graphics
 {
+    // Filters for building mip levels
+    enum class MipFilter
+    {
+        Box,                // Average of 2x2 texels
+        Kaiser,             // Kaiser windowed sinc over 6x6 texels, keeps details sharper than box
+        OctahedralNormal    // Average of the decoded RG16 octahedral normals, renormalized
+    };
+
     class Image
     {
     public:
         Image() = default;
-        Image(uint8_t bpp, uint16_t width, uint16_t height = 1, uint16_t depth = 1);
+        Image(uint8_t bpp, uint16_t width, uint16_t height = 1, uint16_t depth = 1,
+              ImageMemory memory = ImageMemory::Zeroed);
 
-        void setDimensions(uint8_t bpp, uint16_t width, uint16_t height = 1, uint16_t depth = 1);
+        // The data is allocated from the image pool, when the dimensions change
+        void setDimensions(uint8_t bpp, uint16_t width, uint16_t height = 1, uint16_t depth = 1,
+                           ImageMemory memory = ImageMemory::Zeroed);
         void fillData(Range<const uint8_t> data);
 
-        void copy(const Image& srcImage, Rect<int, 2> dstRect,
-                  std::function<void(void* dst, const void* src)> convertAndAssign);
+        // Converts the source rectangle into this image at the destination position, one row
+        // at a time. The source must be in the Src format and this image in the destination
+        // format of the conversion. The rectangle is clipped against both images, and the
+        // written rectangle is returned. Instantiated for the R8, BGR8 and BGRA8 sources.
+        template<PixelFormat Src, PixelConversion Conversion>
+        Rect<int, 2> copy(const Image& srcImage, Rect<int, 2> srcRect, int2 dstPos);
 
         const uint8_t* data() const;
         uint32_t dataSize() const;
 
         template<typename T>
-        Range<T> asRange() { return Range<T>(reinterpret_cast<T*>(m_data->data()), dataSize()); }
+        Range<T> asRange() { return Range<T>(reinterpret_cast<T*>(m_data.get()), dataSize()); }
 
         template<typename T>
-        Range<T> asRange() const { return Range<T>(reinterpret_cast<T*>(m_data->data()), dataSize()); }
+        Range<T> asRange() const { return Range<T>(reinterpret_cast<T*>(m_data.get()), dataSize()); }
 
         uint16_t width() const  { return m_width; }
         uint16_t height() const { return m_height; }
@@ -43,12 +59,22 @@ namespace graphics
         uint32_t depthStride() const;
 
         uint32_t byteOffset(int x, int y = 0, int z = 0) const;
+
+        // Writes the next mip level of the rectangle to dst, which must be the next mip level of
+        // this image. Texels outside the rectangle are never read, so neighbouring atlas entries do
+        // not bleed into each other. RGBA8 images are filtered with colorFilter in RGB and with
+        // alphaFilter in A. RG16 images must use OctahedralNormal. Returns the written rectangle.
+        Rect<int, 2> downsample(Rect<int, 2> rect, Image& dst, MipFilter colorFilter,
+                                MipFilter alphaFilter = MipFilter::Box) const;
+
+        // The rectangle covering the same area in the next mip level
+        static Rect<int, 2> mipRect(Rect<int, 2> rect);
     private:
-        std::shared_ptr<std::vector<uint8_t>> m_data;
+        std::shared_ptr<uint8_t> m_data;
 
-        uint16_t    m_width;
-        uint16_t    m_height;
-        uint16_t    m_depth;
-        uint8_t     m_bpp;
+        uint16_t    m_width     = 0;
+        uint16_t    m_height    = 0;
+        uint16_t    m_depth     = 0;
+        uint8_t     m_bpp       = 0;
     };
 }
@@ -0,0 +1,232 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    ImagePool.cpp
+*/
+
+#include "ImagePool.hpp"
+#include "../Log.hpp"
+
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <malloc.h>
+#else
+#include <cstdlib>
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+    // Blocks up to this are rounded to the alignment, larger ones to a quarter of their power of two
+    constexpr size_t SmallBlockBytes        = 4096;
+    constexpr size_t DefaultMaxPooledBytes  = 256 * 1024 * 1024;
+
+    uint8_t* alignedAlloc(size_t bytes)
+    {
+#ifdef _WIN32
+        return static_cast<uint8_t*>(_aligned_malloc(bytes, graphics::ImagePool::Alignment));
+#else
+        return static_cast<uint8_t*>(aligned_alloc(graphics::ImagePool::Alignment, bytes));
+#endif
+    }
+
+    void alignedFree(uint8_t* block)
+    {
+#ifdef _WIN32
+        _aligned_free(block);
+#else
+        free(block);
+#endif
+    }
+
+    // Size of a large page, or zero if the process cannot use them
+    size_t enableLargePages()
+    {
+#ifdef _WIN32
+        HANDLE token;
+        if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) return 0;
+
+        TOKEN_PRIVILEGES privileges;
+        privileges.PrivilegeCount           = 1;
+        privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+        // Note: AdjustTokenPrivileges() succeeds also when the privilege was not held
+        bool enabled = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid) &&
+                       AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) &&
+                       (GetLastError() == ERROR_SUCCESS);
+        CloseHandle(token);
+        return enabled ? GetLargePageMinimum() : 0;
+#else
+        return 2 * 1024 * 1024;
+#endif
+    }
+}
+
+namespace graphics
+{
+    ImagePool& ImagePool::instance()
+    {
+        // Never destroyed, so that images in static storage can still release their blocks
+        static ImagePool* pool = new ImagePool();
+        return *pool;
+    }
+
+    ImagePool::ImagePool() :
+        m_maxPooledBytes(DefaultMaxPooledBytes),
+        m_statistics(),
+        m_largePagesChecked(false),
+        m_largePageSize(0)
+    {
+    }
+
+    std::shared_ptr<uint8_t> ImagePool::allocate(size_t bytes, ImageMemory memory)
+    {
+        if (bytes == 0) return nullptr;
+
+        if (memory == ImageMemory::LargePages)
+        {
+            size_t blockSize;
+            uint8_t* block = allocateLargePages(bytes, blockSize);
+            if (block)
+            {
+                return std::shared_ptr<uint8_t>(block, [this, blockSize](uint8_t* b) { releaseLargePages(b, blockSize); });
+            }
+            memory = ImageMemory::Zeroed;
+        }
+
+        size_t blockSize = sizeClass(bytes);
+        uint8_t* block = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_statistics.allocations++;
+
+            auto freeBlocks = m_freeBlocks.find(blockSize);
+            if ((freeBlocks != m_freeBlocks.end()) && !freeBlocks->second.empty())
+            {
+                block = freeBlocks->second.back();
+                freeBlocks->second.pop_back();
+                m_statistics.pooledBytes -= blockSize;
+                m_statistics.reused++;
+            }
+        }
+
+        if (!block) block = alignedAlloc(blockSize);
+        if (!block)
+        {
+            logError("Image allocation failed\n");
+            return nullptr;
+        }
+
+        if (memory == ImageMemory::Zeroed) memset(block, 0, bytes);
+
+        return std::shared_ptr<uint8_t>(block, [this, blockSize](uint8_t* b) { release(b, blockSize); });
+    }
+
+    void ImagePool::setMaxPooledBytes(size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_maxPooledBytes = bytes;
+        for (auto& freeBlocks : m_freeBlocks)
+        {
+            while (!freeBlocks.second.empty() && (m_statistics.pooledBytes > m_maxPooledBytes))
+            {
+                alignedFree(freeBlocks.second.back());
+                freeBlocks.second.pop_back();
+                m_statistics.pooledBytes -= freeBlocks.first;
+            }
+        }
+    }
+
+    void ImagePool::trim()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& freeBlocks : m_freeBlocks)
+        {
+            for (auto block : freeBlocks.second) alignedFree(block);
+        }
+        m_freeBlocks.clear();
+        m_statistics.pooledBytes = 0;
+    }
+
+    ImagePoolStatistics ImagePool::statistics() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_statistics;
+    }
+
+    size_t ImagePool::sizeClass(size_t bytes)
+    {
+        size_t step = Alignment;
+        if (bytes > SmallBlockBytes)
+        {
+            // 2^p < bytes <= 2^(p+1), so that there are four classes per power of two
+            size_t power = SmallBlockBytes;
+            while (2 * power < bytes) power *= 2;
+            step = power / 4;
+        }
+        return (bytes + step - 1) / step * step;
+    }
+
+    uint8_t* ImagePool::allocateLargePages(size_t bytes, size_t& allocatedBytes)
+    {
+        size_t pageSize;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_largePagesChecked)
+            {
+                m_largePageSize     = enableLargePages();
+                m_largePagesChecked = true;
+                if (m_largePageSize == 0) logError("Large pages not available, using ordinary pages for images\n");
+            }
+            pageSize = m_largePageSize;
+        }
+        if (pageSize == 0) return nullptr;
+
+        allocatedBytes = (bytes + pageSize - 1) / pageSize * pageSize;
+#ifdef _WIN32
+        // The memory is zeroed by the OS
+        uint8_t* block = static_cast<uint8_t*>(VirtualAlloc(nullptr, allocatedBytes,
+            MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE));
+#else
+        uint8_t* block = static_cast<uint8_t*>(aligned_alloc(pageSize, allocatedBytes));
+        if (block)
+        {
+            madvise(block, allocatedBytes, MADV_HUGEPAGE);
+            memset(block, 0, allocatedBytes);
+        }
+#endif
+        // Physical memory may be too fragmented for large pages, even if they are enabled
+        if (!block) return nullptr;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_statistics.allocations++;
+        m_statistics.largePageBytes += allocatedBytes;
+        return block;
+    }
+
+    void ImagePool::release(uint8_t* block, size_t blockSize)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_statistics.pooledBytes + blockSize <= m_maxPooledBytes)
+            {
+                m_freeBlocks[blockSize].emplace_back(block);
+                m_statistics.pooledBytes += blockSize;
+                return;
+            }
+        }
+        alignedFree(block);
+    }
+
+    void ImagePool::releaseLargePages(uint8_t* block, size_t blockSize)
+    {
+#ifdef _WIN32
+        VirtualFree(block, 0, MEM_RELEASE);
+#else
+        free(block);
+#endif
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_statistics.largePageBytes -= blockSize;
+    }
+}
@@ -0,0 +1,74 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    ImagePool.hpp
+
+    Memory for the pixels of images. Released blocks are kept in free lists
+    by size class, so that loading a sequence of textures of similar sizes
+    reuses the same blocks instead of going to the heap each time. Blocks are
+    aligned to 64 bytes, which is a cache line and enough for any SIMD load.
+
+    Large, long lived images, like the patch data layers, can ask for large
+    pages. They need the lock pages privilege, and fall back to ordinary
+    pages without it. Large page blocks go straight back to the OS.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace graphics
+{
+    enum class ImageMemory
+    {
+        Zeroed,
+        Uninitialized,      // The caller writes every texel before reading any
+        LargePages          // Zeroed
+    };
+
+    struct ImagePoolStatistics
+    {
+        uint64_t    allocations;        // Since the start
+        uint64_t    reused;             // Allocations served from the free lists
+        uint64_t    pooledBytes;        // In the free lists now
+        uint64_t    largePageBytes;     // In use now
+    };
+
+    class ImagePool
+    {
+    public:
+        static constexpr size_t Alignment = 64;
+
+        static ImagePool& instance();
+
+        // The block goes back to the pool when the last reference is gone
+        std::shared_ptr<uint8_t> allocate(size_t bytes, ImageMemory memory = ImageMemory::Zeroed);
+
+        // Blocks released beyond this go back to the heap
+        void setMaxPooledBytes(size_t bytes);
+
+        // Returns all the pooled blocks to the heap
+        void trim();
+
+        ImagePoolStatistics statistics() const;
+
+        // The size of the block, which serves the given number of bytes
+        static size_t sizeClass(size_t bytes);
+    private:
+        ImagePool();
+
+        uint8_t* allocateLargePages(size_t bytes, size_t& allocatedBytes);
+        void release(uint8_t* block, size_t blockSize);
+        void releaseLargePages(uint8_t* block, size_t blockSize);
+
+        mutable std::mutex                                  m_mutex;
+        std::unordered_map<size_t, std::vector<uint8_t*>>   m_freeBlocks;
+        size_t                                              m_maxPooledBytes;
+        ImagePoolStatistics                                 m_statistics;
+        bool                                                m_largePagesChecked;
+        size_t                                              m_largePageSize;    // Zero, if not available
+    };
+}
@@ -0,0 +1,430 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    PixelConversion.cpp
+*/
+
+#include "PixelConversion.hpp"
+#include "../Simd.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+    // Byte offsets of the channels in the source pixel. Gray pixels have all channels in the same byte.
+    constexpr uint32_t redOffset(uint32_t srcBytesPerPixel)     { return (srcBytesPerPixel >= 3) ? 2 : 0; }
+    constexpr uint32_t greenOffset(uint32_t srcBytesPerPixel)   { return (srcBytesPerPixel >= 3) ? 1 : 0; }
+    constexpr uint32_t blueOffset(uint32_t)                     { return 0; }
+
+    // The encoding divides by the sum of the absolute values, so the normal does not need to be
+    // normalized first. A zero vector ends up in the center.
+    void encodeOctahedral16(float x, float y, float z, uint16_t* dst)
+    {
+        float invLength = 1.f / std::max<float>(std::abs(x) + std::abs(y) + std::abs(z), FLT_MIN);
+        x *= invLength;
+        y *= invLength;
+        if (z < 0.f)
+        {
+            float wrappedX = (1.f - std::abs(y)) * (x >= 0.f ? 1.f : -1.f);
+            float wrappedY = (1.f - std::abs(x)) * (y >= 0.f ? 1.f : -1.f);
+            x = wrappedX;
+            y = wrappedY;
+        }
+        dst[0] = static_cast<uint16_t>((x * 0.5f + 0.5f) * 65535.f + 0.5f);
+        dst[1] = static_cast<uint16_t>((y * 0.5f + 0.5f) * 65535.f + 0.5f);
+    }
+
+    // Each SIMD routine returns the number of pixels it converted. The rest are done with scalar code.
+
+#if defined(SP_SIMD_SSE)
+    // Shuffle masks that move the source channels to their RGBA positions. 0x80 writes zero.
+    template<uint32_t SrcBytes>
+    SP_TARGET_SSSE3 __m128i rgbMask()
+    {
+        return (SrcBytes == 1) ?
+            _mm_setr_epi8(0, 0, 0, -128, 1, 1, 1, -128, 2, 2, 2, -128, 3, 3, 3, -128) :
+               (SrcBytes == 3) ?
+            _mm_setr_epi8(2, 1, 0, -128, 5, 4, 3, -128, 8, 7, 6, -128, 11, 10, 9, -128) :
+            _mm_setr_epi8(2, 1, 0, -128, 6, 5, 4, -128, 10, 9, 8, -128, 14, 13, 12, -128);
+    }
+
+    template<uint32_t SrcBytes>
+    SP_TARGET_SSSE3 __m128i alphaMask()
+    {
+        return (SrcBytes == 1) ?
+            _mm_setr_epi8(-128, -128, -128, 0, -128, -128, -128, 1, -128, -128, -128, 2, -128, -128, -128, 3) :
+               (SrcBytes == 3) ?
+            _mm_setr_epi8(-128, -128, -128, 2, -128, -128, -128, 5, -128, -128, -128, 8, -128, -128, -128, 11) :
+            _mm_setr_epi8(-128, -128, -128, 2, -128, -128, -128, 6, -128, -128, -128, 10, -128, -128, -128, 14);
+    }
+
+    // Converts four pixels, keeping the destination bytes selected by keep
+    SP_TARGET_SSSE3 void convertFour(uint8_t* dst, __m128i srcPixels, __m128i shuffle, __m128i keep)
+    {
+        __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst));
+        __m128i s = _mm_shuffle_epi8(srcPixels, shuffle);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_or_si128(s, _mm_and_si128(d, keep)));
+    }
+
+    template<uint32_t SrcBytes>
+    SP_TARGET_SSSE3 uint32_t shuffleRowSSSE3(uint8_t* dst, const uint8_t* src, uint32_t pixels,
+                                             __m128i shuffle, __m128i keep)
+    {
+        uint32_t x = 0;
+        if (SrcBytes == 1)
+        {
+            for (; x + 16 <= pixels; x += 16)
+            {
+                __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+
+                uint8_t* d = dst + x * 4;
+                convertFour(d,      s,                      shuffle, keep);
+                convertFour(d + 16, _mm_srli_si128(s, 4),   shuffle, keep);
+                convertFour(d + 32, _mm_srli_si128(s, 8),   shuffle, keep);
+                convertFour(d + 48, _mm_srli_si128(s, 12),  shuffle, keep);
+            }
+        }
+        else if (SrcBytes == 3)
+        {
+            // 16 pixels are exactly three registers of source data
+            for (; x + 16 <= pixels; x += 16)
+            {
+                const __m128i* s = reinterpret_cast<const __m128i*>(src + x * 3);
+                __m128i s0 = _mm_loadu_si128(s);
+                __m128i s1 = _mm_loadu_si128(s + 1);
+                __m128i s2 = _mm_loadu_si128(s + 2);
+
+                uint8_t* d = dst + x * 4;
+                convertFour(d,      s0,                         shuffle, keep);
+                convertFour(d + 16, _mm_alignr_epi8(s1, s0, 12), shuffle, keep);
+                convertFour(d + 32, _mm_alignr_epi8(s2, s1, 8),  shuffle, keep);
+                convertFour(d + 48, _mm_srli_si128(s2, 4),       shuffle, keep);
+            }
+        }
+        else
+        {
+            for (; x + 4 <= pixels; x += 4)
+            {
+                __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+                convertFour(dst + x * 4, s, shuffle, keep);
+            }
+        }
+        return x;
+    }
+
+    template<uint32_t SrcBytes>
+    uint32_t convertRowToRGBSimd(uint8_t* dst, const uint8_t* src, uint32_t pixels)
+    {
+        if (!simd::hasSSSE3()) return 0;
+        return shuffleRowSSSE3<SrcBytes>(dst, src, pixels, rgbMask<SrcBytes>(),
+                                         _mm_set1_epi32(static_cast<int>(0xff000000)));
+    }
+
+    template<uint32_t SrcBytes>
+    uint32_t convertRowRedToAlphaSimd(uint8_t* dst, const uint8_t* src, uint32_t pixels)
+    {
+        if (!simd::hasSSSE3()) return 0;
+        return shuffleRowSSSE3<SrcBytes>(dst, src, pixels, alphaMask<SrcBytes>(), _mm_set1_epi32(0x00ffffff));
+    }
+
+    // Four pixels at a time with SSE2, one channel per register
+    template<uint32_t SrcBytes>
+    uint32_t convertRowToOctahedralSimd(uint16_t* dst, const uint8_t* src, uint32_t pixels)
+    {
+        const __m128i byteMask  = _mm_set1_epi32(0xff);
+        const __m128  bias      = _mm_set1_ps(128.f);
+        const __m128  half      = _mm_set1_ps(0.5f);
+        const __m128  one       = _mm_set1_ps(1.f);
+        const __m128  signMask  = _mm_set1_ps(-0.f);
+        const __m128  minLength = _mm_set1_ps(FLT_MIN);
+        const __m128  scale     = _mm_set1_ps(65535.f);
+        const __m128i offset    = _mm_set1_epi32(32768);
+        const __m128i flip      = _mm_set1_epi16(static_cast<short>(0x8000));
+
+        uint32_t x = 0;
+        for (; x + 4 <= pixels; x += 4)
+        {
+            // BGRX in each 32-bit lane
+            __m128i packed;
+            if (SrcBytes == 4)
+            {
+                packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+            }
+            else
+            {
+                const uint8_t* s = src + x * SrcBytes;
+                int lanes[4];
+                for (int i = 0; i < 4; i++, s += SrcBytes)
+                {
+                    lanes[i] = s[blueOffset(SrcBytes)] | (s[greenOffset(SrcBytes)] << 8) |
+                               (s[redOffset(SrcBytes)] << 16);
+                }
+                packed = _mm_setr_epi32(lanes[0], lanes[1], lanes[2], lanes[3]);
+            }
+            __m128 nx = _mm_sub_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(packed, 16), byteMask)), bias);
+            __m128 ny = _mm_sub_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(packed, 8), byteMask)), bias);
+            __m128 nz = _mm_sub_ps(_mm_cvtepi32_ps(_mm_and_si128(packed, byteMask)), bias);
+
+            __m128 absX = _mm_andnot_ps(signMask, nx);
+            __m128 absY = _mm_andnot_ps(signMask, ny);
+            __m128 absZ = _mm_andnot_ps(signMask, nz);
+            __m128 invLength = _mm_div_ps(one, _mm_max_ps(_mm_add_ps(_mm_add_ps(absX, absY), absZ), minLength));
+            nx      = _mm_mul_ps(nx, invLength);
+            ny      = _mm_mul_ps(ny, invLength);
+            absX    = _mm_mul_ps(absX, invLength);
+            absY    = _mm_mul_ps(absY, invLength);
+
+            // The lower hemisphere is folded over the diagonals
+            __m128 lower    = _mm_cmplt_ps(nz, _mm_setzero_ps());
+            __m128 wrappedX = _mm_or_ps(_mm_sub_ps(one, absY), _mm_and_ps(signMask, nx));
+            __m128 wrappedY = _mm_or_ps(_mm_sub_ps(one, absX), _mm_and_ps(signMask, ny));
+            nx = _mm_or_ps(_mm_and_ps(lower, wrappedX), _mm_andnot_ps(lower, nx));
+            ny = _mm_or_ps(_mm_and_ps(lower, wrappedY), _mm_andnot_ps(lower, ny));
+
+            __m128i ix = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(nx, half), half), scale), half));
+            __m128i iy = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(ny, half), half), scale), half));
+
+            // There is no unsigned saturating pack before SSE4.1, so pack with an offset
+            __m128i xy = _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(ix, offset), _mm_sub_epi32(iy, offset)), flip);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 2), _mm_unpacklo_epi16(xy, _mm_srli_si128(xy, 8)));
+        }
+        return x;
+    }
+#elif defined(SP_SIMD_NEON)
+    // The structured loads and stores do the (de)interleaving, 16 pixels at a time
+    template<uint32_t SrcBytes>
+    void loadBGR16(const uint8_t* src, uint8x16_t& b, uint8x16_t& g, uint8x16_t& r)
+    {
+        if (SrcBytes == 1)
+        {
+            b = g = r = vld1q_u8(src);
+        }
+        else if (SrcBytes == 3)
+        {
+            uint8x16x3_t s = vld3q_u8(src);
+            b = s.val[0]; g = s.val[1]; r = s.val[2];
+        }
+        else
+        {
+            uint8x16x4_t s = vld4q_u8(src);
+            b = s.val[0]; g = s.val[1]; r = s.val[2];
+        }
+    }
+
+    template<uint32_t SrcBytes>
+    uint32_t convertRowToRGBSimd(uint8_t* dst, const uint8_t* src, uint32_t pixels)
+    {
+        uint32_t x = 0;
+        for (; x + 16 <= pixels; x += 16)
+        {
+            uint8x16_t b, g, r;
+            loadBGR16<SrcBytes>(src + x * SrcBytes, b, g, r);
+            uint8x16x4_t d = vld4q_u8(dst + x * 4);
+            d.val[0] = r;
+            d.val[1] = g;
+            d.val[2] = b;
+            vst4q_u8(dst + x * 4, d);
+        }
+        return x;
+    }
+
+    template<uint32_t SrcBytes>
+    uint32_t convertRowRedToAlphaSimd(uint8_t* dst, const uint8_t* src, uint32_t pixels)
+    {
+        uint32_t x = 0;
+        for (; x + 16 <= pixels; x += 16)
+        {
+            uint8x16_t b, g, r;
+            loadBGR16<SrcBytes>(src + x * SrcBytes, b, g, r);
+            uint8x16x4_t d = vld4q_u8(dst + x * 4);
+            d.val[3] = r;
+            vst4q_u8(dst + x * 4, d);
+        }
+        return x;
+    }
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+    // Encodes four normals, returns the coordinates scaled to 16 bits
+    void encodeOctahedral4(uint32x4_t r, uint32x4_t g, uint32x4_t b, uint16x4_t& ox, uint16x4_t& oy)
+    {
+        float32x4_t bias = vdupq_n_f32(128.f);
+        float32x4_t one  = vdupq_n_f32(1.f);
+        float32x4_t nx   = vsubq_f32(vcvtq_f32_u32(r), bias);
+        float32x4_t ny   = vsubq_f32(vcvtq_f32_u32(g), bias);
+        float32x4_t nz   = vsubq_f32(vcvtq_f32_u32(b), bias);
+
+        float32x4_t length = vmaxq_f32(vaddq_f32(vaddq_f32(vabsq_f32(nx), vabsq_f32(ny)), vabsq_f32(nz)),
+                                       vdupq_n_f32(FLT_MIN));
+        nx = vdivq_f32(nx, length);
+        ny = vdivq_f32(ny, length);
+
+        // The lower hemisphere is folded over the diagonals
+        uint32x4_t lower    = vcltq_f32(nz, vdupq_n_f32(0.f));
+        uint32x4_t signMask = vdupq_n_u32(0x80000000);
+        float32x4_t wrappedX = vbslq_f32(signMask, nx, vsubq_f32(one, vabsq_f32(ny)));
+        float32x4_t wrappedY = vbslq_f32(signMask, ny, vsubq_f32(one, vabsq_f32(nx)));
+        nx = vbslq_f32(lower, wrappedX, nx);
+        ny = vbslq_f32(lower, wrappedY, ny);
+
+        float32x4_t half  = vdupq_n_f32(0.5f);
+        float32x4_t scale = vdupq_n_f32(65535.f);
+        ox = vmovn_u32(vcvtq_u32_f32(vmlaq_f32(half, vmlaq_f32(half, nx, half), scale)));
+        oy = vmovn_u32(vcvtq_u32_f32(vmlaq_f32(half, vmlaq_f32(half, ny, half), scale)));
+    }
+
+    template<uint32_t SrcBytes>
+    uint32_t convertRowToOctahedralSimd(uint16_t* dst, const uint8_t* src, uint32_t pixels)
+    {
+        uint32_t x = 0;
+        for (; x + 16 <= pixels; x += 16)
+        {
+            uint8x16_t b, g, r;
+            loadBGR16<SrcBytes>(src + x * SrcBytes, b, g, r);
+            uint16x8_t r16[2] = { vmovl_u8(vget_low_u8(r)), vmovl_u8(vget_high_u8(r)) };
+            uint16x8_t g16[2] = { vmovl_u8(vget_low_u8(g)), vmovl_u8(vget_high_u8(g)) };
+            uint16x8_t b16[2] = { vmovl_u8(vget_low_u8(b)), vmovl_u8(vget_high_u8(b)) };
+            for (int i = 0; i < 2; i++)
+            {
+                uint16x4_t lowX, lowY, highX, highY;
+                encodeOctahedral4(vmovl_u16(vget_low_u16(r16[i])), vmovl_u16(vget_low_u16(g16[i])),
+                                  vmovl_u16(vget_low_u16(b16[i])), lowX, lowY);
+                encodeOctahedral4(vmovl_u16(vget_high_u16(r16[i])), vmovl_u16(vget_high_u16(g16[i])),
+                                  vmovl_u16(vget_high_u16(b16[i])), highX, highY);
+                uint16x8x2_t xy = { { vcombine_u16(lowX, highX), vcombine_u16(lowY, highY) } };
+                vst2q_u16(dst + (x + 8 * i) * 2, xy);
+            }
+        }
+        return x;
+    }
+#else
+    template<uint32_t SrcBytes>
+    uint32_t convertRowToOctahedralSimd(uint16_t*, const uint8_t*, uint32_t) { return 0; }
+#endif
+#else
+    template<uint32_t SrcBytes>
+    uint32_t convertRowToRGBSimd(uint8_t*, const uint8_t*, uint32_t)             { return 0; }
+    template<uint32_t SrcBytes>
+    uint32_t convertRowRedToAlphaSimd(uint8_t*, const uint8_t*, uint32_t)        { return 0; }
+    template<uint32_t SrcBytes>
+    uint32_t convertRowToOctahedralSimd(uint16_t*, const uint8_t*, uint32_t)     { return 0; }
+#endif
+
+    template<uint32_t SrcBytes>
+    void rowToRGB(uint8_t* dst, const uint8_t* src, uint32_t pixels)
+    {
+        for (uint32_t x = convertRowToRGBSimd<SrcBytes>(dst, src, pixels); x < pixels; x++)
+        {
+            const uint8_t* s = src + x * SrcBytes;
+            uint8_t* d = dst + x * 4;
+            d[0] = s[redOffset(SrcBytes)];
+            d[1] = s[greenOffset(SrcBytes)];
+            d[2] = s[blueOffset(SrcBytes)];
+        }
+    }
+
+    template<uint32_t SrcBytes>
+    void rowRedToAlpha(uint8_t* dst, const uint8_t* src, uint32_t pixels)
+    {
+        for (uint32_t x = convertRowRedToAlphaSimd<SrcBytes>(dst, src, pixels); x < pixels; x++)
+        {
+            dst[x * 4 + 3] = src[x * SrcBytes + redOffset(SrcBytes)];
+        }
+    }
+
+    template<uint32_t SrcBytes>
+    void rowToOctahedral(uint16_t* dst, const uint8_t* src, uint32_t pixels)
+    {
+        for (uint32_t x = convertRowToOctahedralSimd<SrcBytes>(dst, src, pixels); x < pixels; x++)
+        {
+            const uint8_t* s = src + x * SrcBytes;
+            encodeOctahedral16(static_cast<float>(s[redOffset(SrcBytes)]) - 128.f,
+                               static_cast<float>(s[greenOffset(SrcBytes)]) - 128.f,
+                               static_cast<float>(s[blueOffset(SrcBytes)]) - 128.f, dst + x * 2);
+        }
+    }
+}
+
+namespace graphics
+{
+    template<PixelFormat Src, PixelConversion Conversion>
+    void convertRow(uint8_t* dst, const uint8_t* src, uint32_t pixels)
+    {
+        constexpr uint32_t SrcBytes = pixelBytes(Src);
+        switch (Conversion)
+        {
+        case PixelConversion::RGB:
+            rowToRGB<SrcBytes>(dst, src, pixels);
+            break;
+        case PixelConversion::RedToAlpha:
+            rowRedToAlpha<SrcBytes>(dst, src, pixels);
+            break;
+        case PixelConversion::Octahedral:
+            rowToOctahedral<SrcBytes>(reinterpret_cast<uint16_t*>(dst), src, pixels);
+            break;
+        default:
+            break;
+        }
+    }
+
+    template void convertRow<PixelFormat::R8,    PixelConversion::RGB>(uint8_t*, const uint8_t*, uint32_t);
+    template void convertRow<PixelFormat::BGR8,  PixelConversion::RGB>(uint8_t*, const uint8_t*, uint32_t);
+    template void convertRow<PixelFormat::BGRA8, PixelConversion::RGB>(uint8_t*, const uint8_t*, uint32_t);
+    template void convertRow<PixelFormat::R8,    PixelConversion::RedToAlpha>(uint8_t*, const uint8_t*, uint32_t);
+    template void convertRow<PixelFormat::BGR8,  PixelConversion::RedToAlpha>(uint8_t*, const uint8_t*, uint32_t);
+    template void convertRow<PixelFormat::BGRA8, PixelConversion::RedToAlpha>(uint8_t*, const uint8_t*, uint32_t);
+    template void convertRow<PixelFormat::R8,    PixelConversion::Octahedral>(uint8_t*, const uint8_t*, uint32_t);
+    template void convertRow<PixelFormat::BGR8,  PixelConversion::Octahedral>(uint8_t*, const uint8_t*, uint32_t);
+    template void convertRow<PixelFormat::BGRA8, PixelConversion::Octahedral>(uint8_t*, const uint8_t*, uint32_t);
+
+    template<PixelConversion Conversion>
+    void convertRow(uint8_t* dst, const uint8_t* src, uint32_t pixels, uint32_t srcBytesPerPixel)
+    {
+        switch (sourcePixelFormat(srcBytesPerPixel))
+        {
+        case PixelFormat::R8:
+            convertRow<PixelFormat::R8, Conversion>(dst, src, pixels);
+            break;
+        case PixelFormat::BGR8:
+            convertRow<PixelFormat::BGR8, Conversion>(dst, src, pixels);
+            break;
+        default:
+            convertRow<PixelFormat::BGRA8, Conversion>(dst, src, pixels);
+            break;
+        }
+    }
+
+    void convertRow(PixelConversion conversion, uint8_t* dst, const uint8_t* src, uint32_t pixels,
+                    uint32_t srcBytesPerPixel)
+    {
+        switch (conversion)
+        {
+        case PixelConversion::RGB:
+            convertRow<PixelConversion::RGB>(dst, src, pixels, srcBytesPerPixel);
+            break;
+        case PixelConversion::RedToAlpha:
+            convertRow<PixelConversion::RedToAlpha>(dst, src, pixels, srcBytesPerPixel);
+            break;
+        case PixelConversion::Octahedral:
+            convertRow<PixelConversion::Octahedral>(dst, src, pixels, srcBytesPerPixel);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void convertRowToRGB(uint8_t* dst, const uint8_t* src, uint32_t pixels, uint32_t srcBytesPerPixel)
+    {
+        convertRow<PixelConversion::RGB>(dst, src, pixels, srcBytesPerPixel);
+    }
+
+    void convertRowRedToAlpha(uint8_t* dst, const uint8_t* src, uint32_t pixels, uint32_t srcBytesPerPixel)
+    {
+        convertRow<PixelConversion::RedToAlpha>(dst, src, pixels, srcBytesPerPixel);
+    }
+
+    void convertRowToOctahedral(uint16_t* dst, const uint8_t* src, uint32_t pixels, uint32_t srcBytesPerPixel)
+    {
+        convertRow<PixelConversion::Octahedral>(reinterpret_cast<uint8_t*>(dst), src, pixels, srcBytesPerPixel);
+    }
+}
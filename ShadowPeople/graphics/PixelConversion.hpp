@@ -0,0 +1,71 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    PixelConversion.hpp
+
+    Row conversion kernels from the BGR(A) byte order of image files to the
+    formats of the material cache. Sources may have 1 (gray), 3 (BGR) or
+    4 (BGRA) bytes per pixel. The destination is never read past the row and
+    the source is never read past the given number of pixels.
+
+    The kernels are templates on the source format and the conversion, so
+    that each combination is compiled to its own loop without per pixel
+    branches. The functions taking the bytes per pixel pick the kernel at run
+    time, once per row.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+namespace graphics
+{
+    enum class PixelFormat
+    {
+        R8,         // Gray, all the channels in the same byte
+        BGR8,
+        BGRA8,
+        RGBA8,
+        RG16
+    };
+
+    enum class PixelConversion
+    {
+        RGB,            // To RGBA8, writes RGB and keeps the existing alpha
+        RedToAlpha,     // To RGBA8, writes the red channel of the source into the alpha and keeps the existing RGB
+        Octahedral      // To RG16, decodes a tangent space normal map and writes it as octahedral coordinates
+    };
+
+    constexpr uint32_t pixelBytes(PixelFormat format)
+    {
+        return (format == PixelFormat::R8) ? 1 :
+               (format == PixelFormat::BGR8) ? 3 : 4;
+    }
+
+    constexpr PixelFormat conversionDestination(PixelConversion conversion)
+    {
+        return (conversion == PixelConversion::Octahedral) ? PixelFormat::RG16 : PixelFormat::RGBA8;
+    }
+
+    // The source format of 1, 3 or 4 bytes per pixel
+    inline PixelFormat sourcePixelFormat(uint32_t srcBytesPerPixel)
+    {
+        return (srcBytesPerPixel == 1) ? PixelFormat::R8 :
+               (srcBytesPerPixel == 3) ? PixelFormat::BGR8 : PixelFormat::BGRA8;
+    }
+
+    // Instantiated for the R8, BGR8 and BGRA8 sources
+    template<PixelFormat Src, PixelConversion Conversion>
+    void convertRow(uint8_t* dst, const uint8_t* src, uint32_t pixels);
+
+    void convertRow(PixelConversion conversion, uint8_t* dst, const uint8_t* src, uint32_t pixels,
+                    uint32_t srcBytesPerPixel);
+
+    // Writes RGB of 8-bit RGBA pixels, keeps the existing alpha
+    void convertRowToRGB(uint8_t* dst, const uint8_t* src, uint32_t pixels, uint32_t srcBytesPerPixel);
+
+    // Writes the red channel of the source into the alpha of 8-bit RGBA pixels, keeps the existing RGB
+    void convertRowRedToAlpha(uint8_t* dst, const uint8_t* src, uint32_t pixels, uint32_t srcBytesPerPixel);
+
+    // Decodes a tangent space normal map and writes it as 16-bit octahedral RG pixels
+    void convertRowToOctahedral(uint16_t* dst, const uint8_t* src, uint32_t pixels, uint32_t srcBytesPerPixel);
+}
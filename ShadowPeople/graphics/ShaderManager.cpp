@@ -7,9 +7,9 @@
 
 namespace graphics
 {
-	ShaderManager::ShaderManager(Device& device)
+	ShaderManager::ShaderManager(Device& device, asset::AssetCache* assetCache)
 	{
-		pImpl = std::make_shared<ShaderManagerImpl>(*device.pImpl);
+		pImpl = std::make_shared<ShaderManagerImpl>(*device.pImpl, assetCache);
 	}
 
 	bool ShaderManager::compile(Shader& shader)
@@ -9,6 +9,11 @@
 
 #include "Descriptors.hpp"
 
+namespace asset
+{
+	class AssetCache;
+}
+
 namespace graphics
 {
 	class Device;
@@ -18,7 +23,7 @@ namespace graphics
 	class ShaderManager
 	{
 	public:
-		ShaderManager(Device& device);
+		ShaderManager(Device& device, asset::AssetCache* assetCache = nullptr);
 
 		bool compile(Shader& shader);
 		void hotReload();
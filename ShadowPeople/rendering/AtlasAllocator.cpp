@@ -0,0 +1,211 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    AtlasAllocator.cpp
+*/
+
+#include "AtlasAllocator.hpp"
+#include "../Math.hpp"
+
+#include <algorithm>
+
+namespace
+{
+    uint64_t area(const Rect<int, 2>& rect)
+    {
+        return static_cast<uint64_t>(rect.size()[0]) * static_cast<uint64_t>(rect.size()[1]);
+    }
+
+    bool fits(const Rect<int, 2>& rect, int2 size)
+    {
+        return (rect.size()[0] >= size[0]) && (rect.size()[1] >= size[1]);
+    }
+
+    // Row by row from the origin
+    bool closer(int2 a, int2 b)
+    {
+        return (a[1] < b[1]) || ((a[1] == b[1]) && (a[0] < b[0]));
+    }
+}
+
+namespace rendering
+{
+    AtlasAllocator::AtlasAllocator(int2 size, int alignment) :
+        m_size(size),
+        m_alignment(std::max<int>(alignment, 1))
+    {
+        m_free.emplace_back(Rect<int, 2>(size));
+    }
+
+    Rect<int, 2> AtlasAllocator::allocate(int2 size)
+    {
+        if ((size[0] <= 0) || (size[1] <= 0)) return Rect<int, 2>();
+
+        int2 alignedSize{ math::divRoundUp(size[0], m_alignment) * m_alignment,
+                          math::divRoundUp(size[1], m_alignment) * m_alignment };
+        int freeIndex = bestFit(alignedSize);
+        if (freeIndex < 0) return Rect<int, 2>();
+
+        Rect<int, 2> rect(m_free[freeIndex].minCorner(), alignedSize);
+        allocateFrom(freeIndex, rect);
+        return rect;
+    }
+
+    void AtlasAllocator::free(Rect<int, 2> rect)
+    {
+        auto allocated = std::find(m_allocated.begin(), m_allocated.end(), rect);
+        if (allocated == m_allocated.end()) return;
+
+        *allocated = m_allocated.back();
+        m_allocated.pop_back();
+        mergeFree(rect);
+    }
+
+    bool AtlasAllocator::relocate(AtlasRelocation& relocation)
+    {
+        std::vector<Rect<int, 2>> furthestFirst(m_allocated);
+        std::sort(furthestFirst.begin(), furthestFirst.end(), [](const Rect<int, 2>& a, const Rect<int, 2>& b)
+        {
+            return closer(b.minCorner(), a.minCorner());
+        });
+
+        for (const auto& from : furthestFirst)
+        {
+            // The free rectangle closest to the origin, which is still closer than the allocation
+            int target = -1;
+            for (int i = 0; i < static_cast<int>(m_free.size()); i++)
+            {
+                const Rect<int, 2>& candidate = m_free[i];
+                if (!fits(candidate, from.size()) || !closer(candidate.minCorner(), from.minCorner())) continue;
+                if ((target < 0) || closer(candidate.minCorner(), m_free[target].minCorner())) target = i;
+            }
+            if (target < 0) continue;
+
+            Rect<int, 2> to(m_free[target].minCorner(), from.size());
+            allocateFrom(target, to);
+            free(from);
+
+            relocation = AtlasRelocation{ from, to };
+            return true;
+        }
+        return false;
+    }
+
+    Rect<int, 2> AtlasAllocator::allocation(int2 texel) const
+    {
+        for (const auto& rect : m_allocated)
+        {
+            int2 maxCorner = rect.minCorner() + rect.size();
+            if ((texel[0] >= rect.minCorner()[0]) && (texel[1] >= rect.minCorner()[1]) &&
+                (texel[0] < maxCorner[0]) && (texel[1] < maxCorner[1])) return rect;
+        }
+        return Rect<int, 2>();
+    }
+
+    AtlasStatistics AtlasAllocator::statistics() const
+    {
+        AtlasStatistics statistics = {};
+        statistics.allocations  = static_cast<uint32_t>(m_allocated.size());
+        statistics.freeRects    = static_cast<uint32_t>(m_free.size());
+        for (const auto& rect : m_allocated) statistics.allocatedArea += area(rect);
+        for (const auto& rect : m_free)
+        {
+            statistics.freeArea         += area(rect);
+            statistics.largestFreeArea  = std::max<uint64_t>(statistics.largestFreeArea, area(rect));
+        }
+        statistics.fragmentation = (statistics.freeArea > 0) ?
+            1.f - static_cast<float>(statistics.largestFreeArea) / static_cast<float>(statistics.freeArea) : 0.f;
+        return statistics;
+    }
+
+    int AtlasAllocator::bestFit(int2 size) const
+    {
+        // Least area left over, and then the shortest side left over
+        int best = -1;
+        uint64_t bestArea = 0;
+        int bestSide = 0;
+        for (int i = 0; i < static_cast<int>(m_free.size()); i++)
+        {
+            const Rect<int, 2>& rect = m_free[i];
+            if (!fits(rect, size)) continue;
+
+            uint64_t leftoverArea   = area(rect) - static_cast<uint64_t>(size[0]) * static_cast<uint64_t>(size[1]);
+            int leftoverSide        = std::min<int>(rect.size()[0] - size[0], rect.size()[1] - size[1]);
+            if ((best < 0) || (leftoverArea < bestArea) || ((leftoverArea == bestArea) && (leftoverSide < bestSide)))
+            {
+                best        = i;
+                bestArea    = leftoverArea;
+                bestSide    = leftoverSide;
+            }
+        }
+        return best;
+    }
+
+    void AtlasAllocator::allocateFrom(int freeIndex, Rect<int, 2> rect)
+    {
+        // The rectangle is at the corner of the free one, and the rest of it is split in two
+        Rect<int, 2> freeRect = m_free[freeIndex];
+        m_free[freeIndex] = m_free.back();
+        m_free.pop_back();
+
+        int2 corner     = freeRect.minCorner();
+        int2 size       = rect.size();
+        int2 leftover   = freeRect.size() - size;
+        Rect<int, 2> right, below;
+        if (leftover[0] < leftover[1])
+        {
+            right = Rect<int, 2>(int2{ corner[0] + size[0], corner[1] }, int2{ leftover[0], size[1] });
+            below = Rect<int, 2>(int2{ corner[0], corner[1] + size[1] }, int2{ freeRect.size()[0], leftover[1] });
+        }
+        else
+        {
+            right = Rect<int, 2>(int2{ corner[0] + size[0], corner[1] }, int2{ leftover[0], freeRect.size()[1] });
+            below = Rect<int, 2>(int2{ corner[0], corner[1] + size[1] }, int2{ size[0], leftover[1] });
+        }
+        if (area(right) > 0) m_free.emplace_back(right);
+        if (area(below) > 0) m_free.emplace_back(below);
+
+        m_allocated.emplace_back(rect);
+    }
+
+    void AtlasAllocator::mergeFree(Rect<int, 2> rect)
+    {
+        m_free.emplace_back(rect);
+        if (m_allocated.empty())
+        {
+            m_free.assign(1, Rect<int, 2>(m_size));
+            return;
+        }
+
+        // A merge can let two older free rectangles merge too
+        bool merged = true;
+        while (merged)
+        {
+            merged = false;
+            for (size_t i = 0; (i < m_free.size()) && !merged; i++)
+            {
+                for (size_t j = i + 1; (j < m_free.size()) && !merged; j++)
+                {
+                    int2 aMin = m_free[i].minCorner();
+                    int2 aMax = m_free[i].minCorner() + m_free[i].size();
+                    int2 bMin = m_free[j].minCorner();
+                    int2 bMax = m_free[j].minCorner() + m_free[j].size();
+
+                    bool sameRows       = (aMin[1] == bMin[1]) && (aMax[1] == bMax[1]);
+                    bool sameColumns    = (aMin[0] == bMin[0]) && (aMax[0] == bMax[0]);
+                    bool besideX        = (aMax[0] == bMin[0]) || (bMax[0] == aMin[0]);
+                    bool besideY        = (aMax[1] == bMin[1]) || (bMax[1] == aMin[1]);
+                    if ((sameRows && besideX) || (sameColumns && besideY))
+                    {
+                        int2 mergedMin{ std::min<int>(aMin[0], bMin[0]), std::min<int>(aMin[1], bMin[1]) };
+                        int2 mergedMax{ std::max<int>(aMax[0], bMax[0]), std::max<int>(aMax[1], bMax[1]) };
+                        m_free[i] = Rect<int, 2>(mergedMin, mergedMax - mergedMin);
+
+                        m_free[j] = m_free.back();
+                        m_free.pop_back();
+                        merged = true;
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,74 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    AtlasAllocator.hpp
+
+    Rectangle allocator for texture atlases. Free space is kept as a list of
+    non-overlapping rectangles. An allocation takes the free rectangle that
+    it fits best, and the rest of it is split in two along the shorter
+    leftover axis (guillotine packing). Freed rectangles are merged with the
+    free neighbours that share a whole edge with them.
+
+    Allocating and freeing in a different order leaves the free space in
+    small pieces. The atlas is compacted incrementally by moving one
+    allocation at a time closer to the origin, into space that is free while
+    the allocation still exists, so the source and the destination of a move
+    never overlap.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "../Types.hpp"
+
+namespace rendering
+{
+    struct AtlasRelocation
+    {
+        Rect<int, 2>    from;
+        Rect<int, 2>    to;
+    };
+
+    struct AtlasStatistics
+    {
+        uint32_t    allocations;
+        uint32_t    freeRects;
+        uint64_t    allocatedArea;
+        uint64_t    freeArea;
+        uint64_t    largestFreeArea;
+        float       fragmentation;  // 0 when the free space is in one piece, towards 1 when in many small ones
+    };
+
+    class AtlasAllocator
+    {
+    public:
+        // Sizes are rounded up to the alignment, so all the rectangles start at aligned positions
+        AtlasAllocator(int2 size, int alignment);
+
+        // Returns an empty rectangle, if there is no room
+        Rect<int, 2> allocate(int2 size);
+
+        // The rectangle must be one returned by allocate() or relocate()
+        void free(Rect<int, 2> rect);
+
+        // Moves the allocation furthest from the origin, which can be moved closer. Returns false,
+        // if there is none. The caller moves the contents and patches the references.
+        bool relocate(AtlasRelocation& relocation);
+
+        // The allocation containing the texel, or an empty rectangle
+        Rect<int, 2> allocation(int2 texel) const;
+
+        AtlasStatistics statistics() const;
+    private:
+        // Index of the free rectangle for the size, or -1
+        int bestFit(int2 size) const;
+        void allocateFrom(int freeIndex, Rect<int, 2> rect);
+        void mergeFree(Rect<int, 2> rect);
+
+        int2                        m_size;
+        int                         m_alignment;
+        std::vector<Rect<int, 2>>   m_free;
+        std::vector<Rect<int, 2>>   m_allocated;
+    };
+}
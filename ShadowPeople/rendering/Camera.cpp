@@ -6,6 +6,9 @@ namespace rendering
 {
 	static const float Epsilon = 1e-6f;
 
+    // The camera is rebuilt several times per frame, and its error stays well below a pixel
+    static constexpr math::Accuracy CameraAccuracy = math::Accuracy::High;
+
 	Camera::Camera(float fov, float aspectRatio, float4 position, float yaw, float pitch,
 				   float nearZ, float farZ) :
 		m_position(position),
@@ -31,7 +34,7 @@ namespace rendering
 
 	Matrix4x4 Camera::viewMatrix() const
 	{
-		Matrix4x4 rot = math::rotationMatrix(m_yaw, m_pitch);
+		Matrix4x4 rot = math::rotationMatrix<CameraAccuracy>(m_yaw, m_pitch);
 
         Matrix4x4 mov;
 		mov(0, 3) = -m_position[0];
@@ -72,7 +75,7 @@ namespace rendering
 
     Matrix4x4 Camera::invViewMatrix() const
     {
-        Matrix4x4 invRot = math::rotationMatrix(m_yaw, m_pitch).transpose();
+        Matrix4x4 invRot = math::rotationMatrix<CameraAccuracy>(m_yaw, m_pitch).transpose();
 
         Matrix4x4 invMov;
 		invMov(0, 3) = m_position[0];
@@ -101,12 +104,35 @@ namespace rendering
         }
         else
         {
-            // TODO
+			int2 s = m_orthoDimensions.size();
+			mat(0, 0) = 0.5f * s[0];
+			mat(1, 1) = 0.5f * s[1];
+			mat(2, 2) = m_far - m_near;
+			mat(2, 3) = m_near;
         }
 
         return mat;
     }
 
+    // Gribb & Hartmann, "Fast Extraction of Viewing Frustum Planes from the World-View-Projection
+    // Matrix". The clip space depth range is [0, w], as in Direct3D.
+    std::array<float4, 6> Camera::frustumPlanes() const
+    {
+        Matrix4x4 viewProj = projectionMatrix() * viewMatrix();
+        float4 x = viewProj.row(0);
+        float4 y = viewProj.row(1);
+        float4 z = viewProj.row(2);
+        float4 w = viewProj.row(3);
+
+        std::array<float4, 6> planes = { w + x, w - x, w + y, w - y, z, w - z };
+        for (auto& plane : planes)
+        {
+            float lengthSq = plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2];
+            if (lengthSq > Epsilon * Epsilon) plane = plane * math::rsqrt<CameraAccuracy>(lengthSq);
+        }
+        return planes;
+    }
+
 	float4 Camera::position() const
 	{
 		return m_position;
@@ -129,24 +155,27 @@ namespace rendering
 		m_pitch		= pitch;
 	}
 
+    // The rows of the rotation matrix, which are unit length as they are
 	float4 Camera::front() const
 	{
-		Matrix4x4 mat = math::rotationMatrix(m_yaw, m_pitch); 
-		float4 front = { mat(2, 0), mat(2, 1), mat(2, 2), 0.f };
-		return normalize(front);
+        float sy, cy, sp, cp;
+        math::sincos<CameraAccuracy>(m_yaw, sy, cy);
+        math::sincos<CameraAccuracy>(m_pitch, sp, cp);
+		return { cp * sy, sp, cp * cy, 0.f };
 	}
 
 	float4 Camera::up() const
 	{
-		Matrix4x4 mat = math::rotationMatrix(m_yaw, m_pitch); 
-		float4 up = { mat(1, 0), mat(1, 1), mat(1, 2), 0.f };
-		return normalize(up);
+        float sy, cy, sp, cp;
+        math::sincos<CameraAccuracy>(m_yaw, sy, cy);
+        math::sincos<CameraAccuracy>(m_pitch, sp, cp);
+		return { -sp * sy, cp, -sp * cy, 0.f };
 	}
 
 	float4 Camera::right() const
 	{
-		Matrix4x4 mat = math::rotationMatrix(m_yaw, m_pitch); 
-		float4 right = { mat(0, 0), mat(0, 1), mat(0, 2), 0.f };
-		return normalize(right);
+        float sy, cy;
+        math::sincos<CameraAccuracy>(m_yaw, sy, cy);
+		return { cy, 0.f, -sy, 0.f };
 	}
 }
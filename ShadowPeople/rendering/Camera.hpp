@@ -8,6 +8,8 @@
 #include "../Types.hpp"
 #include "../Math.hpp"
 
+#include <array>
+
 namespace rendering
 {
     constexpr float DefaultNear         = 1.f / 128.f;
@@ -47,6 +49,10 @@ namespace rendering
         Matrix4x4 invViewMatrix() const;
         Matrix4x4 invProjMatrix() const;
 
+        // World space planes (nx, ny, nz, d) with unit normals pointing inside, so that a point p
+        // is inside, if dot(n, p) + d >= 0 for all the planes. Left, right, bottom, top, near, far.
+        std::array<float4, 6> frustumPlanes() const;
+
         float4 position() const;
         float yaw() const;
         float pitch() const;
@@ -59,6 +65,7 @@ namespace rendering
 
         float nearZ() const { return m_near; }
         float farZ() const { return m_far; }
+        Projection projection() const { return m_projection; }
     private:
         float4          m_position;
         float           m_yaw;
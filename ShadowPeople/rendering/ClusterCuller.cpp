@@ -0,0 +1,201 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    ClusterCuller.cpp
+*/
+
+#include "ClusterCuller.hpp"
+#include "Camera.hpp"
+#include "Scene.hpp"
+#include "GeometryCache.hpp"
+
+#include "../Culling.hpp"
+#include "../Parallel.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    constexpr uint32_t ObjectsPerBatch  = 64;
+    constexpr float    MaxLodErrorPixels = 1.f;
+
+    // Same as qRot() in Quaternion.h.hlsl, so that the culling agrees with the vertex shader
+    float3 rotate(const float4& q, const float3& v)
+    {
+        float3 u{ q[0], q[1], q[2] };
+        float3 t = 2.f * cross(u, v);
+        return v + q[3] * t + cross(u, t);
+    }
+}
+
+namespace rendering
+{
+    void ClusterCuller::cull(const Camera& camera, const Scene& scene, const GeometryCache& geometry, int screenHeight)
+    {
+        std::array<float4, 6> planes    = camera.frustumPlanes();
+        bool perspective                = (camera.projection() == Camera::Projection::Perspective);
+        float4 position                 = camera.position();
+        float4 front                    = camera.front();
+        float3 eye{ position[0], position[1], position[2] };
+        float3 viewDir{ front[0], front[1], front[2] };
+        float nearZ                     = camera.nearZ();
+
+        // Pixels per unit at unit depth for perspective, and at any depth for orthographic
+        float pixelsPerUnit             = 0.5f * screenHeight * camera.projectionMatrix()(1, 1);
+
+        const std::vector<Object>& objects = scene.objects();
+
+        m_centers.resize(objects.size());
+        m_radii.resize(objects.size());
+        m_visible.resize(objects.size());
+
+        m_batches.clear();
+        parallelFor(static_cast<uint32_t>(objects.size()), ObjectsPerBatch, [&](uint32_t begin, uint32_t end)
+        {
+            Batch batch;
+            batch.firstObject   = begin;
+            batch.statistics    = {};
+
+            // The bounding spheres of the meshes in world space, culled four at a time
+            Float3StreamRange centers = Float3StreamRange(m_centers).subRange(begin, end - begin);
+            for (uint32_t o = begin; o < end; o++)
+            {
+                const Object& object        = objects[o];
+                const Transform& transform  = object.transform;
+                float4 sphere               = (object.meshStartSize[1] != 0) ? geometry.boundingSphere(object.meshStartSize) : float4(0.f);
+                centers.set(o - begin, transform.position +
+                            transform.scale * rotate(transform.rotation.toFloat4(), float3{ sphere[0], sphere[1], sphere[2] }));
+                m_radii[o]                  = std::fabs(transform.scale) * sphere[3];
+            }
+            Range<uint32_t> visible(&m_visible[begin], (end - begin) * sizeof(uint32_t));
+            size_t numVisible = math::cullSpheres(planes, centers,
+                                                  Range<const float>(&m_radii[begin], (end - begin) * sizeof(float)),
+                                                  visible);
+
+            // The visible indices are in increasing order, so the objects meet them one by one
+            size_t next = 0;
+            for (uint32_t o = begin; o < end; o++)
+            {
+                bool inside = (next < numVisible) && (begin + visible[next] == o);
+                if (inside) next++;
+
+                const Object& object = objects[o];
+                if (object.meshStartSize[1] == 0) continue;
+
+                const Transform& transform  = object.transform;
+                float4 rotation             = transform.rotation.toFloat4();
+                float scale                 = std::fabs(transform.scale);
+
+                Range<const Meshlet> meshlets = geometry.meshlets(object.meshStartSize);
+
+                if (!inside)
+                {
+                    batch.statistics.meshlets       += static_cast<uint32_t>(meshlets.size());
+                    batch.statistics.frustumCulled  += static_cast<uint32_t>(meshlets.size());
+                    continue;
+                }
+
+                float3 meshCenter   = centers[o - begin];
+                float meshRadius    = m_radii[o];
+
+                // Coarsest level of detail that is still accurate enough from the nearest point
+                Range<const MeshLod> lods = geometry.lods(object.meshStartSize);
+                float depth = perspective ? std::max<float>((meshCenter - eye).length() - meshRadius, nearZ) : 1.f;
+                float maxError = MaxLodErrorPixels * depth / (scale * pixelsPerUnit);
+                size_t lod = lods.size();
+                while ((lod > 1) && (lods[lod - 1].error > maxError)) lod--;
+                if (lod > 1)
+                {
+                    const MeshLod& selected = lods[lod - 1];
+                    batch.statistics.simplifiedObjects++;
+                    batch.draws.emplace_back(ObjectDraw{ o, static_cast<uint32_t>(batch.ranges.size()), 1 });
+                    batch.ranges.emplace_back(graphics::IndexRange{ selected.firstIndex, selected.numIndices });
+                    continue;
+                }
+
+                // Mirroring flips the triangles, so the cones would be the wrong way around
+                bool coneTest = (transform.scale > 0.f);
+                uint32_t firstRange = static_cast<uint32_t>(batch.ranges.size());
+
+                for (const auto& meshlet : meshlets)
+                {
+                    batch.statistics.meshlets++;
+
+                    float3 center   = transform.position + transform.scale * rotate(rotation, meshlet.center);
+                    float radius    = scale * meshlet.radius;
+
+                    if (math::outsideFrustum(planes, Sphere(center, radius)))
+                    {
+                        batch.statistics.frustumCulled++;
+                        continue;
+                    }
+
+                    if (coneTest && (meshlet.coneCutoff < 1.f))
+                    {
+                        // An orthographic camera looks at everything from the same direction
+                        float3 axis = rotate(rotation, meshlet.coneAxis);
+                        bool backfacing = false;
+                        if (perspective)
+                        {
+                            float3 toCenter = center - eye;
+                            backfacing = (toCenter.dot(axis) >= meshlet.coneCutoff * toCenter.length() + radius);
+                        }
+                        else
+                        {
+                            backfacing = (viewDir.dot(axis) >= meshlet.coneCutoff);
+                        }
+
+                        if (backfacing)
+                        {
+                            batch.statistics.backfaceCulled++;
+                            continue;
+                        }
+                    }
+
+                    // Merge with the previous range, if the meshlets are adjacent
+                    if (batch.ranges.size() > firstRange)
+                    {
+                        graphics::IndexRange& last = batch.ranges.back();
+                        if (last.firstIndex + last.numIndices == meshlet.firstIndex)
+                        {
+                            last.numIndices += meshlet.numIndices;
+                            continue;
+                        }
+                    }
+                    batch.ranges.emplace_back(graphics::IndexRange{ meshlet.firstIndex, meshlet.numIndices });
+                }
+
+                uint32_t numRanges = static_cast<uint32_t>(batch.ranges.size()) - firstRange;
+                if (numRanges > 0) batch.draws.emplace_back(ObjectDraw{ o, firstRange, numRanges });
+            }
+
+            std::lock_guard<std::mutex> lock(m_batchMutex);
+            m_batches.emplace_back(std::move(batch));
+        });
+
+        // Batches finish in any order, but the draws follow the objects
+        std::sort(m_batches.begin(), m_batches.end(), [](const Batch& a, const Batch& b)
+        {
+            return a.firstObject < b.firstObject;
+        });
+
+        m_draws.clear();
+        m_ranges.clear();
+        m_statistics = {};
+        for (const auto& batch : m_batches)
+        {
+            uint32_t rangeOffset = static_cast<uint32_t>(m_ranges.size());
+            for (auto draw : batch.draws)
+            {
+                draw.firstRange += rangeOffset;
+                m_draws.emplace_back(draw);
+            }
+            m_ranges.insert(m_ranges.end(), batch.ranges.begin(), batch.ranges.end());
+            m_statistics.meshlets           += batch.statistics.meshlets;
+            m_statistics.frustumCulled      += batch.statistics.frustumCulled;
+            m_statistics.backfaceCulled     += batch.statistics.backfaceCulled;
+            m_statistics.simplifiedObjects  += batch.statistics.simplifiedObjects;
+        }
+        m_statistics.draws = static_cast<uint32_t>(m_ranges.size());
+    }
+}
@@ -0,0 +1,86 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    ClusterCuller.hpp
+
+    CPU culling of the meshlets of all the objects in a scene. A meshlet is
+    culled, if its bounding sphere is outside the view frustum, or if its
+    normal cone shows that all its triangles face away from the camera.
+    The visible meshlets of an object that are next to each other in the
+    index buffer are merged, so the result is a compact list of index
+    ranges, grouped by object. Each object is drawn with one set of
+    bindings and constants.
+
+    Each object is drawn at the coarsest level of detail whose error stays
+    within a pixel on the screen. Only the full mesh has meshlets, so the
+    coarser levels are culled as a whole.
+
+    The objects are culled in parallel in batches, and the draws are kept
+    in the order of the objects. The bounding spheres of the objects in a
+    batch are gathered into streams, and tested four at a time.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <mutex>
+
+#include "../Types.hpp"
+#include "../Streams.hpp"
+#include "../graphics/Descriptors.hpp"
+
+namespace rendering
+{
+    class Camera;
+    class Scene;
+    class GeometryCache;
+
+    // The visible index ranges of one object
+    struct ObjectDraw
+    {
+        uint32_t    object;
+        uint32_t    firstRange;
+        uint32_t    numRanges;
+    };
+
+    struct ClusterCullingStatistics
+    {
+        uint32_t    meshlets;
+        uint32_t    frustumCulled;
+        uint32_t    backfaceCulled;
+        uint32_t    simplifiedObjects;
+        uint32_t    draws;          // Index ranges
+    };
+
+    class ClusterCuller
+    {
+    public:
+        void cull(const Camera& camera, const Scene& scene, const GeometryCache& geometry, int screenHeight);
+
+        // In the order of the objects
+        const std::vector<ObjectDraw>&          draws() const { return m_draws; }
+        const std::vector<graphics::IndexRange>& ranges() const { return m_ranges; }
+        const ClusterCullingStatistics&         statistics() const { return m_statistics; }
+    private:
+        struct Batch
+        {
+            uint32_t                            firstObject;
+            std::vector<ObjectDraw>             draws;      // Ranges within the batch
+            std::vector<graphics::IndexRange>   ranges;
+            ClusterCullingStatistics            statistics;
+        };
+
+        std::vector<ObjectDraw>             m_draws;
+        std::vector<graphics::IndexRange>   m_ranges;
+        ClusterCullingStatistics            m_statistics = {};
+
+        // World space bounding spheres of the objects, and the indices of the visible ones
+        // within each batch
+        Float3Stream                m_centers;
+        std::vector<float>          m_radii;
+        std::vector<uint32_t>       m_visible;
+
+        std::vector<Batch>          m_batches;
+        std::mutex                  m_batchMutex;
+    };
+}
@@ -4,22 +4,75 @@
 */
 
 #include "GeometryCache.hpp"
+#include "VertexStreams.hpp"
+
+#include "../Math.hpp"
+#include "../Errors.hpp"
+
+#include <algorithm>
+#include <cfloat>
 
 using namespace graphics;
 
 namespace rendering
 {
-    constexpr uint32_t VertexBufferSize = (1 << 20);
-    constexpr uint32_t IndexBufferSize  = (1 << 22);
+    constexpr uint32_t VertexBufferSize     = (1 << 20);
+    constexpr uint32_t IndexBufferSize      = (1 << 21);
+    constexpr uint32_t ShortIndexBufferSize = (1 << 22);
+    constexpr uint32_t MaxShortIndexVertices = (1 << 16);
 
-    GeometryCache::GeometryCache(graphics::Device& device)
+    PackedVertex packVertex(const Vertex& vertex, const float3& positionOffset, const float3& invPositionScale)
     {
-        m_vertexBuffer = device.createBuffer(desc::Buffer()
-            .elements(VertexBufferSize)
-            .format<Vertex>()
-            .structured(true)
-            .usage(desc::Usage::GpuReadWrite)
-            .name("Geometry cache vertex buffer"));
+        uint32_t position[3];
+        for (int i = 0; i < 3; i++)
+        {
+            float quantized = (vertex.position[i] - positionOffset[i]) * invPositionScale[i] + 0.5f;
+            position[i] = static_cast<uint32_t>(std::max<float>(0.f, std::min<float>(65535.f, quantized)));
+        }
+
+        PackedVertex packed;
+        packed.positionXY   = position[0] | (position[1] << 16);
+        packed.positionZ    = position[2];
+        packed.qTangent     = math::encodeQTangent(vertex.orientation, vertex.bitangentSign);
+        packed.uv           = math::floatToHalf(vertex.uv[0]) | (static_cast<uint32_t>(math::floatToHalf(vertex.uv[1])) << 16);
+        return packed;
+    }
+
+    // Uploads the elements appended since the last upload
+    template<typename T>
+    uint64_t uploadAppended(graphics::CommandBuffer& gfx, graphics::Buffer& buffer, const std::vector<T>& data,
+                            size_t& uploaded)
+    {
+        if (uploaded >= data.size()) return 0;
+
+        Range<const uint8_t> appended(reinterpret_cast<const uint8_t*>(data.data() + uploaded),
+                                      (data.size() - uploaded) * sizeof(T));
+        gfx.update(buffer, appended, static_cast<uint32_t>(uploaded * sizeof(T)));
+        uploaded = data.size();
+        return appended.byteSize();
+    }
+
+    GeometryCache::GeometryCache(graphics::Device& device, VertexFormat vertexFormat) :
+        m_vertexFormat(vertexFormat)
+    {
+        if (m_vertexFormat == VertexFormat::Packed)
+        {
+            m_vertexBuffer = device.createBuffer(desc::Buffer()
+                .elements(VertexBufferSize)
+                .format<PackedVertex>()
+                .structured(true)
+                .usage(desc::Usage::GpuReadWrite)
+                .name("Geometry cache packed vertex buffer"));
+        }
+        else
+        {
+            m_vertexBuffer = device.createBuffer(desc::Buffer()
+                .elements(VertexBufferSize)
+                .format<Vertex>()
+                .structured(true)
+                .usage(desc::Usage::GpuReadWrite)
+                .name("Geometry cache vertex buffer"));
+        }
         m_vertexBufferSRV = device.createBufferView(m_vertexBuffer,
             desc::BufferView(m_vertexBuffer.descriptor()).type(desc::ViewType::SRV));
 
@@ -29,27 +82,168 @@ namespace rendering
             .type(desc::BufferType::Index)
             .usage(desc::Usage::GpuReadWrite)
             .name("Geometry cache index buffer"));
+
+        m_shortIndexBuffer = device.createBuffer(desc::Buffer()
+            .elements(ShortIndexBufferSize)
+            .format<uint16_t>()
+            .type(desc::BufferType::Index)
+            .usage(desc::Usage::GpuReadWrite)
+            .name("Geometry cache 16-bit index buffer"));
     }
 
     int2 GeometryCache::preloadMesh(const Mesh& mesh)
     {
-        int vertexOffset = static_cast<int>(m_vertices.size());
-        m_vertices.insert(m_vertices.end(), mesh.vertices().begin(), mesh.vertices().end());
+        uint32_t numVertices    = static_cast<uint32_t>(mesh.vertices().size());
+        uint32_t numIndices     = static_cast<uint32_t>(mesh.indices().size());
+        bool shortIndices       = (numVertices <= MaxShortIndexVertices);
+
+        size_t indexOffset      = shortIndices ? m_shortIndices.size() : m_indices.size();
+        size_t indexCapacity    = shortIndices ? ShortIndexBufferSize : IndexBufferSize;
+        if ((m_numVertices + numVertices > VertexBufferSize) || (indexOffset + numIndices > indexCapacity))
+        {
+            OutputDebugString("Geometry cache is full\n");
+            return { 0, 0 };
+        }
+
+        // Bounding box, which is also the range of the packed positions
+        Float3Stream positions(numVertices);
+        copyPositions(mesh.vertices(), positions);
+        AABB bounds = math::bounds(positions);
+        float3 minCorner = numVertices ? bounds.minCorner() : float3(0.f);
+        float3 maxCorner = numVertices ? bounds.maxCorner() : float3(0.f);
+        float3 size = maxCorner - minCorner;
+
+        MeshPlacement placement;
+        placement.baseVertex        = m_numVertices;
+        placement.shortIndices      = shortIndices;
+        placement.positionOffset    = minCorner;
+        placement.positionScale     = (1.f / 65535.f) * size;
+
+        if (m_vertexFormat == VertexFormat::Packed)
+        {
+            float3 invPositionScale;
+            for (int i = 0; i < 3; i++) invPositionScale[i] = (size[i] > 0.f) ? 65535.f / size[i] : 0.f;
+
+            for (const auto& vertex : mesh.vertices())
+            {
+                m_packedVertices.emplace_back(packVertex(vertex, placement.positionOffset, invPositionScale));
+            }
+        }
+        else
+        {
+            m_vertices.insert(m_vertices.end(), mesh.vertices().begin(), mesh.vertices().end());
+        }
+        m_numVertices += numVertices;
+
+        if (shortIndices)
+        {
+            for (auto index : mesh.indices()) m_shortIndices.emplace_back(static_cast<uint16_t>(index));
+        }
+        else
+        {
+            m_indices.insert(m_indices.end(), mesh.indices().begin(), mesh.indices().end());
+        }
+
+        int lodOffset = static_cast<int>(m_lods.size());
+        if (!mesh.lods().empty())
+        {
+            for (auto lod : mesh.lods())
+            {
+                lod.firstIndex += static_cast<uint32_t>(indexOffset);
+                m_lods.emplace_back(lod);
+            }
+        }
+        else
+        {
+            m_lods.emplace_back(MeshLod{ static_cast<uint32_t>(indexOffset), numIndices, 0.f });
+        }
+        uint32_t numFullIndices = m_lods[lodOffset].numIndices;
+
+        // Bounding sphere around the bounding box
+        float3 center = 0.5f * (minCorner + maxCorner);
+        float radius = math::maxDistance(positions, center);
 
-        int indexOffset = static_cast<int>(m_indices.size());
-        for (uint32_t i = 0; i < mesh.indices().size(); i++)
+        int meshletOffset = static_cast<int>(m_meshlets.size());
+        if (!mesh.meshlets().empty())
         {
-            uint32_t index = vertexOffset + mesh.indices()[i];
-            m_indices.emplace_back(index);
+            for (auto meshlet : mesh.meshlets())
+            {
+                meshlet.firstIndex += static_cast<uint32_t>(indexOffset);
+                m_meshlets.emplace_back(meshlet);
+            }
         }
+        else
+        {
+            // A cone that never culls
+            Meshlet meshlet;
+            meshlet.firstIndex  = static_cast<uint32_t>(indexOffset);
+            meshlet.numIndices  = numFullIndices;
+            meshlet.center      = center;
+            meshlet.radius      = radius;
+            meshlet.coneAxis    = float3(0.f);
+            meshlet.coneCutoff  = 1.f;
+            m_meshlets.emplace_back(meshlet);
+        }
+
+        int virtualStart = m_nextVirtualStart;
+        m_nextVirtualStart += static_cast<int>(numIndices);
+
+        CachedMesh& cached      = m_meshes[virtualStart];
+        cached.meshlets         = { meshletOffset, static_cast<int>(m_meshlets.size()) - meshletOffset };
+        cached.lods             = { lodOffset, static_cast<int>(m_lods.size()) - lodOffset };
+        cached.boundingSphere   = float4{ center[0], center[1], center[2], radius };
+        cached.placement        = placement;
+
+        return { virtualStart, static_cast<int>(numFullIndices) };
+    }
+
+    Range<const Meshlet> GeometryCache::meshlets(int2 meshStartSize) const
+    {
+        auto cached = m_meshes.find(meshStartSize[0]);
+        if (cached == m_meshes.end()) return Range<const Meshlet>();
 
-        return { indexOffset, static_cast<int>(mesh.indices().size()) };
+        int2 startSize = cached->second.meshlets;
+        return Range<const Meshlet>(m_meshlets.data() + startSize[0], startSize[1] * sizeof(Meshlet));
+    }
+
+    Range<const MeshLod> GeometryCache::lods(int2 meshStartSize) const
+    {
+        auto cached = m_meshes.find(meshStartSize[0]);
+        if (cached == m_meshes.end()) return Range<const MeshLod>();
+
+        int2 startSize = cached->second.lods;
+        return Range<const MeshLod>(m_lods.data() + startSize[0], startSize[1] * sizeof(MeshLod));
+    }
+
+    float4 GeometryCache::boundingSphere(int2 meshStartSize) const
+    {
+        auto cached = m_meshes.find(meshStartSize[0]);
+        if (cached == m_meshes.end()) return float4(0.f);
+
+        return cached->second.boundingSphere;
+    }
+
+    const MeshPlacement* GeometryCache::placement(int2 meshStartSize) const
+    {
+        auto cached = m_meshes.find(meshStartSize[0]);
+        if (cached == m_meshes.end()) return nullptr;
+
+        return &cached->second.placement;
     }
 
     void GeometryCache::updateGPUBuffers(graphics::CommandBuffer& gfx)
     {
-        // TODO: Better logic here
-        gfx.update(m_vertexBuffer, vectorAsByteRange(m_vertices));
-        gfx.update(m_indexBuffer, vectorAsByteRange(m_indices));
+        // Meshes are only ever appended, so everything before the previous end is already there
+        m_uploadedBytes = 0;
+        if (m_vertexFormat == VertexFormat::Packed)
+        {
+            m_uploadedBytes += uploadAppended(gfx, m_vertexBuffer, m_packedVertices, m_uploadedVertices);
+        }
+        else
+        {
+            m_uploadedBytes += uploadAppended(gfx, m_vertexBuffer, m_vertices, m_uploadedVertices);
+        }
+        m_uploadedBytes += uploadAppended(gfx, m_indexBuffer, m_indices, m_uploadedIndices);
+        m_uploadedBytes += uploadAppended(gfx, m_shortIndexBuffer, m_shortIndices, m_uploadedShortIndices);
     }
 }
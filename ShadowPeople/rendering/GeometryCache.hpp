@@ -10,30 +10,94 @@
 #include "Mesh.hpp"
 
 #include <vector>
+#include <unordered_map>
 
 namespace rendering
 {
+    enum class VertexFormat
+    {
+        Full,       // Vertex
+        Packed      // PackedVertex
+    };
+
+    // Where the data of a preloaded mesh is. Indices are relative to the base vertex, and meshes
+    // with at most 65536 vertices have 16-bit indices.
+    struct MeshPlacement
+    {
+        uint32_t    baseVertex;
+        bool        shortIndices;
+        float3      positionOffset;     // Dequantization of packed positions
+        float3      positionScale;
+    };
+
     class GeometryCache
     {
     public:
-        GeometryCache(graphics::Device& device);
+        GeometryCache(graphics::Device& device, VertexFormat vertexFormat = VertexFormat::Full);
 
+        // Returns a virtual start and the size of the full mesh. The start identifies the mesh,
+        // the actual indices are in one of the index buffers.
         int2 preloadMesh(const Mesh& mesh);
 
+        // Meshlets of a preloaded mesh, with their indices in its index buffer. Meshes built
+        // without meshlets have a single one covering the whole mesh.
+        Range<const Meshlet> meshlets(int2 meshStartSize) const;
+
+        // Levels of detail of a preloaded mesh, the full mesh first. Meshes built without LODs have
+        // only the full mesh.
+        Range<const MeshLod> lods(int2 meshStartSize) const;
+
+        // Bounding sphere of a preloaded mesh as center and radius, or a zero radius if not found
+        float4 boundingSphere(int2 meshStartSize) const;
+
+        // Returns null if not found
+        const MeshPlacement* placement(int2 meshStartSize) const;
+
+        // Uploads the meshes preloaded since the last update
         void updateGPUBuffers(graphics::CommandBuffer& gfx);
 
+        // Bytes uploaded by the last updateGPUBuffers()
+        uint64_t uploadedBytes() const { return m_uploadedBytes; }
+
+        VertexFormat vertexFormat() const { return m_vertexFormat; }
+
         // Returns start + size of the allocated range
-        int2 allocatedVertices() const { return { 0, static_cast<int>(m_vertices.size()) }; }
-        int2 allocatedIndices()  const { return { 0, static_cast<int>(m_indices.size()) }; }
+        int2 allocatedVertices() const { return { 0, static_cast<int>(m_numVertices) }; }
 
         const graphics::BufferView& vertexBuffer() const { return m_vertexBufferSRV; }
         const graphics::Buffer& indexBuffer() const { return m_indexBuffer; }
+        const graphics::Buffer& shortIndexBuffer() const { return m_shortIndexBuffer; }
     private:
-        std::vector<Vertex>     m_vertices;
-        std::vector<uint32_t>   m_indices;
+        VertexFormat                m_vertexFormat;
+        uint32_t                    m_numVertices = 0;
+        std::vector<Vertex>         m_vertices;
+        std::vector<PackedVertex>   m_packedVertices;
+        std::vector<uint32_t>       m_indices;
+        std::vector<uint16_t>       m_shortIndices;
+        std::vector<Meshlet>        m_meshlets;
+        std::vector<MeshLod>        m_lods;
+
+        // Elements of the CPU copies, which are already in the GPU buffers
+        size_t                      m_uploadedVertices      = 0;
+        size_t                      m_uploadedIndices       = 0;
+        size_t                      m_uploadedShortIndices  = 0;
+        uint64_t                    m_uploadedBytes         = 0;
+
+        struct CachedMesh
+        {
+            int2            meshlets;   // Start and size in m_meshlets
+            int2            lods;       // Start and size in m_lods
+            float4          boundingSphere;
+            MeshPlacement   placement;
+        };
+
+        // By the virtual start of each mesh
+        std::unordered_map<int, CachedMesh> m_meshes;
+        int                                 m_nextVirtualStart = 0;
 
         graphics::Buffer        m_vertexBuffer;
         graphics::BufferView    m_vertexBufferSRV;
         graphics::Buffer        m_indexBuffer;
+        graphics::Buffer        m_shortIndexBuffer;
     };
 }
@@ -5,119 +5,574 @@
 
 #include "MaterialCache.hpp"
 #include "../Math.hpp"
+#include "../graphics/PixelConversion.hpp"
+#include "../graphics/BlockCompression.hpp"
+#include "../Parallel.hpp"
+#include "../Errors.hpp"
+#include "../Log.hpp"
+
+#include <algorithm>
+#include <cstring>
 
 using namespace graphics;
 
-namespace rendering
+namespace
 {
     constexpr uint32_t MaterialCacheTextureSize = 2048;//8192;
 
+    // Albedo and roughness are compressed to BC7 (or BC3, which is faster to encode) and the
+    // octahedral normals to BC5. This takes a quarter of the memory of RGBA8 and RG16.
+    constexpr BlockFormat           AlbedoRoughnessBlockFormat  = BlockFormat::BC7;
+    constexpr BlockFormat           NormalBlockFormat           = BlockFormat::BC5;
+    constexpr CompressionQuality    MaterialCompressionQuality  = CompressionQuality::Normal;
+
+    // The smallest mip is 1/16 of the cache. Allocations are aligned to whole blocks of it, so
+    // that the materials do not bleed into each other in any mip.
+    constexpr int                   MaterialCacheMipLevels      = 5;
+    constexpr int                   MaterialAllocationAlignment = BlockDim << (MaterialCacheMipLevels - 1);
+
+    // Moved materials are copied through scratch textures in pieces of this size
+    constexpr uint32_t              MaterialScratchSize         = 512;
+
+    // Copies a rectangle of texels or blocks to another image of the same format
+    void copyRect(Image& dstImage, const Image& srcImage, Rect<int, 2> src, int2 dst)
+    {
+        uint8_t* data = dstImage.asRange<uint8_t>().begin();
+        uint32_t rowBytes = static_cast<uint32_t>(src.size()[0]) * math::divRoundUp<uint32_t>(srcImage.bpp(), 8);
+        for (int y = 0; y < src.size()[1]; y++)
+        {
+            memcpy(data + dstImage.byteOffset(dst[0], dst[1] + y),
+                   srcImage.data() + srcImage.byteOffset(src.minCorner()[0], src.minCorner()[1] + y), rowBytes);
+        }
+    }
+
+    // Copies a rectangle of texels or blocks to another place in the same image
+    void moveRect(Image& image, Rect<int, 2> src, int2 dst)
+    {
+        copyRect(image, image, src, dst);
+    }
+
+    bool contains(Rect<int, 2> outer, Rect<int, 2> inner)
+    {
+        int2 outerMax = outer.minCorner() + outer.size();
+        int2 innerMax = inner.minCorner() + inner.size();
+        return (inner.minCorner()[0] >= outer.minCorner()[0]) && (inner.minCorner()[1] >= outer.minCorner()[1]) &&
+               (innerMax[0] <= outerMax[0]) && (innerMax[1] <= outerMax[1]);
+    }
+
+    // Grows the rectangle to whole blocks within an image of the given size
+    Rect<int, 2> alignToBlocks(Rect<int, 2> rect, int2 size)
+    {
+        int2 minTexel = rect.minCorner();
+        int2 maxTexel = rect.minCorner() + rect.size();
+        for (int i = 0; i < 2; i++)
+        {
+            minTexel[i] = std::max(minTexel[i], 0) / BlockDim * BlockDim;
+            maxTexel[i] = std::min(math::divRoundUp(maxTexel[i], BlockDim) * BlockDim, size[i]);
+        }
+        return Rect<int, 2>(minTexel, int2{ std::max(maxTexel[0] - minTexel[0], 0), std::max(maxTexel[1] - minTexel[1], 0) });
+    }
+
+    // D3D11 cannot copy within one subresource, so the rectangle goes through the scratch texture.
+    // The pieces are whole blocks, as the rectangle and the scratch size are.
+    void moveThroughScratch(CommandBuffer& gfx, Texture texture, Texture scratch, Rect<int, 2> src, int2 dst, int mip)
+    {
+        int scratchSize = static_cast<int>(MaterialScratchSize);
+        for (int y = 0; y < src.size()[1]; y += scratchSize)
+        {
+            for (int x = 0; x < src.size()[0]; x += scratchSize)
+            {
+                int2 offset{ x, y };
+                int2 size{ std::min<int>(scratchSize, src.size()[0] - x), std::min<int>(scratchSize, src.size()[1] - y) };
+                gfx.copy(scratch, texture, int2{ 0, 0 }, Rect<int, 2>(src.minCorner() + offset, size),
+                         Subresource{ 0, 0 }, Subresource{ mip, 0 });
+                gfx.copy(texture, scratch, dst + offset, Rect<int, 2>(size), Subresource{ mip, 0 }, Subresource{ 0, 0 });
+            }
+        }
+    }
+
+    Rect<int, 2> blockRect(Rect<int, 2> texelRect)
+    {
+        return Rect<int, 2>(int2{ texelRect.minCorner()[0] / BlockDim, texelRect.minCorner()[1] / BlockDim },
+                            int2{ texelRect.size()[0] / BlockDim, texelRect.size()[1] / BlockDim });
+    }
+
+    // The kernel of the conversion is picked once per image by the source format
+    template<PixelConversion Conversion>
+    Rect<int, 2> copyToCache(Image& dst, const Image& src, Rect<int, 2> srcRect, int2 dstPos)
+    {
+        switch (sourcePixelFormat(math::divRoundUp<uint32_t>(src.bpp(), 8)))
+        {
+        case PixelFormat::R8:
+            return dst.copy<PixelFormat::R8, Conversion>(src, srcRect, dstPos);
+        case PixelFormat::BGR8:
+            return dst.copy<PixelFormat::BGR8, Conversion>(src, srcRect, dstPos);
+        default:
+            return dst.copy<PixelFormat::BGRA8, Conversion>(src, srcRect, dstPos);
+        }
+    }
+
+    // Tiles have a header with their size, followed by the albedo-roughness rows and the normal rows
+    struct MaterialTileHeader
+    {
+        uint32_t width;
+        uint32_t height;
+    };
+}
+
+namespace rendering
+{
+    struct MaterialCache::CompressionJob
+    {
+        MaterialChannel         channel;
+        Rect<int, 2>            rect;   // In the top mip, follows the material when it moves
+
+        std::vector<Image>      texels; // Block aligned copy of the rectangle in each mip
+        std::vector<Image>      blocks; // Written by the worker thread
+        bool                    done = false;
+    };
+
     MaterialCache::MaterialCache(Device& device) :
-        m_albedoRoughnessCache(32, MaterialCacheTextureSize, MaterialCacheTextureSize),
-        m_normalCache(32, MaterialCacheTextureSize, MaterialCacheTextureSize)
+        m_allocator(int2{ static_cast<int>(MaterialCacheTextureSize), static_cast<int>(MaterialCacheTextureSize) },
+                    MaterialAllocationAlignment),
+        m_compact(true),
+        m_uploaded(false),
+        m_uploadedBytes(0),
+        m_quit(false)
     {
-        // 8-bit RGBA - albedo + roughness
+        for (int mip = 0; mip < MaterialCacheMipLevels; mip++)
+        {
+            uint16_t mipSize = static_cast<uint16_t>(MaterialCacheTextureSize >> mip);
+            m_albedoRoughnessCache.emplace_back(Image(32, mipSize, mipSize));
+            m_normalCache.emplace_back(Image(32, mipSize, mipSize));
+            m_albedoRoughnessBlocks.emplace_back(createBlockImage(AlbedoRoughnessBlockFormat, mipSize, mipSize));
+            m_normalBlocks.emplace_back(createBlockImage(NormalBlockFormat, mipSize, mipSize));
+        }
+
+        // Block compressed RGBA - albedo + roughness
         m_albedoRoughness = device.createTexture(desc::Texture()
             .width(MaterialCacheTextureSize)
             .height(MaterialCacheTextureSize)
-            .format(desc::Format())
+            .mipLevels(MaterialCacheMipLevels)
+            .format((AlbedoRoughnessBlockFormat == BlockFormat::BC7) ? desc::Format::bc7() : desc::Format::bc3())
             .usage(desc::Usage::GpuReadWrite)
             .name("Material cache albedo roughness"));
         m_albedoRoughnessSRV = device.createTextureView(m_albedoRoughness,
             desc::TextureView(m_albedoRoughness.descriptor()).type(desc::ViewType::SRV));
 
-        // 16-bit RG - octahedral packed normal
+        // Block compressed RG - octahedral packed normal
         m_normal = device.createTexture(desc::Texture()
             .width(MaterialCacheTextureSize)
             .height(MaterialCacheTextureSize)
-            .format(desc::Format()
-                .channels(desc::FormatChannels::RG)
-                .bytes(desc::FormatBytesPerChannel::B16)
-                .type(desc::FormatType::UNorm))
+            .mipLevels(MaterialCacheMipLevels)
+            .format(desc::Format::bc5())
             .usage(desc::Usage::GpuReadWrite)
             .name("Material cache normal"));
         m_normalSRV = device.createTextureView(m_normal,
             desc::TextureView(m_normal.descriptor()).type(desc::ViewType::SRV));
+
+        // Moved materials are copied through these, since a copy cannot stay within one subresource
+        m_albedoRoughnessScratch = device.createTexture(desc::Texture()
+            .width(MaterialScratchSize)
+            .height(MaterialScratchSize)
+            .format(m_albedoRoughness.descriptor().format)
+            .usage(desc::Usage::GpuReadWrite)
+            .name("Material cache albedo roughness scratch"));
+        m_normalScratch = device.createTexture(desc::Texture()
+            .width(MaterialScratchSize)
+            .height(MaterialScratchSize)
+            .format(desc::Format::bc5())
+            .usage(desc::Usage::GpuReadWrite)
+            .name("Material cache normal scratch"));
+
+        m_compressionThread = std::thread(&MaterialCache::compressionThread, this);
+    }
+
+    MaterialCache::~MaterialCache()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_quit = true;
+        }
+        m_jobAvailable.notify_all();
+        m_compressionThread.join();
     }
 
     Rect<int, 2> MaterialCache::allocate(int2 size)
     {
-        // TODO: A proper allocator
-        Rect<int, 2> rect = Rect<int, 2>({ 0, 0 }, size);
+        Rect<int, 2> rect = m_allocator.allocate(size);
+        if (rect.size()[0] == 0) logError("Material cache is full\n");
         return rect;
     }
 
-    void MaterialCache::preloadMaterial(Image& image, Rect<int, 2> dstRect, MaterialChannel channel)
+    void MaterialCache::free(Rect<int, 2> rect)
     {
-        struct RGBA
-        {
-            uint8_t r;
-            uint8_t g;
-            uint8_t b;
-            uint8_t a;
-        };
+        m_allocator.free(rect);
+        m_compact = false;
 
-        struct BGR
+        // The blocks of the material may still be compressing. They must not be uploaded over the
+        // material, which is allocated or moved here next.
+        for (auto& job : m_compressionJobs)
         {
-            uint8_t b;
-            uint8_t g;
-            uint8_t r;
-        };
+            if (contains(rect, job->rect)) job->rect = Rect<int, 2>();
+        }
+    }
 
-        struct RG16
+    void MaterialCache::defragment(std::vector<AtlasRelocation>& relocations, uint32_t maxRelocations)
+    {
+        for (uint32_t i = 0; (i < maxRelocations) && !m_compact; i++)
         {
-            uint16_t r;
-            uint16_t g;
-        };
+            AtlasRelocation relocation;
+            if (!m_allocator.relocate(relocation))
+            {
+                m_compact = true;
+                break;
+            }
+
+            moveMaterial(relocation);
+            m_pendingCopies.emplace_back(relocation);
+            relocations.emplace_back(relocation);
+        }
+    }
 
-        auto RGB2RGBX = [](void *dst, const void *src)
+    void MaterialCache::moveMaterial(const AtlasRelocation& relocation)
+    {
+        // The allocations are aligned to whole blocks of the smallest mip
+        Rect<int, 2> from   = relocation.from;
+        Rect<int, 2> to     = relocation.to;
+        for (int mip = 0; mip < MaterialCacheMipLevels; mip++, from = Image::mipRect(from), to = Image::mipRect(to))
         {
-            RGBA* dstTyped = reinterpret_cast<RGBA*>(dst);
-            const BGR* srcTyped = reinterpret_cast<const BGR*>(src);
-            dstTyped->r = srcTyped->r;
-            dstTyped->g = srcTyped->g;
-            dstTyped->b = srcTyped->b;
-        };
+            moveRect(m_albedoRoughnessCache[mip], from, to.minCorner());
+            moveRect(m_normalCache[mip], from, to.minCorner());
+            moveRect(m_albedoRoughnessBlocks[mip], blockRect(from), blockRect(to).minCorner());
+            moveRect(m_normalBlocks[mip], blockRect(from), blockRect(to).minCorner());
+        }
 
-        auto RGB2XXXR = [](void *dst, const void *src)
+        // Changes, which have not been uploaded yet, are uploaded to the new place
+        int2 offset = relocation.to.minCorner() - relocation.from.minCorner();
+        for (auto* pendingRects : { &m_pendingAlbedoRoughness, &m_pendingNormal })
         {
-            RGBA* dstTyped = reinterpret_cast<RGBA*>(dst);
-            const BGR* srcTyped = reinterpret_cast<const BGR*>(src);
-            dstTyped->a = srcTyped->r;
-        };
+            for (auto& pending : *pendingRects)
+            {
+                if (contains(relocation.from, pending)) pending = Rect<int, 2>(pending.minCorner() + offset, pending.size());
+            }
+        }
+        for (auto& job : m_compressionJobs)
+        {
+            if (contains(relocation.from, job->rect)) job->rect = Rect<int, 2>(job->rect.minCorner() + offset, job->rect.size());
+        }
+    }
+
+    void MaterialCache::preloadMaterial(Image& image, Rect<int, 2> dstRect, MaterialChannel channel)
+    {
+        if (dstRect.size()[0] == 0) return;
+
+        // A channel larger than the material does not spill over its neighbours
+        Rect<int, 2> srcRect(int2{ std::min<int>(image.width(), dstRect.size()[0]),
+                                   std::min<int>(image.height(), dstRect.size()[1]) });
 
-        auto RGB82RG16 = [](void *dst, const void *src)
+        Rect<int, 2> written;
+        switch (channel)
         {
-            RG16* dstTyped = reinterpret_cast<RG16*>(dst);
-            const BGR* srcTyped = reinterpret_cast<const BGR*>(src);
-            float3 norm{ (static_cast<float>(srcTyped->r) - 128.f) / 128.f,
-                         (static_cast<float>(srcTyped->g) - 128.f) / 128.f,
-                         (static_cast<float>(srcTyped->b) - 128.f) / 128.f };
-            float2 octaNorm = math::encodeOctahedral(normalize(norm));
-            dstTyped->r = static_cast<uint16_t>(octaNorm[0] * 65535.f + 0.5f);
-            dstTyped->g = static_cast<uint16_t>(octaNorm[1] * 65535.f + 0.5f);
-        };
+        case MaterialChannel::Albedo:
+            written = copyToCache<PixelConversion::RGB>(m_albedoRoughnessCache[0], image, srcRect, dstRect.minCorner());
+            break;
+        case MaterialChannel::Roughness:
+            written = copyToCache<PixelConversion::RedToAlpha>(m_albedoRoughnessCache[0], image, srcRect, dstRect.minCorner());
+            break;
+        case MaterialChannel::Normal:
+            written = copyToCache<PixelConversion::Octahedral>(m_normalCache[0], image, srcRect, dstRect.minCorner());
+            break;
+        default:
+            break;
+        }
+        if (written.size()[0] == 0) return;
+
+        markPending((channel == MaterialChannel::Normal) ? m_pendingNormal : m_pendingAlbedoRoughness, written);
+    }
+
+    void MaterialCache::preloadMaterialRow(const uint8_t* src, uint32_t srcBytesPerPixel, uint32_t pixels,
+                                           int2 dstPos, MaterialChannel channel)
+    {
+        if ((dstPos[0] < 0) || (dstPos[0] >= static_cast<int>(MaterialCacheTextureSize)) ||
+            (dstPos[1] < 0) || (dstPos[1] >= static_cast<int>(MaterialCacheTextureSize))) return;
+        pixels = std::min<uint32_t>(pixels, MaterialCacheTextureSize - static_cast<uint32_t>(dstPos[0]));
+
+        Rect<int, 2> rowRect(dstPos, int2{ static_cast<int>(pixels), 1 });
+        markPending((channel == MaterialChannel::Normal) ? m_pendingNormal : m_pendingAlbedoRoughness, rowRect);
 
         switch(channel)
         {
         case MaterialChannel::Albedo:
-            m_albedoRoughnessCache.copy(image, dstRect, RGB2RGBX);
+            convertRowToRGB(m_albedoRoughnessCache[0].asRange<uint8_t>().begin() +
+                            m_albedoRoughnessCache[0].byteOffset(dstPos[0], dstPos[1]),
+                            src, pixels, srcBytesPerPixel);
             break;
         case MaterialChannel::Roughness:
-            m_albedoRoughnessCache.copy(image, dstRect, RGB2XXXR);
+            convertRowRedToAlpha(m_albedoRoughnessCache[0].asRange<uint8_t>().begin() +
+                                 m_albedoRoughnessCache[0].byteOffset(dstPos[0], dstPos[1]),
+                                 src, pixels, srcBytesPerPixel);
             break;
         case MaterialChannel::Normal:
-            m_normalCache.copy(image, dstRect, RGB82RG16);
+            convertRowToOctahedral(reinterpret_cast<uint16_t*>(m_normalCache[0].asRange<uint8_t>().begin() +
+                                                               m_normalCache[0].byteOffset(dstPos[0], dstPos[1])),
+                                   src, pixels, srcBytesPerPixel);
             break;
         default:
             break;
         }
     }
 
+    std::vector<uint8_t> MaterialCache::materialTile(Rect<int, 2> rect) const
+    {
+        const Image& albedoRoughness    = m_albedoRoughnessCache[0];
+        const Image& normal             = m_normalCache[0];
+
+        MaterialTileHeader header{ static_cast<uint32_t>(rect.size()[0]), static_cast<uint32_t>(rect.size()[1]) };
+        uint32_t rowBytes = header.width * 4;
+
+        std::vector<uint8_t> tile(sizeof(header) + 2 * rowBytes * header.height);
+        memcpy(tile.data(), &header, sizeof(header));
+
+        uint8_t* dst = tile.data() + sizeof(header);
+        for (const Image* image : { &albedoRoughness, &normal })
+        {
+            for (uint32_t y = 0; y < header.height; y++, dst += rowBytes)
+            {
+                memcpy(dst, image->data() + image->byteOffset(rect.minCorner()[0], rect.minCorner()[1] + y), rowBytes);
+            }
+        }
+        return tile;
+    }
+
+    bool MaterialCache::preloadMaterialTile(Range<const uint8_t> tile, Rect<int, 2>& dstRect)
+    {
+        MaterialTileHeader header;
+        if (tile.byteSize() < sizeof(header)) return false;
+        memcpy(&header, tile.begin(), sizeof(header));
+
+        uint32_t rowBytes = header.width * 4;
+        if (tile.byteSize() != sizeof(header) + 2 * rowBytes * header.height) return false;
+
+        if (dstRect.size()[0] == 0)
+        {
+            dstRect = allocate(int2{ static_cast<int>(header.width), static_cast<int>(header.height) });
+        }
+        if ((static_cast<int>(header.width) > dstRect.size()[0]) ||
+            (static_cast<int>(header.height) > dstRect.size()[1]) ||
+            (dstRect.minCorner()[0] + header.width > MaterialCacheTextureSize) ||
+            (dstRect.minCorner()[1] + header.height > MaterialCacheTextureSize)) return false;
+
+        Rect<int, 2> tileRect(dstRect.minCorner(), int2{ static_cast<int>(header.width), static_cast<int>(header.height) });
+        markPending(m_pendingAlbedoRoughness, tileRect);
+        markPending(m_pendingNormal, tileRect);
+
+        const uint8_t* src = tile.begin() + sizeof(header);
+        for (Image* image : { &m_albedoRoughnessCache[0], &m_normalCache[0] })
+        {
+            uint8_t* dst = image->asRange<uint8_t>().begin();
+            for (uint32_t y = 0; y < header.height; y++, src += rowBytes)
+            {
+                memcpy(dst + image->byteOffset(dstRect.minCorner()[0], dstRect.minCorner()[1] + y), src, rowBytes);
+            }
+        }
+        return true;
+    }
+
+    void MaterialCache::markPending(std::vector<Rect<int, 2>>& pendingRects, Rect<int, 2> rect)
+    {
+        // The whole material is filtered, compressed and uploaded once, however many rows of it
+        // have changed. Whole materials never share texels in any mip.
+        Rect<int, 2> material = m_allocator.allocation(rect.minCorner());
+        if (material.size()[0] > 0) rect = material;
+
+        if (!pendingRects.empty())
+        {
+            Rect<int, 2>& last = pendingRects.back();
+            bool sameColumns = (last.minCorner()[0] == rect.minCorner()[0]) && (last.size()[0] == rect.size()[0]);
+            if (sameColumns && (last.minCorner()[1] + last.size()[1] == rect.minCorner()[1]))
+            {
+                last = Rect<int, 2>(last.minCorner(), int2{ last.size()[0], last.size()[1] + rect.size()[1] });
+                return;
+            }
+        }
+
+        // Several channels and rows of one material write to the same rectangle
+        for (auto& pending : pendingRects)
+        {
+            int2 pendingMax = pending.minCorner() + pending.size();
+            int2 rectMax    = rect.minCorner() + rect.size();
+            if ((rect.minCorner()[0] >= pending.minCorner()[0]) && (rect.minCorner()[1] >= pending.minCorner()[1]) &&
+                (rectMax[0] <= pendingMax[0]) && (rectMax[1] <= pendingMax[1])) return;
+        }
+
+        pendingRects.emplace_back(rect);
+    }
+
+    void MaterialCache::buildMips(std::vector<Image>& mips, const std::vector<Rect<int, 2>>& pendingRects,
+                                  MipFilter colorFilter, MipFilter alphaFilter)
+    {
+        // The pending rectangles are whole materials, so they do not share texels in any mip
+        parallelFor(static_cast<uint32_t>(pendingRects.size()), 1, [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t i = begin; i < end; i++)
+            {
+                Rect<int, 2> rect = pendingRects[i];
+                for (size_t mip = 1; mip < mips.size(); mip++)
+                {
+                    rect = mips[mip - 1].downsample(rect, mips[mip], colorFilter, alphaFilter);
+                }
+            }
+        });
+    }
+
     void MaterialCache::updateGPUTextures(graphics::CommandBuffer& gfx)
     {
-        // TODO: Better logic here
-        gfx.update(m_albedoRoughness, m_albedoRoughnessCache);            
-        gfx.update(m_normal, m_normalCache);            
+        // Nothing is uploaded, when nothing has changed
+        m_uploadedBytes = 0;
+
+        // The textures have undefined contents until the first upload
+        if (!m_uploaded)
+        {
+            for (int mip = 0; mip < MaterialCacheMipLevels; mip++)
+            {
+                gfx.update(m_albedoRoughness, m_albedoRoughnessBlocks[mip], { 0, 0 }, Rect<int, 2>(), Subresource{ mip, 0 });
+                gfx.update(m_normal, m_normalBlocks[mip], { 0, 0 }, Rect<int, 2>(), Subresource{ mip, 0 });
+                m_uploadedBytes += m_albedoRoughnessBlocks[mip].dataSize() + m_normalBlocks[mip].dataSize();
+            }
+            m_uploaded = true;
+            m_pendingCopies.clear();
+        }
+
+        // Moved materials are copied before the pending changes are uploaded over them. The
+        // source and the destination of a move never overlap, so the pieces can go in any order.
+        for (const auto& relocation : m_pendingCopies)
+        {
+            Rect<int, 2> from   = relocation.from;
+            Rect<int, 2> to     = relocation.to;
+            for (int mip = 0; mip < MaterialCacheMipLevels; mip++, from = Image::mipRect(from), to = Image::mipRect(to))
+            {
+                moveThroughScratch(gfx, m_albedoRoughness, m_albedoRoughnessScratch, from, to.minCorner(), mip);
+                moveThroughScratch(gfx, m_normal, m_normalScratch, from, to.minCorner(), mip);
+            }
+        }
+        m_pendingCopies.clear();
+
+        // Roughness is averaged, because sharpening it would add sparkles
+        buildMips(m_albedoRoughnessCache, m_pendingAlbedoRoughness, MipFilter::Kaiser, MipFilter::Box);
+        buildMips(m_normalCache, m_pendingNormal, MipFilter::OctahedralNormal, MipFilter::OctahedralNormal);
+
+        // Compressing BC7 takes several frames for a large material, so the render thread only
+        // queues the changed materials, and uploads the blocks of the ones finished so far
+        queueCompression(MaterialChannel::Albedo, m_albedoRoughnessCache, m_pendingAlbedoRoughness);
+        m_pendingAlbedoRoughness.clear();
+        queueCompression(MaterialChannel::Normal, m_normalCache, m_pendingNormal);
+        m_pendingNormal.clear();
+
+        uploadCompressed(gfx);
+    }
+
+    void MaterialCache::queueCompression(MaterialChannel channel, const std::vector<Image>& mips,
+                                         const std::vector<Rect<int, 2>>& pendingRects)
+    {
+        for (auto rect : pendingRects)
+        {
+            auto job = std::make_shared<CompressionJob>();
+            job->channel    = channel;
+            job->rect       = rect;
+
+            // The worker reads copies, since the cache may change before it gets to the job
+            for (int mip = 0; mip < MaterialCacheMipLevels; mip++, rect = Image::mipRect(rect))
+            {
+                Rect<int, 2> aligned = alignToBlocks(rect, int2{ mips[mip].width(), mips[mip].height() });
+                Image texels;
+                if (aligned.size()[0] > 0)
+                {
+                    texels = Image(mips[mip].bpp(), static_cast<uint16_t>(aligned.size()[0]),
+                                   static_cast<uint16_t>(aligned.size()[1]), 1, ImageMemory::Uninitialized);
+                    copyRect(texels, mips[mip], aligned, int2{ 0, 0 });
+                }
+                job->texels.emplace_back(texels);
+            }
+
+            m_compressionJobs.emplace_back(job);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_queuedJobs.emplace_back(job);
+            }
+            m_jobAvailable.notify_one();
+        }
+    }
+
+    void MaterialCache::uploadCompressed(graphics::CommandBuffer& gfx)
+    {
+        while (!m_compressionJobs.empty())
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_compressionJobs.front()->done) return;
+            }
+            std::shared_ptr<CompressionJob> job = m_compressionJobs.front();
+            m_compressionJobs.pop_front();
+
+            // The material has been freed
+            if (job->rect.size()[0] == 0) continue;
+
+            bool normal = (job->channel == MaterialChannel::Normal);
+            Texture& texture                = normal ? m_normal : m_albedoRoughness;
+            std::vector<Image>& cpuBlocks   = normal ? m_normalBlocks : m_albedoRoughnessBlocks;
+
+            Rect<int, 2> rect = job->rect;
+            for (int mip = 0; mip < MaterialCacheMipLevels; mip++, rect = Image::mipRect(rect))
+            {
+                const Image& blocks = job->blocks[mip];
+                if (blocks.width() == 0) continue;
+
+                // The material moves by whole blocks of the smallest mip, so the alignment holds
+                int2 dstBlock = blockRect(alignToBlocks(rect, int2{ cpuBlocks[mip].width() * BlockDim,
+                                                                    cpuBlocks[mip].height() * BlockDim })).minCorner();
+                Rect<int, 2> srcBlocks(int2{ blocks.width(), blocks.height() });
+                copyRect(cpuBlocks[mip], blocks, srcBlocks, dstBlock);
+                gfx.update(texture, blocks, dstBlock, srcBlocks, Subresource{ mip, 0 });
+                m_uploadedBytes += blocks.dataSize();
+            }
+        }
+    }
+
+    void MaterialCache::compressionThread()
+    {
+        while (true)
+        {
+            std::shared_ptr<CompressionJob> job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_jobAvailable.wait(lock, [this] { return m_quit || !m_queuedJobs.empty(); });
+                if (m_quit) return;
+
+                job = m_queuedJobs.front();
+                m_queuedJobs.pop_front();
+            }
+
+            // The block rows of each mip are still compressed in parallel
+            bool normal         = (job->channel == MaterialChannel::Normal);
+            BlockFormat format  = normal ? NormalBlockFormat : AlbedoRoughnessBlockFormat;
+            PixelLayout layout  = normal ? PixelLayout::RG16 : PixelLayout::RGBA8;
+            for (const auto& texels : job->texels)
+            {
+                Image blocks;
+                if (texels.width() > 0)
+                {
+                    blocks = createBlockImage(format, texels.width(), texels.height(), ImageMemory::Uninitialized);
+                    compressRect(texels, layout, Rect<int, 2>(int2{ texels.width(), texels.height() }), blocks,
+                                 format, MaterialCompressionQuality);
+                }
+                job->blocks.emplace_back(blocks);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                job->done = true;
+            }
+        }
     }
 }
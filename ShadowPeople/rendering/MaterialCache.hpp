@@ -7,6 +7,15 @@
 
 #include "../graphics/Graphics.hpp"
 
+#include "AtlasAllocator.hpp"
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
 namespace rendering
 {
     enum class MaterialChannel
@@ -20,21 +29,110 @@ namespace rendering
     {
     public:
         MaterialCache(graphics::Device& device);
+        ~MaterialCache();
+
+        MaterialCache(const MaterialCache&)             = delete;
+        MaterialCache& operator=(const MaterialCache&)  = delete;
 
+        // Returns an empty rectangle, if the cache is full
         Rect<int, 2> allocate(int2 size);
+
+        // Frees the rectangle of an unloaded material
+        void free(Rect<int, 2> rect);
+
+        // Moves a few materials closer to the origin of the cache, so that the free space stays in
+        // one piece. The moves are appended to the relocations, and the materials must be patched
+        // with Scene::patchMaterialRects(). The textures are copied in the next updateGPUTextures().
+        void defragment(std::vector<AtlasRelocation>& relocations, uint32_t maxRelocations = 4);
+
+        AtlasStatistics statistics() const { return m_allocator.statistics(); }
+
+        // Nothing is written, if the material did not get a rectangle
         void preloadMaterial(graphics::Image& image, Rect<int, 2> dstRect, MaterialChannel channel);
 
+        // Converts one row of BGR(A) or gray source pixels straight into the cache. This lets
+        // decoders write into the cache without an intermediate image.
+        void preloadMaterialRow(const uint8_t* src, uint32_t srcBytesPerPixel, uint32_t pixels,
+                                int2 dstPos, MaterialChannel channel);
+
+        // A tile is the converted top mip of all the channels of a material, as stored in the
+        // asset cache. Preloading a tile skips decoding and converting the source textures.
+        // An empty destination rectangle is allocated to the size of the tile.
+        std::vector<uint8_t> materialTile(Rect<int, 2> rect) const;
+        bool preloadMaterialTile(Range<const uint8_t> tile, Rect<int, 2>& dstRect);
+
+        // Queues the materials changed since the last update for compression on the worker
+        // thread, and uploads the ones, whose compression has finished
         void updateGPUTextures(graphics::CommandBuffer& gfx);
 
+        // Bytes uploaded by the last updateGPUTextures()
+        uint64_t uploadedBytes() const { return m_uploadedBytes; }
+
         const graphics::TextureView albedoRougness() const { return m_albedoRoughnessSRV; }
         const graphics::TextureView normal() const { return m_normalSRV; }
     private:
+        struct CompressionJob;
+
+        // Changes are widened to the whole material, so that all the rows and channels of it end
+        // up in one pending rectangle
+        void markPending(std::vector<Rect<int, 2>>& pendingRects, Rect<int, 2> rect);
+
+        // Moves the CPU copies and the pending changes to the new rectangle
+        void moveMaterial(const AtlasRelocation& relocation);
+
+        // Filters the lower mips of the pending rectangles from the top mip
+        void buildMips(std::vector<graphics::Image>& mips, const std::vector<Rect<int, 2>>& pendingRects,
+                       graphics::MipFilter colorFilter, graphics::MipFilter alphaFilter);
+
+        // Copies the pending rectangles of each mip into jobs for the worker thread. The channel
+        // is Normal or Albedo, which stands for both albedo and roughness.
+        void queueCompression(MaterialChannel channel, const std::vector<graphics::Image>& mips,
+                              const std::vector<Rect<int, 2>>& pendingRects);
+
+        // Uploads the finished jobs in the order they were queued, up to the first unfinished one,
+        // so that a newer version of a material is never overwritten by an older one
+        void uploadCompressed(graphics::CommandBuffer& gfx);
+
+        void compressionThread();
+
+        AtlasAllocator          m_allocator;
+        bool                    m_compact;  // Nothing to defragment until something is freed
+
         graphics::Texture       m_albedoRoughness;
         graphics::TextureView   m_albedoRoughnessSRV;
         graphics::Texture       m_normal;
         graphics::TextureView   m_normalSRV;
 
-        graphics::Image         m_albedoRoughnessCache;
-        graphics::Image         m_normalCache;
+        // One mip of each format, through which the moved materials are copied
+        graphics::Texture       m_albedoRoughnessScratch;
+        graphics::Texture       m_normalScratch;
+
+        // Uncompressed CPU copies, where the materials are assembled channel by channel.
+        // Index 0 is the top mip, the rest are filtered from it before compression.
+        std::vector<graphics::Image> m_albedoRoughnessCache;
+        std::vector<graphics::Image> m_normalCache;
+
+        // Block compressed CPU copies of each mip, which are uploaded to the GPU
+        std::vector<graphics::Image> m_albedoRoughnessBlocks;
+        std::vector<graphics::Image> m_normalBlocks;
+
+        // Materials, which have changed since the last upload
+        std::vector<Rect<int, 2>> m_pendingAlbedoRoughness;
+        std::vector<Rect<int, 2>> m_pendingNormal;
+
+        // Materials, which have moved since the last upload
+        std::vector<AtlasRelocation> m_pendingCopies;
+        bool                    m_uploaded;
+        uint64_t                m_uploadedBytes;
+
+        // Jobs, which have not been uploaded yet, in the order they were queued. Only the render
+        // thread touches the list and the rectangles of the jobs.
+        std::deque<std::shared_ptr<CompressionJob>> m_compressionJobs;
+
+        mutable std::mutex                          m_mutex;
+        std::condition_variable                     m_jobAvailable;
+        std::deque<std::shared_ptr<CompressionJob>> m_queuedJobs;
+        bool                                        m_quit;
+        std::thread                                 m_compressionThread;
     };
 }
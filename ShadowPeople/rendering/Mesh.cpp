@@ -1,7 +1,239 @@
 #include "Mesh.hpp"
-#include "../Errors.hpp"
+#include "../Math.hpp"
+#include "../Parallel.hpp"
+#include "../Simd.hpp"
 
-//#define EXTRA_CHECKS
+#include <algorithm>
+#include <cmath>
+
+// The tangent frames are computed for four triangles or vertices at a time with SIMD, and one at
+// a time for the rest. Both do the same operations in the same order, so that the frames do not
+// depend on where a vertex lands.
+namespace
+{
+    constexpr uint32_t GroupsPerBatch = 1024;  // Of four triangles or vertices
+
+    // Area weighted unit bitangent and the signed area for the handedness. Triangles without
+    // a proper UV mapping get zero weight.
+    float4 faceFrame(const Vertex& v0, const Vertex& v1, const Vertex& v2)
+    {
+        float3 e1   = v1.position - v0.position;
+        float3 e2   = v2.position - v0.position;
+        float f1u   = v1.uv[0] - v0.uv[0];
+        float f1v   = v1.uv[1] - v0.uv[1];
+        float f2u   = v2.uv[0] - v0.uv[0];
+        float f2v   = v2.uv[1] - v0.uv[1];
+        float det   = f1u * f2v - f1v * f2u;
+
+        // Linear combinations of the edges, along which uv changes by (det, 0) and (0, det)
+        float3 b    = f2v * e1 - f1v * e2;
+        float3 t    = f1u * e2 - f2u * e1;
+        float3 n    = cross(e2, e1);
+
+        float area      = 0.5f * std::sqrt(n.dot(n));
+        float bLength   = std::sqrt(b.dot(b));
+        if (!(bLength > 0.f) || (det == 0.f)) return float4(0.f);
+
+        // The sign of det cancels out in the cross product
+        float handedness    = (n.dot(cross(b, t)) < 0.f) ? -1.f : 1.f;
+        float bScale        = static_cast<float>(math::sign(det)) * area / bLength;
+        return float4{ b[0] * bScale, b[1] * bScale, b[2] * bScale, handedness * area };
+    }
+
+    // Gram-Schmidt against the normal. Without a usable bitangent any tangent will do,
+    // from Duff et al. 2017, "Building an Orthonormal Basis, Revisited".
+    float4 vertexOrientation(const float3& normal, const float4& sum)
+    {
+        float nLength   = std::sqrt(normal.dot(normal));
+        float3 n        = (nLength > 0.f) ? float3((1.f / nLength) * normal) : float3{ 0.f, 0.f, 1.f };
+
+        float3 b        = float3{ sum[0], sum[1], sum[2] };
+        float bLengthSq = b.dot(b);
+        b = b - b.dot(n) * n;
+        float orthoLengthSq = b.dot(b);
+
+        if ((bLengthSq > 0.f) && (orthoLengthSq > 1e-8f * bLengthSq))
+        {
+            b = (1.f / std::sqrt(orthoLengthSq)) * b;
+        }
+        else
+        {
+            float s = (n[2] < 0.f) ? -1.f : 1.f;
+            float a = -1.f / (s + n[2]);
+            b = float3{ 1.f + (s * a) * (n[0] * n[0]), s * (a * (n[0] * n[1])), 0.f - s * n[0] };
+        }
+        float3 t = cross(n, b);
+
+        return Quaternion(Matrix3x3(b, t, n)).toFloat4();
+    }
+
+#ifdef SP_SIMD_FLOAT4
+    using simd::Float4;
+
+    struct Float4x3
+    {
+        Float4 x, y, z;
+    };
+
+    struct Float4x4
+    {
+        Float4 x, y, z, w;
+    };
+
+    Float4x3 sub3(const Float4x3& a, const Float4x3& b)
+    {
+        return { simd::sub(a.x, b.x), simd::sub(a.y, b.y), simd::sub(a.z, b.z) };
+    }
+
+    Float4x3 scale3(const Float4x3& a, Float4 s)
+    {
+        return { simd::mul(a.x, s), simd::mul(a.y, s), simd::mul(a.z, s) };
+    }
+
+    Float4 dot3(const Float4x3& a, const Float4x3& b)
+    {
+        return simd::add(simd::add(simd::mul(a.x, b.x), simd::mul(a.y, b.y)), simd::mul(a.z, b.z));
+    }
+
+    Float4x3 cross3(const Float4x3& a, const Float4x3& b)
+    {
+        return { simd::sub(simd::mul(a.y, b.z), simd::mul(a.z, b.y)),
+                 simd::sub(simd::mul(a.z, b.x), simd::mul(a.x, b.z)),
+                 simd::sub(simd::mul(a.x, b.y), simd::mul(a.y, b.x)) };
+    }
+
+    Float4x3 select3(Float4 mask, const Float4x3& a, const Float4x3& b)
+    {
+        return { simd::select(mask, a.x, b.x), simd::select(mask, a.y, b.y), simd::select(mask, a.z, b.z) };
+    }
+
+    Float4x4 select4(Float4 mask, const Float4x4& a, const Float4x4& b)
+    {
+        return { simd::select(mask, a.x, b.x), simd::select(mask, a.y, b.y),
+                 simd::select(mask, a.z, b.z), simd::select(mask, a.w, b.w) };
+    }
+
+    // The same float vector of four vertices, one per lane
+    Float4x3 gather3(const Vertex* const vertices[4], const float3 Vertex::* member)
+    {
+        const float3& a = vertices[0]->*member;
+        const float3& b = vertices[1]->*member;
+        const float3& c = vertices[2]->*member;
+        const float3& d = vertices[3]->*member;
+        return { simd::set(a[0], b[0], c[0], d[0]), simd::set(a[1], b[1], c[1], d[1]), simd::set(a[2], b[2], c[2], d[2]) };
+    }
+
+    // Same as faceFrame() for four triangles, whose frames are stored one after another
+    void faceFrames(const Vertex* const corners[3][4], float4* frames)
+    {
+        Float4x3 p[3];
+        Float4 u[3], v[3];
+        for (int c = 0; c < 3; c++)
+        {
+            const Vertex* const* x = corners[c];
+            p[c] = gather3(x, &Vertex::position);
+            u[c] = simd::set(x[0]->uv[0], x[1]->uv[0], x[2]->uv[0], x[3]->uv[0]);
+            v[c] = simd::set(x[0]->uv[1], x[1]->uv[1], x[2]->uv[1], x[3]->uv[1]);
+        }
+
+        Float4x3 e1 = sub3(p[1], p[0]);
+        Float4x3 e2 = sub3(p[2], p[0]);
+        Float4 f1u  = simd::sub(u[1], u[0]);
+        Float4 f1v  = simd::sub(v[1], v[0]);
+        Float4 f2u  = simd::sub(u[2], u[0]);
+        Float4 f2v  = simd::sub(v[2], v[0]);
+        Float4 det  = simd::sub(simd::mul(f1u, f2v), simd::mul(f1v, f2u));
+
+        Float4x3 b  = sub3(scale3(e1, f2v), scale3(e2, f1v));
+        Float4x3 t  = sub3(scale3(e2, f1u), scale3(e1, f2u));
+        Float4x3 n  = cross3(e2, e1);
+
+        Float4 zero         = simd::zero();
+        Float4 one          = simd::splat(1.f);
+        Float4 area         = simd::mul(simd::splat(0.5f), simd::sqrt(dot3(n, n)));
+        Float4 bLength      = simd::sqrt(dot3(b, b));
+        Float4 valid        = simd::bitAnd(simd::greater(bLength, zero), simd::notEqual(det, zero));
+
+        Float4 handedness   = simd::select(simd::greater(zero, dot3(n, cross3(b, t))), simd::splat(-1.f), one);
+        Float4 sign         = simd::sub(simd::select(simd::greater(det, zero), one, zero),
+                                        simd::select(simd::greater(zero, det), one, zero));
+        Float4 bScale       = simd::div(simd::mul(sign, area), bLength);
+
+        Float4 x = simd::select(valid, simd::mul(b.x, bScale), zero);
+        Float4 y = simd::select(valid, simd::mul(b.y, bScale), zero);
+        Float4 z = simd::select(valid, simd::mul(b.z, bScale), zero);
+        Float4 w = simd::select(valid, simd::mul(handedness, area), zero);
+        simd::transpose(x, y, z, w);
+        frames[0] = float4(x);
+        frames[1] = float4(y);
+        frames[2] = float4(z);
+        frames[3] = float4(w);
+    }
+
+    // Same as vertexOrientation() for four vertices
+    void vertexOrientations(const Vertex* const vertices[4], const float4* sums, float4* orientations)
+    {
+        Float4 zero = simd::zero();
+        Float4 one  = simd::splat(1.f);
+
+        Float4x3 n      = gather3(vertices, &Vertex::normal);
+        Float4 nLength  = simd::sqrt(dot3(n, n));
+        n = select3(simd::greater(nLength, zero), scale3(n, simd::div(one, nLength)), Float4x3{ zero, zero, one });
+
+        Float4 sx = sums[0].load();
+        Float4 sy = sums[1].load();
+        Float4 sz = sums[2].load();
+        Float4 sw = sums[3].load();
+        simd::transpose(sx, sy, sz, sw);
+
+        Float4x3 b      = { sx, sy, sz };
+        Float4 bLengthSq = dot3(b, b);
+        b = sub3(b, scale3(n, dot3(b, n)));
+        Float4 orthoLengthSq = dot3(b, b);
+
+        Float4 s        = simd::select(simd::greater(zero, n.z), simd::splat(-1.f), one);
+        Float4 a        = simd::div(simd::splat(-1.f), simd::add(s, n.z));
+        Float4x3 basis  = { simd::add(one, simd::mul(simd::mul(s, a), simd::mul(n.x, n.x))),
+                            simd::mul(s, simd::mul(a, simd::mul(n.x, n.y))),
+                            simd::sub(zero, simd::mul(s, n.x)) };
+
+        Float4 usable   = simd::bitAnd(simd::greater(bLengthSq, zero),
+                                       simd::greater(orthoLengthSq, simd::mul(simd::splat(1e-8f), bLengthSq)));
+        b = select3(usable, scale3(b, simd::div(one, simd::sqrt(orthoLengthSq))), basis);
+        Float4x3 t      = cross3(n, b);
+
+        // Same as Quaternion(Matrix3x3({ b, t, n }))
+        Float4 half     = simd::splat(0.5f);
+        Float4 qx = simd::mul(half, simd::sqrt(simd::maximum(simd::sub(simd::sub(simd::add(one, b.x), t.y), n.z), zero)));
+        Float4 qy = simd::mul(half, simd::sqrt(simd::maximum(simd::sub(simd::add(simd::sub(one, b.x), t.y), n.z), zero)));
+        Float4 qz = simd::mul(half, simd::sqrt(simd::maximum(simd::add(simd::sub(simd::sub(one, b.x), t.y), n.z), zero)));
+        Float4 qw = simd::mul(half, simd::sqrt(simd::maximum(simd::add(simd::add(simd::add(one, b.x), t.y), n.z), zero)));
+
+        Float4 largest  = simd::maximum(simd::maximum(qx, qy), simd::maximum(qz, qw));
+        Float4 scale    = simd::div(simd::splat(0.25f), largest);
+        Float4 wx       = simd::mul(simd::sub(t.z, n.y), scale);
+        Float4 wy       = simd::mul(simd::sub(n.x, b.z), scale);
+        Float4 wz       = simd::mul(simd::sub(b.y, t.x), scale);
+        Float4 xy       = simd::mul(simd::add(b.y, t.x), scale);
+        Float4 xz       = simd::mul(simd::add(b.z, n.x), scale);
+        Float4 yz       = simd::mul(simd::add(t.z, n.y), scale);
+
+        // Ties go to w, then x, y and z
+        Float4x4 q  = { xz, yz, largest, wz };
+        q = select4(simd::equal(qy, largest), Float4x4{ xy, largest, yz, wy }, q);
+        q = select4(simd::equal(qx, largest), Float4x4{ largest, xy, xz, wx }, q);
+        q = select4(simd::equal(qw, largest), Float4x4{ wx, wy, wz, largest }, q);
+
+        Float4 flip = simd::select(simd::greater(zero, q.w), simd::splat(-1.f), one);
+        q = { simd::mul(q.x, flip), simd::mul(q.y, flip), simd::mul(q.z, flip), simd::mul(q.w, flip) };
+        simd::transpose(q.x, q.y, q.z, q.w);
+        orientations[0] = float4(q.x);
+        orientations[1] = float4(q.y);
+        orientations[2] = float4(q.z);
+        orientations[3] = float4(q.w);
+    }
+#endif
+}
 
 namespace rendering
 {
@@ -10,117 +242,99 @@ namespace rendering
 		fill(vertices, indices);
 	}
 
-	void Mesh::fill(Range<Vertex> vertices, Range<uint32_t> indices)
+	void Mesh::fill(Range<Vertex> vertices, Range<uint32_t> indices, Range<const MeshLod> lods)
 	{
 		m_vertices.clear();
 		m_indices.clear();
+        m_meshlets.clear();
 		m_vertices.insert(m_vertices.end(), vertices.begin(), vertices.end());
 		m_indices.insert(m_indices.end(), indices.begin(), indices.end());
+        m_lods.assign(lods.begin(), lods.end());
 
         calculateOrientations();
 	}
 
+    void Mesh::assign(Range<const Vertex> vertices, Range<const uint32_t> indices, Range<const Meshlet> meshlets,
+                      Range<const MeshLod> lods)
+    {
+        m_vertices.assign(vertices.begin(), vertices.end());
+        m_indices.assign(indices.begin(), indices.end());
+        m_meshlets.assign(meshlets.begin(), meshlets.end());
+        m_lods.assign(lods.begin(), lods.end());
+    }
+
+    // The bitangent points towards increasing u, and the frame is bent to match the vertex normal,
+    // which might be non-geometric. Each vertex averages the bitangents of all its triangles,
+    // weighted by their areas.
     void Mesh::calculateOrientations()
     {
-        for (int i = 0; i < m_indices.size(); i += 3)
+        // The simplified levels reuse the vertices, so they must not change the orientations
+        uint32_t numIndices     = static_cast<uint32_t>(m_lods.empty() ? m_indices.size() : m_lods[0].numIndices);
+        uint32_t numTriangles   = numIndices / 3;
+        uint32_t numVertices    = static_cast<uint32_t>(m_vertices.size());
+        uint32_t triangleGroups = (numTriangles + 3) / 4;
+        uint32_t vertexGroups   = (numVertices + 3) / 4;
+
+        // Frames of the triangles, which are summed up to their corners
+        std::vector<float4> faces(numTriangles);
+        parallelFor(triangleGroups, GroupsPerBatch, [&](uint32_t begin, uint32_t end)
         {
-            uint32_t i0 = m_indices[i + 0];
-            uint32_t i1 = m_indices[i + 1];
-            uint32_t i2 = m_indices[i + 2];
-
-            // Triangle corners
-            float3 p0   = m_vertices[i0].position;
-            float3 p1   = m_vertices[i1].position;
-            float3 p2   = m_vertices[i2].position;
-
-            // Two edges
-            float3 e1   = p1 - p0;
-            float3 e2   = p2 - p0;
-            
-            // Normal
-            float3 n = normalize(cross(e2, e1));
-
-            // UV corners
-            float2 uv0  = m_vertices[i0].uv;
-            float2 uv1  = m_vertices[i1].uv;
-            float2 uv2  = m_vertices[i2].uv;
-
-            // UV edges
-            float2 f1   = uv1 - uv0;
-            float2 f2   = uv2 - uv0;
-
-            // Bitangent candidate - can be found as a linear combination of the two edges, so that uv = (1, 0)
-            float det   = f1[0] * f2[1] - f1[1] * f2[0];
-            float c1    = f2[1] / det;
-            float c2    = -f1[1] / det;
-
-            float3 b    = normalize(c1 * e1 + c2 * e2);
-
-#if EXTRA_CHECKS
-            const float Epsilon = 1e-1f;
-
-            float2 uu = c1 * f1 + c2 * f2;
-            if (fabs(uu[0] - 1.f) > Epsilon || fabs(uu[1]) > Epsilon)
+            for (uint32_t group = begin; group < end; group++)
             {
-                std::string msg("Fail: ");
-                msg.append(std::to_string(uu[0])).append(" ");
-                msg.append(std::to_string(uu[1])).append("\n");
-                OutputDebugString(msg.c_str());
-            }
+                uint32_t first  = group * 4;
+                uint32_t last   = std::min(first + 4, numTriangles);
+#ifdef SP_SIMD_FLOAT4
+                if (last - first == 4)
+                {
+                    const Vertex* corners[3][4];
+                    for (uint32_t lane = 0; lane < 4; lane++)
+                    {
+                        for (int c = 0; c < 3; c++) corners[c][lane] = &m_vertices[m_indices[(first + lane) * 3 + c]];
+                    }
+                    faceFrames(corners, &faces[first]);
+                    continue;
+                }
 #endif
-            
-            // Tangent candidate            
-            float d1    = -f2[0] / det;
-            float d2    = f1[0] / det;
-
-            float3 t    = normalize(d1 * e1 + d2 * e2);
-
-#if EXTRA_CHECKS
-            float2 vv = d1 * f1 + d2 * f2;
-            if (fabs(vv[0]) > Epsilon || fabs(vv[1] - 1.f) > Epsilon)
-            {
-                std::string msg("Fail: ");
-                msg.append(std::to_string(vv[0])).append(" ");
-                msg.append(std::to_string(vv[1])).append("\n");
-                OutputDebugString(msg.c_str());
+                for (uint32_t t = first; t < last; t++)
+                {
+                    faces[t] = faceFrame(m_vertices[m_indices[t * 3]], m_vertices[m_indices[t * 3 + 1]],
+                                         m_vertices[m_indices[t * 3 + 2]]);
+                }
             }
+        });
 
-            // Chech orthogonality            
-            float nt = n.dot(t);
-            float nb = n.dot(b);
-            float tb = t.dot(b);
-            if (fabs(nt) > Epsilon || fabs(nb) > Epsilon || fabs(tb) > Epsilon)
+        // Scattering the triangles to their corners is a single pass over the indices. Splitting it
+        // between threads would need atomics or a vertex to triangle adjacency, which costs more.
+        std::vector<float4> sums(numVertices, float4(0.f));
+        for (uint32_t i = 0; i < numIndices; i++) sums[m_indices[i]] += faces[i / 3];
+
+        parallelFor(vertexGroups, GroupsPerBatch, [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t group = begin; group < end; group++)
             {
-                std::string msg("Orthogonality broken: ");
-                msg.append(std::to_string(nt)).append(" ");
-                msg.append(std::to_string(nb)).append(" ");
-                msg.append(std::to_string(tb)).append("\n");
-                OutputDebugString(msg.c_str());
-            }
+                uint32_t first  = group * 4;
+                uint32_t last   = std::min(first + 4, numVertices);
+#ifdef SP_SIMD_FLOAT4
+                if (last - first == 4)
+                {
+                    const Vertex* vertices[4] = { &m_vertices[first], &m_vertices[first + 1],
+                                                  &m_vertices[first + 2], &m_vertices[first + 3] };
+                    float4 orientations[4];
+                    vertexOrientations(vertices, &sums[first], orientations);
+                    for (uint32_t lane = 0; lane < 4; lane++)
+                    {
+                        m_vertices[first + lane].orientation    = orientations[lane];
+                        m_vertices[first + lane].bitangentSign  = (sums[first + lane][3] < 0.f) ? -1.f : 1.f;
+                    }
+                    continue;
+                }
 #endif
-
-            // Check for UV-mirroring
-            float bitangentSign = (n.dot(cross(b, t)) < 0.f) ? -1.f : 1.f;
-            //b *= bitangentSign;
-
-            // Bend the tangent frames to match the vertex normals
-            float3 b0   = normalize(b - b.dot(m_vertices[i0].normal) * m_vertices[i0].normal);
-            float3 b1   = normalize(b - b.dot(m_vertices[i1].normal) * m_vertices[i1].normal);
-            float3 b2   = normalize(b - b.dot(m_vertices[i2].normal) * m_vertices[i2].normal);            
-
-            // Tangent
-            float3 t0   = cross(m_vertices[i0].normal, b0);
-            float3 t1   = cross(m_vertices[i1].normal, b1);
-            float3 t2   = cross(m_vertices[i2].normal, b2);
-
-            // Pack in quaternion
-            m_vertices[i0].orientation = Quaternion(Matrix3x3({b0, t0, m_vertices[i0].normal/*b, t, n*/})).toFloat4();
-            m_vertices[i1].orientation = Quaternion(Matrix3x3({b1, t1, m_vertices[i1].normal/*b, t, n*/})).toFloat4();
-            m_vertices[i2].orientation = Quaternion(Matrix3x3({b2, t2, m_vertices[i2].normal/*b, t, n*/})).toFloat4();
-
-            m_vertices[i0].bitangentSign = bitangentSign;
-            m_vertices[i1].bitangentSign = bitangentSign;
-            m_vertices[i2].bitangentSign = bitangentSign;
-        }
+                for (uint32_t v = first; v < last; v++)
+                {
+                    m_vertices[v].orientation   = vertexOrientation(m_vertices[v].normal, sums[v]);
+                    m_vertices[v].bitangentSign = (sums[v][3] < 0.f) ? -1.f : 1.f;
+                }
+            }
+        });
     }
 }
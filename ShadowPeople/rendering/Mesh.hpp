@@ -11,21 +11,58 @@
 
 namespace rendering
 {
+    constexpr uint32_t MeshletMaxVertices   = 64;
+    constexpr uint32_t MeshletMaxTriangles  = 124;
+    constexpr uint32_t MeshMaxLods          = 5;
+
+    // Cluster of nearby triangles, which is culled as a unit. The triangles of a meshlet are
+    // contiguous in the index buffer.
+    struct Meshlet
+    {
+        uint32_t    firstIndex;
+        uint32_t    numIndices;
+        float3      center;         // Bounding sphere
+        float       radius;
+        float3      coneAxis;       // All the triangles face away from the eye, if
+        float       coneCutoff;     // dot(center - eye, coneAxis) >= coneCutoff * |center - eye| + radius
+    };
+
+    // Level of detail. The indices of all the levels share the vertices, and are stored one level after
+    // another, the full mesh first. The error is the distance of the simplified surface from the full one.
+    struct MeshLod
+    {
+        uint32_t    firstIndex;
+        uint32_t    numIndices;
+        float       error;
+    };
+
 	class Mesh
 	{
 	public:
 		Mesh() = default;
 		Mesh(Range<Vertex> vertices, Range<uint32_t> indices);
 
-		void fill(Range<Vertex> vertices, Range<uint32_t> indices);
+        // Indices contain all the levels of detail, if any. Orientations come from the full mesh.
+		void fill(Range<Vertex> vertices, Range<uint32_t> indices, Range<const MeshLod> lods = Range<const MeshLod>());
+
+        // Vertices already have their orientations, e.g. when read from the asset cache
+        void assign(Range<const Vertex> vertices, Range<const uint32_t> indices, Range<const Meshlet> meshlets,
+                    Range<const MeshLod> lods);
+
+        // Meshlets refer to the indices, so they are set after them
+        void setMeshlets(std::vector<Meshlet>&& meshlets) { m_meshlets = std::move(meshlets); }
 
         // TODO: Make these const ranges
         const std::vector<Vertex>& vertices() const { return m_vertices; }
         const std::vector<uint32_t>& indices() const { return m_indices; }
+        const std::vector<Meshlet>& meshlets() const { return m_meshlets; }
+        const std::vector<MeshLod>& lods() const { return m_lods; }
 	private:
         void calculateOrientations();
 
 		std::vector<Vertex>		m_vertices;
 		std::vector<uint32_t>	m_indices;
+        std::vector<Meshlet>    m_meshlets;
+        std::vector<MeshLod>    m_lods;
 	};
 }
@@ -0,0 +1,249 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    PageResidency.cpp
+*/
+
+#include "PageResidency.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace rendering
+{
+    PageResidency::PageResidency(int2 sizeInPages, int2 physicalPages) :
+        m_physicalPages(physicalPages),
+        m_physical(static_cast<size_t>(physicalPages[0] * physicalPages[1])),
+        m_freePhysical(static_cast<uint32_t>(physicalPages[0] * physicalPages[1])),
+        m_residentPages(0),
+        m_frame(1),
+        m_evictions(0)
+    {
+        int2 size = sizeInPages;
+        while (true)
+        {
+            Mip mip;
+            mip.size = size;
+            mip.slots.assign(static_cast<size_t>(size[0] * size[1]), -1);
+            mip.indirection.setDimensions(32, static_cast<uint16_t>(size[0]), static_cast<uint16_t>(size[1]));
+            m_mips.emplace_back(std::move(mip));
+
+            if (((size[0] == 1) && (size[1] == 1)) || (m_mips.size() == VirtualMaxMipLevels)) break;
+            size = int2{ std::max<int>((size[0] + 1) / 2, 1), std::max<int>((size[1] + 1) / 2, 1) };
+        }
+
+        // Nothing has been loaded, so the whole table starts out changed
+        for (auto& mip : m_mips) mip.changes.emplace_back(Rect<int, 2>(mip.size));
+    }
+
+    void PageResidency::beginFrame()
+    {
+        m_frame++;
+        m_requests.clear();
+
+        // The coarsest mip is always wanted
+        const Mip& top = m_mips.back();
+        for (int y = 0; y < top.size[1]; y++)
+        {
+            for (int x = 0; x < top.size[0]; x++)
+            {
+                VirtualPageId page(x, y, mipLevels() - 1);
+                if (!resident(page) && (m_loading.count(page.id) == 0)) m_requests[page.id]++;
+            }
+        }
+    }
+
+    void PageResidency::processFeedback(Range<const uint32_t> feedback)
+    {
+        // Most of the feedback is the same few pages, so each page is walked up the mips only once
+        std::unordered_map<uint32_t, uint32_t> counts;
+        for (auto entry : feedback)
+        {
+            if ((entry != VirtualFeedbackNone) && validPage(VirtualPageId(entry))) counts[entry]++;
+        }
+
+        for (const auto& count : counts)
+        {
+            // The ancestors are the fallbacks of the page, so they are used too
+            for (VirtualPageId page(count.first); ; page = page.parent())
+            {
+                int slot = slotOf(page);
+                if (slot >= 0)
+                {
+                    m_physical[slot].lastUsed = m_frame;
+                }
+                else if (m_loading.count(page.id) == 0)
+                {
+                    m_requests[page.id] += count.second;
+                }
+                if (page.mip() + 1 >= mipLevels()) break;
+            }
+        }
+    }
+
+    void PageResidency::pagesToLoad(std::vector<VirtualPageId>& pages, uint32_t maxPages)
+    {
+        std::vector<std::pair<uint32_t, uint32_t>> requests(m_requests.begin(), m_requests.end());
+        size_t numPages = std::min<size_t>(maxPages, requests.size());
+        std::partial_sort(requests.begin(), requests.begin() + numPages, requests.end(),
+                          [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b)
+        {
+            uint32_t mipA = VirtualPageId(a.first).mip();
+            uint32_t mipB = VirtualPageId(b.first).mip();
+            if (mipA != mipB) return mipA > mipB;
+            if (a.second != b.second) return a.second > b.second;
+            return a.first < b.first;
+        });
+
+        for (size_t i = 0; i < numPages; i++)
+        {
+            pages.emplace_back(VirtualPageId(requests[i].first));
+            m_loading.insert(requests[i].first);
+            m_requests.erase(requests[i].first);
+        }
+    }
+
+    bool PageResidency::pageLoaded(VirtualPageId page, int2& physicalPage)
+    {
+        auto loading = m_loading.find(page.id);
+        if (loading == m_loading.end()) return false;
+        m_loading.erase(loading);
+
+        if (!validPage(page) || (slotOf(page) >= 0)) return false;
+
+        int slot = m_freePhysical.allocate();
+        if (slot < 0)
+        {
+            slot = evictionCandidate();
+            if (slot < 0) return false;
+            evict(slot);
+        }
+
+        m_physical[slot].page       = page;
+        m_physical[slot].lastUsed   = m_frame;
+        slotOf(page)                = slot;
+        m_residentPages++;
+        updateIndirection(page);
+
+        physicalPage = int2{ slot % m_physicalPages[0], slot / m_physicalPages[0] };
+        return true;
+    }
+
+    void PageResidency::pageFailed(VirtualPageId page)
+    {
+        m_loading.erase(page.id);
+    }
+
+    bool PageResidency::resident(VirtualPageId page) const
+    {
+        return validPage(page) && (slotOf(page) >= 0);
+    }
+
+    PageResidencyStatistics PageResidency::statistics() const
+    {
+        PageResidencyStatistics statistics;
+        statistics.residentPages    = m_residentPages;
+        statistics.loadingPages     = static_cast<uint32_t>(m_loading.size());
+        statistics.requestedPages   = static_cast<uint32_t>(m_requests.size());
+        statistics.evictions        = m_evictions;
+        return statistics;
+    }
+
+    void PageResidency::clearIndirectionChanges()
+    {
+        for (auto& mip : m_mips) mip.changes.clear();
+    }
+
+    bool PageResidency::validPage(VirtualPageId page) const
+    {
+        if (page.mip() >= mipLevels()) return false;
+        int2 size = m_mips[page.mip()].size;
+        return (static_cast<int>(page.x()) < size[0]) && (static_cast<int>(page.y()) < size[1]);
+    }
+
+    int& PageResidency::slotOf(VirtualPageId page)
+    {
+        Mip& mip = m_mips[page.mip()];
+        return mip.slots[page.y() * mip.size[0] + page.x()];
+    }
+
+    int PageResidency::slotOf(VirtualPageId page) const
+    {
+        const Mip& mip = m_mips[page.mip()];
+        return mip.slots[page.y() * mip.size[0] + page.x()];
+    }
+
+    int PageResidency::evictionCandidate() const
+    {
+        // Least recently used, and the finer mip of equally old pages, because it is the cheaper
+        // one to lose
+        int candidate = -1;
+        for (int slot = 0; slot < static_cast<int>(m_physical.size()); slot++)
+        {
+            const PhysicalPage& physical = m_physical[slot];
+            if ((physical.page.id == VirtualFeedbackNone) || (physical.lastUsed >= m_frame) ||
+                (physical.page.mip() + 1 >= mipLevels())) continue;
+
+            if ((candidate < 0) || (physical.lastUsed < m_physical[candidate].lastUsed) ||
+                ((physical.lastUsed == m_physical[candidate].lastUsed) &&
+                 (physical.page.mip() < m_physical[candidate].page.mip())))
+            {
+                candidate = slot;
+            }
+        }
+        return candidate;
+    }
+
+    void PageResidency::evict(int slot)
+    {
+        VirtualPageId page = m_physical[slot].page;
+        slotOf(page) = -1;
+        m_physical[slot] = PhysicalPage();
+        m_residentPages--;
+        m_evictions++;
+        updateIndirection(page);
+    }
+
+    void PageResidency::updateIndirection(VirtualPageId page)
+    {
+        // The area of the page in each finer mip, from the page downwards, so that each entry
+        // can copy the entry of its parent
+        for (int mip = static_cast<int>(page.mip()); mip >= 0; mip--)
+        {
+            int shift   = static_cast<int>(page.mip()) - mip;
+            Mip& level  = m_mips[mip];
+            int x0      = static_cast<int>(page.x()) << shift;
+            int y0      = static_cast<int>(page.y()) << shift;
+            int x1      = std::min<int>(x0 + (1 << shift), level.size[0]);
+            int y1      = std::min<int>(y0 + (1 << shift), level.size[1]);
+            if ((x0 >= x1) || (y0 >= y1)) break;
+
+            uint8_t* entries = level.indirection.asRange<uint8_t>().begin();
+            const uint8_t* parentEntries = (mip + 1 < static_cast<int>(mipLevels())) ?
+                m_mips[mip + 1].indirection.data() : nullptr;
+            for (int y = y0; y < y1; y++)
+            {
+                for (int x = x0; x < x1; x++)
+                {
+                    uint8_t* entry = entries + level.indirection.byteOffset(x, y);
+                    int slot = level.slots[y * level.size[0] + x];
+                    if (slot >= 0)
+                    {
+                        entry[0] = static_cast<uint8_t>(slot % m_physicalPages[0]);
+                        entry[1] = static_cast<uint8_t>(slot / m_physicalPages[0]);
+                        entry[2] = static_cast<uint8_t>(mip);
+                        entry[3] = 1;
+                    }
+                    else if (parentEntries)
+                    {
+                        memcpy(entry, parentEntries + m_mips[mip + 1].indirection.byteOffset(x / 2, y / 2), 4);
+                    }
+                    else
+                    {
+                        memset(entry, 0, 4);
+                    }
+                }
+            }
+            level.changes.emplace_back(Rect<int, 2>(int2{ x0, y0 }, int2{ x1 - x0, y1 - y0 }));
+        }
+    }
+}
@@ -0,0 +1,140 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    PageResidency.hpp
+
+    Decides which pages of a virtual texture are in the physical page cache.
+    The renderer writes the pages it wants to sample into a feedback buffer
+    (see cpugpu/VirtualTextureTypes.h), and the missing ones are loaded in
+    order of importance: coarser mips first, because the finer ones fall back
+    to them, and then the most requested ones. When the cache is full, the
+    least recently used page is evicted. The coarsest mip is a single page,
+    which is never evicted, so there is always something to fall back to.
+
+    The indirection table is kept up to date on the CPU, and the changed
+    entries are collected for upload. There is no dependency on the device,
+    so the residency can be driven with synthetic feedback.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "../Types.hpp"
+#include "../FreeList.hpp"
+#include "../graphics/Image.hpp"
+#include "../cpugpu/VirtualTextureTypes.h"
+
+namespace rendering
+{
+    // Same bits as a feedback entry
+    struct VirtualPageId
+    {
+        uint32_t id;
+
+        VirtualPageId(uint32_t x, uint32_t y, uint32_t mip)
+        {
+            id = (x & VirtualPageCoordMask) |
+                 ((y & VirtualPageCoordMask) << VirtualPageCoordBits) |
+                 (mip << (2 * VirtualPageCoordBits));
+        }
+        explicit VirtualPageId(uint32_t id) : id(id) {}
+
+        bool operator==(const VirtualPageId& pageId) const noexcept
+        {
+            return id == pageId.id;
+        }
+
+        uint32_t x() const              { return id & VirtualPageCoordMask; }
+        uint32_t y() const              { return (id >> VirtualPageCoordBits) & VirtualPageCoordMask; }
+        uint32_t mip() const            { return id >> (2 * VirtualPageCoordBits); }
+        VirtualPageId parent() const    { return VirtualPageId(x() / 2, y() / 2, mip() + 1); }
+    };
+
+    struct PageResidencyStatistics
+    {
+        uint32_t    residentPages;
+        uint32_t    loadingPages;
+        uint32_t    requestedPages;     // Missing pages requested in this frame
+        uint64_t    evictions;          // Since the start
+    };
+
+    class PageResidency
+    {
+    public:
+        // The virtual texture is sizeInPages at mip 0, and has mips down to a single page. The
+        // cache holds physicalPages[0] x physicalPages[1] pages.
+        PageResidency(int2 sizeInPages, int2 physicalPages);
+
+        uint32_t mipLevels() const { return static_cast<uint32_t>(m_mips.size()); }
+        int2 sizeInPages(uint32_t mip) const { return m_mips[mip].size; }
+
+        // Pages used in a frame are not evicted before the next one begins
+        void beginFrame();
+
+        // Marks the requested resident pages and their ancestors used, and counts the requests for
+        // the missing ones. Entries outside the virtual texture are ignored.
+        void processFeedback(Range<const uint32_t> feedback);
+
+        // Appends at most maxPages missing pages to load, most important first. They are loading
+        // until pageLoaded() or pageFailed() is called for them.
+        void pagesToLoad(std::vector<VirtualPageId>& pages, uint32_t maxPages);
+
+        // Returns the physical page to write the loaded page to. Returns false, if the page is
+        // no longer loading, or if all the physical pages are used in this frame. The page is
+        // then requested again, when it is needed.
+        bool pageLoaded(VirtualPageId page, int2& physicalPage);
+        void pageFailed(VirtualPageId page);
+
+        bool resident(VirtualPageId page) const;
+
+        PageResidencyStatistics statistics() const;
+
+        // RGBA8 images, one texel per page
+        const graphics::Image& indirection(uint32_t mip) const { return m_mips[mip].indirection; }
+
+        // Rectangles of the indirection mip, which have changed since clearIndirectionChanges()
+        const std::vector<Rect<int, 2>>& indirectionChanges(uint32_t mip) const { return m_mips[mip].changes; }
+        void clearIndirectionChanges();
+    private:
+        bool validPage(VirtualPageId page) const;
+        int& slotOf(VirtualPageId page);
+        int slotOf(VirtualPageId page) const;
+
+        // Index of the physical page to reuse, or -1
+        int evictionCandidate() const;
+        void evict(int slot);
+
+        // Points the page and all the non-resident pages below it to the nearest resident page
+        void updateIndirection(VirtualPageId page);
+
+        struct Mip
+        {
+            int2                        size;
+            std::vector<int>            slots;          // Physical page of each page, or -1
+            graphics::Image             indirection;
+            std::vector<Rect<int, 2>>   changes;
+        };
+
+        struct PhysicalPage
+        {
+            VirtualPageId   page = VirtualPageId(VirtualFeedbackNone);
+            uint64_t        lastUsed = 0;
+        };
+
+        int2                                    m_physicalPages;
+        std::vector<Mip>                        m_mips;
+        std::vector<PhysicalPage>               m_physical;
+        FreeList                                m_freePhysical;
+        uint32_t                                m_residentPages;
+
+        uint64_t                                m_frame;
+        uint64_t                                m_evictions;
+
+        // Requests of the missing pages in this frame
+        std::unordered_map<uint32_t, uint32_t>  m_requests;
+        std::unordered_set<uint32_t>            m_loading;
+    };
+}
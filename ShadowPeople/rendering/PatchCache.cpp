@@ -21,7 +21,8 @@ namespace rendering
 
         for (uint32_t i = 0; i < PatchMipLevels; i++)
         {
-            m_patchDataCPU[i].setDimensions(16, PatchCacheSize, PatchCacheSize);
+            // Each layer is several megabytes and lives as long as the cache, so large pages save TLB misses
+            m_patchDataCPU[i].setDimensions(16, PatchCacheSize, PatchCacheSize, 1, ImageMemory::LargePages);
         }
 
         m_patchMetadata = device.createBuffer(desc::Buffer()
@@ -185,7 +185,8 @@ namespace rendering
     {
         std::uniform_real_distribution<float> dist(-patch.steepness, patch.steepness);
 
-        float amplitude     = MaxAmplitude * powf(0.5f, static_cast<float>(patch.id.mip() + 7));
+        // Halves with each level. Exact, and much cheaper than powf().
+        float amplitude     = ldexpf(MaxAmplitude, -(patch.id.mip() + 7));
 
         const Image& pLayer = m_patchCache.patchData(patch.id.mip() - 1);
         
@@ -2,17 +2,37 @@
 
 namespace rendering
 {
-    int Scene::addObject(Object& object)
+    int Scene::addObject(const Object& object)
     {
         int index = static_cast<int>(m_geometry.size());
         m_geometry.emplace_back(object);
         return index;
     }
 
-    int Scene::addMaterial(Material& material)
+    int Scene::addObjects(uint32_t count)
+    {
+        int index = static_cast<int>(m_geometry.size());
+        m_geometry.resize(m_geometry.size() + count);
+        return index;
+    }
+
+    int Scene::addMaterial(const Material& material)
     {
         int index = static_cast<int>(m_materials.size());
         m_materials.emplace_back(material);
         return index;
     }
+
+    void Scene::patchMaterialRects(const std::vector<AtlasRelocation>& relocations)
+    {
+        // In order, because a material can move into the place of another one that moved earlier.
+        // Several materials can share a rectangle, so all of them are patched.
+        for (const auto& relocation : relocations)
+        {
+            for (auto& material : m_materials)
+            {
+                if (material.materialRect == relocation.from) material.materialRect = relocation.to;
+            }
+        }
+    }
 }
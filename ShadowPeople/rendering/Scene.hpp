@@ -8,6 +8,7 @@
 #include <vector>
 
 #include "../Types.hpp"
+#include "AtlasAllocator.hpp"
 
 namespace rendering
 {
@@ -16,7 +17,7 @@ namespace rendering
     struct Transform
     {
         float3      position;
-        float       scale;
+        float       scale = 1.f;
         Quaternion  rotation;
     };
 
@@ -25,6 +26,7 @@ namespace rendering
         int2        meshStartSize;
         Transform   transform;
 
+        Object() = default;
         Object(int2 meshStartSize, Transform transform) :
             meshStartSize(meshStartSize),
             transform(transform)
@@ -51,10 +53,20 @@ namespace rendering
 
         const Camera& camera() const { return m_camera; }
 
-        int addObject(Object& object);
-        int addMaterial(Material& material);
+        int addObject(const Object& object);
+        int addMaterial(const Material& material);
 
-        const std::vector<Object> objects() const { return m_geometry; }
+        // Adds default objects in bulk with one allocation, and returns the index of the first one.
+        // Objects without a mesh, i.e. with zero size, are not drawn.
+        int addObjects(uint32_t count);
+
+        Object& object(int index) { return m_geometry[index]; }
+        const std::vector<Object>& objects() const { return m_geometry; }
+
+        Material& material(int index) { return m_materials[index]; }
+
+        // Points the materials to their new rectangles, after the material cache has moved them
+        void patchMaterialRects(const std::vector<AtlasRelocation>& relocations);
     private:
         std::vector<Object>     m_geometry;
         std::vector<Material>   m_materials;
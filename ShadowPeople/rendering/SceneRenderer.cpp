@@ -12,6 +12,7 @@
 
 #include "../shaders/Lighting.if.h"
 #include "../shaders/GeometryRenderer.if.h"
+#include "../shaders/PackedGeometryRenderer.if.h"
 #include "../shaders/PatchRenderer.if.h"
 
 #include "../imgui/imgui.h"
@@ -52,6 +53,15 @@ namespace rendering
 				.depthTestingEnable(true)
 				.depthFunc(desc::ComparisonMode::Less)));
 
+        m_packedGeometryRenderingPipeline = device.createGraphicsPipeline(desc::GraphicsPipeline()
+            .binding<shaders::PackedGeometryRenderer>()
+            .setPrimitiveTopology(desc::PrimitiveTopology::TriangleList)
+            .numRenderTargets(1)
+            .rasterizerState(desc::RasterizerState().cullMode(desc::CullMode::Front))
+            .depthStencilState(desc::DepthStencilState()
+                .depthTestingEnable(true)
+                .depthFunc(desc::ComparisonMode::Less)));
+
         m_patchRenderingPipeline = device.createGraphicsPipeline(desc::GraphicsPipeline()
             .binding<shaders::PatchRenderer>()
             .setPrimitiveTopology(desc::PrimitiveTopology::TriangleList)
@@ -61,14 +71,14 @@ namespace rendering
                 .depthWriteEnable(true)
                 .depthFunc(desc::ComparisonMode::Less)));
 
-        m_bilinearSampler = device.createSampler(desc::Sampler()
-            .type(desc::SamplerType::Bilinear)
-            .name("Scene renderer bilinear sampler"));
+        m_trilinearSampler = device.createSampler(desc::Sampler()
+            .type(desc::SamplerType::Trilinear)
+            .name("Scene renderer trilinear sampler"));
 	}
 
 	void SceneRenderer::render(CommandBuffer& gfx, const Scene& scene)
 	{
-		culling(gfx, scene.camera());
+		culling(gfx, scene.camera(), scene);
 		geometryRendering(gfx, scene.camera(), scene);
 		lighting(gfx, scene.camera());
 		postprocess(gfx);
@@ -76,15 +86,15 @@ namespace rendering
 		gfx.copyToBackBuffer(m_outputImage.output);
 	}
 
-	void SceneRenderer::culling(CommandBuffer& gfx, const Camera& camera)
+	void SceneRenderer::culling(CommandBuffer& gfx, const Camera& camera, const Scene& scene)
 	{
-        
+        m_clusterCuller.cull(camera, scene, m_geometry, m_screenSize[1]);
 	}
 	
 	void SceneRenderer::geometryRendering(CommandBuffer& gfx, const Camera& camera, const Scene& scene)
 	{
         m_geometry.updateGPUBuffers(gfx);
-        m_materials.updateGPUTextures(gfx); // TODO: This is too heavy
+        m_materials.updateGPUTextures(gfx);
         m_patches.updateGPUBuffersAndTextures(gfx);
 
 		m_screenBuffers.clear(gfx);
@@ -103,19 +113,63 @@ namespace rendering
         }
         */
 
-        gfx.setIndexBuffer(m_geometry.indexBuffer());
-
-        for (const auto& obj : scene.objects())
-		{
-			auto binding = m_geometryRenderingPipeline.bind<shaders::GeometryRenderer>(gfx);
+        const auto& objects = scene.objects();
+        const auto& draws   = m_clusterCuller.draws();
+        const auto& ranges  = m_clusterCuller.ranges();
 
-			binding->constants.view     = camera.viewMatrix();
-			binding->constants.proj     = camera.projectionMatrix();
-            binding->constants.camNear  = camera.nearZ();
-            binding->vertexBuffer       = m_geometry.vertexBuffer();
+        auto setConstants = [&](auto& binding, const ObjectDraw& draw, const MeshPlacement& placement)
+        {
+            const Transform& transform = objects[draw.object].transform;
+
+            binding->constants.view             = camera.viewMatrix();
+            binding->constants.proj             = camera.projectionMatrix();
+            binding->constants.camNear          = camera.nearZ();
+            binding->constants.baseVertex       = placement.baseVertex;
+            binding->constants.objectRotation   = transform.rotation.toFloat4();
+            binding->constants.objectPosition   = transform.position;
+            binding->constants.objectScale      = transform.scale;
+            binding->vertexBuffer               = m_geometry.vertexBuffer();
+        };
+
+        m_placements.resize(draws.size());
+        for (size_t d = 0; d < draws.size(); d++)
+        {
+            m_placements[d] = m_geometry.placement(objects[draws[d].object].meshStartSize);
+        }
 
-			gfx.drawIndexed(*binding, obj.meshStartSize[1], obj.meshStartSize[0], 0);
-		}
+        // Meshes with few vertices are in the 16-bit index buffer, and the rest in the 32-bit one.
+        // Each object is bound once, and all its visible ranges drawn with the same constants.
+        bool packed = (m_geometry.vertexFormat() == VertexFormat::Packed);
+        for (bool shortIndices : { true, false })
+        {
+            gfx.setIndexBuffer(shortIndices ? m_geometry.shortIndexBuffer() : m_geometry.indexBuffer());
+
+            for (size_t d = 0; d < draws.size(); d++)
+            {
+                const MeshPlacement* placement = m_placements[d];
+                if (!placement || (placement->shortIndices != shortIndices)) continue;
+
+                const ObjectDraw& draw = draws[d];
+                Range<const graphics::IndexRange> drawRanges(&ranges[draw.firstRange],
+                                                             draw.numRanges * sizeof(graphics::IndexRange));
+                if (packed)
+                {
+                    auto binding = m_packedGeometryRenderingPipeline.bind<shaders::PackedGeometryRenderer>(gfx);
+                    setConstants(binding, draw, *placement);
+                    binding->constants.positionOffset   = placement->positionOffset;
+                    binding->constants.positionScale    = placement->positionScale;
+
+                    gfx.drawIndexed(*binding, drawRanges, 0);
+                }
+                else
+                {
+                    auto binding = m_geometryRenderingPipeline.bind<shaders::GeometryRenderer>(gfx);
+                    setConstants(binding, draw, *placement);
+
+                    gfx.drawIndexed(*binding, drawRanges, 0);
+                }
+            }
+        }
 
         gfx.setIndexBuffer();
 
@@ -135,7 +189,7 @@ namespace rendering
 			binding->litBuffer		    = m_imageBuffers.litBuffer();            
             binding->albedoRoughness    = m_materials.albedoRougness();
             binding->normal             = m_materials.normal();
-            binding->bilinearSampler    = m_bilinearSampler;
+            binding->trilinearSampler   = m_trilinearSampler;
 
 			gfx.dispatch(*binding, m_screenSize[0], m_screenSize[1], 1);
 		}
@@ -157,7 +211,8 @@ namespace rendering
 
     void SceneRenderer::debugRendering(CommandBuffer& gfx, const Camera& camera, const Scene& scene)
     {
-        if (false)
+        // The debug renderer reads the full vertex format
+        if (false && (m_geometry.vertexFormat() == VertexFormat::Full))
         {
             gfx.setRenderTargets(m_screenBuffers.zBufferDSV(), m_outputImage.outputRTV);        
 		    m_debugRenderer.render(gfx, camera, m_geometry.vertexBuffer(), m_geometry.allocatedVertices());
@@ -10,6 +10,7 @@
 #include "ImageBuffers.hpp"
 #include "ImGuiRenderer.hpp"
 #include "DebugRenderer.hpp"
+#include "ClusterCuller.hpp"
 
 namespace rendering
 {
@@ -18,6 +19,7 @@ namespace rendering
     class GeometryCache;
     class MaterialCache;
     class PatchCache;
+    struct MeshPlacement;
 
     struct VisibleGeometry
     {
@@ -37,7 +39,7 @@ namespace rendering
 
         void render(graphics::CommandBuffer& gfx, const Scene& scene);
     private:
-        void culling(graphics::CommandBuffer& gfx, const Camera& camera);
+        void culling(graphics::CommandBuffer& gfx, const Camera& camera, const Scene& scene);
         void geometryRendering(graphics::CommandBuffer& gfx, const Camera& camera, const Scene& scene);
         void lighting(graphics::CommandBuffer& gfx, const Camera& camera);
         void postprocess(graphics::CommandBuffer& gfx);
@@ -50,13 +52,17 @@ namespace rendering
 
         graphics::ComputePipeline   m_lightingPipeline;
         graphics::GraphicsPipeline  m_geometryRenderingPipeline;
+        graphics::GraphicsPipeline  m_packedGeometryRenderingPipeline;
         graphics::GraphicsPipeline  m_patchRenderingPipeline;
 
-        graphics::Sampler           m_bilinearSampler;
+        graphics::Sampler           m_trilinearSampler;
 
         ImGuiRenderer               m_imGuiRenderer;
         DebugRenderer               m_debugRenderer;
 
+        ClusterCuller               m_clusterCuller;
+        std::vector<const MeshPlacement*> m_placements;     // Of the culled draws
+
         int2                        m_screenSize;
 
         GeometryCache&              m_geometry;
@@ -0,0 +1,26 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    VertexStreams.cpp
+*/
+
+#include "VertexStreams.hpp"
+#include "../Errors.hpp"
+#include "../Parallel.hpp"
+
+namespace
+{
+    constexpr uint32_t VerticesPerBatch = 4096;
+}
+
+namespace rendering
+{
+    void copyPositions(Range<const Vertex> vertices, Float3StreamRange positions)
+    {
+        SP_ASSERT(positions.size() == vertices.size(), "Positions must have as many elements as the vertices");
+
+        parallelFor(static_cast<uint32_t>(vertices.size()), VerticesPerBatch, [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t v = begin; v < end; v++) positions.set(v, vertices[v].position);
+        });
+    }
+}
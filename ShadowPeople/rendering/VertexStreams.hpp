@@ -0,0 +1,21 @@
+/*
+    Copyright 2018 Samuel Siltanen
+    VertexStreams.hpp
+
+    Attributes of Vertex copied out to streams, for the batch math of
+    Streams.hpp. The interleaved Vertex is the layout of the GPU, the asset
+    cache and the mesh optimizer, so the meshes keep it, and only the
+    attributes a kernel needs are copied out.
+*/
+
+#pragma once
+
+#include "../Types.hpp"
+#include "../Streams.hpp"
+#include "../cpugpu/GeometryTypes.h"
+
+namespace rendering
+{
+    // The positions, e.g. for bounding volumes. Positions must have as many elements as the vertices.
+    void copyPositions(Range<const Vertex> vertices, Float3StreamRange positions);
+}
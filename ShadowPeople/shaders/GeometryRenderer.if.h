@@ -8,7 +8,11 @@ CBuffer(constants,
     float4x4    view;
     float4x4    proj;
     float       camNear;
-    float3      __padding;
+    uint        baseVertex;
+    float2      __padding;
+    float4      objectRotation;
+    float3      objectPosition;
+    float       objectScale;
 });
 
 StructuredBuffer<Vertex>    vertexBuffer;
@@ -1,4 +1,6 @@
+#ifndef PACKED_VERTICES
 #include "GeometryRenderer.if.h"
+#endif
 
 struct PSInput
 {
@@ -31,5 +33,8 @@ uint4 main(PSInput input) : SV_TARGET
     uint orientation_xy    = packFloat2ToUint(0.5f + 0.5f * orientation.xy);
     uint orientation_zw    = packFloat2ToUint(0.5f + 0.5f * orientation.zw);
 
-	return uint4(uvInt, orientation_xy, orientation_zw, asuint(bitangentSign));
+    // The mip and the bitangent sign are packed as halfs, the sign only needs one bit
+    uint mip_bts    = f32tof16(mip) | (f32tof16(bitangentSign) << 16);
+
+	return uint4(uvInt, orientation_xy, orientation_zw, mip_bts);
 }
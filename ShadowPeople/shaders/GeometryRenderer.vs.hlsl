@@ -1,4 +1,8 @@
+#ifndef PACKED_VERTICES
 #include "GeometryRenderer.if.h"
+#endif
+#include "Quaternion.h.hlsl"
+#include "VertexPacking.h.hlsl"
 
 struct VSOutput
 {
@@ -9,15 +13,20 @@ struct VSOutput
 
 VSOutput main(uint vertexId : SV_VertexID)
 {
-    Vertex v = vertexBuffer[vertexId];
+    // Note: SV_VertexID does not include the base vertex
+#ifdef PACKED_VERTICES
+    Vertex v = unpackVertex(vertexBuffer[baseVertex + vertexId], positionOffset, positionScale);
+#else
+    Vertex v = vertexBuffer[baseVertex + vertexId];
+#endif
 
-    float4 worldPos = float4(v.position, 1.f);
+    float4 worldPos = float4(objectPosition + objectScale * qRot(objectRotation, v.position), 1.f);
     float4 viewPos  = mul(view, worldPos);
     float4 ndcPos   = mul(proj, viewPos);
 
     VSOutput output;
 
-    output.orientation = v.orientation;
+    output.orientation = qMul(objectRotation, v.orientation);
     output.uv_bts      = float3(v.uv, v.bitangentSign);
     output.pos         = ndcPos;
 
@@ -118,12 +118,13 @@ void main(uint3 DTid : SV_DispatchThreadID)
         float2 uvFlt    = unpackUintToFloat2(pixel.x);
         float2 oxyFlt   = unpackUintToFloat2(pixel.y);
         float2 ozwFlt   = unpackUintToFloat2(pixel.z);
-        float bitangentSign = asfloat(pixel.w);
+        float mip           = f16tof32(pixel.w);
+        float bitangentSign = f16tof32(pixel.w >> 16);
         float4 orientation = float4(oxyFlt.x, oxyFlt.y, ozwFlt.x, ozwFlt.y) * 2.f - 1.f;
 
         // Read material
-        float4 texel    = albedoRoughness.SampleLevel(bilinearSampler, uvFlt, 0);
-        float2 texel2   = normal.SampleLevel(bilinearSampler, uvFlt, 0);
+        float4 texel    = albedoRoughness.SampleLevel(trilinearSampler, uvFlt, mip);
+        float2 texel2   = normal.SampleLevel(trilinearSampler, uvFlt, mip);
 
         // Interpret material data
         float3 n        = decodeOctahedral(texel2);
@@ -17,7 +17,7 @@ RWTexture2D<float4> litBuffer;
 
 Texture2D<float4>   albedoRoughness;
 Texture2D<float2>   normal;
-sampler             bilinearSampler;
+sampler             trilinearSampler;
 
 THREAD_GROUP_SIZE(16, 16, 1)
 
@@ -0,0 +1,26 @@
+#include "../cpugpu/ShaderInterface.h"
+#include "../cpugpu/GeometryTypes.h"
+
+BEGIN_SHADER_INTERFACE(PackedGeometryRenderer)
+
+CBuffer(constants,
+{
+    float4x4    view;
+    float4x4    proj;
+    float       camNear;
+    uint        baseVertex;
+    float2      __padding;
+    float4      objectRotation;
+    float3      objectPosition;
+    float       objectScale;
+    float3      positionOffset;
+    float       __padding2;
+    float3      positionScale;
+    float       __padding3;
+});
+
+StructuredBuffer<PackedVertex>  vertexBuffer;
+
+GRAPHICS_PIPELINE
+
+END_SHADER_INTERFACE(PackedGeometryRenderer)
\ No newline at end of file
@@ -0,0 +1,4 @@
+// GeometryRenderer with packed vertices
+#define PACKED_VERTICES
+#include "PackedGeometryRenderer.if.h"
+#include "GeometryRenderer.vs.hlsl"
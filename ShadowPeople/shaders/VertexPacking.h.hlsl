@@ -0,0 +1,34 @@
+#ifndef SP_VERTEX_PACKING_H_HLSL
+#define SP_VERTEX_PACKING_H_HLSL
+
+#include "Quaternion.h.hlsl"
+
+// Same as math::decodeQTangent()
+float4 decodeQTangent(uint packed, out float bitangentSign)
+{
+    uint largest    = (packed >> 27) & 3;
+    bitangentSign   = ((packed >> 29) & 1) ? -1.f : 1.f;
+
+    float3 smallest = (float3(uint3(packed, packed >> 9, packed >> 18) & 0x1ff) - 256.f) * (0.70710678f / 255.f);
+    float w         = sqrt(saturate(1.f - dot(smallest, smallest)));
+
+    return (largest == 0) ? float4(w, smallest) :
+           (largest == 1) ? float4(smallest.x, w, smallest.yz) :
+           (largest == 2) ? float4(smallest.xy, w, smallest.z) :
+                            float4(smallest, w);
+}
+
+// Positions are dequantized within the bounds of their mesh
+Vertex unpackVertex(PackedVertex packed, float3 positionOffset, float3 positionScale)
+{
+    uint3 position  = uint3(packed.positionXY, packed.positionXY >> 16, packed.positionZ) & 0xffff;
+
+    Vertex v;
+    v.position      = positionOffset + positionScale * float3(position);
+    v.orientation   = decodeQTangent(packed.qTangent, v.bitangentSign);
+    v.normal        = qRot(v.orientation, float3(0.f, 0.f, 1.f));
+    v.uv            = f16tof32(uint2(packed.uv, packed.uv >> 16));
+    return v;
+}
+
+#endif